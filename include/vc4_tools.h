@@ -25,6 +25,8 @@
 
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 #define ATTRIBUTE_CONST __attribute__((__const__))
+#define MIN2(a, b) ((a) < (b) ? (a) : (b))
+#define MAX2(a, b) ((a) > (b) ? (a) : (b))
 
 static inline float
 uif(uint32_t u)
@@ -49,6 +51,3 @@ fui(float f)
         uf.f = f;
         return uf.u;
 }
-
-void
-vc4_qpu_disasm(FILE *out, const uint64_t *instructions, int num_instructions);
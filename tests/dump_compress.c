@@ -0,0 +1,203 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/** @file dump_compress.c
+ *
+ * Captures a hang with vc4_dump_hang_state --compress, then captures the
+ * compressed dump again without it, and checks that every BO comes back
+ * as it went in: one spanning several of the compressed blocks, with zero
+ * pages in it, and one that's all zeroes.  vc4_dump_parse should decode
+ * the compressed dump the same as the original, too.
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include "vc4_test.h"
+#include "vc4_packet.h"
+#include "vc4_dump_file.h"
+
+#define CL_PADDR        0x10000000
+#define DATA_PADDR      0x20000000
+#define DATA_SIZE       (VC4_DUMP_BLOCK_SIZE * 5 / 2)
+#define ZERO_PADDR      0x30000000
+#define ZERO_SIZE       (64 * 1024)
+
+static char dir[] = "/tmp/vc4-compress-XXXXXX";
+
+static uint8_t cl[VC4_DUMP_ALIGN];
+static uint8_t data[DATA_SIZE];
+static uint8_t zero[ZERO_SIZE];
+
+static const struct vc4_test_bo bos[] = {
+        { CL_PADDR, sizeof(cl), cl },
+        { DATA_PADDR, sizeof(data), data },
+        { ZERO_PADDR, sizeof(zero), zero },
+};
+
+/* Writes a version 1 dump of a render CL of a few packets, next to the
+ * data and zero BOs.
+ */
+static void
+write_hang(const char *path)
+{
+        struct drm_vc4_get_hang_state state = {
+                .start_bin = CL_PADDR,
+                .ct0ca = CL_PADDR,
+                .ct0ea = CL_PADDR,
+                .start_render = CL_PADDR,
+                .ct1ca = CL_PADDR,
+                .ct1ea = CL_PADDR + 5,
+        };
+        uint32_t seed = 1;
+
+        cl[0] = VC4_PACKET_NOP;
+        cl[1] = VC4_PACKET_FLUSH_ALL;
+        cl[2] = VC4_PACKET_NOP;
+        cl[3] = VC4_PACKET_NOP;
+        cl[4] = VC4_PACKET_STORE_MS_TILE_BUFFER_AND_EOF;
+
+        /* Noise that doesn't compress, with every fourth page left as
+         * zeroes.
+         */
+        for (uint32_t i = 0; i < DATA_SIZE; i++) {
+                if ((i / VC4_DUMP_ALIGN) % 4 == 3)
+                        continue;
+
+                seed = seed * 1103515245 + 12345;
+                data[i] = seed >> 16;
+        }
+
+        vc4_test_write_dump(path, &state, bos, ARRAY_SIZE(bos));
+}
+
+/* Checks that the version 1 dump at path has the BOs that went into the
+ * hang.
+ */
+static void
+check_bos(const char *path)
+{
+        int fd = open(path, O_RDONLY);
+
+        if (fd == -1)
+                vc4_test_fail("Couldn't open %s\n", path);
+
+        for (int i = 0; i < ARRAY_SIZE(bos); i++) {
+                static uint8_t contents[DATA_SIZE];
+                struct vc4_dump_bo entry;
+
+                vc4_test_find_bo(path, bos[i].paddr, &entry);
+                if (entry.bo.size != bos[i].size ||
+                    pread(fd, contents, entry.bo.size, entry.offset) !=
+                    entry.bo.size) {
+                        vc4_test_fail("%s: couldn't read the %d byte BO at "
+                                      "0x%08x\n", path, bos[i].size,
+                                      bos[i].paddr);
+                }
+                if (memcmp(contents, bos[i].data, bos[i].size)) {
+                        vc4_test_fail("%s: the BO at 0x%08x changed\n",
+                                      path, bos[i].paddr);
+                }
+        }
+
+        close(fd);
+}
+
+int
+main(int argc, char **argv)
+{
+        const char *hang_state_path = argc > 1 ? argv[1] :
+                VC4_DUMP_HANG_STATE;
+        const char *parse_path = argc > 2 ? argv[2] : VC4_DUMP_PARSE;
+        char hang_path[64], compressed_path[64], round_trip_path[64];
+        char log_path[64], hang_text_path[64], compressed_text_path[64];
+        char fake_device_arg[96];
+        char *hang_text, *compressed_text;
+        uint32_t version;
+        int fd;
+
+        if (!mkdtemp(dir))
+                vc4_test_fail("Couldn't make a temporary directory\n");
+        snprintf(hang_path, sizeof(hang_path), "%s/hang.dump", dir);
+        snprintf(compressed_path, sizeof(compressed_path),
+                 "%s/compressed.dump", dir);
+        snprintf(round_trip_path, sizeof(round_trip_path),
+                 "%s/round-trip.dump", dir);
+        snprintf(log_path, sizeof(log_path), "%s/capture.txt", dir);
+        snprintf(hang_text_path, sizeof(hang_text_path), "%s/hang.txt", dir);
+        snprintf(compressed_text_path, sizeof(compressed_text_path),
+                 "%s/compressed.txt", dir);
+
+        write_hang(hang_path);
+
+        printf("Capturing the hang compressed\n");
+        snprintf(fake_device_arg, sizeof(fake_device_arg),
+                 "--fake-device=%s", hang_path);
+        if (vc4_test_run((const char *[]) { hang_state_path,
+                                            fake_device_arg, "--compress",
+                                            compressed_path, NULL },
+                         log_path, NULL)) {
+                vc4_test_fail("Capturing the hang failed\n");
+        }
+
+        fd = open(compressed_path, O_RDONLY);
+        if (fd == -1 ||
+            pread(fd, &version, sizeof(version), 0) != sizeof(version) ||
+            version != VC4_DUMP_VERSION_COMPRESSED) {
+                vc4_test_fail("%s isn't a compressed dump\n",
+                              compressed_path);
+        }
+        close(fd);
+
+        printf("Capturing the compressed dump uncompressed\n");
+        snprintf(fake_device_arg, sizeof(fake_device_arg),
+                 "--fake-device=%s", compressed_path);
+        if (vc4_test_run((const char *[]) { hang_state_path,
+                                            fake_device_arg,
+                                            round_trip_path, NULL },
+                         log_path, NULL)) {
+                vc4_test_fail("Capturing the compressed dump failed\n");
+        }
+        check_bos(round_trip_path);
+
+        printf("Parsing the hang and the compressed dump\n");
+        if (vc4_test_run((const char *[]) { parse_path, hang_path, NULL },
+                         hang_text_path, NULL) ||
+            vc4_test_run((const char *[]) { parse_path, compressed_path,
+                                            NULL },
+                         compressed_text_path, NULL)) {
+                vc4_test_fail("Parsing the dumps failed\n");
+        }
+        hang_text = vc4_test_read_file(hang_text_path);
+        compressed_text = vc4_test_read_file(compressed_text_path);
+        if (strcmp(hang_text, compressed_text)) {
+                vc4_test_fail("%s and %s differ\n", hang_text_path,
+                              compressed_text_path);
+        }
+        free(hang_text);
+        free(compressed_text);
+
+        vc4_test_remove_dir(dir);
+
+        vc4_report_result(VC4_RESULT_PASS);
+}
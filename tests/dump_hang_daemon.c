@@ -0,0 +1,308 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/** @file dump_hang_daemon.c
+ *
+ * Runs vc4_dump_hang_state --daemon against a fake device, a directory that
+ * hangs are dropped into one at a time, and checks that each one lands in
+ * the ring with the right contents, that the oldest ones are removed to
+ * keep the ring under its size, and that the daemon is close to free while
+ * there's nothing to capture.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "vc4_test.h"
+#include "vc4_dump_file.h"
+
+#define BO_SIZE         (64 * 1024)
+#define DUMP_SIZE       (VC4_DUMP_ALIGN + BO_SIZE)
+/* Room for two of the dumps, so each new one evicts the oldest. */
+#define RING_BYTES      (DUMP_SIZE * 5 / 2)
+#define HANG_COUNT      5
+#define INTERVAL_MS     50
+#define TIMEOUT_MS      10000
+
+static char spool_dir[] = "/tmp/vc4-spool-XXXXXX";
+static char ring_dir[] = "/tmp/vc4-ring-XXXXXX";
+static pid_t daemon_pid;
+
+/* Stops the daemon if the test fails while it's running. */
+static void
+kill_daemon(void)
+{
+        if (daemon_pid)
+                kill(daemon_pid, SIGKILL);
+}
+
+static uint8_t
+pattern(int hang, uint32_t offset)
+{
+        /* Never zero, so that none of the BO is left out as zeroes. */
+        return ((offset * 7 + hang * 13) & 0xff) | 1;
+}
+
+/* Writes a version 1 dump with a single BO into the spool, under a hidden
+ * name first so that the daemon never sees it half written.
+ */
+static void
+drop_hang(int hang)
+{
+        static uint8_t contents[BO_SIZE];
+        const struct vc4_test_bo bo = { 0x10000000, BO_SIZE, contents };
+        const struct drm_vc4_get_hang_state state = { 0 };
+        char tmp_path[256], path[256];
+
+        for (uint32_t i = 0; i < BO_SIZE; i++)
+                contents[i] = pattern(hang, i);
+
+        snprintf(tmp_path, sizeof(tmp_path), "%s/.hang", spool_dir);
+        snprintf(path, sizeof(path), "%s/hang-%d", spool_dir, hang);
+
+        vc4_test_write_dump(tmp_path, &state, &bo, 1);
+        if (rename(tmp_path, path))
+                vc4_test_fail("Couldn't rename %s to %s\n", tmp_path, path);
+}
+
+static void
+ring_dump_path(char *path, size_t size, int seq)
+{
+        snprintf(path, size, "%s/vc4-hang-%06d.dump", ring_dir, seq);
+}
+
+/* Returns the number of dumps in the ring and their total size. */
+static int
+ring_usage(uint64_t *total)
+{
+        DIR *d = opendir(ring_dir);
+        struct dirent *entry;
+        int count = 0;
+
+        if (!d)
+                vc4_test_fail("Couldn't open %s\n", ring_dir);
+
+        *total = 0;
+        while ((entry = readdir(d))) {
+                char path[512];
+                struct stat st;
+
+                if (entry->d_name[0] == '.')
+                        continue;
+
+                snprintf(path, sizeof(path), "%s/%s", ring_dir,
+                         entry->d_name);
+                if (stat(path, &st) == 0) {
+                        *total += st.st_size;
+                        count++;
+                }
+        }
+        closedir(d);
+
+        return count;
+}
+
+static void
+check_daemon_running(void)
+{
+        int status;
+
+        if (waitpid(daemon_pid, &status, WNOHANG) == daemon_pid) {
+                daemon_pid = 0;
+                vc4_test_fail("vc4_dump_hang_state exited with status "
+                              "0x%x\n", status);
+        }
+}
+
+static void
+sleep_ms(int ms)
+{
+        struct timespec t = {
+                .tv_sec = ms / 1000,
+                .tv_nsec = (ms % 1000) * 1000000l,
+        };
+
+        nanosleep(&t, NULL);
+}
+
+/* Waits for the daemon to capture a hang and finish trimming the ring. */
+static void
+wait_for_capture(int seq)
+{
+        char path[256];
+        uint64_t total;
+
+        ring_dump_path(path, sizeof(path), seq);
+
+        for (int ms = 0; ms < TIMEOUT_MS; ms += 10) {
+                check_daemon_running();
+                if (access(path, F_OK) == 0 &&
+                    ring_usage(&total) <= 2 && total <= RING_BYTES) {
+                        return;
+                }
+                sleep_ms(10);
+        }
+
+        ring_usage(&total);
+        vc4_test_fail("Timed out waiting for %s (ring holds %llu bytes)\n",
+                      path, (unsigned long long)total);
+}
+
+/* Checks that the captured dump has the BO that went into the spool. */
+static void
+check_dump(int seq, int hang)
+{
+        struct vc4_dump_header header;
+        struct vc4_dump_bo entry;
+        static uint8_t bo[BO_SIZE];
+        char path[256];
+        int fd;
+
+        ring_dump_path(path, sizeof(path), seq);
+        fd = open(path, O_RDONLY);
+        if (fd == -1)
+                vc4_test_fail("Couldn't open %s\n", path);
+
+        if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+            header.version != VC4_DUMP_VERSION ||
+            header.state.bo_count != 1 ||
+            pread(fd, &entry, sizeof(entry), header.bo_table_offset) !=
+            sizeof(entry) ||
+            entry.bo.size != BO_SIZE ||
+            pread(fd, bo, BO_SIZE, entry.offset) != BO_SIZE) {
+                vc4_test_fail("%s isn't a dump of one %d byte BO\n", path,
+                              BO_SIZE);
+        }
+        close(fd);
+
+        for (uint32_t i = 0; i < BO_SIZE; i++) {
+                if (bo[i] != pattern(hang, i)) {
+                        vc4_test_fail("%s: BO byte %d is 0x%02x, "
+                                      "expected 0x%02x\n",
+                                      path, i, bo[i], pattern(hang, i));
+                }
+        }
+}
+
+/* Returns the CPU time the daemon has used, in clock ticks. */
+static unsigned long
+daemon_cpu_ticks(void)
+{
+        unsigned long utime, stime;
+        char path[64];
+        FILE *f;
+        int ret;
+
+        snprintf(path, sizeof(path), "/proc/%d/stat", daemon_pid);
+        f = fopen(path, "r");
+        if (!f)
+                vc4_test_fail("Couldn't open %s\n", path);
+
+        /* Skip to the utime and stime fields, past the command name. */
+        ret = fscanf(f, "%*d (%*[^)]) %*c %*d %*d %*d %*d %*d %*u %*u %*u "
+                     "%*u %*u %lu %lu", &utime, &stime);
+        fclose(f);
+        if (ret != 2)
+                vc4_test_fail("Couldn't parse %s\n", path);
+
+        return utime + stime;
+}
+
+int
+main(int argc, char **argv)
+{
+        const char *daemon_path = argc > 1 ? argv[1] : VC4_DUMP_HANG_STATE;
+        char fake_device_arg[64], daemon_arg[64], interval_arg[64];
+        char ring_bytes_arg[64];
+        unsigned long ticks_per_sec = sysconf(_SC_CLK_TCK);
+        unsigned long idle_ticks;
+
+        atexit(kill_daemon);
+        if (!mkdtemp(spool_dir) || !mkdtemp(ring_dir))
+                vc4_test_fail("Couldn't make temporary directories\n");
+
+        snprintf(fake_device_arg, sizeof(fake_device_arg),
+                 "--fake-device=%s", spool_dir);
+        snprintf(daemon_arg, sizeof(daemon_arg), "--daemon=%s", ring_dir);
+        snprintf(interval_arg, sizeof(interval_arg), "--interval=%d",
+                 INTERVAL_MS);
+        snprintf(ring_bytes_arg, sizeof(ring_bytes_arg), "--ring-bytes=%d",
+                 RING_BYTES);
+
+        daemon_pid = fork();
+        if (daemon_pid == -1)
+                vc4_test_fail("fork failed\n");
+        if (daemon_pid == 0) {
+                execl(daemon_path, daemon_path, fake_device_arg, daemon_arg,
+                      interval_arg, ring_bytes_arg, (char *)NULL);
+                fprintf(stderr, "Couldn't run %s\n", daemon_path);
+                _exit(1);
+        }
+
+        /* With nothing to capture, the daemon should spend its time
+         * asleep.  Allow it 5% of a CPU.
+         */
+        printf("Checking the daemon's CPU use while idle\n");
+        sleep_ms(200);
+        check_daemon_running();
+        idle_ticks = daemon_cpu_ticks();
+        sleep_ms(1000);
+        idle_ticks = daemon_cpu_ticks() - idle_ticks;
+        if (idle_ticks > ticks_per_sec / 20) {
+                vc4_test_fail("Daemon used %lu/%lu ticks of CPU while "
+                              "idle\n", idle_ticks, ticks_per_sec);
+        }
+
+        for (int hang = 0; hang < HANG_COUNT; hang++) {
+                int seq = hang + 1;
+                char path[256];
+
+                printf("Capturing hang %d\n", hang);
+                drop_hang(hang);
+                wait_for_capture(seq);
+                check_dump(seq, hang);
+                if (seq > 1)
+                        check_dump(seq - 1, hang - 1);
+
+                for (int old = 1; old < seq - 1; old++) {
+                        ring_dump_path(path, sizeof(path), old);
+                        if (access(path, F_OK) == 0)
+                                vc4_test_fail("%s wasn't evicted\n", path);
+                }
+        }
+
+        kill(daemon_pid, SIGTERM);
+        waitpid(daemon_pid, NULL, 0);
+        daemon_pid = 0;
+
+        vc4_test_remove_dir(spool_dir);
+        vc4_test_remove_dir(ring_dir);
+
+        vc4_report_result(VC4_RESULT_PASS);
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/** @file dump_index.c
+ *
+ * Saves the .vc4idx sidecar of a captured hang with vc4_dump_parse --index
+ * and checks that a --locus decode through it matches one without it.
+ * Then the dump is overwritten in place with a different hang of the same
+ * size, and the stale sidecar has to be passed over rather than replayed
+ * against the new dump's CLs.
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "vc4_test.h"
+#include "vc4_packet.h"
+#include "vc4_dump_file.h"
+#include "vc4_dump_index.h"
+
+#define CL_PADDR        0x10000000
+
+static char dir[] = "/tmp/vc4-index-XXXXXX";
+
+/* Writes a version 1 dump of a render CL of single-byte packets, stopped
+ * at its fourth, or for the other hang, one that starts with a line width
+ * instead.  Both have the same BOs, so their captures come out the same
+ * size.
+ */
+static void
+write_hang(const char *path, bool other)
+{
+        static uint8_t cl[VC4_DUMP_ALIGN];
+        const struct vc4_test_bo bo = { CL_PADDR, sizeof(cl), cl };
+        struct drm_vc4_get_hang_state state = {
+                .start_bin = CL_PADDR,
+                .ct0ca = CL_PADDR,
+                .ct0ea = CL_PADDR,
+                .start_render = CL_PADDR,
+                .ct1ca = CL_PADDR + 3,
+                .ct1ea = CL_PADDR + 6,
+        };
+
+        memset(cl, 0, sizeof(cl));
+        if (other) {
+                cl[0] = VC4_PACKET_LINE_WIDTH;
+                memcpy(&cl[1], &(float){ 2.0 }, sizeof(float));
+        } else {
+                cl[0] = VC4_PACKET_NOP;
+                cl[1] = VC4_PACKET_FLUSH_ALL;
+                cl[2] = VC4_PACKET_NOP;
+                cl[3] = VC4_PACKET_FLUSH;
+                cl[4] = VC4_PACKET_NOP;
+        }
+        cl[5] = VC4_PACKET_STORE_MS_TILE_BUFFER_AND_EOF;
+
+        vc4_test_write_dump(path, &state, &bo, 1);
+}
+
+static void
+capture(const char *hang_state_path, const char *hang_path,
+        const char *path)
+{
+        char fake_device_arg[96];
+
+        snprintf(fake_device_arg, sizeof(fake_device_arg),
+                 "--fake-device=%s", hang_path);
+        if (vc4_test_run((const char *[]) { hang_state_path,
+                                            fake_device_arg, path, NULL },
+                         "/dev/null", "/dev/null")) {
+                vc4_test_fail("Capturing the hang to %s failed\n", path);
+        }
+}
+
+/* Overwrites the file at dst with src's contents, keeping its inode. */
+static void
+overwrite(const char *src, const char *dst)
+{
+        int src_fd = open(src, O_RDONLY);
+        int dst_fd = open(dst, O_WRONLY | O_TRUNC);
+        struct stat st;
+        char *contents;
+
+        if (src_fd == -1 || dst_fd == -1 || fstat(src_fd, &st))
+                vc4_test_fail("Couldn't open %s and %s\n", src, dst);
+        contents = malloc(st.st_size);
+        if (!contents ||
+            read(src_fd, contents, st.st_size) != st.st_size ||
+            write(dst_fd, contents, st.st_size) != st.st_size ||
+            close(dst_fd)) {
+                vc4_test_fail("Couldn't copy %s to %s\n", src, dst);
+        }
+        close(src_fd);
+        free(contents);
+}
+
+/* Runs vc4_dump_parse --locus=1 on the dump, with the index option if
+ * there is one, and returns its output.  With a window of one packet, the
+ * decode starts from the index rather than the start of the CL.
+ */
+static char *
+parse_locus(const char *parse_path, const char *index_arg, const char *path)
+{
+        const char *args[] = { parse_path, "--locus=1", path, NULL, NULL };
+        char out_path[64];
+
+        if (index_arg) {
+                args[2] = index_arg;
+                args[3] = path;
+        }
+
+        snprintf(out_path, sizeof(out_path), "%s/parse.txt", dir);
+        if (vc4_test_run(args, out_path, NULL)) {
+                vc4_test_fail("vc4_dump_parse --locus=1 %s %s failed\n",
+                              index_arg ? index_arg : "", path);
+        }
+
+        return vc4_test_read_file(out_path);
+}
+
+/* Checks that a --locus decode through the dump's sidecar, if it has a
+ * good one, matches one that doesn't look for it, and returns it.
+ */
+static char *
+check_locus(const char *parse_path, const char *path)
+{
+        /* --locus loads the index unless it's told not to. */
+        char *indexed = parse_locus(parse_path, NULL, path);
+        char *plain = parse_locus(parse_path, "--no-index", path);
+
+        if (strcmp(indexed, plain)) {
+                vc4_test_fail("Decoding %s through its index gave:\n%s\n"
+                              "instead of:\n%s", path, indexed, plain);
+        }
+        free(plain);
+
+        return indexed;
+}
+
+int
+main(int argc, char **argv)
+{
+        const char *hang_state_path = argc > 1 ? argv[1] :
+                VC4_DUMP_HANG_STATE;
+        const char *parse_path = argc > 2 ? argv[2] : VC4_DUMP_PARSE;
+        char hang_path[64], dump_path[64], other_path[64], index_path[96];
+        struct vc4_index_header header;
+        char *first, *second;
+        int fd;
+
+        if (!mkdtemp(dir))
+                vc4_test_fail("Couldn't make a temporary directory\n");
+        snprintf(hang_path, sizeof(hang_path), "%s/hang.dump", dir);
+        snprintf(dump_path, sizeof(dump_path), "%s/captured.dump", dir);
+        snprintf(other_path, sizeof(other_path), "%s/other.dump", dir);
+        snprintf(index_path, sizeof(index_path), "%s" VC4_INDEX_SUFFIX,
+                 dump_path);
+
+        write_hang(hang_path, false);
+        capture(hang_state_path, hang_path, dump_path);
+        write_hang(hang_path, true);
+        capture(hang_state_path, hang_path, other_path);
+
+        printf("Saving the index and decoding through it\n");
+        free(parse_locus(parse_path, "--index", dump_path));
+        fd = open(index_path, O_RDONLY);
+        if (fd == -1 ||
+            read(fd, &header, sizeof(header)) != sizeof(header) ||
+            header.magic != VC4_INDEX_MAGIC) {
+                vc4_test_fail("--index didn't save %s\n", index_path);
+        }
+        close(fd);
+        first = check_locus(parse_path, dump_path);
+
+        printf("Replacing the dump under its index\n");
+        overwrite(other_path, dump_path);
+        second = check_locus(parse_path, dump_path);
+        if (strcmp(first, second) == 0)
+                vc4_test_fail("The two hangs decoded the same\n");
+        free(first);
+        free(second);
+
+        vc4_test_remove_dir(dir);
+
+        vc4_report_result(VC4_RESULT_PASS);
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/** @file dump_short_shader.c
+ *
+ * Captures a hang with vc4_dump_hang_state --max-bytes set so that only the
+ * start of its shader BO fits, and checks that vc4_dump_parse disassembles
+ * up to the end of what was kept and then says that the shader was cut
+ * short, instead of reading on past the BO looking for the program end.
+ */
+
+#include <string.h>
+#include "vc4_test.h"
+#include "vc4_packet.h"
+#include "vc4_dump_file.h"
+
+#define CL_PADDR        0x10000000
+#define REC_PADDR       0x20000000
+#define SHADER_PADDR    0x30000000
+#define SHADER_SIZE     (64 * 1024)
+/* Room for the header and tables, the CL and shader record BOs, and a
+ * page of the shader.
+ */
+#define MAX_BYTES       (4 * VC4_DUMP_ALIGN)
+
+static char dir[] = "/tmp/vc4-short-shader-XXXXXX";
+
+/* Writes a version 1 dump of a render CL that runs a single NV shader
+ * whose program end is right at the end of its BO.
+ */
+static void
+write_hang(const char *path)
+{
+        static uint8_t cl[VC4_DUMP_ALIGN], rec[VC4_DUMP_ALIGN];
+        static uint64_t shader[SHADER_SIZE / sizeof(uint64_t)];
+        const struct vc4_test_bo bos[] = {
+                { CL_PADDR, sizeof(cl), cl },
+                { REC_PADDR, sizeof(rec), rec },
+                { SHADER_PADDR, sizeof(shader), shader },
+        };
+        struct drm_vc4_get_hang_state state = {
+                .start_bin = CL_PADDR,
+                .ct0ca = CL_PADDR,
+                .ct0ea = CL_PADDR,
+                .start_render = CL_PADDR,
+                .ct1ca = CL_PADDR,
+                .ct1ea = CL_PADDR + 6,
+        };
+
+        cl[0] = VC4_PACKET_NV_SHADER_STATE;
+        memcpy(&cl[1], &(uint32_t){ REC_PADDR }, sizeof(uint32_t));
+        cl[5] = VC4_PACKET_STORE_MS_TILE_BUFFER_AND_EOF;
+
+        /* The NV shader record's fragment shader address. */
+        memcpy(&rec[4], &(uint32_t){ SHADER_PADDR }, sizeof(uint32_t));
+
+        for (int i = 0; i < ARRAY_SIZE(shader); i++)
+                shader[i] = qpu_NOP();
+        shader[ARRAY_SIZE(shader) - 3] =
+                qpu_set_sig(qpu_NOP(), QPU_SIG_PROG_END);
+
+        vc4_test_write_dump(path, &state, bos, ARRAY_SIZE(bos));
+}
+
+static bool
+has_instruction(const char *text, uint32_t paddr)
+{
+        char line[16];
+
+        snprintf(line, sizeof(line), "\n0x%08x: ", paddr);
+        return strstr(text, line);
+}
+
+int
+main(int argc, char **argv)
+{
+        const char *hang_state_path = argc > 1 ? argv[1] :
+                VC4_DUMP_HANG_STATE;
+        const char *parse_path = argc > 2 ? argv[2] : VC4_DUMP_PARSE;
+        char hang_path[64], dump_path[64], log_path[64], text_path[64];
+        char fake_device_arg[96], max_bytes_arg[64];
+        struct vc4_dump_bo entry;
+        uint32_t kept;
+        char *text;
+
+        if (!mkdtemp(dir))
+                vc4_test_fail("Couldn't make a temporary directory\n");
+        snprintf(hang_path, sizeof(hang_path), "%s/hang.dump", dir);
+        snprintf(dump_path, sizeof(dump_path), "%s/short.dump", dir);
+        snprintf(log_path, sizeof(log_path), "%s/capture.txt", dir);
+        snprintf(text_path, sizeof(text_path), "%s/short.txt", dir);
+        snprintf(fake_device_arg, sizeof(fake_device_arg),
+                 "--fake-device=%s", hang_path);
+        snprintf(max_bytes_arg, sizeof(max_bytes_arg), "--max-bytes=%d",
+                 MAX_BYTES);
+
+        write_hang(hang_path);
+
+        printf("Capturing the hang in %d bytes\n", MAX_BYTES);
+        if (vc4_test_run((const char *[]) { hang_state_path,
+                                            fake_device_arg, max_bytes_arg,
+                                            dump_path, NULL },
+                         log_path, NULL)) {
+                vc4_test_fail("Capturing the hang failed\n");
+        }
+        vc4_test_find_bo(dump_path, SHADER_PADDR, &entry);
+        kept = entry.bo.size;
+        if (kept == 0 || kept >= SHADER_SIZE) {
+                vc4_test_fail("Kept %d bytes of the %d byte shader BO\n",
+                              kept, SHADER_SIZE);
+        }
+
+        printf("Parsing the %d bytes kept of the shader\n", kept);
+        if (vc4_test_run((const char *[]) { parse_path, dump_path, NULL },
+                         text_path, NULL)) {
+                vc4_test_fail("Parsing the dump failed\n");
+        }
+        text = vc4_test_read_file(text_path);
+        if (!has_instruction(text, SHADER_PADDR + kept - sizeof(uint64_t))) {
+                vc4_test_fail("The last instruction kept wasn't "
+                              "disassembled\n");
+        }
+        if (has_instruction(text, SHADER_PADDR + kept))
+                vc4_test_fail("Disassembled past the end of the shader BO\n");
+        if (!strstr(text, "Shader cut short at end of BO\n"))
+                vc4_test_fail("The shader wasn't reported as cut short\n");
+        free(text);
+
+        vc4_test_remove_dir(dir);
+
+        vc4_report_result(VC4_RESULT_PASS);
+}
@@ -0,0 +1,182 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/** @file dump_verify.c
+ *
+ * Captures a hang with vc4_dump_hang_state, which checksums the header
+ * and each BO, and checks that vc4_dump_parse --verify passes it as it
+ * was written, fails it with a byte of a BO flipped, naming the BO, and
+ * that a flipped byte in the header keeps the dump from being read at all.
+ */
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include "vc4_test.h"
+#include "vc4_packet.h"
+#include "vc4_dump_file.h"
+
+#define CL_PADDR        0x10000000
+#define DATA_PADDR      0x20000000
+#define DATA_SIZE       (16 * 1024)
+
+static char dir[] = "/tmp/vc4-verify-XXXXXX";
+
+static void
+write_hang(const char *path)
+{
+        static uint8_t cl[VC4_DUMP_ALIGN], data[DATA_SIZE];
+        const struct vc4_test_bo bos[] = {
+                { CL_PADDR, sizeof(cl), cl },
+                { DATA_PADDR, sizeof(data), data },
+        };
+        struct drm_vc4_get_hang_state state = {
+                .start_bin = CL_PADDR,
+                .ct0ca = CL_PADDR,
+                .ct0ea = CL_PADDR,
+                .start_render = CL_PADDR,
+                .ct1ca = CL_PADDR,
+                .ct1ea = CL_PADDR + 2,
+        };
+
+        cl[0] = VC4_PACKET_NOP;
+        cl[1] = VC4_PACKET_STORE_MS_TILE_BUFFER_AND_EOF;
+        for (uint32_t i = 0; i < DATA_SIZE; i++)
+                data[i] = i * 7 + 1;
+
+        vc4_test_write_dump(path, &state, bos, ARRAY_SIZE(bos));
+}
+
+static void
+capture(const char *hang_state_path, const char *hang_path,
+        const char *path)
+{
+        char fake_device_arg[96];
+
+        snprintf(fake_device_arg, sizeof(fake_device_arg),
+                 "--fake-device=%s", hang_path);
+        if (vc4_test_run((const char *[]) { hang_state_path,
+                                            fake_device_arg, path, NULL },
+                         "/dev/null", "/dev/null")) {
+                vc4_test_fail("Capturing the hang to %s failed\n", path);
+        }
+}
+
+/* Flips the bits of the byte at offset in the file at path. */
+static void
+damage(const char *path, uint64_t offset)
+{
+        uint8_t byte;
+        int fd = open(path, O_RDWR);
+
+        if (fd == -1 || pread(fd, &byte, 1, offset) != 1)
+                vc4_test_fail("Couldn't read %s\n", path);
+        byte = ~byte;
+        if (pwrite(fd, &byte, 1, offset) != 1 || close(fd))
+                vc4_test_fail("Couldn't write %s\n", path);
+}
+
+/* Runs vc4_dump_parse with the arguments, returning its exit status, and
+ * its stdout and stderr in *out and *err.
+ */
+static int
+parse(const char *parse_path, const char *arg, const char *path,
+      char **out, char **err)
+{
+        char out_path[64], err_path[64];
+        int status;
+
+        snprintf(out_path, sizeof(out_path), "%s/parse.out", dir);
+        snprintf(err_path, sizeof(err_path), "%s/parse.err", dir);
+        status = vc4_test_run((const char *[]) { parse_path, arg, path,
+                                                 NULL },
+                              out_path, err_path);
+        *out = vc4_test_read_file(out_path);
+        *err = vc4_test_read_file(err_path);
+
+        return status;
+}
+
+int
+main(int argc, char **argv)
+{
+        const char *hang_state_path = argc > 1 ? argv[1] :
+                VC4_DUMP_HANG_STATE;
+        const char *parse_path = argc > 2 ? argv[2] : VC4_DUMP_PARSE;
+        char hang_path[64], dump_path[64], bo_path[64], header_path[64];
+        char bad_bo[64];
+        struct vc4_dump_bo entry;
+        char *out, *err;
+        int status;
+
+        if (!mkdtemp(dir))
+                vc4_test_fail("Couldn't make a temporary directory\n");
+        snprintf(hang_path, sizeof(hang_path), "%s/hang.dump", dir);
+        snprintf(dump_path, sizeof(dump_path), "%s/good.dump", dir);
+        snprintf(bo_path, sizeof(bo_path), "%s/bad-bo.dump", dir);
+        snprintf(header_path, sizeof(header_path), "%s/bad-header.dump",
+                 dir);
+
+        write_hang(hang_path);
+        capture(hang_state_path, hang_path, dump_path);
+        capture(hang_state_path, hang_path, bo_path);
+        capture(hang_state_path, hang_path, header_path);
+
+        printf("Verifying the dump as captured\n");
+        status = parse(parse_path, "--verify", dump_path, &out, &err);
+        if (status || !strstr(out, "All 2 BOs match their checksums\n")) {
+                vc4_test_fail("--verify failed the dump as captured:\n%s%s",
+                              out, err);
+        }
+        free(out);
+        free(err);
+
+        printf("Verifying the dump with a BO damaged\n");
+        vc4_test_find_bo(bo_path, DATA_PADDR, &entry);
+        damage(bo_path, entry.offset + DATA_SIZE / 2);
+        snprintf(bad_bo, sizeof(bad_bo), "at 0x%08x) has checksum",
+                 DATA_PADDR);
+        status = parse(parse_path, "--verify", bo_path, &out, &err);
+        if (!status || !strstr(err, bad_bo) ||
+            !strstr(err, "1 of 2 BOs don't match their checksums\n")) {
+                vc4_test_fail("--verify didn't catch the damaged BO:\n%s%s",
+                              out, err);
+        }
+        free(out);
+        free(err);
+
+        printf("Reading the dump with its header damaged\n");
+        damage(header_path, offsetof(struct vc4_dump_header, pad));
+        status = parse(parse_path, "--stats", header_path, &out, &err);
+        if (!status || !strstr(err, "don't match their checksum\n")) {
+                vc4_test_fail("The damaged header wasn't caught:\n%s%s",
+                              out, err);
+        }
+        free(out);
+        free(err);
+
+        vc4_test_remove_dir(dir);
+
+        vc4_report_result(VC4_RESULT_PASS);
+}
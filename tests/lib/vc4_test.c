@@ -21,7 +21,14 @@
  * IN THE SOFTWARE.
  */
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include "vc4_test.h"
+#include "vc4_dump_file.h"
 
 int
 main_func_for_single_test(int argc, char **argv, void (*func)(int fd))
@@ -62,3 +69,190 @@ vc4_report_result(enum vc4_result result)
                 exit(77);
         }
 }
+
+/* Prints the reason for failing, and fails the test. */
+void
+vc4_test_fail(const char *fmt, ...)
+{
+        va_list va;
+
+        va_start(va, fmt);
+        vfprintf(stderr, fmt, va);
+        va_end(va);
+
+        vc4_report_result(VC4_RESULT_FAIL);
+}
+
+/**
+ * Writes a version 1 dump of the BOs to path, for the dump tools to read
+ * as a hang from a fake device.  The BOs get handles from 1 up, and state
+ * gives the registers.
+ */
+void
+vc4_test_write_dump(const char *path,
+                    const struct drm_vc4_get_hang_state *state,
+                    const struct vc4_test_bo *bos, uint32_t bo_count)
+{
+        struct vc4_dump_header header = {
+                .version = VC4_DUMP_VERSION,
+                .header_size = sizeof(header),
+                .bo_entry_size = sizeof(struct vc4_dump_bo),
+                .align = VC4_DUMP_ALIGN,
+                .bo_table_offset = sizeof(header),
+                .state = *state,
+        };
+        struct vc4_dump_bo *entries = calloc(bo_count, sizeof(*entries));
+        uint64_t offset = vc4_dump_align(sizeof(header) +
+                                         bo_count * sizeof(*entries));
+        bool ok;
+        int fd;
+
+        if (!entries)
+                vc4_test_fail("malloc failure\n");
+
+        header.state.bo_count = bo_count;
+        for (uint32_t i = 0; i < bo_count; i++) {
+                entries[i].bo.handle = i + 1;
+                entries[i].bo.paddr = bos[i].paddr;
+                entries[i].bo.size = bos[i].size;
+                entries[i].offset = offset;
+                offset += vc4_dump_align(bos[i].size);
+        }
+
+        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        ok = (fd != -1 &&
+              pwrite(fd, &header, sizeof(header), 0) == sizeof(header) &&
+              pwrite(fd, entries, bo_count * sizeof(*entries),
+                     header.bo_table_offset) ==
+              bo_count * sizeof(*entries) &&
+              ftruncate(fd, offset) == 0);
+        for (uint32_t i = 0; ok && i < bo_count; i++) {
+                ok = pwrite(fd, bos[i].data, bos[i].size,
+                            entries[i].offset) == bos[i].size;
+        }
+        if (fd == -1 || close(fd) || !ok)
+                vc4_test_fail("Couldn't write %s\n", path);
+
+        free(entries);
+}
+
+/**
+ * Looks up the BO at paddr in the version 1 dump at path, for where its
+ * contents are in the file and how much of it was captured.
+ */
+void
+vc4_test_find_bo(const char *path, uint32_t paddr, struct vc4_dump_bo *entry)
+{
+        struct vc4_dump_header header;
+        int fd = open(path, O_RDONLY);
+
+        if (fd == -1)
+                vc4_test_fail("Couldn't open %s\n", path);
+        if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+            header.version != VC4_DUMP_VERSION) {
+                vc4_test_fail("%s isn't a version %d dump\n", path,
+                              VC4_DUMP_VERSION);
+        }
+
+        for (uint32_t i = 0; i < header.state.bo_count; i++) {
+                if (pread(fd, entry, sizeof(*entry),
+                          header.bo_table_offset +
+                          i * header.bo_entry_size) != sizeof(*entry)) {
+                        vc4_test_fail("Couldn't read %s's BO table\n", path);
+                }
+                if (entry->bo.paddr == paddr) {
+                        close(fd);
+                        return;
+                }
+        }
+
+        vc4_test_fail("%s left out the BO at 0x%08x\n", path, paddr);
+}
+
+/* Points fd at a new file at path, if there is a path. */
+static void
+redirect(int fd, const char *path)
+{
+        int file_fd;
+
+        if (!path)
+                return;
+
+        file_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (file_fd == -1 || dup2(file_fd, fd) == -1) {
+                fprintf(stderr, "Couldn't open %s\n", path);
+                _exit(1);
+        }
+        close(file_fd);
+}
+
+/**
+ * Runs a tool with its stdout going to out_path and its stderr to err_path,
+ * or left alone where they're NULL, and returns its exit status.  Fails if
+ * it didn't exit normally.
+ */
+int
+vc4_test_run(const char *const *argv, const char *out_path,
+             const char *err_path)
+{
+        int status;
+        pid_t pid = fork();
+
+        if (pid == -1)
+                vc4_test_fail("fork failed\n");
+        if (pid == 0) {
+                redirect(STDOUT_FILENO, out_path);
+                redirect(STDERR_FILENO, err_path);
+                execv(argv[0], (char *const *)argv);
+                fprintf(stderr, "Couldn't run %s\n", argv[0]);
+                _exit(1);
+        }
+
+        if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+                vc4_test_fail("%s died with status 0x%x\n", argv[0], status);
+
+        return WEXITSTATUS(status);
+}
+
+/* Returns the contents of the file at path, as a string. */
+char *
+vc4_test_read_file(const char *path)
+{
+        struct stat st;
+        char *contents;
+        int fd = open(path, O_RDONLY);
+
+        if (fd == -1 || fstat(fd, &st))
+                vc4_test_fail("Couldn't open %s\n", path);
+        contents = calloc(st.st_size + 1, 1);
+        if (!contents || read(fd, contents, st.st_size) != st.st_size)
+                vc4_test_fail("Couldn't read %s\n", path);
+        close(fd);
+
+        return contents;
+}
+
+/* Removes a directory that the test made, along with the files in it. */
+void
+vc4_test_remove_dir(const char *path)
+{
+        DIR *d = opendir(path);
+        struct dirent *entry;
+
+        if (!d)
+                return;
+
+        while ((entry = readdir(d))) {
+                char file_path[512];
+
+                if (strcmp(entry->d_name, ".") == 0 ||
+                    strcmp(entry->d_name, "..") == 0) {
+                        continue;
+                }
+                snprintf(file_path, sizeof(file_path), "%s/%s", path,
+                         entry->d_name);
+                unlink(file_path);
+        }
+        closedir(d);
+        rmdir(path);
+}
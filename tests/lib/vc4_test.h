@@ -40,8 +40,28 @@ enum vc4_result {
         VC4_RESULT_SKIP,
 };
 
+struct vc4_dump_bo;
+
+/* One BO of a dump for vc4_test_write_dump(), with its contents. */
+struct vc4_test_bo {
+        uint32_t paddr;
+        uint32_t size;
+        const void *data;
+};
+
 int main_func_for_single_test(int argc, char **argv, void (*func)(int fd));
 void vc4_report_result(enum vc4_result result);
+void vc4_test_fail(const char *fmt, ...)
+        __attribute__ ((format(__printf__, 1, 2)));
+void vc4_test_write_dump(const char *path,
+                         const struct drm_vc4_get_hang_state *state,
+                         const struct vc4_test_bo *bos, uint32_t bo_count);
+void vc4_test_find_bo(const char *path, uint32_t paddr,
+                      struct vc4_dump_bo *entry);
+int vc4_test_run(const char *const *argv, const char *out_path,
+                 const char *err_path);
+char *vc4_test_read_file(const char *path);
+void vc4_test_remove_dir(const char *path);
 
 #define SINGLE_TEST_WITH_DRM()                                      \
         static void func(int fd);                                       \
@@ -0,0 +1,236 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <err.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "vc4_drm.h"
+
+#include "vc4_addr_space.h"
+#include "vc4_tools.h"
+
+static int
+compare_paddr(const void *a, const void *b)
+{
+        const struct vc4_addr_range *ra = a, *rb = b;
+
+        if (ra->paddr != rb->paddr)
+                return ra->paddr < rb->paddr ? -1 : 1;
+        return ra->bo_index < rb->bo_index ? -1 : 1;
+}
+
+static int
+compare_map(const void *a, const void *b)
+{
+        const struct vc4_addr_range *ra = a, *rb = b;
+        uintptr_t ma = (uintptr_t)ra->map, mb = (uintptr_t)rb->map;
+
+        if (ma != mb)
+                return ma < mb ? -1 : 1;
+        return ra->bo_index < rb->bo_index ? -1 : 1;
+}
+
+void
+vc4_addr_space_init(struct vc4_addr_space *space,
+                    const struct drm_vc4_get_hang_state_bo *bo_state,
+                    void **maps, uint32_t bo_count)
+{
+        memset(space, 0, sizeof(*space));
+
+        space->by_paddr = calloc(bo_count + 1, sizeof(*space->by_paddr));
+        space->by_map = calloc(bo_count + 1, sizeof(*space->by_map));
+        space->paddr_reach = calloc(bo_count + 1,
+                                    sizeof(*space->paddr_reach));
+        if (!space->by_paddr || !space->by_map || !space->paddr_reach)
+                err(1, "malloc failure");
+
+        /* Empty BOs can never be the result of a lookup, and leaving them
+         * out means every entry has a nonempty interval to search.
+         */
+        for (uint32_t i = 0; i < bo_count; i++) {
+                if (!bo_state[i].size)
+                        continue;
+
+                struct vc4_addr_range *range =
+                        &space->by_paddr[space->count++];
+                range->paddr = bo_state[i].paddr;
+                range->size = bo_state[i].size;
+                range->map = maps[i];
+                range->bo_index = i;
+        }
+
+        for (uint32_t i = 0; i < space->count; i++) {
+                if (space->by_paddr[i].map)
+                        space->by_map[space->map_count++] = space->by_paddr[i];
+        }
+        qsort(space->by_paddr, space->count, sizeof(*space->by_paddr),
+              compare_paddr);
+        qsort(space->by_map, space->map_count, sizeof(*space->by_map),
+              compare_map);
+
+        for (uint32_t i = 0; i < space->count; i++) {
+                const struct vc4_addr_range *range = &space->by_paddr[i];
+                uint64_t end = (uint64_t)range->paddr + range->size;
+                uint64_t reach = i ? space->paddr_reach[i - 1] : 0;
+
+                if (range->paddr < reach)
+                        space->overlapping = true;
+                space->paddr_reach[i] = MAX2(reach, end);
+        }
+}
+
+void
+vc4_addr_space_fini(struct vc4_addr_space *space)
+{
+        free(space->by_paddr);
+        free(space->by_map);
+        free(space->paddr_reach);
+        memset(space, 0, sizeof(*space));
+}
+
+static inline bool
+range_has_paddr(const struct vc4_addr_range *range, uint32_t paddr)
+{
+        return paddr - range->paddr < range->size;
+}
+
+static inline bool
+range_has_pointer(const struct vc4_addr_range *range, uintptr_t p)
+{
+        return p - (uintptr_t)range->map < range->size;
+}
+
+/* Finds the lowest-numbered BO containing paddr among the ranges before
+ * by_paddr[end], going back only as far as some range might still reach
+ * it.
+ */
+static const struct vc4_addr_range *
+lookup_overlapping_paddr(struct vc4_addr_space *space, uint32_t paddr,
+                         uint32_t end)
+{
+        const struct vc4_addr_range *found = NULL;
+
+        for (uint32_t i = end; i > 0 && space->paddr_reach[i - 1] > paddr;
+             i--) {
+                const struct vc4_addr_range *range = &space->by_paddr[i - 1];
+
+                if (range_has_paddr(range, paddr) &&
+                    (!found || range->bo_index < found->bo_index)) {
+                        found = range;
+                }
+        }
+
+        return found;
+}
+
+const struct vc4_addr_range *
+vc4_addr_space_lookup_paddr(struct vc4_addr_space *space, uint32_t paddr)
+{
+        if (!space->overlapping && space->last_paddr &&
+            range_has_paddr(space->last_paddr, paddr)) {
+                return space->last_paddr;
+        }
+
+        /* Find the last range starting at or below paddr. */
+        uint32_t lo = 0, hi = space->count;
+        while (lo < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+                if (space->by_paddr[mid].paddr <= paddr)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+
+        if (space->overlapping)
+                return lookup_overlapping_paddr(space, paddr, lo);
+
+        if (lo == 0 || !range_has_paddr(&space->by_paddr[lo - 1], paddr))
+                return NULL;
+
+        space->last_paddr = &space->by_paddr[lo - 1];
+        return space->last_paddr;
+}
+
+const struct vc4_addr_range *
+vc4_addr_space_lookup_pointer(struct vc4_addr_space *space, const void *p)
+{
+        uintptr_t ptr = (uintptr_t)p;
+
+        /* Sorting moves the entries, so last_map may no longer be the
+         * range it was.
+         */
+        if (space->map_unsorted) {
+                qsort(space->by_map, space->map_count,
+                      sizeof(*space->by_map), compare_map);
+                space->map_unsorted = false;
+                space->last_map = NULL;
+        }
+
+        if (space->last_map && range_has_pointer(space->last_map, ptr))
+                return space->last_map;
+
+        uint32_t lo = 0, hi = space->map_count;
+        while (lo < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+                if ((uintptr_t)space->by_map[mid].map <= ptr)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+
+        if (lo == 0 || !range_has_pointer(&space->by_map[lo - 1], ptr))
+                return NULL;
+
+        space->last_map = &space->by_map[lo - 1];
+        return space->last_map;
+}
+
+/**
+ * Returns the mapping of the range's BO, having map_bo map it if this is
+ * its first use.
+ */
+void *
+vc4_addr_space_map(struct vc4_addr_space *space,
+                   const struct vc4_addr_range *range)
+{
+        if (range->map || !space->map_bo)
+                return range->map;
+
+        /* The ranges are only handed out as const so that callers don't
+         * change them, but this is the one place they're meant to change.
+         */
+        struct vc4_addr_range *mapped = (struct vc4_addr_range *)range;
+        mapped->map = space->map_bo(space->map_bo_data, range->bo_index);
+        if (!mapped->map)
+                return NULL;
+
+        /* Append it to by_map, leaving the next pointer lookup to sort it
+         * into place rather than moving the entries after it each time.
+         */
+        space->by_map[space->map_count++] = *mapped;
+        space->map_unsorted = true;
+
+        return mapped->map;
+}
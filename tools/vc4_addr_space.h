@@ -0,0 +1,96 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef VC4_ADDR_SPACE_H
+#define VC4_ADDR_SPACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct drm_vc4_get_hang_state_bo;
+
+/** One BO of the dump, as a [paddr, paddr + size) interval. */
+struct vc4_addr_range {
+        uint32_t paddr;
+        uint32_t size;
+        /* NULL until vc4_addr_space_map() maps the BO. */
+        void *map;
+        /* Index of the BO in the dump's bo_state array. */
+        uint32_t bo_index;
+};
+
+/**
+ * Translation table between GPU physical addresses and our mappings of the
+ * dumped BOs.
+ *
+ * The BOs are kept in two arrays, one sorted by paddr and one sorted by
+ * mapping, so that either direction of translation is a binary search.
+ * Since references in a CL tend to hit the same BO over and over, the last
+ * hit in each direction is checked before searching.
+ *
+ * BOs may be left unmapped until they're first used, in which case map_bo
+ * is called to map them.  Only mapped BOs are in by_map, and ones mapped
+ * later are appended to it and only sorted into place by the next pointer
+ * lookup, so that mapping every BO isn't quadratic.
+ *
+ * BOs aren't supposed to overlap in paddr, but a dump may still have them
+ * do so.  Then an address is in the lowest-numbered BO containing it, as
+ * it was when the BOs were searched in order, and a lookup also checks the
+ * ranges before the one it finds.
+ */
+struct vc4_addr_space {
+        struct vc4_addr_range *by_paddr;
+        struct vc4_addr_range *by_map;
+        uint32_t count;
+        uint32_t map_count;
+        /* Whether BOs have been appended to by_map since it was sorted. */
+        bool map_unsorted;
+
+        /* The end of the furthest-reaching range in by_paddr up to and
+         * including each entry, and whether any ranges overlap.
+         */
+        uint64_t *paddr_reach;
+        bool overlapping;
+
+        void *(*map_bo)(void *data, uint32_t bo_index);
+        void *map_bo_data;
+
+        const struct vc4_addr_range *last_paddr;
+        const struct vc4_addr_range *last_map;
+};
+
+void vc4_addr_space_init(struct vc4_addr_space *space,
+                         const struct drm_vc4_get_hang_state_bo *bo_state,
+                         void **maps, uint32_t bo_count);
+void vc4_addr_space_fini(struct vc4_addr_space *space);
+
+const struct vc4_addr_range *
+vc4_addr_space_lookup_paddr(struct vc4_addr_space *space, uint32_t paddr);
+
+const struct vc4_addr_range *
+vc4_addr_space_lookup_pointer(struct vc4_addr_space *space, const void *p);
+
+void *vc4_addr_space_map(struct vc4_addr_space *space,
+                         const struct vc4_addr_range *range);
+
+#endif /* VC4_ADDR_SPACE_H */
@@ -0,0 +1,183 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/** @file vc4_addr_space_bench.c
+ *
+ * Measures paddr lookups per second through struct vc4_addr_space against
+ * the linear scan over bo_state that the tools used to do, for a range of BO
+ * counts.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "vc4_drm.h"
+
+#include "vc4_addr_space.h"
+#include "vc4_tools.h"
+
+#define LOOKUPS (1 << 20)
+
+static struct drm_vc4_get_hang_state_bo *bo_state;
+static void **maps;
+
+/* Keeps the compiler from optimizing out the timed loops. */
+static volatile uintptr_t sink;
+
+static double
+get_time(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *
+linear_lookup(uint32_t bo_count, uint32_t addr)
+{
+        for (int i = 0; i < bo_count; i++) {
+                uint32_t paddr = bo_state[i].paddr;
+                if (addr >= paddr && addr < paddr + bo_state[i].size)
+                        return maps[i] + (addr - paddr);
+        }
+
+        return NULL;
+}
+
+/* Sets up bo_count BOs of random size in [4k, 64k], with small gaps in
+ * between, shuffled the way the kernel's BO list would be.
+ */
+static void
+make_bos(uint32_t bo_count)
+{
+        uint32_t paddr = 0x10000000;
+
+        bo_state = calloc(bo_count, sizeof(*bo_state));
+        maps = calloc(bo_count, sizeof(*maps));
+        if (!bo_state || !maps)
+                err(1, "malloc failure");
+
+        for (uint32_t i = 0; i < bo_count; i++) {
+                bo_state[i].handle = i + 1;
+                bo_state[i].paddr = paddr;
+                bo_state[i].size = 4096 * (1 + rand() % 16);
+                maps[i] = (void *)(uintptr_t)(paddr + 0x1000);
+                paddr += bo_state[i].size + 4096 * (rand() % 2);
+        }
+
+        for (uint32_t i = bo_count - 1; i > 0; i--) {
+                uint32_t j = rand() % (i + 1);
+                struct drm_vc4_get_hang_state_bo tmp_bo = bo_state[i];
+                void *tmp_map = maps[i];
+
+                bo_state[i] = bo_state[j];
+                bo_state[j] = tmp_bo;
+                maps[i] = maps[j];
+                maps[j] = tmp_map;
+        }
+}
+
+static void
+bench(uint32_t bo_count)
+{
+        struct vc4_addr_space space;
+        uint32_t *addrs = malloc(LOOKUPS * sizeof(*addrs));
+        uintptr_t sum_linear = 0, sum_indexed = 0;
+        uint32_t linear_lookups = LOOKUPS;
+
+        if (!addrs)
+                err(1, "malloc failure");
+
+        make_bos(bo_count);
+        vc4_addr_space_init(&space, bo_state, maps, bo_count);
+
+        for (int i = 0; i < LOOKUPS; i++) {
+                uint32_t bo = rand() % bo_count;
+                addrs[i] = bo_state[bo].paddr + rand() % bo_state[bo].size;
+        }
+
+        /* Keep the slow path from taking forever at high BO counts. */
+        while (linear_lookups > 1024 &&
+               (uint64_t)linear_lookups * bo_count > (1ull << 30)) {
+                linear_lookups /= 2;
+        }
+
+        double start = get_time();
+        for (int i = 0; i < linear_lookups; i++) {
+                void *map = linear_lookup(bo_count, addrs[i]);
+
+                sum_linear += (uintptr_t)map;
+        }
+        double linear_time = get_time() - start;
+
+        start = get_time();
+        for (int i = 0; i < LOOKUPS; i++) {
+                const struct vc4_addr_range *range =
+                        vc4_addr_space_lookup_paddr(&space, addrs[i]);
+                sum_indexed += (uintptr_t)range->map +
+                        (addrs[i] - range->paddr);
+        }
+        double indexed_time = get_time() - start;
+
+        /* Check that the two agree, on the prefix they both did. */
+        uintptr_t check = 0;
+        for (int i = 0; i < linear_lookups; i++) {
+                const struct vc4_addr_range *range =
+                        vc4_addr_space_lookup_paddr(&space, addrs[i]);
+                check += (uintptr_t)range->map + (addrs[i] - range->paddr);
+        }
+        if (check != sum_linear)
+                errx(1, "lookup mismatch at %d BOs", bo_count);
+        sink = sum_indexed;
+
+        printf("%8d BOs: linear %12.0f lookups/s, indexed %12.0f lookups/s "
+               "(%.1fx)\n",
+               bo_count,
+               linear_lookups / linear_time,
+               LOOKUPS / indexed_time,
+               (LOOKUPS / indexed_time) / (linear_lookups / linear_time));
+
+        vc4_addr_space_fini(&space);
+        free(bo_state);
+        free(maps);
+        free(addrs);
+}
+
+int
+main(int argc, char **argv)
+{
+        static const uint32_t bo_counts[] = {
+                1, 16, 256, 1024, 4096, 16384, 65536
+        };
+
+        srand(0);
+
+        for (int i = 0; i < ARRAY_SIZE(bo_counts); i++)
+                bench(bo_counts[i]);
+
+        return 0;
+}
@@ -0,0 +1,266 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/** @file vc4_cl_ir.h
+ *
+ * Decoded form of a CL.
+ *
+ * vc4_dump_cl() decodes the CL bytes once into an array of items, and then
+ * hands the array to the context's renderer.  Renderers and other analyses
+ * only look at the items, never at the CL bytes.
+ */
+
+#ifndef VC4_CL_IR_H
+#define VC4_CL_IR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum vc4_cl_item_kind {
+        /** A packet whose fields are decoded into the union by opcode. */
+        VC4_CL_ITEM_PACKET,
+        /**
+         * A packet we don't decode the fields of, or one that runs off the
+         * end of the CL.  u.raw has the bytes after the opcode.
+         */
+        VC4_CL_ITEM_RAW_PACKET,
+        /** An opcode byte that isn't a known packet.  Decoding stops. */
+        VC4_CL_ITEM_UNKNOWN_PACKET,
+        /** The CL ran past its end address at offset.  Decoding stops. */
+        VC4_CL_ITEM_OVERFLOW,
+        /**
+         * offset was already decoded as part of another CL.  Decoding
+         * stops.
+         */
+        VC4_CL_ITEM_REVISIT,
+
+        /* Entries of compressed primitive lists.  opcode is the first byte
+         * of the entry.
+         */
+        VC4_CL_ITEM_COMPRESSED_ESCAPE,
+        VC4_CL_ITEM_COMPRESSED_BRANCH,
+        VC4_CL_ITEM_COMPRESSED_TRI_3ABS,
+        VC4_CL_ITEM_COMPRESSED_TRI_1ABS_2REL,
+        VC4_CL_ITEM_COMPRESSED_TRI_3REL,
+        VC4_CL_ITEM_COMPRESSED_TRI_1REL,
+        VC4_CL_ITEM_COMPRESSED_UNKNOWN,
+        /** The clipped vertex address in a clipped compressed primitive. */
+        VC4_CL_ITEM_CLIPPED_VERTS,
+};
+
+struct vc4_cl_item {
+        /** Address of the first byte of the packet or entry. */
+        uint32_t offset;
+        uint8_t kind;
+        uint8_t opcode;
+        uint16_t pad;
+
+        /**
+         * For items that queued another mem area to be decoded (sublists,
+         * compressed lists and shader records), the mem area's handle.
+         * Otherwise 0.
+         */
+        uint32_t link;
+
+        union {
+                struct {
+                        uint32_t addr;
+                } branch;
+
+                /* LOAD/STORE_FULL_RES_TILE_BUFFER */
+                struct {
+                        uint32_t addr;
+                        uint8_t flags;
+                } loadstore_full;
+
+                /* LOAD/STORE_TILE_BUFFER_GENERAL */
+                struct {
+                        uint8_t bits[2];
+                        uint32_t addr;
+                } loadstore_general;
+
+                struct {
+                        uint8_t mode;
+                        uint32_t count;
+                        uint32_t ib_offset;
+                        uint32_t max_index;
+                } indexed_prim;
+
+                struct {
+                        uint8_t mode;
+                        uint32_t count;
+                        uint32_t start;
+                } array_prim;
+
+                struct {
+                        uint8_t format;
+                } prim_list_format;
+
+                struct {
+                        uint32_t rec_paddr;
+                        uint8_t attributes;
+                        bool extended;
+                } gl_shader_state;
+
+                struct {
+                        uint32_t rec_paddr;
+                } nv_shader_state;
+
+                struct {
+                        uint8_t bits[3];
+                } config_bits;
+
+                struct {
+                        uint32_t bits;
+                } flat_shade_flags;
+
+                /* POINT_SIZE, LINE_WIDTH */
+                struct {
+                        uint32_t bits;
+                } value;
+
+                struct {
+                        uint16_t left;
+                        uint16_t bottom;
+                        uint16_t width;
+                        uint16_t height;
+                } clip_window;
+
+                struct {
+                        uint16_t x;
+                        uint16_t y;
+                } viewport_offset;
+
+                struct {
+                        uint32_t x;
+                        uint32_t y;
+                } clipper_xy_scaling;
+
+                struct {
+                        uint32_t scale;
+                        uint32_t offset;
+                } clipper_z_scaling;
+
+                struct {
+                        uint32_t tile_alloc_addr;
+                        uint32_t tile_alloc_size;
+                        uint32_t tile_state_addr;
+                        uint8_t width;
+                        uint8_t height;
+                        uint8_t flags;
+                } tile_binning_config;
+
+                struct {
+                        uint32_t color_addr;
+                        uint16_t width;
+                        uint16_t height;
+                        uint16_t bits;
+                } tile_rendering_config;
+
+                struct {
+                        uint32_t color[2];
+                        uint32_t zs;
+                        uint8_t stencil;
+                } clear_colors;
+
+                struct {
+                        uint8_t x;
+                        uint8_t y;
+                } tile_coordinates;
+
+                struct {
+                        uint32_t handles[2];
+                } gem_handles;
+
+                struct {
+                        uint8_t count;
+                        uint8_t bytes[15];
+                } raw;
+
+                struct {
+                        bool cycle;
+                } revisit;
+
+                struct {
+                        uint32_t addr;
+                        int16_t branch;
+                } compressed_branch;
+
+                struct {
+                        uint16_t index[3];
+                } compressed_abs;
+
+                struct {
+                        uint8_t bytes[2];
+                } compressed_rel;
+
+                struct {
+                        uint32_t bits;
+                } clipped_verts;
+        } u;
+};
+
+struct vc4_cl_ir {
+        /** Address the CL was decoded from. */
+        uint32_t start;
+        /** Address just past the last byte decoded. */
+        uint32_t end;
+
+        struct vc4_cl_item *items;
+        uint32_t count;
+        uint32_t size;
+};
+
+/**
+ * A consumer of decoded CLs, called once for each CL that vc4_dump_cl()
+ * decodes.
+ */
+struct vc4_cl_renderer {
+        void (*render)(void *data, const struct vc4_cl_ir *ir);
+        void *data;
+};
+
+/** Totals accumulated over CLs by vc4_cl_render_stats(). */
+struct vc4_cl_stats {
+        uint32_t packets[256];
+        uint32_t unknown_packets;
+
+        /* GL array and indexed primitive packets, and their vertices. */
+        uint32_t draws;
+        uint64_t vertices;
+        uint32_t max_draw_vertices;
+
+        /* Triangles in compressed primitive lists. */
+        uint32_t compressed_prims;
+
+        uint32_t tiles;
+};
+
+void vc4_cl_render_text(void *data, const struct vc4_cl_ir *ir);
+void vc4_cl_render_json(void *data, const struct vc4_cl_ir *ir);
+void vc4_cl_render_stats(void *data, const struct vc4_cl_ir *ir);
+
+const char *vc4_cl_packet_name(uint8_t opcode);
+const char *vc4_cl_prim_name(uint8_t mode);
+
+#endif /* VC4_CL_IR_H */
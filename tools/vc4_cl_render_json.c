@@ -0,0 +1,386 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/** @file vc4_cl_render_json.c
+ *
+ * The JSON CL dump, rendered from the decoded CL items.
+ *
+ * Each CL becomes an "items" array with one object per item.  Fields are
+ * given as the raw values from the packet, with the flag bits broken out
+ * as booleans.
+ */
+
+#include "vc4_cl_ir.h"
+#include "vc4_json.h"
+#include "vc4_packet.h"
+#include "vc4_tools.h"
+
+static const char * const kind_name[] = {
+        [VC4_CL_ITEM_PACKET] = "packet",
+        [VC4_CL_ITEM_RAW_PACKET] = "raw_packet",
+        [VC4_CL_ITEM_UNKNOWN_PACKET] = "unknown_packet",
+        [VC4_CL_ITEM_OVERFLOW] = "overflow",
+        [VC4_CL_ITEM_REVISIT] = "revisit",
+        [VC4_CL_ITEM_COMPRESSED_ESCAPE] = "compressed_escape",
+        [VC4_CL_ITEM_COMPRESSED_BRANCH] = "compressed_branch",
+        [VC4_CL_ITEM_COMPRESSED_TRI_3ABS] = "compressed_tri_3abs",
+        [VC4_CL_ITEM_COMPRESSED_TRI_1ABS_2REL] = "compressed_tri_1abs_2rel",
+        [VC4_CL_ITEM_COMPRESSED_TRI_3REL] = "compressed_tri_3rel",
+        [VC4_CL_ITEM_COMPRESSED_TRI_1REL] = "compressed_tri_1rel",
+        [VC4_CL_ITEM_COMPRESSED_UNKNOWN] = "compressed_unknown",
+        [VC4_CL_ITEM_CLIPPED_VERTS] = "clipped_verts",
+};
+
+static void
+json_float(struct vc4_json *json, const char *key, uint32_t bits)
+{
+        vc4_json_double(json, key, uif(bits));
+}
+
+static void
+render_packet_fields(struct vc4_json *json, const struct vc4_cl_item *item)
+{
+        switch (item->opcode) {
+        case VC4_PACKET_BRANCH:
+        case VC4_PACKET_BRANCH_TO_SUB_LIST:
+                vc4_json_uint(json, "target", item->u.branch.addr);
+                break;
+
+        case VC4_PACKET_STORE_FULL_RES_TILE_BUFFER:
+        case VC4_PACKET_LOAD_FULL_RES_TILE_BUFFER: {
+                uint8_t flags = item->u.loadstore_full.flags;
+
+                vc4_json_uint(json, "buffer_addr",
+                              item->u.loadstore_full.addr);
+                vc4_json_bool(json, "clear", !(flags &
+                              VC4_LOADSTORE_FULL_RES_DISABLE_CLEAR_ALL));
+                vc4_json_bool(json, "zs",
+                              !(flags & VC4_LOADSTORE_FULL_RES_DISABLE_ZS));
+                vc4_json_bool(json, "color", !(flags &
+                              VC4_LOADSTORE_FULL_RES_DISABLE_COLOR));
+                vc4_json_bool(json, "eof",
+                              flags & VC4_LOADSTORE_FULL_RES_EOF);
+                break;
+        }
+
+        case VC4_PACKET_STORE_TILE_BUFFER_GENERAL:
+        case VC4_PACKET_LOAD_TILE_BUFFER_GENERAL: {
+                const uint8_t *bytes = item->u.loadstore_general.bits;
+                uint32_t addr = item->u.loadstore_general.addr;
+
+                vc4_json_uint(json, "buffer", bytes[0] & 0x7);
+                vc4_json_uint(json, "tiling", (bytes[0] >> 4) & 0x7);
+                vc4_json_uint(json, "format", bytes[1] & 0x3);
+                vc4_json_uint(json, "bits", bytes[0] | bytes[1] << 8);
+                vc4_json_uint(json, "buffer_addr", addr & ~15);
+                vc4_json_uint(json, "disable_mask", addr & 0x7);
+                vc4_json_bool(json, "eof", addr & (1 << 3));
+                break;
+        }
+
+        case VC4_PACKET_GL_INDEXED_PRIMITIVE: {
+                uint8_t mode = item->u.indexed_prim.mode;
+
+                vc4_json_uint(json, "mode", mode);
+                vc4_json_string(json, "prim", vc4_cl_prim_name(mode));
+                vc4_json_uint(json, "index_size",
+                              (mode & VC4_INDEX_BUFFER_U16) ? 16 : 8);
+                vc4_json_uint(json, "count", item->u.indexed_prim.count);
+                vc4_json_uint(json, "ib_offset",
+                              item->u.indexed_prim.ib_offset);
+                vc4_json_uint(json, "max_index",
+                              item->u.indexed_prim.max_index);
+                break;
+        }
+
+        case VC4_PACKET_GL_ARRAY_PRIMITIVE: {
+                uint8_t mode = item->u.array_prim.mode;
+
+                vc4_json_uint(json, "mode", mode);
+                vc4_json_string(json, "prim", vc4_cl_prim_name(mode));
+                vc4_json_uint(json, "count", item->u.array_prim.count);
+                vc4_json_uint(json, "start", item->u.array_prim.start);
+                break;
+        }
+
+        case VC4_PACKET_PRIMITIVE_LIST_FORMAT: {
+                uint8_t format = item->u.prim_list_format.format;
+
+                vc4_json_uint(json, "prim_mode", format & 0xf);
+                vc4_json_uint(json, "data_type", format >> 4);
+                break;
+        }
+
+        case VC4_PACKET_GL_SHADER_STATE:
+                vc4_json_uint(json, "rec_addr",
+                              item->u.gl_shader_state.rec_paddr);
+                vc4_json_uint(json, "attributes",
+                              item->u.gl_shader_state.attributes);
+                vc4_json_bool(json, "extended",
+                              item->u.gl_shader_state.extended);
+                break;
+
+        case VC4_PACKET_NV_SHADER_STATE:
+                vc4_json_uint(json, "rec_addr",
+                              item->u.nv_shader_state.rec_paddr);
+                break;
+
+        case VC4_PACKET_CONFIGURATION_BITS: {
+                const uint8_t *b = item->u.config_bits.bits;
+
+                vc4_json_uint(json, "bits",
+                              b[0] | b[1] << 8 | b[2] << 16);
+                vc4_json_bool(json, "front",
+                              b[0] & VC4_CONFIG_BITS_ENABLE_PRIM_FRONT);
+                vc4_json_bool(json, "back",
+                              b[0] & VC4_CONFIG_BITS_ENABLE_PRIM_BACK);
+                vc4_json_bool(json, "cw",
+                              b[0] & VC4_CONFIG_BITS_CW_PRIMITIVES);
+                vc4_json_bool(json, "depth_offset",
+                              b[0] & VC4_CONFIG_BITS_ENABLE_DEPTH_OFFSET);
+                vc4_json_bool(json, "aa_points_lines",
+                              b[0] & VC4_CONFIG_BITS_AA_POINTS_AND_LINES);
+                vc4_json_uint(json, "oversample", b[0] &
+                              VC4_CONFIG_BITS_RASTERIZER_OVERSAMPLE_MASK);
+                vc4_json_bool(json, "z_update",
+                              b[1] & VC4_CONFIG_BITS_Z_UPDATE);
+                vc4_json_uint(json, "z_func",
+                              (b[1] >> VC4_CONFIG_BITS_DEPTH_FUNC_SHIFT) &
+                              0x7);
+                vc4_json_bool(json, "early_z",
+                              b[2] & VC4_CONFIG_BITS_EARLY_Z);
+                vc4_json_bool(json, "early_z_update",
+                              b[2] & VC4_CONFIG_BITS_EARLY_Z_UPDATE);
+                break;
+        }
+
+        case VC4_PACKET_FLAT_SHADE_FLAGS:
+                vc4_json_uint(json, "bits", item->u.flat_shade_flags.bits);
+                break;
+
+        case VC4_PACKET_POINT_SIZE:
+        case VC4_PACKET_LINE_WIDTH:
+                json_float(json, "value", item->u.value.bits);
+                vc4_json_uint(json, "bits", item->u.value.bits);
+                break;
+
+        case VC4_PACKET_CLIP_WINDOW:
+                vc4_json_uint(json, "left", item->u.clip_window.left);
+                vc4_json_uint(json, "bottom", item->u.clip_window.bottom);
+                vc4_json_uint(json, "width", item->u.clip_window.width);
+                vc4_json_uint(json, "height", item->u.clip_window.height);
+                break;
+
+        case VC4_PACKET_VIEWPORT_OFFSET:
+                vc4_json_double(json, "x",
+                                item->u.viewport_offset.x / 16.0);
+                vc4_json_double(json, "y",
+                                item->u.viewport_offset.y / 16.0);
+                break;
+
+        case VC4_PACKET_CLIPPER_XY_SCALING:
+                json_float(json, "x", item->u.clipper_xy_scaling.x);
+                json_float(json, "y", item->u.clipper_xy_scaling.y);
+                break;
+
+        case VC4_PACKET_CLIPPER_Z_SCALING:
+                json_float(json, "scale", item->u.clipper_z_scaling.scale);
+                json_float(json, "offset",
+                           item->u.clipper_z_scaling.offset);
+                break;
+
+        case VC4_PACKET_TILE_BINNING_MODE_CONFIG:
+                vc4_json_uint(json, "tile_alloc_addr",
+                              item->u.tile_binning_config.tile_alloc_addr);
+                vc4_json_uint(json, "tile_alloc_size",
+                              item->u.tile_binning_config.tile_alloc_size);
+                vc4_json_uint(json, "tile_state_addr",
+                              item->u.tile_binning_config.tile_state_addr);
+                vc4_json_uint(json, "width",
+                              item->u.tile_binning_config.width);
+                vc4_json_uint(json, "height",
+                              item->u.tile_binning_config.height);
+                vc4_json_uint(json, "flags",
+                              item->u.tile_binning_config.flags);
+                break;
+
+        case VC4_PACKET_TILE_RENDERING_MODE_CONFIG: {
+                uint16_t bits = item->u.tile_rendering_config.bits;
+
+                vc4_json_uint(json, "color_addr",
+                              item->u.tile_rendering_config.color_addr);
+                vc4_json_uint(json, "width",
+                              item->u.tile_rendering_config.width);
+                vc4_json_uint(json, "height",
+                              item->u.tile_rendering_config.height);
+                vc4_json_uint(json, "bits", bits);
+                vc4_json_uint(json, "format",
+                              VC4_GET_FIELD(bits, VC4_RENDER_CONFIG_FORMAT));
+                vc4_json_uint(json, "tiling",
+                              VC4_GET_FIELD(bits,
+                                            VC4_RENDER_CONFIG_MEMORY_FORMAT));
+                vc4_json_bool(json, "ms_4x",
+                              bits & VC4_RENDER_CONFIG_MS_MODE_4X);
+                vc4_json_bool(json, "tile_buffer_64bit",
+                              bits & VC4_RENDER_CONFIG_TILE_BUFFER_64BIT);
+                break;
+        }
+
+        case VC4_PACKET_CLEAR_COLORS:
+                vc4_json_array_begin(json, "color");
+                vc4_json_uint(json, NULL, item->u.clear_colors.color[0]);
+                vc4_json_uint(json, NULL, item->u.clear_colors.color[1]);
+                vc4_json_array_end(json);
+                vc4_json_uint(json, "zs", item->u.clear_colors.zs);
+                vc4_json_uint(json, "stencil", item->u.clear_colors.stencil);
+                break;
+
+        case VC4_PACKET_TILE_COORDINATES:
+                vc4_json_uint(json, "x", item->u.tile_coordinates.x);
+                vc4_json_uint(json, "y", item->u.tile_coordinates.y);
+                break;
+
+        case VC4_PACKET_GEM_HANDLES:
+                vc4_json_array_begin(json, "handles");
+                vc4_json_uint(json, NULL, item->u.gem_handles.handles[0]);
+                vc4_json_uint(json, NULL, item->u.gem_handles.handles[1]);
+                vc4_json_array_end(json);
+                break;
+
+        default:
+                break;
+        }
+}
+
+static void
+render_item(struct vc4_json *json, const struct vc4_cl_item *item)
+{
+        vc4_json_object_begin(json, NULL);
+        vc4_json_uint(json, "addr", item->offset);
+        vc4_json_string(json, "kind", kind_name[item->kind]);
+
+        switch (item->kind) {
+        case VC4_CL_ITEM_PACKET:
+        case VC4_CL_ITEM_RAW_PACKET:
+                vc4_json_uint(json, "opcode", item->opcode);
+                vc4_json_string(json, "name",
+                                vc4_cl_packet_name(item->opcode));
+                break;
+        case VC4_CL_ITEM_UNKNOWN_PACKET:
+                vc4_json_uint(json, "opcode", item->opcode);
+                break;
+        case VC4_CL_ITEM_COMPRESSED_ESCAPE:
+        case VC4_CL_ITEM_COMPRESSED_BRANCH:
+        case VC4_CL_ITEM_COMPRESSED_TRI_3ABS:
+        case VC4_CL_ITEM_COMPRESSED_TRI_1ABS_2REL:
+        case VC4_CL_ITEM_COMPRESSED_TRI_3REL:
+        case VC4_CL_ITEM_COMPRESSED_TRI_1REL:
+        case VC4_CL_ITEM_COMPRESSED_UNKNOWN:
+                vc4_json_uint(json, "code", item->opcode);
+                break;
+        default:
+                break;
+        }
+
+        switch (item->kind) {
+        case VC4_CL_ITEM_PACKET:
+                render_packet_fields(json, item);
+                break;
+
+        case VC4_CL_ITEM_RAW_PACKET:
+                vc4_json_array_begin(json, "bytes");
+                for (int i = 0; i < item->u.raw.count; i++)
+                        vc4_json_uint(json, NULL, item->u.raw.bytes[i]);
+                vc4_json_array_end(json);
+                break;
+
+        case VC4_CL_ITEM_REVISIT:
+                vc4_json_bool(json, "cycle", item->u.revisit.cycle);
+                break;
+
+        case VC4_CL_ITEM_COMPRESSED_BRANCH:
+                vc4_json_uint(json, "target",
+                              item->u.compressed_branch.addr);
+                vc4_json_int(json, "branch",
+                             item->u.compressed_branch.branch);
+                break;
+
+        case VC4_CL_ITEM_COMPRESSED_TRI_3ABS:
+                vc4_json_array_begin(json, "indices");
+                for (int i = 0; i < 3; i++) {
+                        vc4_json_uint(json, NULL,
+                                      item->u.compressed_abs.index[i]);
+                }
+                vc4_json_array_end(json);
+                break;
+
+        case VC4_CL_ITEM_COMPRESSED_TRI_1ABS_2REL:
+                vc4_json_array_begin(json, "indices");
+                vc4_json_uint(json, NULL, item->u.compressed_abs.index[0]);
+                vc4_json_array_end(json);
+                break;
+
+        case VC4_CL_ITEM_COMPRESSED_TRI_3REL: {
+                const uint8_t *b = item->u.compressed_rel.bytes;
+
+                vc4_json_array_begin(json, "deltas");
+                vc4_json_int(json, NULL, (int8_t)b[0] >> 4);
+                vc4_json_int(json, NULL, ((int8_t)b[1] << 4) >> 4);
+                vc4_json_int(json, NULL, (int8_t)b[1] >> 4);
+                vc4_json_array_end(json);
+                break;
+        }
+
+        case VC4_CL_ITEM_COMPRESSED_TRI_1REL:
+                vc4_json_array_begin(json, "deltas");
+                vc4_json_int(json, NULL, (int8_t)item->opcode >> 2);
+                vc4_json_array_end(json);
+                break;
+
+        case VC4_CL_ITEM_CLIPPED_VERTS:
+                vc4_json_uint(json, "verts_addr",
+                              item->u.clipped_verts.bits & ~0x7);
+                vc4_json_uint(json, "clip", item->u.clipped_verts.bits & 0x7);
+                break;
+
+        default:
+                break;
+        }
+
+        vc4_json_object_end(json);
+}
+
+/**
+ * Renders the CL as an "items" array member to the struct vc4_json in data,
+ * which must have an object open.
+ */
+void
+vc4_cl_render_json(void *data, const struct vc4_cl_ir *ir)
+{
+        struct vc4_json *json = data;
+
+        vc4_json_array_begin(json, "items");
+        for (uint32_t i = 0; i < ir->count; i++)
+                render_item(json, &ir->items[i]);
+        vc4_json_array_end(json);
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/** @file vc4_cl_render_stats.c
+ *
+ * Counts packets and draws in the decoded CL items, without producing any
+ * output.
+ */
+
+#include "vc4_cl_ir.h"
+#include "vc4_packet.h"
+#include "vc4_tools.h"
+
+static void
+count_draw(struct vc4_cl_stats *stats, uint32_t count)
+{
+        stats->draws++;
+        stats->vertices += count;
+        stats->max_draw_vertices = MAX2(stats->max_draw_vertices, count);
+}
+
+/**
+ * Adds the CL's items to the struct vc4_cl_stats in data.
+ */
+void
+vc4_cl_render_stats(void *data, const struct vc4_cl_ir *ir)
+{
+        struct vc4_cl_stats *stats = data;
+
+        for (uint32_t i = 0; i < ir->count; i++) {
+                const struct vc4_cl_item *item = &ir->items[i];
+
+                switch (item->kind) {
+                case VC4_CL_ITEM_PACKET:
+                case VC4_CL_ITEM_RAW_PACKET:
+                        stats->packets[item->opcode]++;
+                        break;
+                case VC4_CL_ITEM_UNKNOWN_PACKET:
+                        stats->unknown_packets++;
+                        continue;
+                case VC4_CL_ITEM_COMPRESSED_TRI_3ABS:
+                case VC4_CL_ITEM_COMPRESSED_TRI_1ABS_2REL:
+                case VC4_CL_ITEM_COMPRESSED_TRI_3REL:
+                case VC4_CL_ITEM_COMPRESSED_TRI_1REL:
+                        stats->compressed_prims++;
+                        continue;
+                default:
+                        continue;
+                }
+
+                switch (item->opcode) {
+                case VC4_PACKET_GL_INDEXED_PRIMITIVE:
+                        if (item->kind == VC4_CL_ITEM_PACKET)
+                                count_draw(stats, item->u.indexed_prim.count);
+                        break;
+                case VC4_PACKET_GL_ARRAY_PRIMITIVE:
+                        if (item->kind == VC4_CL_ITEM_PACKET)
+                                count_draw(stats, item->u.array_prim.count);
+                        break;
+                case VC4_PACKET_TILE_COORDINATES:
+                        stats->tiles++;
+                        break;
+                default:
+                        break;
+                }
+        }
+}
@@ -0,0 +1,652 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/** @file vc4_cl_render_text.c
+ *
+ * The human-readable CL dump, rendered from the decoded CL items.
+ */
+
+#include <stdarg.h>
+#include "vc4_cl_ir.h"
+#include "vc4_output.h"
+#include "vc4_packet.h"
+#include "vc4_tools.h"
+
+/* Starts a line of the dump with the address it describes. */
+static void
+dump_addr(struct vc4_output *out, uint32_t paddr)
+{
+        vc4_out_lit(out, "0x");
+        vc4_out_hex(out, paddr, 8);
+        vc4_out_lit(out, ": ");
+}
+
+static void
+dump_printf(struct vc4_output *out, uint32_t paddr, const char *format, ...)
+        __attribute__ ((format(__printf__, 3, 4)));
+
+static void
+dump_printf(struct vc4_output *out, uint32_t paddr, const char *format, ...)
+{
+        va_list ap;
+
+        dump_addr(out, paddr);
+        vc4_out_lit(out, "     ");
+        va_start(ap, format);
+        vc4_out_vprintf(out, format, ap);
+        va_end(ap);
+}
+
+/* Prints a field of a packet, at offset bytes after the opcode. */
+#define field_printf(out, item, delta, ...) \
+        dump_printf(out, (item)->offset + 1 + (delta), __VA_ARGS__)
+
+static void
+dump_value(struct vc4_output *out, const struct vc4_cl_item *item)
+{
+        field_printf(out, item, 0, "%f (0x%08x)\n",
+                     uif(item->u.value.bits), item->u.value.bits);
+}
+
+static void
+dump_branch(struct vc4_output *out, const struct vc4_cl_item *item)
+{
+        field_printf(out, item, 0, "addr 0x%08x\n", item->u.branch.addr);
+}
+
+static void
+dump_loadstore_full(struct vc4_output *out, const struct vc4_cl_item *item)
+{
+        uint8_t flags = item->u.loadstore_full.flags;
+
+        field_printf(out, item, 0, "addr 0x%08x%s%s%s%s\n",
+                     item->u.loadstore_full.addr,
+                     (flags & VC4_LOADSTORE_FULL_RES_DISABLE_CLEAR_ALL) ? "" : " clear",
+                     (flags & VC4_LOADSTORE_FULL_RES_DISABLE_ZS) ? "" : " zs",
+                     (flags & VC4_LOADSTORE_FULL_RES_DISABLE_COLOR) ? "" : " color",
+                     (flags & VC4_LOADSTORE_FULL_RES_EOF) ? " eof" : "");
+}
+
+static void
+dump_loadstore_general(struct vc4_output *out, const struct vc4_cl_item *item)
+{
+        const uint8_t *bytes = item->u.loadstore_general.bits;
+        uint32_t addr = item->u.loadstore_general.addr;
+
+        const char *fullvg = "";
+        const char *fullzs = "";
+        const char *fullcolor = "";
+        const char *buffer = "???";
+
+        switch ((bytes[0] & 0x7)){
+        case 0:
+                buffer = "none";
+                break;
+        case 1:
+                buffer = "color";
+                break;
+        case 2:
+                buffer = "zs";
+                break;
+        case 3:
+                buffer = "z";
+                break;
+        case 4:
+                buffer = "vgmask";
+                break;
+        case 5:
+                buffer = "full";
+                if (addr & (1 << 0))
+                        fullcolor = " !color";
+                if (addr & (1 << 1))
+                        fullzs = " !zs";
+                if (addr & (1 << 2))
+                        fullvg = " !vgmask";
+                break;
+        }
+
+        const char *tiling = "???";
+        switch ((bytes[0] >> 4) & 7) {
+        case 0:
+                tiling = "linear";
+                break;
+        case 1:
+                tiling = "T";
+                break;
+        case 2:
+                tiling = "LT";
+                break;
+        }
+
+        const char *format = "???";
+        switch (bytes[1] & 3) {
+        case 0:
+                format = "RGBA8888";
+                break;
+        case 1:
+                format = "BGR565_DITHER";
+                break;
+        case 2:
+                format = "BGR565";
+                break;
+        }
+
+        field_printf(out, item, 0, "0x%02x %s %s\n",
+                     bytes[0], buffer, tiling);
+        field_printf(out, item, 1, "0x%02x %s\n", bytes[1], format);
+        field_printf(out, item, 2, "addr 0x%08x %s%s%s%s\n",
+                     addr & ~15,
+                     fullcolor, fullzs, fullvg,
+                     (addr & (1 << 3)) ? " EOF" : "");
+}
+
+static void
+dump_indexed_primitive(struct vc4_output *out, const struct vc4_cl_item *item)
+{
+        uint8_t mode = item->u.indexed_prim.mode;
+
+        field_printf(out, item, 0, "0x%02x %s %s\n",
+                     mode, (mode & VC4_INDEX_BUFFER_U16) ? "16-bit" : "8-bit",
+                     vc4_cl_prim_name(mode));
+        field_printf(out, item, 1, "     %d verts\n",
+                     item->u.indexed_prim.count);
+        field_printf(out, item, 5, "0x%08x IB offset\n",
+                     item->u.indexed_prim.ib_offset);
+        field_printf(out, item, 9, "0x%08x max index\n",
+                     item->u.indexed_prim.max_index);
+}
+
+static void
+dump_array_primitive(struct vc4_output *out, const struct vc4_cl_item *item)
+{
+        uint8_t mode = item->u.array_prim.mode;
+
+        field_printf(out, item, 0, "0x%02x %s\n",
+                     mode, vc4_cl_prim_name(mode));
+        field_printf(out, item, 1, "%d verts\n", item->u.array_prim.count);
+        field_printf(out, item, 5, "0x%08x start\n",
+                     item->u.array_prim.start);
+}
+
+static void
+dump_primitive_list_format(struct vc4_output *out,
+                           const struct vc4_cl_item *item)
+{
+        uint8_t b = item->u.prim_list_format.format;
+        const char *prim_mode = "unknown";
+        const char *data_type = "unknown";
+
+        switch (b & 0xf) {
+        case 0:
+                prim_mode = "points";
+                break;
+        case 1:
+                prim_mode = "lines";
+                break;
+        case 2:
+                prim_mode = "triangles";
+                break;
+        case 3:
+                prim_mode = "RHT";
+                break;
+        }
+
+        switch (b >> 4) {
+        case 1:
+                data_type = "16-bit index";
+                break;
+        case 3:
+                prim_mode = "32-bit x/y";
+                break;
+        }
+
+        field_printf(out, item, 0, "0x%02x: prim_mode %s, data_type %s\n",
+                     b, prim_mode, data_type);
+}
+
+static void
+dump_gl_shader_state(struct vc4_output *out, const struct vc4_cl_item *item)
+{
+        field_printf(out, item, 0, "0x%08x %d attr count, %s\n",
+                     item->u.gl_shader_state.rec_paddr,
+                     item->u.gl_shader_state.attributes,
+                     item->u.gl_shader_state.extended ?
+                     "extended" : "unextended");
+}
+
+static void
+dump_nv_shader_state(struct vc4_output *out, const struct vc4_cl_item *item)
+{
+        field_printf(out, item, 0, "0x%08x\n",
+                     item->u.nv_shader_state.rec_paddr);
+}
+
+static void
+dump_configuration_bits(struct vc4_output *out,
+                        const struct vc4_cl_item *item)
+{
+        const uint8_t *b = item->u.config_bits.bits;
+        const char *msaa;
+
+        switch (b[0] & VC4_CONFIG_BITS_RASTERIZER_OVERSAMPLE_MASK) {
+        case VC4_CONFIG_BITS_RASTERIZER_OVERSAMPLE_NONE:
+                msaa = "1x";
+                break;
+        case VC4_CONFIG_BITS_RASTERIZER_OVERSAMPLE_4X:
+                msaa = "4x";
+                break;
+        case VC4_CONFIG_BITS_RASTERIZER_OVERSAMPLE_16X:
+                msaa = "16x";
+                break;
+        default:
+                msaa = "unknownx";
+                break;
+        }
+
+        field_printf(out, item, 0,
+                     "0x%02x f %d, b %d, %s, depthoff %d, aapointslines %d, %s\n",
+                     b[0],
+                     (b[0] & VC4_CONFIG_BITS_ENABLE_PRIM_FRONT) != 0,
+                     (b[0] & VC4_CONFIG_BITS_ENABLE_PRIM_BACK) != 0,
+                     (b[0] & VC4_CONFIG_BITS_CW_PRIMITIVES) ? "cw" : "ccw",
+                     (b[0] & VC4_CONFIG_BITS_ENABLE_DEPTH_OFFSET) != 0,
+                     (b[0] & VC4_CONFIG_BITS_AA_POINTS_AND_LINES) != 0,
+                     msaa);
+
+        field_printf(out, item, 1, "0x%02x z_upd %d, z_func %d\n", b[1],
+                     (b[1] & VC4_CONFIG_BITS_Z_UPDATE) != 0,
+                     ((b[1] >> VC4_CONFIG_BITS_DEPTH_FUNC_SHIFT) & 0x7));
+
+
+        field_printf(out, item, 2, "0x%02x ez %d, ezup %d\n", b[2],
+                     (b[2] & VC4_CONFIG_BITS_EARLY_Z) != 0,
+                     (b[2] & VC4_CONFIG_BITS_EARLY_Z_UPDATE) != 0);
+
+}
+
+static void
+dump_flat_shade_flags(struct vc4_output *out, const struct vc4_cl_item *item)
+{
+        field_printf(out, item, 0, "bits 0x%08x\n",
+                     item->u.flat_shade_flags.bits);
+}
+
+static void
+dump_clip_window(struct vc4_output *out, const struct vc4_cl_item *item)
+{
+        field_printf(out, item, 0, "%d, %d (b,l)\n",
+                     item->u.clip_window.left, item->u.clip_window.bottom);
+        field_printf(out, item, 2, "%d, %d (w,h)\n",
+                     item->u.clip_window.width, item->u.clip_window.height);
+}
+
+static void
+dump_viewport_offset(struct vc4_output *out, const struct vc4_cl_item *item)
+{
+        uint16_t x = item->u.viewport_offset.x;
+        uint16_t y = item->u.viewport_offset.y;
+
+        field_printf(out, item, 0, "%f, %f (0x%04x, 0x%04x)\n",
+                     x / 16.0, y / 16.0, x, y);
+}
+
+static void
+dump_clipper_xy_scaling(struct vc4_output *out,
+                        const struct vc4_cl_item *item)
+{
+        uint32_t x = item->u.clipper_xy_scaling.x;
+        uint32_t y = item->u.clipper_xy_scaling.y;
+
+        field_printf(out, item, 0, "%f, %f (%f, %f, 0x%08x, 0x%08x)\n",
+                     uif(x) / 16.0, uif(y) / 16.0,
+                     uif(x), uif(y),
+                     x, y);
+}
+
+static void
+dump_clipper_z_scaling(struct vc4_output *out, const struct vc4_cl_item *item)
+{
+        uint32_t scale = item->u.clipper_z_scaling.scale;
+        uint32_t offset = item->u.clipper_z_scaling.offset;
+
+        field_printf(out, item, 0, "%f, %f (0x%08x, 0x%08x)\n",
+                     uif(scale), uif(offset), scale, offset);
+}
+
+static void
+dump_tile_binning_mode_config(struct vc4_output *out,
+                              const struct vc4_cl_item *item)
+{
+        field_printf(out, item, 0, " tile alloc addr 0x%08x\n",
+                     item->u.tile_binning_config.tile_alloc_addr);
+        field_printf(out, item, 4, " tile alloc size %db\n",
+                     item->u.tile_binning_config.tile_alloc_size);
+        field_printf(out, item, 8, " tile state addr 0x%08x\n",
+                     item->u.tile_binning_config.tile_state_addr);
+        field_printf(out, item, 12, " tiles (%d, %d)\n",
+                     item->u.tile_binning_config.width,
+                     item->u.tile_binning_config.height);
+        field_printf(out, item, 14, " flags 0x%02x\n",
+                     item->u.tile_binning_config.flags);
+}
+
+static void
+dump_tile_rendering_mode_config(struct vc4_output *out,
+                                const struct vc4_cl_item *item)
+{
+        uint16_t bits = item->u.tile_rendering_config.bits;
+
+        field_printf(out, item, 0, "color offset 0x%08x\n",
+                     item->u.tile_rendering_config.color_addr);
+        field_printf(out, item, 4, "width %d\n",
+                     item->u.tile_rendering_config.width);
+        field_printf(out, item, 6, "height %d\n",
+                     item->u.tile_rendering_config.height);
+
+        const char *format = "???";
+        switch (VC4_GET_FIELD(bits, VC4_RENDER_CONFIG_FORMAT)) {
+        case VC4_RENDER_CONFIG_FORMAT_BGR565_DITHERED:
+                format = "BGR565_DITHERED";
+                break;
+        case VC4_RENDER_CONFIG_FORMAT_RGBA8888:
+                format = "RGBA8888";
+                break;
+        case VC4_RENDER_CONFIG_FORMAT_BGR565:
+                format = "BGR565";
+                break;
+        }
+        if (bits & VC4_RENDER_CONFIG_TILE_BUFFER_64BIT)
+                format = "64bit";
+
+        const char *tiling = "???";
+        switch (VC4_GET_FIELD(bits, VC4_RENDER_CONFIG_MEMORY_FORMAT)) {
+        case VC4_TILING_FORMAT_LINEAR:
+                tiling = "linear";
+                break;
+        case VC4_TILING_FORMAT_T:
+                tiling = "T";
+                break;
+        case VC4_TILING_FORMAT_LT:
+                tiling = "LT";
+                break;
+        }
+
+        const char *earlyz = "";
+        if (bits & VC4_RENDER_CONFIG_EARLY_Z_COVERAGE_DISABLE) {
+                earlyz = "early_z disabled";
+        } else {
+                if (bits & VC4_RENDER_CONFIG_EARLY_Z_DIRECTION_G)
+                        earlyz = "early_z >";
+                else
+                        earlyz = "early_z <";
+        }
+
+        const char *decimate;
+        switch (bits & VC4_RENDER_CONFIG_DECIMATE_MODE_MASK) {
+        case VC4_RENDER_CONFIG_DECIMATE_MODE_1X:
+                decimate = "1x";
+                break;
+        case VC4_RENDER_CONFIG_DECIMATE_MODE_4X:
+                decimate = "4x";
+                break;
+        case VC4_RENDER_CONFIG_DECIMATE_MODE_16X:
+                decimate = "16x";
+                break;
+        default:
+                decimate = "unknown";
+                break;
+        }
+
+        field_printf(out, item, 8, "0x%04x %s, %s, %s, %s, decimate %s\n",
+                     bits, format, tiling,
+                     earlyz,
+                     (bits & VC4_RENDER_CONFIG_MS_MODE_4X) ? "ms_4x" : "ss",
+                     decimate);
+}
+
+static void
+dump_clear_colors(struct vc4_output *out, const struct vc4_cl_item *item)
+{
+        field_printf(out, item, 0, "0x%08x rgba8888[0]\n",
+                     item->u.clear_colors.color[0]);
+        field_printf(out, item, 4, "0x%08x rgba8888[1]\n",
+                     item->u.clear_colors.color[1]);
+        field_printf(out, item, 8, "0x%08x zs\n", item->u.clear_colors.zs);
+        field_printf(out, item, 12, "0x%02x stencil\n",
+                     item->u.clear_colors.stencil);
+}
+
+static void
+dump_tile_coordinates(struct vc4_output *out, const struct vc4_cl_item *item)
+{
+        field_printf(out, item, 0, "%d, %d\n",
+                     item->u.tile_coordinates.x, item->u.tile_coordinates.y);
+}
+
+static void
+dump_gem_handles(struct vc4_output *out, const struct vc4_cl_item *item)
+{
+        field_printf(out, item, 0, "handle 0: %d, handle 1: %d\n",
+                     item->u.gem_handles.handles[0],
+                     item->u.gem_handles.handles[1]);
+}
+
+/* Prints the line with a packet's opcode. */
+static void
+dump_packet_name(struct vc4_output *out, uint32_t paddr, uint8_t code)
+{
+        dump_addr(out, paddr);
+        vc4_out_lit(out, "0x");
+        vc4_out_hex(out, code, 2);
+        vc4_out_char(out, ' ');
+        vc4_out_str(out, vc4_cl_packet_name(code));
+        vc4_out_char(out, '\n');
+}
+
+static void
+dump_packet(struct vc4_output *out, const struct vc4_cl_item *item)
+{
+        dump_packet_name(out, item->offset, item->opcode);
+
+        switch (item->opcode) {
+        case VC4_PACKET_BRANCH:
+        case VC4_PACKET_BRANCH_TO_SUB_LIST:
+                dump_branch(out, item);
+                break;
+        case VC4_PACKET_STORE_FULL_RES_TILE_BUFFER:
+        case VC4_PACKET_LOAD_FULL_RES_TILE_BUFFER:
+                dump_loadstore_full(out, item);
+                break;
+        case VC4_PACKET_STORE_TILE_BUFFER_GENERAL:
+        case VC4_PACKET_LOAD_TILE_BUFFER_GENERAL:
+                dump_loadstore_general(out, item);
+                break;
+        case VC4_PACKET_GL_INDEXED_PRIMITIVE:
+                dump_indexed_primitive(out, item);
+                break;
+        case VC4_PACKET_GL_ARRAY_PRIMITIVE:
+                dump_array_primitive(out, item);
+                break;
+        case VC4_PACKET_PRIMITIVE_LIST_FORMAT:
+                dump_primitive_list_format(out, item);
+                break;
+        case VC4_PACKET_GL_SHADER_STATE:
+                dump_gl_shader_state(out, item);
+                break;
+        case VC4_PACKET_NV_SHADER_STATE:
+                dump_nv_shader_state(out, item);
+                break;
+        case VC4_PACKET_CONFIGURATION_BITS:
+                dump_configuration_bits(out, item);
+                break;
+        case VC4_PACKET_FLAT_SHADE_FLAGS:
+                dump_flat_shade_flags(out, item);
+                break;
+        case VC4_PACKET_POINT_SIZE:
+        case VC4_PACKET_LINE_WIDTH:
+                dump_value(out, item);
+                break;
+        case VC4_PACKET_CLIP_WINDOW:
+                dump_clip_window(out, item);
+                break;
+        case VC4_PACKET_VIEWPORT_OFFSET:
+                dump_viewport_offset(out, item);
+                break;
+        case VC4_PACKET_CLIPPER_XY_SCALING:
+                dump_clipper_xy_scaling(out, item);
+                break;
+        case VC4_PACKET_CLIPPER_Z_SCALING:
+                dump_clipper_z_scaling(out, item);
+                break;
+        case VC4_PACKET_TILE_BINNING_MODE_CONFIG:
+                dump_tile_binning_mode_config(out, item);
+                break;
+        case VC4_PACKET_TILE_RENDERING_MODE_CONFIG:
+                dump_tile_rendering_mode_config(out, item);
+                break;
+        case VC4_PACKET_CLEAR_COLORS:
+                dump_clear_colors(out, item);
+                break;
+        case VC4_PACKET_TILE_COORDINATES:
+                dump_tile_coordinates(out, item);
+                break;
+        case VC4_PACKET_GEM_HANDLES:
+                dump_gem_handles(out, item);
+                break;
+        default:
+                break;
+        }
+}
+
+static void
+dump_item(struct vc4_output *out, const struct vc4_cl_item *item)
+{
+        uint32_t paddr = item->offset;
+        uint8_t code = item->opcode;
+
+        switch (item->kind) {
+        case VC4_CL_ITEM_PACKET:
+                dump_packet(out, item);
+                break;
+
+        case VC4_CL_ITEM_RAW_PACKET:
+                dump_packet_name(out, paddr, code);
+                for (int i = 0; i < item->u.raw.count; i++) {
+                        dump_addr(out, paddr + 1 + i);
+                        vc4_out_lit(out, "0x");
+                        vc4_out_hex(out, item->u.raw.bytes[i], 2);
+                        vc4_out_char(out, '\n');
+                }
+                break;
+
+        case VC4_CL_ITEM_UNKNOWN_PACKET:
+                dump_addr(out, paddr);
+                vc4_out_printf(out, "Unknown packet 0x%02x (%d)!\n",
+                               code, code);
+                break;
+
+        case VC4_CL_ITEM_OVERFLOW:
+                dump_addr(out, paddr);
+                vc4_out_lit(out, "CL overflow!\n");
+                break;
+
+        case VC4_CL_ITEM_REVISIT:
+                dump_addr(out, paddr);
+                if (item->u.revisit.cycle) {
+                        vc4_out_lit(out,
+                                    "Already decoded, branch cycle!\n");
+                } else {
+                        vc4_out_lit(out, "Already decoded by an overlapping "
+                                    "CL\n");
+                }
+                break;
+
+        case VC4_CL_ITEM_COMPRESSED_ESCAPE:
+                dump_printf(out, paddr, "0x%02x: escape\n", code);
+                break;
+
+        case VC4_CL_ITEM_COMPRESSED_BRANCH:
+                dump_printf(out, paddr,
+                            "0x%02x: relative branch 0x%08x (0x%04x)\n",
+                            code, item->u.compressed_branch.addr,
+                            (uint16_t)item->u.compressed_branch.branch);
+                break;
+
+        case VC4_CL_ITEM_COMPRESSED_TRI_3ABS:
+                dump_printf(out, paddr, "0x%02x: 3 abs, 0 rel indices\n",
+                            code);
+                for (int i = 0; i < 3; i++) {
+                        dump_printf(out, paddr + 2 + i * 2,
+                                    "index %d: 0x%04x\n",
+                                    i, item->u.compressed_abs.index[i]);
+                }
+                break;
+
+        case VC4_CL_ITEM_COMPRESSED_TRI_1ABS_2REL:
+                dump_printf(out, paddr, "0x%02x: 1 abs, 2 rel indices\n",
+                            code);
+                dump_printf(out, paddr + 2, "index 0: 0x%04x\n",
+                            item->u.compressed_abs.index[0]);
+                break;
+
+        case VC4_CL_ITEM_COMPRESSED_TRI_3REL: {
+                const uint8_t *b = item->u.compressed_rel.bytes;
+                dump_printf(out, paddr,
+                            "0x%02x: 3 rel indices (%d, %d, %d)\n",
+                            code,
+                            (int8_t)b[0] >> 4,
+                            ((int8_t)b[1] << 4) >> 4,
+                            (int8_t)b[1] >> 4);
+                break;
+        }
+
+        case VC4_CL_ITEM_COMPRESSED_TRI_1REL:
+                dump_printf(out, paddr, "0x%02x: 1 rel index (%d)\n",
+                            code, (int8_t)code >> 2);
+                break;
+
+        case VC4_CL_ITEM_COMPRESSED_UNKNOWN:
+                dump_printf(out, paddr, "0x%02x: unknown (UNPARSED!)\n",
+                            code);
+                break;
+
+        case VC4_CL_ITEM_CLIPPED_VERTS:
+                dump_printf(out, paddr,
+                            "clipped verts at 0x%08x, clip 0x%1x\n",
+                            item->u.clipped_verts.bits & ~0x7,
+                            item->u.clipped_verts.bits & 0x7);
+                break;
+        }
+}
+
+/**
+ * Renders the CL as text to the struct vc4_output in data.
+ */
+void
+vc4_cl_render_text(void *data, const struct vc4_cl_ir *ir)
+{
+        struct vc4_output *out = data;
+
+        for (uint32_t i = 0; i < ir->count; i++)
+                dump_item(out, &ir->items[i]);
+}
@@ -0,0 +1,327 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/** @file vc4_crc32c.c
+ *
+ * The hardware path runs three CRCs at once over neighboring blocks of the
+ * data, since the CRC instructions can start one every cycle but take
+ * three to finish, and then shifts the first two CRCs over the blocks after
+ * them to put them together.  The shifts are done with tables for the two
+ * block sizes, built at startup along with the software path's tables.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "vc4_crc32c.h"
+#include "vc4_tools.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#define HAVE_HW_CRC32C
+#define HW_TARGET __attribute__((target("sse4.2")))
+#define hw_crc_u8(crc, value) _mm_crc32_u8(crc, value)
+#define hw_crc_u64(crc, value) ((uint32_t)_mm_crc32_u64(crc, value))
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define HAVE_HW_CRC32C
+#define HW_TARGET
+#define hw_crc_u8(crc, value) __crc32cb(crc, value)
+#define hw_crc_u64(crc, value) __crc32cd(crc, value)
+#endif
+
+/* The Castagnoli polynomial, bit reversed. */
+#define CRC32C_POLY     0x82f63b78
+
+/* Sizes of the blocks that the hardware path runs three streams over. */
+#define CRC32C_LONG     8192
+#define CRC32C_SHORT    256
+
+static uint32_t crc32c_table[8][256];
+static uint32_t crc32c_long[4][256];
+static uint32_t crc32c_short[4][256];
+/* Operators on a CRC register for 2^k zero bytes. */
+static uint32_t crc32c_zeros_op[64][32];
+
+static uint32_t (*crc32c_func)(uint32_t crc, const void *data, size_t size) =
+        vc4_crc32c_sw;
+
+static uint32_t
+gf2_matrix_times(const uint32_t *mat, uint32_t vec)
+{
+        uint32_t sum = 0;
+
+        while (vec) {
+                if (vec & 1)
+                        sum ^= *mat;
+                vec >>= 1;
+                mat++;
+        }
+
+        return sum;
+}
+
+static void
+gf2_matrix_square(uint32_t *square, const uint32_t *mat)
+{
+        for (int n = 0; n < 32; n++)
+                square[n] = gf2_matrix_times(mat, mat[n]);
+}
+
+/* Advances a CRC register over size zero bytes, with the operators for
+ * the powers of two in size.
+ */
+static uint32_t
+shift_zeros(uint32_t crc, uint64_t size)
+{
+        for (int k = 0; size; k++, size >>= 1) {
+                if (size & 1)
+                        crc = gf2_matrix_times(crc32c_zeros_op[k], crc);
+        }
+
+        return crc;
+}
+
+/* Makes the operators for 2^k zero bytes, by squaring the operator for one
+ * zero bit.
+ */
+static void
+make_zeros_ops(void)
+{
+        uint32_t bit[32], square[32];
+        uint32_t row = 1;
+
+        bit[0] = CRC32C_POLY;
+        for (int n = 1; n < 32; n++) {
+                bit[n] = row;
+                row <<= 1;
+        }
+
+        gf2_matrix_square(square, bit);
+        gf2_matrix_square(bit, square);
+        gf2_matrix_square(crc32c_zeros_op[0], bit);
+
+        for (int k = 1; k < ARRAY_SIZE(crc32c_zeros_op); k++) {
+                gf2_matrix_square(crc32c_zeros_op[k],
+                                  crc32c_zeros_op[k - 1]);
+        }
+}
+
+/* Makes the tables for shifting a CRC register over size zero bytes one
+ * byte of the register at a time.
+ */
+static void
+make_shift_table(uint32_t table[4][256], uint64_t size)
+{
+        uint32_t op[32];
+
+        for (int n = 0; n < 32; n++)
+                op[n] = shift_zeros(1u << n, size);
+
+        for (int k = 0; k < 4; k++) {
+                for (uint32_t n = 0; n < 256; n++)
+                        table[k][n] = gf2_matrix_times(op, n << (k * 8));
+        }
+}
+
+static inline uint32_t
+shift_table(const uint32_t table[4][256], uint32_t crc)
+{
+        return (table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^
+                table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24]);
+}
+
+static inline uint32_t
+load_le32(const uint8_t *p)
+{
+        return ((uint32_t)p[0] | (uint32_t)p[1] << 8 |
+                (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+}
+
+uint32_t
+vc4_crc32c_sw(uint32_t crc, const void *data, size_t size)
+{
+        const uint8_t *next = data;
+
+        crc = ~crc;
+
+        while (size && ((uintptr_t)next & 7)) {
+                crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *next++) & 0xff];
+                size--;
+        }
+
+        while (size >= 8) {
+                uint32_t lo = crc ^ load_le32(next);
+                uint32_t hi = load_le32(next + 4);
+
+                crc = (crc32c_table[7][lo & 0xff] ^
+                       crc32c_table[6][(lo >> 8) & 0xff] ^
+                       crc32c_table[5][(lo >> 16) & 0xff] ^
+                       crc32c_table[4][lo >> 24] ^
+                       crc32c_table[3][hi & 0xff] ^
+                       crc32c_table[2][(hi >> 8) & 0xff] ^
+                       crc32c_table[1][(hi >> 16) & 0xff] ^
+                       crc32c_table[0][hi >> 24]);
+                next += 8;
+                size -= 8;
+        }
+
+        while (size--)
+                crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *next++) & 0xff];
+
+        return ~crc;
+}
+
+#ifdef HAVE_HW_CRC32C
+static inline uint64_t
+load64(const uint8_t *p)
+{
+        uint64_t value;
+
+        memcpy(&value, p, sizeof(value));
+        return value;
+}
+
+/* Advances crc0 over the data three blocks of block_size bytes at a time,
+ * with a CRC for each block.
+ */
+#define HW_CRC_BLOCKS(block_size, table)                                \
+        while (size >= 3 * block_size) {                                \
+                const uint8_t *end = next + block_size;                 \
+                uint32_t crc1 = 0, crc2 = 0;                            \
+                                                                        \
+                do {                                                    \
+                        crc0 = hw_crc_u64(crc0, load64(next));          \
+                        crc1 = hw_crc_u64(crc1,                         \
+                                          load64(next + block_size));   \
+                        crc2 = hw_crc_u64(crc2,                         \
+                                          load64(next +                 \
+                                                 2 * block_size));      \
+                        next += 8;                                      \
+                } while (next < end);                                   \
+                                                                        \
+                crc0 = shift_table(table, crc0) ^ crc1;                 \
+                crc0 = shift_table(table, crc0) ^ crc2;                 \
+                next += 2 * block_size;                                 \
+                size -= 3 * block_size;                                 \
+        }
+
+HW_TARGET static uint32_t
+crc32c_hw(uint32_t crc, const void *data, size_t size)
+{
+        const uint8_t *next = data;
+        uint32_t crc0 = ~crc;
+
+        while (size && ((uintptr_t)next & 7)) {
+                crc0 = hw_crc_u8(crc0, *next++);
+                size--;
+        }
+
+        HW_CRC_BLOCKS(CRC32C_LONG, crc32c_long);
+        HW_CRC_BLOCKS(CRC32C_SHORT, crc32c_short);
+
+        while (size >= 8) {
+                crc0 = hw_crc_u64(crc0, load64(next));
+                next += 8;
+                size -= 8;
+        }
+
+        while (size--)
+                crc0 = hw_crc_u8(crc0, *next++);
+
+        return ~crc0;
+}
+
+static bool
+have_hw_crc32c(void)
+{
+#if defined(__x86_64__)
+        return __builtin_cpu_supports("sse4.2");
+#else
+        return true;
+#endif
+}
+#endif /* HAVE_HW_CRC32C */
+
+static void __attribute__((constructor))
+crc32c_init(void)
+{
+        make_zeros_ops();
+
+        for (uint32_t n = 0; n < 256; n++) {
+                uint32_t crc = n;
+
+                for (int k = 0; k < 8; k++)
+                        crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+                crc32c_table[0][n] = crc;
+        }
+        for (uint32_t n = 0; n < 256; n++) {
+                for (int k = 1; k < 8; k++) {
+                        uint32_t crc = crc32c_table[k - 1][n];
+
+                        crc32c_table[k][n] = ((crc >> 8) ^
+                                              crc32c_table[0][crc & 0xff]);
+                }
+        }
+
+#ifdef HAVE_HW_CRC32C
+        if (have_hw_crc32c()) {
+                make_shift_table(crc32c_long, CRC32C_LONG);
+                make_shift_table(crc32c_short, CRC32C_SHORT);
+                crc32c_func = crc32c_hw;
+        }
+#endif
+}
+
+uint32_t
+vc4_crc32c(uint32_t crc, const void *data, size_t size)
+{
+        return crc32c_func(crc, data, size);
+}
+
+uint32_t
+vc4_crc32c_zeros(uint32_t crc, uint64_t size)
+{
+        return ~shift_zeros(~crc, size);
+}
+
+uint32_t
+vc4_crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t size2)
+{
+        return shift_zeros(crc1, size2) ^ crc2;
+}
+
+const char *
+vc4_crc32c_impl(void)
+{
+#ifdef HAVE_HW_CRC32C
+        if (crc32c_func == crc32c_hw) {
+#if defined(__x86_64__)
+                return "SSE4.2";
+#else
+                return "ARMv8 CRC";
+#endif
+        }
+#endif
+        return "tables";
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/** @file vc4_crc32c.h
+ *
+ * CRC32C (the Castagnoli polynomial) of dump contents, for catching dumps
+ * that were truncated or corrupted on their way from the capture.
+ *
+ * The CRC uses the CPU's CRC instructions when it has them: SSE4.2 on x86,
+ * checked for at runtime since dumps are often read on a different machine
+ * than they were captured on, and the ARMv8 CRC extension when building
+ * for a CPU that has it.  Otherwise it's computed eight bytes at a time with
+ * tables.
+ */
+
+#ifndef VC4_CRC32C_H
+#define VC4_CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Returns the CRC of crc's data followed by size bytes of data, starting
+ * from a crc of 0 for no data.
+ */
+uint32_t vc4_crc32c(uint32_t crc, const void *data, size_t size);
+
+/* Returns the CRC of crc's data followed by size zero bytes. */
+uint32_t vc4_crc32c_zeros(uint32_t crc, uint64_t size);
+
+/**
+ * Returns the CRC of two pieces of data given each one's CRC, so that
+ * pieces can be checksummed in parallel.
+ */
+uint32_t vc4_crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t size2);
+
+/* Returns the CRC of data computed with the tables alone, for comparison. */
+uint32_t vc4_crc32c_sw(uint32_t crc, const void *data, size_t size);
+
+/* Returns a name for the implementation that vc4_crc32c() uses. */
+const char *vc4_crc32c_impl(void);
+
+#endif /* VC4_CRC32C_H */
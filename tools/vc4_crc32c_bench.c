@@ -0,0 +1,155 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/** @file vc4_crc32c_bench.c
+ *
+ * Measures the MB/s of vc4_crc32c() against the table-driven version and
+ * against just reading the same memory, and checks that the two CRCs
+ * agree.
+ *
+ * Given dumps on the command line, it also times vc4_dump_file_verify() on
+ * each, as vc4_dump_parse --verify would run it.
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "vc4_crc32c.h"
+#include "vc4_dump_file.h"
+#include "vc4_tools.h"
+
+#define BUFFER_SIZE (64 * 1024 * 1024)
+#define RUNS 5
+
+/* Keeps the compiler from optimizing out the timed loops. */
+static volatile uint64_t sink;
+
+static double
+get_time(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+read_memory(const uint64_t *data, size_t size)
+{
+        uint64_t sum = 0;
+
+        for (size_t i = 0; i < size / sizeof(*data); i++)
+                sum += data[i];
+        sink = sum;
+}
+
+static void
+bench_buffer(void)
+{
+        uint64_t *data = malloc(BUFFER_SIZE);
+        double read_time = 1e9, sw_time = 1e9, hw_time = 1e9;
+        uint32_t sw_crc = 0, hw_crc = 0;
+
+        if (!data)
+                err(1, "malloc failure");
+
+        srand(0);
+        for (size_t i = 0; i < BUFFER_SIZE / sizeof(*data); i++)
+                data[i] = (uint64_t)rand() << 32 | rand();
+
+        for (int run = 0; run < RUNS; run++) {
+                double start = get_time();
+                read_memory(data, BUFFER_SIZE);
+                read_time = MIN2(read_time, get_time() - start);
+
+                start = get_time();
+                sw_crc = vc4_crc32c_sw(0, data, BUFFER_SIZE);
+                sw_time = MIN2(sw_time, get_time() - start);
+
+                start = get_time();
+                hw_crc = vc4_crc32c(0, data, BUFFER_SIZE);
+                hw_time = MIN2(hw_time, get_time() - start);
+        }
+
+        if (sw_crc != hw_crc) {
+                errx(1, "vc4_crc32c() gave 0x%08x, but the tables gave "
+                     "0x%08x", hw_crc, sw_crc);
+        }
+
+        double mb = BUFFER_SIZE / (1024.0 * 1024.0);
+        printf("reading memory:     %8.1f MB/s\n", mb / read_time);
+        printf("tables:             %8.1f MB/s\n", mb / sw_time);
+        printf("vc4_crc32c() (%s): %8.1f MB/s (%.1fx)\n",
+               vc4_crc32c_impl(), mb / hw_time, sw_time / hw_time);
+
+        free(data);
+}
+
+static void
+bench_verify(const char *filename)
+{
+        double best = 1e9;
+        uint64_t size = 0;
+
+        for (int run = 0; run < RUNS; run++) {
+                struct vc4_dump_file *file = vc4_dump_file_open(filename);
+
+                if (file->error)
+                        errx(1, "%s", file->error);
+                if (!(file->crc_flags & VC4_DUMP_CRC_BOS))
+                        errx(1, "%s doesn't have BO checksums", filename);
+
+                size = 0;
+                for (uint32_t i = 0; i < file->state->bo_count; i++)
+                        size += file->bo_state[i].size;
+
+                double start = get_time();
+                uint32_t bad = vc4_dump_file_verify(file, NULL);
+                best = MIN2(best, get_time() - start);
+
+                if (file->error)
+                        errx(1, "%s", file->error);
+                if (bad)
+                        errx(1, "%s: %d BOs don't match", filename, bad);
+                vc4_dump_file_close(file);
+        }
+
+        printf("%s: verified %.1f MB of BOs at %.1f MB/s\n", filename,
+               size / (1024.0 * 1024.0), size / (1024.0 * 1024.0) / best);
+}
+
+int
+main(int argc, char **argv)
+{
+        bench_buffer();
+
+        for (int i = 1; i < argc; i++)
+                bench_verify(argv[i]);
+
+        return 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/** @file vc4_dump.h
+ *
+ * libvc4dump: reading and decoding vc4 hang dumps.
+ *
+ * Everything about a dump being parsed lives in its struct vc4_dump_ctx:
+ * the file, the translation between GPU addresses and the BO mappings, the
+ * CL decoder's state and the memory areas queued up by the CLs.  Any number
+ * of dumps can be open at once, each used from one thread at a time.
+ *
+ * As in the tools built on it, running out of memory is fatal.  A file that
+ * isn't a dump, or is damaged, is left to the caller to report: see
+ * vc4_dump_ctx_error().  Nothing is written to stderr; smaller problems
+ * found while decoding go to the output set by
+ * vc4_dump_ctx_set_diagnostics().
+ */
+
+#ifndef VC4_DUMP_H
+#define VC4_DUMP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct drm_vc4_get_hang_state;
+struct vc4_cl_renderer;
+struct vc4_dump_ctx;
+struct vc4_output;
+
+/** What vc4_dump_print() writes. */
+enum vc4_dump_format {
+        VC4_DUMP_FORMAT_TEXT,
+        VC4_DUMP_FORMAT_JSON,
+        /* Packet and draw totals over the CLs, instead of the CLs. */
+        VC4_DUMP_FORMAT_STATS,
+};
+
+struct vc4_dump_ctx *vc4_dump_ctx_open(const char *filename);
+void vc4_dump_ctx_close(struct vc4_dump_ctx *ctx);
+const char *vc4_dump_ctx_error(struct vc4_dump_ctx *ctx);
+
+const struct drm_vc4_get_hang_state *
+vc4_dump_ctx_state(struct vc4_dump_ctx *ctx);
+uint32_t vc4_dump_ctx_bo_count(struct vc4_dump_ctx *ctx);
+void vc4_dump_ctx_print_bo_list(struct vc4_dump_ctx *ctx,
+                                struct vc4_output *out);
+
+bool vc4_dump_ctx_has_bo_crcs(struct vc4_dump_ctx *ctx);
+uint32_t vc4_dump_ctx_verify(struct vc4_dump_ctx *ctx);
+
+void *vc4_dump_ctx_paddr_to_pointer(struct vc4_dump_ctx *ctx, uint32_t paddr);
+uint32_t vc4_dump_ctx_pointer_to_paddr(struct vc4_dump_ctx *ctx, void *p);
+
+void vc4_dump_ctx_set_output(struct vc4_dump_ctx *ctx, struct vc4_output *out,
+                             enum vc4_dump_format format);
+void vc4_dump_ctx_set_diagnostics(struct vc4_dump_ctx *ctx,
+                                  struct vc4_output *diag);
+void vc4_dump_ctx_set_range(struct vc4_dump_ctx *ctx, uint32_t start,
+                            uint32_t end);
+bool vc4_dump_ctx_set_range_bo(struct vc4_dump_ctx *ctx, uint32_t bo);
+void vc4_dump_ctx_set_threads(struct vc4_dump_ctx *ctx, uint32_t threads);
+
+void vc4_dump_ctx_set_renderer(struct vc4_dump_ctx *ctx,
+                               const struct vc4_cl_renderer *renderer);
+uint32_t vc4_dump_cl(struct vc4_dump_ctx *ctx, uint32_t start, uint32_t end,
+                     bool is_render, bool in_compressed_list,
+                     uint8_t prim_mode);
+
+void vc4_dump_print(struct vc4_dump_ctx *ctx);
+void vc4_dump_print_locus(struct vc4_dump_ctx *ctx, uint32_t window);
+
+void vc4_qpu_disasm(struct vc4_output *out, const uint64_t *instructions,
+                    int num_instructions);
+
+#endif /* VC4_DUMP_H */
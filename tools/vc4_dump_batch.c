@@ -0,0 +1,271 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/** @file vc4_dump_batch.c
+ *
+ * Decodes a whole set of hang dumps in one process, for triage.
+ *
+ * The dumps are decoded on a vc4_dump_pool, each into a vc4_dump_ctx of
+ * its own.  Each dump's output goes either to its own file in
+ * --output-dir, or into one summary on stdout, in the order the dumps were
+ * given.  Dumps that the reader can't decode are left out.
+ */
+
+/* For asprintf(). */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <err.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "vc4_dump.h"
+#include "vc4_dump_pool.h"
+#include "vc4_json.h"
+#include "vc4_output.h"
+
+struct batch {
+        enum vc4_dump_format format;
+        const char *output_dir;
+};
+
+/* Decodes the dump into out, returning false if it couldn't be read. */
+static bool
+render_dump(const char *path, struct vc4_output *out,
+            enum vc4_dump_format format)
+{
+        struct vc4_dump_ctx *ctx = vc4_dump_ctx_open(path);
+        /* Each of the library's reports is written in one piece, so they
+         * don't get mixed up between the dumps being decoded at once.
+         */
+        struct vc4_output *diag = vc4_output_create(STDERR_FILENO, 4096);
+
+        if (!vc4_dump_ctx_error(ctx)) {
+                vc4_dump_ctx_set_output(ctx, out, format);
+                vc4_dump_ctx_set_diagnostics(ctx, diag);
+                vc4_dump_print(ctx);
+        }
+
+        const char *error = vc4_dump_ctx_error(ctx);
+        if (error)
+                warnx("%s", error);
+        vc4_dump_ctx_close(ctx);
+        vc4_output_destroy(diag);
+
+        return !error;
+}
+
+static char *
+output_path(struct vc4_dump_pool *pool, uint32_t i)
+{
+        const struct batch *b = pool->data;
+        const char *name = strrchr(pool->paths[i], '/');
+        char *path;
+
+        if (asprintf(&path, "%s/%s.%s", b->output_dir,
+                     name ? name + 1 : pool->paths[i],
+                     b->format == VC4_DUMP_FORMAT_JSON ? "json" : "txt") == -1)
+                err(1, "malloc failure");
+
+        return path;
+}
+
+static bool
+write_output_file(struct vc4_dump_pool *pool, uint32_t i)
+{
+        const struct batch *b = pool->data;
+        char *path = output_path(pool, i);
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+        if (fd == -1)
+                err(1, "Couldn't open %s", path);
+
+        struct vc4_output *out = vc4_output_create(fd, 256 * 1024);
+        bool ok = render_dump(pool->paths[i], out, b->format);
+        vc4_output_destroy(out);
+
+        close(fd);
+        free(path);
+
+        return ok;
+}
+
+static bool
+batch_process(struct vc4_dump_pool *pool, uint32_t i, struct vc4_output *out)
+{
+        const struct batch *b = pool->data;
+
+        if (b->output_dir)
+                return write_output_file(pool, i);
+        else
+                return render_dump(pool->paths[i], out, b->format);
+}
+
+/* Adds a decoded dump to the summary: after a header line for text, or as
+ * an element of the array for JSON.
+ */
+static void
+batch_write(struct vc4_dump_pool *pool, uint32_t i,
+            const struct vc4_output *result, struct vc4_output *out)
+{
+        const struct batch *b = pool->data;
+        bool first = !vc4_dump_pool_written(pool);
+
+        if (b->output_dir)
+                return;
+
+        if (b->format == VC4_DUMP_FORMAT_JSON) {
+                struct vc4_json json;
+
+                if (!first)
+                        vc4_out_lit(out, ",\n");
+                vc4_out_lit(out, "{\"file\": ");
+                vc4_json_init(&json, out);
+                vc4_json_string(&json, NULL, pool->paths[i]);
+                vc4_out_lit(out, ", \"dump\": ");
+                /* Without the newline that ends the dump's document. */
+                vc4_out_mem(out, result->buf, result->len - 1);
+                vc4_out_char(out, '}');
+        } else {
+                if (!first)
+                        vc4_out_char(out, '\n');
+                vc4_out_printf(out, "==> %s <==\n", pool->paths[i]);
+                vc4_out_mem(out, result->buf, result->len);
+        }
+}
+
+/* Removes what a dump that couldn't be decoded left of its file. */
+static void
+batch_failed(struct vc4_dump_pool *pool, uint32_t i)
+{
+        const struct batch *b = pool->data;
+
+        if (b->output_dir) {
+                char *path = output_path(pool, i);
+                unlink(path);
+                free(path);
+        }
+}
+
+static void
+usage(const char *name)
+{
+        fprintf(stderr,
+                "Usage: %s [--jobs=N] [--json | --stats]\n"
+                "       [--output-dir=DIR] [--files-from=LIST]\n"
+                "       [dump | dir]...\n",
+                name);
+        exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+        static const struct option long_options[] = {
+                { "jobs", required_argument, NULL, 'j' },
+                { "json", no_argument, NULL, 'J' },
+                { "stats", no_argument, NULL, 's' },
+                { "output-dir", required_argument, NULL, 'o' },
+                { "files-from", required_argument, NULL, 'f' },
+                { NULL, 0, NULL, 0 },
+        };
+        struct batch b = {
+                .format = VC4_DUMP_FORMAT_TEXT,
+        };
+        struct vc4_dump_pool pool = {
+                .process = batch_process,
+                .write = batch_write,
+                .failed = batch_failed,
+                .data = &b,
+        };
+        long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+        bool json = false, stats = false;
+        const char *list = NULL;
+        char *end;
+        int c;
+
+        while ((c = getopt_long(argc, argv, "j:", long_options,
+                                NULL)) != -1) {
+                switch (c) {
+                case 'j':
+                        jobs = strtol(optarg, &end, 0);
+                        if (*end || !*optarg || jobs < 1)
+                                usage(argv[0]);
+                        break;
+                case 'J':
+                        json = true;
+                        b.format = VC4_DUMP_FORMAT_JSON;
+                        break;
+                case 's':
+                        stats = true;
+                        b.format = VC4_DUMP_FORMAT_STATS;
+                        break;
+                case 'o':
+                        b.output_dir = optarg;
+                        break;
+                case 'f':
+                        list = optarg;
+                        break;
+                default:
+                        usage(argv[0]);
+                }
+        }
+
+        if ((json && stats) || (optind == argc && !list))
+                usage(argv[0]);
+        pool.jobs = jobs;
+
+        for (int i = optind; i < argc; i++)
+                vc4_dump_pool_add_arg(&pool, argv[i]);
+        if (list)
+                vc4_dump_pool_add_list(&pool, list);
+
+        if (b.output_dir && mkdir(b.output_dir, 0777) == -1 &&
+            errno != EEXIST) {
+                err(1, "Couldn't create %s", b.output_dir);
+        }
+
+        if (!b.output_dir && json)
+                printf("[\n");
+
+        uint32_t failed = vc4_dump_pool_run(&pool);
+
+        if (!b.output_dir && json)
+                printf("%s]\n", vc4_dump_pool_written(&pool) ? "\n" : "");
+
+        if (failed)
+                warnx("%u of %u dumps couldn't be decoded",
+                      failed, pool.count);
+
+        return failed ? 1 : 0;
+}
@@ -0,0 +1,815 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/** @file vc4_dump_ctx.c
+ *
+ * The parse context: opening a dump, translating addresses in it, and the
+ * bookkeeping behind the CL decoder's hooks, which queue up the sublists,
+ * shader records and shaders it finds for the parse phases in
+ * vc4_dump_print.c.
+ */
+
+#include <assert.h>
+#include <err.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "vc4_drm.h"
+
+#include "vc4_tools.h"
+#include "vc4_addr_space.h"
+#include "vc4_dump_file.h"
+#include "vc4_dump_parse.h"
+#include "vc4_output.h"
+
+/* How far up the chain of queueing CLs we look to classify a revisit as a
+ * branch cycle.
+ */
+#define VC4_CL_MAX_CYCLE_DEPTH  64
+
+/* Returns whether size bytes at paddr overlap the range window. */
+bool
+vc4_parse_in_range(struct vc4_dump_ctx *ctx, uint32_t paddr, uint32_t size)
+{
+        if (!ctx->range.enabled)
+                return true;
+
+        return (paddr < ctx->range.end &&
+                (uint64_t)paddr + size > ctx->range.start);
+}
+
+/**
+ * Writes a diagnostic to the output set by vc4_dump_ctx_set_diagnostics(),
+ * if there is one.  It's flushed straight away, so that it keeps its place
+ * among the caller's own messages.
+ */
+void
+vc4_parse_diag(struct vc4_dump_ctx *ctx, const char *format, ...)
+{
+        va_list ap;
+
+        if (!ctx->diag)
+                return;
+
+        va_start(ap, format);
+        vc4_out_vprintf(ctx->diag, format, ap);
+        va_end(ap);
+        vc4_output_flush(ctx->diag);
+}
+
+/**
+ * Writes the dump's BOs, and the memory left out of it, to out.
+ */
+void
+vc4_dump_ctx_print_bo_list(struct vc4_dump_ctx *ctx, struct vc4_output *out)
+{
+        vc4_out_printf(out, "BOs:\n");
+
+        for (int i = 0; i < ctx->state->bo_count; i++) {
+                uint32_t paddr = ctx->bo_state[i].paddr;
+                vc4_out_printf(out, "%d: 0x%08x..0x%08x (%p)\n",
+                               i, paddr,
+                               paddr + ctx->bo_state[i].size - 1,
+                               ctx->file->map[i]);
+        }
+
+        if (ctx->file->omitted_bo_count)
+                vc4_out_printf(out, "Left out of the dump:\n");
+        for (int i = 0; i < ctx->file->omitted_bo_count; i++) {
+                uint32_t paddr = ctx->file->omitted_bos[i].paddr;
+                int truncated = vc4_dump_file_truncated_bo(ctx->file, i);
+
+                vc4_out_printf(out, "0x%08x..0x%08x", paddr,
+                               paddr + ctx->file->omitted_bos[i].size - 1);
+                if (truncated >= 0) {
+                        vc4_out_printf(out, " (the rest of BO %d)",
+                                       truncated);
+                }
+                vc4_out_printf(out, "\n");
+        }
+}
+
+/* Follows a diagnostic with the BO list, for telling where the address in
+ * it should have been.
+ */
+static void
+diag_bo_list(struct vc4_dump_ctx *ctx)
+{
+        if (!ctx->diag)
+                return;
+
+        vc4_dump_ctx_print_bo_list(ctx, ctx->diag);
+        vc4_output_flush(ctx->diag);
+}
+
+/* Reports an address that doesn't translate.  If it's in memory that the
+ * dump left out, that's expected of a trimmed dump and only gets counted,
+ * and otherwise the BO list is shown along with the first bad one.
+ */
+static void
+report_untranslated(struct vc4_dump_ctx *ctx, const char *what,
+                    uint32_t paddr)
+{
+        if (vc4_dump_file_is_omitted(ctx->file, paddr)) {
+                ctx->omitted_refs++;
+                return;
+        }
+        if (ctx->quiet)
+                return;
+
+        vc4_parse_diag(ctx, "Couldn't translate %s 0x%08x\n", what, paddr);
+        if (!ctx->bo_list_shown) {
+                diag_bo_list(ctx);
+                ctx->bo_list_shown = true;
+        }
+}
+
+void *
+vc4_dump_ctx_paddr_to_pointer(struct vc4_dump_ctx *ctx, uint32_t addr)
+{
+        const struct vc4_addr_range *range =
+                vc4_addr_space_lookup_paddr(ctx->addr_space, addr);
+        if (range && vc4_addr_space_map(ctx->addr_space, range))
+                return range->map + (addr - range->paddr);
+
+        report_untranslated(ctx, "address", addr);
+
+        return NULL;
+}
+
+uint32_t
+vc4_dump_ctx_pointer_to_paddr(struct vc4_dump_ctx *ctx, void *p)
+{
+        const struct vc4_addr_range *range =
+                vc4_addr_space_lookup_pointer(ctx->addr_space, p);
+        if (range)
+                return range->paddr + (p - range->map);
+
+        vc4_parse_diag(ctx, "Couldn't translate pointer %p\n", p);
+        diag_bo_list(ctx);
+
+        return 0;
+}
+
+uint32_t
+vc4_parse_get_end_paddr(struct vc4_dump_ctx *ctx, uint32_t paddr)
+{
+        const struct vc4_addr_range *range =
+                vc4_addr_space_lookup_paddr(ctx->addr_space, paddr);
+        if (range)
+                return range->paddr + range->size;
+
+        report_untranslated(ctx, "paddr", paddr);
+
+        return 0;
+}
+
+static enum vc4_mem_area_bucket
+vc4_mem_area_bucket(enum vc4_mem_area_type type)
+{
+        switch (type) {
+        case VC4_MEM_AREA_SUB_LIST:
+        case VC4_MEM_AREA_COMPRESSED_PRIM_LIST:
+                return VC4_MEM_AREA_BUCKET_CL;
+        case VC4_MEM_AREA_GL_SHADER_REC:
+        case VC4_MEM_AREA_NV_SHADER_REC:
+                return VC4_MEM_AREA_BUCKET_SHADER_REC;
+        default:
+                return VC4_MEM_AREA_BUCKET_SHADER;
+        }
+}
+
+static uint32_t
+vc4_mem_area_handle(enum vc4_mem_area_bucket bucket, uint32_t index)
+{
+        return ((index << 2) | bucket) + 1;
+}
+
+struct vc4_mem_area_rec *
+vc4_parse_mem_area(struct vc4_dump_ctx *ctx, uint32_t handle)
+{
+        handle--;
+        return &ctx->mem_areas[handle & 3].recs[handle >> 2];
+}
+
+static uint32_t
+vc4_mem_area_hash(const struct vc4_mem_area_rec *rec)
+{
+        uint32_t hash = rec->paddr;
+
+        hash ^= rec->size * 0x9e3779b1;
+        hash ^= (rec->type << 24 | rec->prim_mode << 16 |
+                 rec->attributes << 8 | rec->extended) * 0x85ebca6b;
+        hash ^= hash >> 15;
+        hash *= 0xc2b2ae35;
+        hash ^= hash >> 13;
+
+        return hash;
+}
+
+static bool
+vc4_mem_area_equal(const struct vc4_mem_area_rec *a,
+                   const struct vc4_mem_area_rec *b)
+{
+        return (a->type == b->type &&
+                a->paddr == b->paddr &&
+                a->size == b->size &&
+                a->prim_mode == b->prim_mode &&
+                a->attributes == b->attributes &&
+                a->extended == b->extended);
+}
+
+static void
+vc4_mem_area_set_insert(struct vc4_dump_ctx *ctx, uint32_t handle,
+                        uint32_t hash)
+{
+        uint32_t mask = ctx->mem_area_set_size - 1;
+        uint32_t i = hash & mask;
+
+        while (ctx->mem_area_set[i].handle)
+                i = (i + 1) & mask;
+        ctx->mem_area_set[i].handle = handle;
+        ctx->mem_area_set[i].hash = hash;
+}
+
+static void
+vc4_mem_area_set_grow(struct vc4_dump_ctx *ctx)
+{
+        struct vc4_mem_area_set_entry *old_set = ctx->mem_area_set;
+        uint32_t old_size = ctx->mem_area_set_size;
+
+        ctx->mem_area_set_size = old_size ? old_size * 2 : 256;
+        ctx->mem_area_set = calloc(ctx->mem_area_set_size,
+                                   sizeof(*ctx->mem_area_set));
+        if (!ctx->mem_area_set)
+                err(1, "malloc failure");
+
+        for (uint32_t i = 0; i < old_size; i++) {
+                if (old_set[i].handle) {
+                        vc4_mem_area_set_insert(ctx, old_set[i].handle,
+                                                old_set[i].hash);
+                }
+        }
+        free(old_set);
+}
+
+/**
+ * Adds a copy of rec to its phase's array, unless it's already there, and
+ * returns the handle of the array entry.
+ */
+uint32_t
+vc4_parse_insert_mem_area(struct vc4_dump_ctx *ctx,
+                          struct vc4_mem_area_rec *rec)
+{
+        /* Don't add exact duplicates of memory areas to the list, so that
+         * each sublist, shader record and shader gets dumped once no matter
+         * how many times it's referenced.
+         */
+        uint32_t hash = vc4_mem_area_hash(rec);
+
+        if (ctx->mem_area_set_size) {
+                uint32_t mask = ctx->mem_area_set_size - 1;
+
+                for (uint32_t i = hash & mask;
+                     ctx->mem_area_set[i].handle;
+                     i = (i + 1) & mask) {
+                        struct vc4_mem_area_set_entry *entry =
+                                &ctx->mem_area_set[i];
+                        struct vc4_mem_area_rec *set_rec;
+
+                        if (entry->hash != hash)
+                                continue;
+
+                        set_rec = vc4_parse_mem_area(ctx, entry->handle);
+                        if (vc4_mem_area_equal(rec, set_rec)) {
+                                ctx->mem_area_duplicates++;
+                                return entry->handle;
+                        }
+                }
+        }
+
+        /* Keep the load factor under 3/4. */
+        if ((ctx->mem_area_count + 1) * 4 > ctx->mem_area_set_size * 3)
+                vc4_mem_area_set_grow(ctx);
+
+        enum vc4_mem_area_bucket bucket = vc4_mem_area_bucket(rec->type);
+        struct vc4_mem_area_list *list = &ctx->mem_areas[bucket];
+        if (list->count == list->size) {
+                list->size = list->size ? list->size * 2 : 64;
+                list->recs = realloc(list->recs,
+                                     list->size * sizeof(*list->recs));
+                if (!list->recs)
+                        err(1, "malloc failure");
+        }
+
+        uint32_t index = list->count++;
+        uint32_t handle = vc4_mem_area_handle(bucket, index);
+        list->recs[index] = *rec;
+        vc4_mem_area_set_insert(ctx, handle, hash);
+        ctx->mem_area_count++;
+
+        return handle;
+}
+
+/**
+ * Queues up rec to be dumped, returning its handle, or 0 if it's a CL
+ * outside of the range window.
+ *
+ * Those CLs aren't decoded at all, other than the one closest before the
+ * range that may run on into it, which gets held back until the sublist
+ * phase.
+ */
+static uint32_t
+vc4_add_mem_area_to_list(struct vc4_dump_ctx *ctx,
+                         struct vc4_mem_area_rec *rec)
+{
+        if (!ctx->range.enabled ||
+            vc4_mem_area_bucket(rec->type) != VC4_MEM_AREA_BUCKET_CL ||
+            vc4_parse_in_range(ctx, rec->paddr, 1)) {
+                return vc4_parse_insert_mem_area(ctx, rec);
+        }
+
+        if (rec->paddr >= ctx->range.bo_start &&
+            rec->paddr < ctx->range.start &&
+            (!ctx->range.has_straddler ||
+             rec->paddr > ctx->range.straddler.paddr)) {
+                ctx->range.straddler = *rec;
+                ctx->range.has_straddler = true;
+        }
+
+        return 0;
+}
+
+static void
+vc4_init_mem_area(struct vc4_dump_ctx *ctx, struct vc4_mem_area_rec *rec,
+                  enum vc4_mem_area_type type, uint32_t paddr, uint32_t size)
+{
+        memset(rec, 0, sizeof(*rec));
+        rec->type = type;
+        rec->paddr = paddr;
+        rec->addr = vc4_dump_ctx_paddr_to_pointer(ctx, paddr);
+        rec->size = size;
+        rec->prim_mode = ~0;
+}
+
+static void
+vc4_init_mem_area_unsized(struct vc4_dump_ctx *ctx,
+                          struct vc4_mem_area_rec *rec,
+                          enum vc4_mem_area_type type, uint32_t paddr)
+{
+        vc4_init_mem_area(ctx, rec, type, paddr,
+                          vc4_parse_get_end_paddr(ctx, paddr) - paddr);
+}
+
+struct vc4_mem_area_rec *
+vc4_parse_add_mem_area(struct vc4_dump_ctx *ctx, enum vc4_mem_area_type type,
+                       uint32_t paddr)
+{
+        struct vc4_mem_area_rec rec;
+        vc4_init_mem_area_unsized(ctx, &rec, type, paddr);
+        return vc4_parse_mem_area(ctx, vc4_add_mem_area_to_list(ctx, &rec));
+}
+
+static uint32_t
+add_sublist(struct vc4_dump_ctx *ctx, uint32_t paddr, uint8_t prim_mode)
+{
+        struct vc4_mem_area_rec rec;
+        vc4_init_mem_area_unsized(ctx, &rec, VC4_MEM_AREA_SUB_LIST, paddr);
+        rec.prim_mode = prim_mode;
+        rec.parent = ctx->cl_current;
+        return vc4_add_mem_area_to_list(ctx, &rec);
+}
+
+static uint32_t
+add_compressed_list(struct vc4_dump_ctx *ctx, uint32_t paddr,
+                    uint8_t prim_mode)
+{
+        struct vc4_mem_area_rec rec;
+        vc4_init_mem_area_unsized(ctx, &rec,
+                                  VC4_MEM_AREA_COMPRESSED_PRIM_LIST, paddr);
+        rec.prim_mode = prim_mode;
+        rec.parent = ctx->cl_current;
+        return vc4_add_mem_area_to_list(ctx, &rec);
+}
+
+static uint32_t *
+vc4_get_cl_visited(struct vc4_dump_ctx *ctx,
+                   const struct vc4_addr_range *range)
+{
+        uint32_t **bitmap = &ctx->cl_visited[range->bo_index];
+
+        if (!*bitmap) {
+                *bitmap = calloc((range->size + 31) / 32, sizeof(**bitmap));
+                if (!*bitmap)
+                        err(1, "malloc failure");
+        }
+
+        return *bitmap;
+}
+
+static void
+mark_cl_visited(struct vc4_dump_ctx *ctx, uint32_t paddr, uint32_t size)
+{
+        const struct vc4_addr_range *range =
+                vc4_addr_space_lookup_paddr(ctx->addr_space, paddr);
+        if (!range || !size)
+                return;
+
+        uint32_t *bitmap = vc4_get_cl_visited(ctx, range);
+        uint32_t start = paddr - range->paddr;
+        uint32_t end = MIN2(start + size, range->size);
+        uint32_t first = start / 32, last = end / 32;
+        uint32_t head = ~0u << (start % 32);
+        uint32_t tail = (1u << (end % 32)) - 1;
+
+        /* Fill whole words, masking off the bits outside of the range in
+         * the first and last ones.
+         */
+        if (first == last) {
+                bitmap[first] |= head & tail;
+                return;
+        }
+
+        bitmap[first] |= head;
+        for (uint32_t i = first + 1; i < last; i++)
+                bitmap[i] = ~0u;
+        if (tail)
+                bitmap[last] |= tail;
+}
+
+/**
+ * Returns whether paddr was decoded by one of the CLs whose decode led to
+ * the current one, meaning that we've been sent around a loop.
+ */
+static bool
+vc4_cl_revisit_is_cycle(struct vc4_dump_ctx *ctx, uint32_t paddr)
+{
+        struct vc4_mem_area_list *list =
+                &ctx->mem_areas[VC4_MEM_AREA_BUCKET_CL];
+        uint32_t cl = ctx->cl_current;
+
+        for (int depth = 0; depth < VC4_CL_MAX_CYCLE_DEPTH; depth++) {
+                uint32_t start, end;
+
+                switch (cl) {
+                case VC4_CL_NONE:
+                        return false;
+                case VC4_CL_BIN:
+                case VC4_CL_RENDER:
+                        start = ctx->root_cls[cl - VC4_CL_BIN].start;
+                        end = ctx->root_cls[cl - VC4_CL_BIN].end;
+                        return paddr >= start && paddr < end;
+                default:
+                        start = list->recs[cl].paddr;
+                        end = list->recs[cl].decoded_end;
+                        if (paddr >= start && paddr < end)
+                                return true;
+                        cl = list->recs[cl].parent;
+                        break;
+                }
+        }
+
+        return false;
+}
+
+/* The visited bitmaps are what keep a corrupted dump that branches in a
+ * loop, or has sublists overlapping each other, from being decoded over and
+ * over.
+ */
+static const uint32_t *
+get_cl_visited(struct vc4_dump_ctx *ctx, uint32_t paddr, uint32_t *bo_paddr,
+               uint32_t *bo_size)
+{
+        const struct vc4_addr_range *range =
+                vc4_addr_space_lookup_paddr(ctx->addr_space, paddr);
+        if (!range)
+                return NULL;
+
+        *bo_paddr = range->paddr;
+        *bo_size = range->size;
+        return ctx->cl_visited[range->bo_index];
+}
+
+static bool
+note_cl_revisit(struct vc4_dump_ctx *ctx, uint32_t paddr)
+{
+        bool cycle = vc4_cl_revisit_is_cycle(ctx, paddr);
+
+        if (cycle)
+                ctx->cl_cycles++;
+        else
+                ctx->cl_overlaps++;
+
+        return cycle;
+}
+
+/* Sets up a shader rec's mem area, cut short at the end of its BO if it
+ * runs past that, so that the fields it doesn't have aren't read.
+ */
+static void
+vc4_init_shader_rec(struct vc4_dump_ctx *ctx, struct vc4_mem_area_rec *rec,
+                    enum vc4_mem_area_type type, uint32_t paddr, uint32_t size)
+{
+        vc4_init_mem_area(ctx, rec, type, paddr, size);
+
+        if (rec->addr) {
+                uint32_t end = vc4_parse_get_end_paddr(ctx, paddr);
+
+                if (end - paddr < size)
+                        rec->size = end - paddr;
+        }
+}
+
+static uint32_t
+add_gl_shader_rec(struct vc4_dump_ctx *ctx, uint32_t paddr, uint8_t attributes,
+                  bool extended)
+{
+        uint32_t size = 36 + attributes * 8;
+
+        assert(!extended);
+
+        struct vc4_mem_area_rec rec;
+        vc4_init_shader_rec(ctx, &rec, VC4_MEM_AREA_GL_SHADER_REC, paddr,
+                            size);
+        rec.attributes = attributes;
+        rec.extended = extended;
+        return vc4_add_mem_area_to_list(ctx, &rec);
+}
+
+static uint32_t
+add_nv_shader_rec(struct vc4_dump_ctx *ctx, uint32_t paddr)
+{
+        struct vc4_mem_area_rec rec;
+        vc4_init_shader_rec(ctx, &rec, VC4_MEM_AREA_NV_SHADER_REC, paddr, 16);
+        return vc4_add_mem_area_to_list(ctx, &rec);
+}
+
+static const struct vc4_dump_cl_hooks parse_hooks = {
+        .paddr_to_pointer = vc4_dump_ctx_paddr_to_pointer,
+        .add_sublist = add_sublist,
+        .add_compressed_list = add_compressed_list,
+        .add_gl_shader_rec = add_gl_shader_rec,
+        .add_nv_shader_rec = add_nv_shader_rec,
+        .get_cl_visited = get_cl_visited,
+        .note_cl_revisit = note_cl_revisit,
+        .mark_cl_visited = mark_cl_visited,
+};
+
+/**
+ * Makes a context for decoding CLs in space through hooks, which get data
+ * as ctx->hooks_data.
+ */
+struct vc4_dump_ctx *
+vc4_dump_ctx_create(struct vc4_addr_space *space,
+                    const struct vc4_dump_cl_hooks *hooks, void *data)
+{
+        struct vc4_dump_ctx *ctx = calloc(1, sizeof(*ctx));
+
+        if (!ctx)
+                err(1, "malloc failure");
+
+        ctx->addr_space = space;
+        ctx->hooks = hooks;
+        ctx->hooks_data = data;
+        ctx->cl_current = VC4_CL_NONE;
+        ctx->threads = 1;
+
+        return ctx;
+}
+
+/**
+ * Opens the dump in filename for parsing.  Nothing gets rendered until
+ * vc4_dump_ctx_set_output() or vc4_dump_ctx_set_renderer() is called.
+ *
+ * If the dump can't be read, the context only holds the error, which
+ * vc4_dump_ctx_error() returns, and is only good for closing.
+ */
+struct vc4_dump_ctx *
+vc4_dump_ctx_open(const char *filename)
+{
+        struct vc4_dump_file *file = vc4_dump_file_open(filename);
+        struct vc4_dump_ctx *ctx = vc4_dump_ctx_create(NULL, &parse_hooks,
+                                                       NULL);
+
+        ctx->file = file;
+        ctx->filename = strdup(filename);
+        if (!ctx->filename)
+                err(1, "malloc failure");
+        if (file->error)
+                return ctx;
+
+        ctx->state = file->state;
+        ctx->bo_state = file->bo_state;
+        ctx->addr_space = &ctx->file_addr_space;
+        vc4_dump_file_init_addr_space(file, ctx->addr_space);
+
+        ctx->cl_visited = calloc(ctx->state->bo_count,
+                                 sizeof(*ctx->cl_visited));
+        if (!ctx->cl_visited)
+                err(1, "malloc failure");
+
+        return ctx;
+}
+
+/**
+ * Frees the context, along with its dump if it has one.  The output set by
+ * vc4_dump_ctx_set_output() is left to the caller.
+ */
+void
+vc4_dump_ctx_close(struct vc4_dump_ctx *ctx)
+{
+        if (ctx->cl_visited) {
+                for (uint32_t i = 0; i < ctx->state->bo_count; i++)
+                        free(ctx->cl_visited[i]);
+                free(ctx->cl_visited);
+        }
+
+        for (int b = 0; b < VC4_MEM_AREA_BUCKET_COUNT; b++)
+                free(ctx->mem_areas[b].recs);
+        free(ctx->mem_area_set);
+        free(ctx->cl_ir.items);
+
+        if (ctx->scratch)
+                vc4_output_destroy(ctx->scratch);
+        if (ctx->index)
+                vc4_dump_index_free(ctx->index);
+        free(ctx->filename);
+
+        if (ctx->file) {
+                vc4_addr_space_fini(&ctx->file_addr_space);
+                vc4_dump_file_close(ctx->file);
+        }
+
+        free(ctx);
+}
+
+/**
+ * Returns why the dump couldn't be read, or NULL.
+ *
+ * Besides a dump that vc4_dump_ctx_open() couldn't open, this covers
+ * contents that turn out to be unreadable once they're used, like a block
+ * of a compressed dump that doesn't decompress.  Those are left out of
+ * what gets printed, so a caller should check this afterwards too.
+ */
+const char *
+vc4_dump_ctx_error(struct vc4_dump_ctx *ctx)
+{
+        return ctx->file ? ctx->file->error : NULL;
+}
+
+const struct drm_vc4_get_hang_state *
+vc4_dump_ctx_state(struct vc4_dump_ctx *ctx)
+{
+        return ctx->state;
+}
+
+uint32_t
+vc4_dump_ctx_bo_count(struct vc4_dump_ctx *ctx)
+{
+        return ctx->state->bo_count;
+}
+
+/* Returns whether the dump was written with a checksum of each BO. */
+bool
+vc4_dump_ctx_has_bo_crcs(struct vc4_dump_ctx *ctx)
+{
+        return ctx->file->crc_flags & VC4_DUMP_CRC_BOS;
+}
+
+/**
+ * Checks the BOs against the checksums they were captured with, reporting
+ * the ones that don't match as diagnostics, and returns how many didn't.
+ */
+uint32_t
+vc4_dump_ctx_verify(struct vc4_dump_ctx *ctx)
+{
+        uint32_t bad = vc4_dump_file_verify(ctx->file, ctx->diag);
+
+        if (ctx->diag)
+                vc4_output_flush(ctx->diag);
+
+        return bad;
+}
+
+/**
+ * Sets where the problems found in the dump while decoding it get reported,
+ * such as addresses that don't translate, or NULL (the default) to leave
+ * them unreported.  Like the output, it's left to the caller to free.
+ */
+void
+vc4_dump_ctx_set_diagnostics(struct vc4_dump_ctx *ctx,
+                             struct vc4_output *diag)
+{
+        ctx->diag = diag;
+}
+
+/**
+ * Sets where vc4_dump_print() writes to, and in what format.
+ */
+void
+vc4_dump_ctx_set_output(struct vc4_dump_ctx *ctx, struct vc4_output *out,
+                        enum vc4_dump_format format)
+{
+        ctx->out = out;
+        ctx->format = format;
+        ctx->json = NULL;
+        ctx->text = false;
+
+        switch (format) {
+        case VC4_DUMP_FORMAT_TEXT:
+                ctx->text = true;
+                ctx->renderer.render = vc4_cl_render_text;
+                ctx->renderer.data = out;
+                break;
+        case VC4_DUMP_FORMAT_JSON:
+                vc4_json_init(&ctx->json_writer, out);
+                ctx->json = &ctx->json_writer;
+                if (!ctx->scratch)
+                        ctx->scratch = vc4_output_create(-1, 256);
+                ctx->renderer.render = vc4_cl_render_json;
+                ctx->renderer.data = ctx->json;
+                break;
+        case VC4_DUMP_FORMAT_STATS:
+                memset(&ctx->stats, 0, sizeof(ctx->stats));
+                ctx->renderer.render = vc4_cl_render_stats;
+                ctx->renderer.data = &ctx->stats;
+                break;
+        }
+
+        ctx->cl_renderer = &ctx->renderer;
+}
+
+/**
+ * Limits vc4_dump_print() to the CLs, shader recs and shaders that overlap
+ * [start, end).
+ */
+void
+vc4_dump_ctx_set_range(struct vc4_dump_ctx *ctx, uint32_t start, uint32_t end)
+{
+        const struct vc4_addr_range *range =
+                vc4_addr_space_lookup_paddr(ctx->addr_space, start);
+
+        ctx->range.enabled = true;
+        ctx->range.start = start;
+        ctx->range.end = end;
+        ctx->range.bo_start = range ? range->paddr : start;
+}
+
+/**
+ * Limits vc4_dump_print() to what overlaps BO number bo of the dump,
+ * returning false if there's no such BO.
+ */
+bool
+vc4_dump_ctx_set_range_bo(struct vc4_dump_ctx *ctx, uint32_t bo)
+{
+        if (bo >= ctx->state->bo_count)
+                return false;
+
+        vc4_dump_ctx_set_range(ctx, ctx->bo_state[bo].paddr,
+                               ctx->bo_state[bo].paddr +
+                               ctx->bo_state[bo].size);
+        return true;
+}
+
+/**
+ * Sets how many threads vc4_dump_print() renders the sublists, shader recs
+ * and shaders with.  The output is the same for any number.
+ */
+void
+vc4_dump_ctx_set_threads(struct vc4_dump_ctx *ctx, uint32_t threads)
+{
+        ctx->threads = threads ? threads : 1;
+}
+
+/**
+ * Sets what vc4_dump_cl() hands the decoded CLs to, or NULL to just decode
+ * them for the memory areas they queue.
+ */
+void
+vc4_dump_ctx_set_renderer(struct vc4_dump_ctx *ctx,
+                          const struct vc4_cl_renderer *renderer)
+{
+        ctx->cl_renderer = renderer;
+}
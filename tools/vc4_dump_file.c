@@ -0,0 +1,873 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/* For SEEK_DATA, SEEK_HOLE and vasprintf(). */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "vc4_addr_space.h"
+#include "vc4_crc32c.h"
+#include "vc4_dump_file.h"
+#include "vc4_output.h"
+#include "vc4_tools.h"
+
+/* BOs up to this size get read ahead in full as soon as they're mapped,
+ * since the tools go on to read most of any CL, shader rec or shader BO
+ * they touch.  Bigger ones, like the tile alloc BO, are left to be faulted
+ * in as they're read.
+ */
+#define WILLNEED_MAX_SIZE       (256 * 1024)
+
+/* Records why the dump couldn't be read, keeping the first error if there
+ * was already one, and returns false for the caller to pass on.
+ */
+static bool
+file_error(struct vc4_dump_file *file, const char *fmt, ...)
+        __attribute__ ((format(__printf__, 2, 3)));
+
+static bool
+file_error(struct vc4_dump_file *file, const char *fmt, ...)
+{
+        va_list va;
+
+        if (file->error)
+                return false;
+
+        va_start(va, fmt);
+        if (vasprintf(&file->error, fmt, va) == -1)
+                err(1, "malloc failure");
+        va_end(va);
+
+        return false;
+}
+
+static bool
+open_v0(struct vc4_dump_file *file, const char *filename)
+{
+        void *input = mmap(NULL, file->size, PROT_READ, MAP_SHARED,
+                           file->fd, 0);
+        if (input == MAP_FAILED) {
+                return file_error(file, "Couldn't map input file %s: %s",
+                                  filename, strerror(errno));
+        }
+        file->input = input;
+
+        uint32_t *version = file->input;
+        file->state = (void *)&version[1];
+        file->bo_state = (void *)&file->state[1];
+
+        uint64_t offset = ((void *)&file->bo_state[file->state->bo_count] -
+                           file->input);
+        if (offset > file->size) {
+                return file_error(file, "Input file %s is truncated",
+                                  filename);
+        }
+
+        file->bo_offset = calloc(file->state->bo_count,
+                                 sizeof(*file->bo_offset));
+        if (!file->bo_offset)
+                err(1, "malloc failure");
+
+        for (int i = 0; i < file->state->bo_count; i++) {
+                file->map[i] = file->input + offset;
+                file->bo_offset[i] = offset;
+                offset += file->bo_state[i].size;
+                if (offset > file->size) {
+                        return file_error(file, "Input file %s is truncated",
+                                          filename);
+                }
+        }
+
+        return true;
+}
+
+static bool
+load_block(struct vc4_dump_file *file, uint32_t index)
+{
+        const struct vc4_dump_block *block = &file->blocks[index];
+        uint64_t offset = (uint64_t)index * file->block_size;
+        void *dst = file->image + offset;
+        uLongf size = MIN2(file->block_size, file->size - offset);
+
+        switch (block->type) {
+        case VC4_DUMP_BLOCK_ZERO:
+                break;
+        case VC4_DUMP_BLOCK_RAW:
+                if (block->size != size ||
+                    pread(file->fd, dst, size, block->offset) != size) {
+                        return file_error(file, "Couldn't read block %d of "
+                                          "the input file", index);
+                }
+                break;
+        case VC4_DUMP_BLOCK_ZLIB:
+                if (block->size > compressBound(file->block_size) ||
+                    pread(file->fd, file->block_data, block->size,
+                          block->offset) != block->size ||
+                    uncompress(dst, &size, file->block_data,
+                               block->size) != Z_OK ||
+                    size != MIN2(file->block_size, file->size - offset)) {
+                        return file_error(file, "Couldn't decompress block "
+                                          "%d of the input file", index);
+                }
+                break;
+        default:
+                return file_error(file, "Block %d of the input file has "
+                                  "unknown type %d", index, block->type);
+        }
+
+        file->blocks_loaded[index / 32] |= 1u << (index % 32);
+        return true;
+}
+
+/* Decompresses any blocks of the image under the given range that haven't
+ * been yet.
+ */
+static bool
+load_image(struct vc4_dump_file *file, uint64_t offset, uint64_t size)
+{
+        if (!size)
+                return true;
+
+        for (uint32_t i = offset / file->block_size;
+             i <= (offset + size - 1) / file->block_size; i++) {
+                if (!(file->blocks_loaded[i / 32] & (1u << (i % 32))) &&
+                    !load_block(file, i)) {
+                        return false;
+                }
+        }
+
+        return true;
+}
+
+static bool
+read_at(struct vc4_dump_file *file, const char *filename,
+        void *data, size_t size, uint64_t offset)
+{
+        if (file->image) {
+                if (offset > file->size || size > file->size - offset) {
+                        return file_error(file, "Input file %s is truncated",
+                                          filename);
+                }
+                if (!load_image(file, offset, size))
+                        return false;
+                memcpy(data, file->image + offset, size);
+                return true;
+        }
+
+        if (pread(file->fd, data, size, offset) != size) {
+                return file_error(file, "Input file %s is truncated",
+                                  filename);
+        }
+
+        return true;
+}
+
+/* Reads the block table of a compressed dump and sets up the image to
+ * decompress into, which read_at() reads from from then on.
+ */
+static bool
+open_compressed(struct vc4_dump_file *file, const char *filename)
+{
+        struct vc4_dump_compressed_header header;
+
+        if (!read_at(file, filename, &header, sizeof(header), 0))
+                return false;
+        if (header.header_size < sizeof(header) || !header.image_size ||
+            !header.block_size || header.block_size % VC4_DUMP_ALIGN ||
+            header.block_count != ((header.image_size +
+                                    header.block_size - 1) /
+                                   header.block_size)) {
+                return file_error(file, "Input file %s has a bad header",
+                                  filename);
+        }
+
+        /* The block table is at the end of the file. */
+        uint64_t table_size = ((uint64_t)header.block_count *
+                               sizeof(struct vc4_dump_block));
+        if (table_size > file->size - header.header_size) {
+                return file_error(file, "Input file %s is truncated",
+                                  filename);
+        }
+
+        file->block_size = header.block_size;
+        file->block_count = header.block_count;
+        file->blocks = malloc(table_size);
+        file->blocks_loaded = calloc((header.block_count + 31) / 32,
+                                     sizeof(uint32_t));
+        file->block_data = malloc(compressBound(header.block_size));
+        if (!file->blocks || !file->blocks_loaded || !file->block_data)
+                err(1, "malloc failure");
+        if (!read_at(file, filename, file->blocks, table_size,
+                     file->size - table_size)) {
+                return false;
+        }
+
+        /* Only the pages that blocks get decompressed into are ever
+         * backed by memory.
+         */
+        void *image = mmap(NULL, header.image_size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                           -1, 0);
+        if (image == MAP_FAILED) {
+                return file_error(file, "Couldn't allocate the image of %s: "
+                                  "%s", filename, strerror(errno));
+        }
+        file->image = image;
+        file->size = header.image_size;
+
+        return true;
+}
+
+static bool
+read_zero_ranges(struct vc4_dump_file *file, const char *filename,
+                 const struct vc4_dump_header *header)
+{
+        uint32_t count = header->zero_range_count;
+        uint32_t bo_count = header->state.bo_count;
+
+        file->zero_ranges = calloc(count, sizeof(*file->zero_ranges));
+        file->bo_zero_ranges = calloc(bo_count + 1,
+                                      sizeof(*file->bo_zero_ranges));
+        if ((count && !file->zero_ranges) || !file->bo_zero_ranges)
+                err(1, "malloc failure");
+
+        if (!read_at(file, filename, file->zero_ranges,
+                     (size_t)count * sizeof(*file->zero_ranges),
+                     header->zero_table_offset)) {
+                return false;
+        }
+
+        /* Count up the ranges in each BO, then turn the counts into the
+         * index of each BO's first range.
+         */
+        uint32_t last_end = 0;
+        for (uint32_t i = 0; i < count; i++) {
+                const struct vc4_dump_zero_range *range =
+                        &file->zero_ranges[i];
+
+                if (range->bo >= bo_count ||
+                    range->offset > file->bo_state[range->bo].size ||
+                    range->size > (file->bo_state[range->bo].size -
+                                   range->offset) ||
+                    (i && (range->bo < range[-1].bo ||
+                           (range->bo == range[-1].bo &&
+                            range->offset < last_end)))) {
+                        return file_error(file, "Input file %s has a bad "
+                                          "zero range table", filename);
+                }
+                last_end = range->offset + range->size;
+                file->bo_zero_ranges[range->bo + 1]++;
+        }
+        for (uint32_t i = 0; i < bo_count; i++)
+                file->bo_zero_ranges[i + 1] += file->bo_zero_ranges[i];
+
+        return true;
+}
+
+/* Checks the header and tables against their checksum, before anything
+ * in them gets used.
+ */
+static bool
+check_metadata_crc(struct vc4_dump_file *file, const char *filename,
+                   const struct vc4_dump_header *header)
+{
+        const struct {
+                uint64_t offset;
+                uint64_t size;
+        } parts[] = {
+                { 0, header->header_size },
+                { header->bo_table_offset,
+                  (uint64_t)header->state.bo_count * header->bo_entry_size },
+                { header->omitted_table_offset,
+                  (uint64_t)header->omitted_bo_count *
+                  sizeof(struct drm_vc4_get_hang_state_bo) },
+                { header->zero_table_offset,
+                  (uint64_t)header->zero_range_count *
+                  sizeof(struct vc4_dump_zero_range) },
+        };
+        uint32_t crc = 0;
+
+        if (header->header_size < sizeof(*header))
+                return file_error(file, "Input file %s has a bad header",
+                                  filename);
+
+        for (int i = 0; i < ARRAY_SIZE(parts); i++) {
+                if (parts[i].size > file->size) {
+                        return file_error(file, "Input file %s is truncated",
+                                          filename);
+                }
+
+                void *data = malloc(parts[i].size);
+                if (!data && parts[i].size)
+                        err(1, "malloc failure");
+                if (!read_at(file, filename, data, parts[i].size,
+                             parts[i].offset)) {
+                        free(data);
+                        return false;
+                }
+
+                if (i == 0) {
+                        struct vc4_dump_header *copy = data;
+                        copy->metadata_crc = 0;
+                }
+
+                crc = vc4_crc32c(crc, data, parts[i].size);
+                free(data);
+        }
+
+        if (crc != header->metadata_crc) {
+                return file_error(file, "Input file %s is corrupt: its "
+                                  "header and tables don't match their "
+                                  "checksum", filename);
+        }
+
+        return true;
+}
+
+static bool
+open_v1(struct vc4_dump_file *file, const char *filename)
+{
+        struct vc4_dump_header header;
+
+        /* Dumps from before the checksums have a shorter header, which
+         * leaves them zeroed.
+         */
+        memset(&header, 0, sizeof(header));
+        if (!read_at(file, filename, &header, VC4_DUMP_HEADER_V1_SIZE, 0))
+                return false;
+        if (header.header_size < VC4_DUMP_HEADER_V1_SIZE ||
+            header.bo_entry_size < VC4_DUMP_BO_V1_SIZE) {
+                return file_error(file, "Input file %s has a bad header",
+                                  filename);
+        }
+        if (!read_at(file, filename, &header,
+                     MIN2(header.header_size, sizeof(header)), 0)) {
+                return false;
+        }
+
+        file->crc_flags = header.crc_flags;
+        file->metadata_crc = header.metadata_crc;
+        if (header.crc_flags & VC4_DUMP_CRC_METADATA &&
+            !check_metadata_crc(file, filename, &header)) {
+                return false;
+        }
+
+        file->state = malloc(sizeof(*file->state));
+        file->bo_state = calloc(header.state.bo_count,
+                                sizeof(*file->bo_state));
+        file->bo_offset = calloc(header.state.bo_count,
+                                 sizeof(*file->bo_offset));
+        file->bo_crc = calloc(header.state.bo_count, sizeof(*file->bo_crc));
+        if (!file->state || !file->bo_state || !file->bo_offset ||
+            !file->bo_crc) {
+                err(1, "malloc failure");
+        }
+        *file->state = header.state;
+
+        size_t table_size = (size_t)header.state.bo_count *
+                header.bo_entry_size;
+        void *table = malloc(table_size);
+        if (!table)
+                err(1, "malloc failure");
+        if (!read_at(file, filename, table, table_size,
+                     header.bo_table_offset)) {
+                free(table);
+                return false;
+        }
+
+        for (uint32_t i = 0; i < header.state.bo_count; i++) {
+                struct vc4_dump_bo entry;
+
+                memset(&entry, 0, sizeof(entry));
+                memcpy(&entry, table + (size_t)i * header.bo_entry_size,
+                       MIN2(header.bo_entry_size, sizeof(entry)));
+                if (entry.offset > file->size ||
+                    entry.bo.size > file->size - entry.offset) {
+                        free(table);
+                        return file_error(file, "Input file %s is truncated",
+                                          filename);
+                }
+
+                file->bo_state[i] = entry.bo;
+                file->bo_offset[i] = entry.offset;
+                file->bo_crc[i] = entry.crc;
+        }
+
+        free(table);
+
+        if (!read_zero_ranges(file, filename, &header))
+                return false;
+
+        file->omitted_bo_count = header.omitted_bo_count;
+        file->omitted_bos = calloc(header.omitted_bo_count,
+                                   sizeof(*file->omitted_bos));
+        if (header.omitted_bo_count && !file->omitted_bos)
+                err(1, "malloc failure");
+        return read_at(file, filename, file->omitted_bos,
+                       (size_t)header.omitted_bo_count *
+                       sizeof(*file->omitted_bos),
+                       header.omitted_table_offset);
+}
+
+/**
+ * Opens a dump and reads its header and BO table.
+ *
+ * If the dump can't be read, the file returned has the reason in its
+ * error, and is only good for passing to vc4_dump_file_close().  Running
+ * out of memory still exits, like the rest of the tools.
+ */
+struct vc4_dump_file *
+vc4_dump_file_open(const char *filename)
+{
+        struct vc4_dump_file *file = calloc(1, sizeof(*file));
+        struct stat stat;
+        uint32_t version;
+
+        if (!file)
+                err(1, "malloc failure");
+
+        file->fd = open(filename, O_RDONLY);
+        if (file->fd == -1) {
+                file_error(file, "Couldn't open input file %s: %s",
+                           filename, strerror(errno));
+                return file;
+        }
+
+        if (fstat(file->fd, &stat)) {
+                file_error(file, "Couldn't get size of input file %s: %s",
+                           filename, strerror(errno));
+                return file;
+        }
+        file->size = stat.st_size;
+
+        if (!read_at(file, filename, &version, sizeof(version), 0))
+                return file;
+        if (version == VC4_DUMP_VERSION_COMPRESSED) {
+                if (!open_compressed(file, filename) ||
+                    !read_at(file, filename, &version, sizeof(version), 0)) {
+                        return file;
+                }
+                if (version != 1) {
+                        file_error(file, "Compressed input %s holds a "
+                                   "version %d dump", filename, version);
+                        return file;
+                }
+        }
+        file->version = version;
+
+        /* Both versions start with the version and then the hang state,
+         * whose bo_count sizes the arrays.
+         */
+        struct drm_vc4_get_hang_state state;
+        bool ok;
+        switch (version) {
+        case 0:
+                ok = read_at(file, filename, &state, sizeof(state),
+                             sizeof(version));
+                break;
+        case 1:
+                ok = read_at(file, filename, &state, sizeof(state),
+                             offsetof(struct vc4_dump_header, state));
+                break;
+        default:
+                file_error(file, "Input had wrong version %d", version);
+                return file;
+        }
+        if (!ok)
+                return file;
+
+        file->map = calloc(state.bo_count, sizeof(*file->map));
+        if (!file->map)
+                err(1, "malloc failure");
+
+        if (version == 0)
+                open_v0(file, filename);
+        else
+                open_v1(file, filename);
+
+        return file;
+}
+
+/**
+ * Unmaps and frees everything that vc4_dump_file_open() set up, which may
+ * have stopped partway.
+ */
+void
+vc4_dump_file_close(struct vc4_dump_file *file)
+{
+        if (file->input) {
+                /* The state and BO state point into the mapping. */
+                munmap(file->input, file->size);
+        } else {
+                if (file->image) {
+                        munmap(file->image, file->size);
+                } else if (file->state && file->map) {
+                        long page_size = sysconf(_SC_PAGESIZE);
+
+                        for (uint32_t i = 0; i < file->state->bo_count; i++) {
+                                uint64_t delta = (file->bo_offset[i] %
+                                                  page_size);
+
+                                if (file->map[i]) {
+                                        munmap(file->map[i] - delta,
+                                               file->bo_state[i].size +
+                                               delta);
+                                }
+                        }
+                }
+
+                free(file->state);
+                free(file->bo_state);
+        }
+
+        free(file->map);
+        free(file->bo_offset);
+        free(file->zero_ranges);
+        free(file->bo_zero_ranges);
+        free(file->omitted_bos);
+        free(file->bo_crc);
+        free(file->blocks);
+        free(file->blocks_loaded);
+        free(file->block_data);
+        free(file->error);
+        if (file->fd != -1)
+                close(file->fd);
+        free(file);
+}
+
+/**
+ * Returns the mapping of a BO's contents, mapping it first if it hasn't
+ * been yet, or NULL with the file's error set if it can't be read.
+ */
+void *
+vc4_dump_file_map_bo(struct vc4_dump_file *file, uint32_t bo)
+{
+        uint32_t size = file->bo_state[bo].size;
+
+        if (file->map[bo] || !size)
+                return file->map[bo];
+
+        if (file->image) {
+                if (!load_image(file, file->bo_offset[bo], size))
+                        return NULL;
+                file->map[bo] = file->image + file->bo_offset[bo];
+                return file->map[bo];
+        }
+
+        /* The offset is only aligned to VC4_DUMP_ALIGN, which may be less
+         * than the page size, so map from the page containing it.
+         */
+        long page_size = sysconf(_SC_PAGESIZE);
+        uint64_t offset = file->bo_offset[bo];
+        uint64_t delta = offset % page_size;
+        void *map = mmap(NULL, size + delta, PROT_READ, MAP_SHARED,
+                         file->fd, offset - delta);
+        if (map == MAP_FAILED) {
+                file_error(file, "Couldn't map BO %d of the input file: %s",
+                           bo, strerror(errno));
+                return NULL;
+        }
+
+        file->map[bo] = map + delta;
+
+        /* Read ahead the parts that are stored in the file.  Holes read
+         * back as zeroes without any I/O anyway.
+         */
+        if (size <= WILLNEED_MAX_SIZE) {
+                uint32_t start = vc4_dump_file_next_data(file, bo, 0);
+
+                while (start < size) {
+                        uint32_t end = vc4_dump_file_next_hole(file, bo,
+                                                               start);
+                        void *page = (void *)((uintptr_t)(file->map[bo] +
+                                                          start) &
+                                              ~(page_size - 1));
+
+                        madvise(page, file->map[bo] + end - page,
+                                MADV_WILLNEED);
+                        start = vc4_dump_file_next_data(file, bo, end);
+                }
+        }
+
+        return file->map[bo];
+}
+
+/* Returns the first zero range of bo that doesn't end at or before offset,
+ * or NULL.
+ */
+static const struct vc4_dump_zero_range *
+find_zero_range(struct vc4_dump_file *file, uint32_t bo, uint32_t offset)
+{
+        for (uint32_t i = file->bo_zero_ranges[bo];
+             i < file->bo_zero_ranges[bo + 1]; i++) {
+                const struct vc4_dump_zero_range *range =
+                        &file->zero_ranges[i];
+
+                if (range->offset + range->size > offset)
+                        return range;
+        }
+
+        return NULL;
+}
+
+/* Seeks for data or a hole from offset in the BO, returning ~0 if the
+ * filesystem can't tell us.
+ */
+static uint32_t
+seek_bo(struct vc4_dump_file *file, uint32_t bo, uint32_t offset,
+        int whence)
+{
+        uint64_t start = file->bo_offset[bo];
+        uint32_t size = file->bo_state[bo].size;
+        off_t found = lseek(file->fd, start + offset, whence);
+
+        if (found == -1) {
+                /* ENXIO means there's no more data after offset. */
+                if (errno == ENXIO && whence == SEEK_DATA)
+                        return size;
+                return ~0;
+        }
+
+        return MIN2(found - start, size);
+}
+
+/**
+ * Returns the offset of the first byte at or after offset in the BO that
+ * may be nonzero, or the BO's size if the rest is all zero.
+ *
+ * Scans of BO contents can use this with vc4_dump_file_next_hole() to
+ * skip the zero pages that the file doesn't store.
+ */
+uint32_t
+vc4_dump_file_next_data(struct vc4_dump_file *file, uint32_t bo,
+                        uint32_t offset)
+{
+        uint32_t size = file->bo_state[bo].size;
+
+        if (offset >= size)
+                return size;
+
+        if (file->bo_zero_ranges) {
+                const struct vc4_dump_zero_range *range =
+                        find_zero_range(file, bo, offset);
+
+                if (range && range->offset <= offset)
+                        return range->offset + range->size;
+                return offset;
+        }
+
+        uint32_t found = seek_bo(file, bo, offset, SEEK_DATA);
+        return found == ~0 ? offset : found;
+}
+
+/**
+ * Returns the offset of the first byte at or after offset in the BO that's
+ * known to be zero, or the BO's size.
+ */
+uint32_t
+vc4_dump_file_next_hole(struct vc4_dump_file *file, uint32_t bo,
+                        uint32_t offset)
+{
+        uint32_t size = file->bo_state[bo].size;
+
+        if (offset >= size)
+                return size;
+
+        if (file->bo_zero_ranges) {
+                const struct vc4_dump_zero_range *range =
+                        find_zero_range(file, bo, offset);
+
+                if (!range)
+                        return size;
+                return MAX2(range->offset, offset);
+        }
+
+        uint32_t found = seek_bo(file, bo, offset, SEEK_HOLE);
+        return found == ~0 ? size : found;
+}
+
+/**
+ * Returns whether paddr is in memory that was left out of the dump, so
+ * that tools can tell a reference to it from a bad address.
+ */
+bool
+vc4_dump_file_is_omitted(struct vc4_dump_file *file, uint32_t paddr)
+{
+        for (uint32_t i = 0; i < file->omitted_bo_count; i++) {
+                const struct drm_vc4_get_hang_state_bo *bo =
+                        &file->omitted_bos[i];
+
+                if (paddr - bo->paddr < bo->size)
+                        return true;
+        }
+
+        return false;
+}
+
+/**
+ * Returns the index of the BO that omitted BO "omitted" is the missing end
+ * of, if the dump cut that BO short, or -1.
+ */
+int
+vc4_dump_file_truncated_bo(struct vc4_dump_file *file, uint32_t omitted)
+{
+        const struct drm_vc4_get_hang_state_bo *tail =
+                &file->omitted_bos[omitted];
+
+        for (uint32_t i = 0; i < file->state->bo_count; i++) {
+                const struct drm_vc4_get_hang_state_bo *bo =
+                        &file->bo_state[i];
+
+                if (bo->handle == tail->handle &&
+                    bo->paddr + bo->size == tail->paddr) {
+                        return i;
+                }
+        }
+
+        return -1;
+}
+
+/* Returns the first offset at or after offset in the BO that the file has
+ * data for, rather than a hole, or the BO's size.
+ */
+static uint32_t
+next_stored(struct vc4_dump_file *file, uint32_t bo, uint32_t offset)
+{
+        uint32_t found;
+
+        if (file->image || offset >= file->bo_state[bo].size)
+                return offset;
+
+        found = seek_bo(file, bo, offset, SEEK_DATA);
+        return found == ~0 ? offset : found;
+}
+
+static uint32_t
+next_unstored(struct vc4_dump_file *file, uint32_t bo, uint32_t offset)
+{
+        uint32_t size = file->bo_state[bo].size;
+        uint32_t found;
+
+        if (file->image || offset >= size)
+                return size;
+
+        found = seek_bo(file, bo, offset, SEEK_HOLE);
+        return found == ~0 ? size : found;
+}
+
+/**
+ * Returns the CRC32C of a BO's contents as the tools see them.
+ *
+ * That includes the zero ranges, since a damaged file can have something
+ * other than zeroes there, but holes in the file are skipped over rather
+ * than read, since those can't have been damaged.
+ */
+uint32_t
+vc4_dump_file_bo_crc(struct vc4_dump_file *file, uint32_t bo)
+{
+        uint32_t size = file->bo_state[bo].size;
+        void *map = vc4_dump_file_map_bo(file, bo);
+        uint32_t offset = 0, crc = 0;
+
+        if (!map)
+                return 0;
+
+        while (offset < size) {
+                uint32_t start = next_stored(file, bo, offset);
+                uint32_t end = next_unstored(file, bo, start);
+
+                crc = vc4_crc32c_zeros(crc, start - offset);
+                crc = vc4_crc32c(crc, map + start, end - start);
+                offset = end;
+        }
+
+        return crc;
+}
+
+/**
+ * Checks each BO's contents against its checksum, printing the ones that
+ * don't match to report if it's non-NULL, and returns how many didn't.  Stops at a BO that can't be
+ * read, leaving the file's error set.
+ *
+ * Only for dumps with VC4_DUMP_CRC_BOS set in crc_flags.
+ */
+uint32_t
+vc4_dump_file_verify(struct vc4_dump_file *file, struct vc4_output *report)
+{
+        uint32_t bad = 0;
+
+        for (uint32_t i = 0; i < file->state->bo_count; i++) {
+                uint32_t crc = vc4_dump_file_bo_crc(file, i);
+
+                if (file->error)
+                        break;
+                if (crc == file->bo_crc[i])
+                        continue;
+
+                if (report) {
+                        vc4_out_printf(report, "BO %d (handle %d at 0x%08x) "
+                                       "has checksum 0x%08x, expected "
+                                       "0x%08x\n",
+                                       i, file->bo_state[i].handle,
+                                       file->bo_state[i].paddr, crc,
+                                       file->bo_crc[i]);
+                }
+                bad++;
+        }
+
+        return bad;
+}
+
+static void *
+map_bo(void *data, uint32_t bo)
+{
+        return vc4_dump_file_map_bo(data, bo);
+}
+
+/**
+ * Sets up an address space for the dump's BOs, which maps each BO on its
+ * first lookup.
+ */
+void
+vc4_dump_file_init_addr_space(struct vc4_dump_file *file,
+                              struct vc4_addr_space *space)
+{
+        vc4_addr_space_init(space, file->bo_state, file->map,
+                            file->state->bo_count);
+        space->map_bo = map_bo;
+        space->map_bo_data = file;
+}
@@ -0,0 +1,264 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/** @file vc4_dump_file.h
+ *
+ * On-disk format of vc4 hang dumps, and the reader shared by the tools.
+ *
+ * Version 0 is a uint32_t version, struct drm_vc4_get_hang_state, its
+ * bo_state array, and then the contents of each BO packed back to back, so
+ * finding a BO means adding up the sizes of all the ones before it.
+ *
+ * Version 1 is a struct vc4_dump_header, a table of struct vc4_dump_bo
+ * giving each BO's file offset, and then the contents of each BO starting
+ * at a multiple of VC4_DUMP_ALIGN.  That lets the reader map just the BOs
+ * it touches, each on its own, and give the kernel per-BO hints about
+ * them.
+ *
+ * Version 1 also has a table of the VC4_DUMP_ALIGN-sized pages of BO
+ * contents that are all zero.  The writer seeks over those instead of
+ * writing them, leaving holes in the file, and the padding between BOs is
+ * left as holes too.  The table lets readers skip the zeroes even if the
+ * file was copied without keeping its holes.  Readers of version 0 dumps,
+ * or of copies that kept the holes, can find them with SEEK_HOLE and
+ * SEEK_DATA instead.  Dumps rewritten by vc4_dump_trim use the same table
+ * for the bytes that nothing refers to, which they zero out.
+ *
+ * Version 1 dumps written since checksums were added have a CRC32C of the
+ * header and tables, which readers check when they open the dump, and one
+ * of each BO's contents, which vc4_dump_file_verify() checks.  The BO
+ * checksums are left out of dumps written to a pipe, since the header has
+ * to go out before the BOs are read.
+ *
+ * A compressed dump holds a version 1 dump, the "image", cut into
+ * VC4_DUMP_BLOCK_SIZE blocks that are each compressed with zlib on their
+ * own, so that the writer can compress them in parallel and the reader can
+ * decompress just the blocks under the BOs it touches.  It's a struct
+ * vc4_dump_compressed_header, the blocks, and then a table of struct
+ * vc4_dump_block at the very end of the file, which lets the writer stream
+ * it out without seeking back.
+ */
+
+#ifndef VC4_DUMP_FILE_H
+#define VC4_DUMP_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "vc4_drm.h"
+
+#define VC4_DUMP_VERSION        1
+#define VC4_DUMP_VERSION_COMPRESSED 2
+
+/* Alignment of the BO contents in a version 1 dump. */
+#define VC4_DUMP_ALIGN          4096
+
+/* Size of the image blocks that a compressed dump is made of. */
+#define VC4_DUMP_BLOCK_SIZE     (256 * 1024)
+
+struct vc4_dump_header {
+        /* VC4_DUMP_VERSION, in the same place as version 0's. */
+        uint32_t version;
+        /* sizeof(struct vc4_dump_header) and sizeof(struct vc4_dump_bo)
+         * when written, so that fields can be added to the end of either.
+         */
+        uint32_t header_size;
+        uint32_t bo_entry_size;
+        /* Alignment that the BO contents were written with. */
+        uint32_t align;
+        /* File offset of the table of state.bo_count BO entries. */
+        uint64_t bo_table_offset;
+        /* File offset and length of the table of struct
+         * vc4_dump_zero_range, sorted by BO and offset.
+         */
+        uint64_t zero_table_offset;
+        uint32_t zero_range_count;
+        uint32_t pad;
+
+        struct drm_vc4_get_hang_state state;
+
+        /* File offset and length of the table of struct
+         * drm_vc4_get_hang_state_bo for BOs that were left out of the
+         * dump, such as by capturing only what the CLs reach.  A BO that
+         * was cut short to fit a size limit is in both tables under the
+         * same handle: the start that was captured in the BO table, and
+         * the rest in this one.
+         */
+        uint64_t omitted_table_offset;
+        uint32_t omitted_bo_count;
+        uint32_t pad2;
+
+        /* VC4_DUMP_CRC_* for the checksums that were filled in. */
+        uint32_t crc_flags;
+        /* CRC32C of the header_size bytes of the header with this field
+         * zeroed, then the BO table, the omitted table and the zero range
+         * table.
+         */
+        uint32_t metadata_crc;
+};
+
+/* Size of the header in dumps written before checksums were added. */
+#define VC4_DUMP_HEADER_V1_SIZE offsetof(struct vc4_dump_header, crc_flags)
+
+#define VC4_DUMP_CRC_METADATA   (1 << 0)
+#define VC4_DUMP_CRC_BOS        (1 << 1)
+
+struct vc4_dump_bo {
+        struct drm_vc4_get_hang_state_bo bo;
+        /* File offset of the BO's contents. */
+        uint64_t offset;
+        /* CRC32C of the BO's contents, including the zero ranges. */
+        uint32_t crc;
+        uint32_t pad;
+};
+
+/* Size of the BO entries in dumps written before checksums were added. */
+#define VC4_DUMP_BO_V1_SIZE     offsetof(struct vc4_dump_bo, crc)
+
+/**
+ * A run of bytes in a BO that reads back as zero, and that's left out of
+ * the file wherever it covers whole pages.
+ */
+struct vc4_dump_zero_range {
+        uint32_t bo;
+        uint32_t offset;
+        uint32_t size;
+        /* VC4_DUMP_ZERO_RANGE_* */
+        uint32_t flags;
+};
+
+/* The bytes weren't zero, but vc4_dump_trim dropped them since nothing in
+ * the CLs refers to them.
+ */
+#define VC4_DUMP_ZERO_RANGE_TRIMMED     (1 << 0)
+
+struct vc4_dump_compressed_header {
+        /* VC4_DUMP_VERSION_COMPRESSED. */
+        uint32_t version;
+        uint32_t header_size;
+        uint32_t block_size;
+        uint32_t block_count;
+        /* Size of the uncompressed image. */
+        uint64_t image_size;
+};
+
+enum vc4_dump_block_type {
+        /* All zeroes, and not stored in the file. */
+        VC4_DUMP_BLOCK_ZERO,
+        /* Stored as is, since it didn't compress. */
+        VC4_DUMP_BLOCK_RAW,
+        /* A zlib stream. */
+        VC4_DUMP_BLOCK_ZLIB,
+};
+
+struct vc4_dump_block {
+        /* File offset and size of the block's stored data. */
+        uint64_t offset;
+        uint32_t size;
+        uint32_t type;
+};
+
+static inline uint64_t
+vc4_dump_align(uint64_t offset)
+{
+        return (offset + VC4_DUMP_ALIGN - 1) & ~(uint64_t)(VC4_DUMP_ALIGN - 1);
+}
+
+/** A dump opened for reading, of either version. */
+struct vc4_dump_file {
+        int fd;
+        uint64_t size;
+        uint32_t version;
+
+        struct drm_vc4_get_hang_state *state;
+        struct drm_vc4_get_hang_state_bo *bo_state;
+
+        /**
+         * The mapping of each BO's contents.  For version 0 these all
+         * point into one mapping of the file, while for version 1 they're
+         * NULL until vc4_dump_file_map_bo() maps the BO.
+         */
+        void **map;
+
+        /* The file offset of each BO's contents. */
+        uint64_t *bo_offset;
+
+        /* Version 1: the zero ranges, and the index of each BO's first
+         * one, with an extra entry at the end for the total.
+         */
+        struct vc4_dump_zero_range *zero_ranges;
+        uint32_t *bo_zero_ranges;
+
+        /* Version 1: the BOs that were left out of the dump. */
+        struct drm_vc4_get_hang_state_bo *omitted_bos;
+        uint32_t omitted_bo_count;
+
+        /* Version 1: VC4_DUMP_CRC_* for the checksums the dump has, the
+         * checksum of the header and tables, and each BO's checksum.
+         */
+        uint32_t crc_flags;
+        uint32_t metadata_crc;
+        uint32_t *bo_crc;
+
+        /* Version 0: the mapping of the whole file. */
+        void *input;
+
+        /* Compressed dumps: the image that blocks get decompressed into
+         * as they're first needed, and a bitmap of the ones that have
+         * been.  The offsets and size above are all within the image.
+         */
+        void *image;
+        uint32_t block_size;
+        uint32_t block_count;
+        struct vc4_dump_block *blocks;
+        uint32_t *blocks_loaded;
+        void *block_data;
+
+        /* Why the dump couldn't be read, or NULL.  Set by
+         * vc4_dump_file_open() for a dump that it couldn't open at all, or
+         * later for contents that can't be read, such as a block that
+         * doesn't decompress.
+         */
+        char *error;
+};
+
+struct vc4_addr_space;
+struct vc4_output;
+
+struct vc4_dump_file *vc4_dump_file_open(const char *filename);
+void vc4_dump_file_close(struct vc4_dump_file *file);
+void *vc4_dump_file_map_bo(struct vc4_dump_file *file, uint32_t bo);
+uint32_t vc4_dump_file_next_data(struct vc4_dump_file *file, uint32_t bo,
+                                 uint32_t offset);
+uint32_t vc4_dump_file_next_hole(struct vc4_dump_file *file, uint32_t bo,
+                                 uint32_t offset);
+bool vc4_dump_file_is_omitted(struct vc4_dump_file *file, uint32_t paddr);
+int vc4_dump_file_truncated_bo(struct vc4_dump_file *file, uint32_t omitted);
+uint32_t vc4_dump_file_bo_crc(struct vc4_dump_file *file, uint32_t bo);
+uint32_t vc4_dump_file_verify(struct vc4_dump_file *file,
+                              struct vc4_output *report);
+void vc4_dump_file_init_addr_space(struct vc4_dump_file *file,
+                                   struct vc4_addr_space *space);
+
+#endif /* VC4_DUMP_FILE_H */
@@ -21,28 +21,83 @@
  * IN THE SOFTWARE.
  */
 
+/* For vmsplice(). */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <dirent.h>
 #include <err.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/errno.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <zlib.h>
 #include "xf86drm.h"
 #include "vc4_drm.h"
+#include "vc4_addr_space.h"
+#include "vc4_crc32c.h"
+#include "vc4_dump_file.h"
+#include "vc4_dump_reach.h"
+#include "vc4_tools.h"
 
 struct hang {
+        /* The DRM device, or the dump standing in for one. */
+        int fd;
+        struct vc4_dump_file *fake;
+
         struct drm_vc4_get_hang_state *get_state;
         struct drm_vc4_get_hang_state_bo *bo_state;
         void **maps;
         uint32_t bo_count;
+
+        struct vc4_dump_zero_range *zero_ranges;
+        uint32_t zero_range_count, zero_range_size;
+
+        /* The header and tables at the start of the dump, the space
+         * reserved for them, where each BO's contents go after them, and
+         * the dump's total size.
+         */
+        void *metadata;
+        uint64_t metadata_size, metadata_reserved;
+        uint64_t *bo_offset;
+        uint64_t image_size;
+
+        /* BOs that were left out of the dump. */
+        struct drm_vc4_get_hang_state_bo *omitted_bos;
+        uint32_t omitted_bo_count;
+
+        /* The GEM handles that getting the hang state opened for its
+         * BOs, which are closed once the dump is written.
+         */
+        uint32_t *handles;
+        uint32_t handle_count;
+
+        /* The CRC32C of each BO's contents, as it's captured. */
+        uint32_t *bo_crc;
 };
 
-static void
-get_hang_state(int fd, struct hang *hang)
+static const char zero_page[VC4_DUMP_ALIGN];
+
+/* Gets the hang state from the kernel, returning false if there's no hang
+ * recorded.  The kernel drops the hang state once it's been read in full,
+ * so each hang is only returned once.
+ */
+static bool
+get_hang_state(struct hang *hang)
 {
         int ret;
 
@@ -50,11 +105,12 @@ get_hang_state(int fd, struct hang *hang)
         if (!hang->get_state)
                 err(1, "malloc failure");
 
-        ret = ioctl(fd, DRM_IOCTL_VC4_GET_HANG_STATE, hang->get_state);
+        ret = ioctl(hang->fd, DRM_IOCTL_VC4_GET_HANG_STATE, hang->get_state);
         if (ret) {
                 if (errno == ENOENT) {
-                        fprintf(stdout, "No hang state recorded\n");
-                        exit(0);
+                        free(hang->get_state);
+                        hang->get_state = NULL;
+                        return false;
                 }
 
                 if (errno == EACCES && geteuid() != 0) {
@@ -74,97 +130,1661 @@ get_hang_state(int fd, struct hang *hang)
         hang->get_state->bo = (uintptr_t)hang->bo_state;
 
 
-        ret = ioctl(fd, DRM_IOCTL_VC4_GET_HANG_STATE, hang->get_state);
+        ret = ioctl(hang->fd, DRM_IOCTL_VC4_GET_HANG_STATE, hang->get_state);
         if (ret)
                 err(1, "Full get hang state failed");
+
+        hang->handle_count = hang->bo_count;
+        hang->handles = calloc(hang->handle_count, sizeof(*hang->handles));
+        if (!hang->handles)
+                err(1, "malloc failure");
+        for (int i = 0; i < hang->bo_count; i++)
+                hang->handles[i] = hang->bo_state[i].handle;
+
+        return true;
+}
+
+/* Returns the path of the first dump by name in dir, skipping hidden files
+ * so that dumps can be written under a hidden name and renamed in, or NULL
+ * if there isn't one.
+ */
+static char *
+first_spooled_dump(const char *dir)
+{
+        DIR *d = opendir(dir);
+        struct dirent *entry;
+        char *first = NULL;
+        char *path = NULL;
+
+        if (!d)
+                err(1, "Couldn't open %s", dir);
+
+        while ((entry = readdir(d))) {
+                if (entry->d_name[0] == '.' ||
+                    (first && strcmp(entry->d_name, first) >= 0)) {
+                        continue;
+                }
+
+                free(first);
+                first = strdup(entry->d_name);
+                if (!first)
+                        err(1, "malloc failure");
+        }
+        closedir(d);
+
+        if (first && asprintf(&path, "%s/%s", dir, first) == -1)
+                err(1, "malloc failure");
+        free(first);
+
+        return path;
+}
+
+/* Takes the hang state from an existing dump instead of the kernel, with
+ * the dump's BOs standing in for the device's, so that capture can be
+ * tested and timed without a hang to capture.
+ *
+ * If fake_device is a directory, the dumps put in it are a series of hangs:
+ * each call takes the first one by name and removes it, like the kernel
+ * drops a hang once it's been read, and returns false if there are none.
+ */
+static bool
+get_fake_hang_state(const char *fake_device, struct hang *hang)
+{
+        struct stat st;
+
+        if (stat(fake_device, &st) == 0 && S_ISDIR(st.st_mode)) {
+                char *path = first_spooled_dump(fake_device);
+
+                if (!path)
+                        return false;
+
+                hang->fake = vc4_dump_file_open(path);
+                if (unlink(path))
+                        err(1, "Couldn't remove %s", path);
+                free(path);
+        } else {
+                hang->fake = vc4_dump_file_open(fake_device);
+        }
+        if (hang->fake->error)
+                errx(1, "%s", hang->fake->error);
+
+        hang->get_state = hang->fake->state;
+        hang->bo_state = hang->fake->bo_state;
+        hang->bo_count = hang->get_state->bo_count;
+
+        return true;
 }
 
+/* Whether the hang state arrays are still the fake device's own. */
+static bool
+state_is_fake(struct hang *hang)
+{
+        return hang->fake && hang->get_state == hang->fake->state;
+}
+
+/* Unmaps the BOs, closes their handles, and frees everything that was set
+ * up for the hang.
+ */
 static void
-map_bos(int fd, struct hang *hang)
+free_hang(struct hang *hang)
 {
-        int ret;
+        if (!hang->fake) {
+                for (int i = 0; i < hang->bo_count; i++) {
+                        if (hang->maps[i])
+                                munmap(hang->maps[i], hang->bo_state[i].size);
+                }
+        }
+
+        for (uint32_t i = 0; i < hang->handle_count; i++) {
+                struct drm_gem_close gem_close = {
+                        .handle = hang->handles[i],
+                };
+
+                ioctl(hang->fd, DRM_IOCTL_GEM_CLOSE, &gem_close);
+        }
+
+        if (!state_is_fake(hang)) {
+                free(hang->get_state);
+                free(hang->bo_state);
+        }
+        if (hang->fake)
+                vc4_dump_file_close(hang->fake);
+
+        free(hang->maps);
+        free(hang->handles);
+        free(hang->zero_ranges);
+        free(hang->metadata);
+        free(hang->bo_offset);
+        free(hang->omitted_bos);
+        free(hang->bo_crc);
+        memset(hang, 0, sizeof(*hang));
+}
+
+static void *
+map_bo(struct hang *hang, int i)
+{
+        struct drm_vc4_mmap_bo map;
+        void *ptr;
+
+        if (hang->fake) {
+                ptr = vc4_dump_file_map_bo(hang->fake, i);
+                if (!ptr && hang->fake->error)
+                        errx(1, "%s", hang->fake->error);
+                return ptr;
+        }
+
+        memset(&map, 0, sizeof(map));
+        map.handle = hang->bo_state[i].handle;
+        if (ioctl(hang->fd, DRM_IOCTL_VC4_MMAP_BO, &map)) {
+                err(1, "Couldn't get map offset for "
+                    "bo %d (handle %d)", i, hang->bo_state[i].handle);
+        }
+
+        ptr = mmap(NULL, hang->bo_state[i].size, PROT_READ, MAP_SHARED,
+                   hang->fd, map.offset);
+        if (ptr == MAP_FAILED) {
+                err(1, "Failed to map BO %d (handle %d)",
+                    i, hang->bo_state[i].handle);
+        }
+
+        return ptr;
+}
+
+static void
+map_bos(struct hang *hang)
+{
+        for (int i = 0; i < hang->bo_count; i++) {
+                if (!hang->maps[i])
+                        hang->maps[i] = map_bo(hang, i);
+        }
+}
+
+static void *
+reach_map_bo(void *data, uint32_t bo)
+{
+        struct hang *hang = data;
+
+        if (!hang->maps[bo])
+                hang->maps[bo] = map_bo(hang, bo);
+        return hang->maps[bo];
+}
+
+/* The order that BOs go into a dump limited by --max-bytes, by the most
+ * important thing that the CLs use each one for.
+ */
+enum bo_priority {
+        BO_PRIORITY_CL,
+        BO_PRIORITY_SHADER,
+        BO_PRIORITY_TILE_STATE,
+        BO_PRIORITY_VERTICES,
+        /* Textures, and anything else that the CLs don't point at. */
+        BO_PRIORITY_OTHER,
+        BO_PRIORITY_COUNT,
+};
+
+static const uint8_t reach_priority[] = {
+        [VC4_DUMP_REACH_CL] = BO_PRIORITY_CL,
+        [VC4_DUMP_REACH_SHADER_REC] = BO_PRIORITY_CL,
+        [VC4_DUMP_REACH_SHADER] = BO_PRIORITY_SHADER,
+        [VC4_DUMP_REACH_UNIFORMS] = BO_PRIORITY_SHADER,
+        [VC4_DUMP_REACH_TILE_STATE] = BO_PRIORITY_TILE_STATE,
+        [VC4_DUMP_REACH_VERTICES] = BO_PRIORITY_VERTICES,
+};
+
+static void
+classify_bo(void *data, const struct vc4_addr_range *range, uint32_t offset,
+            uint32_t size, enum vc4_dump_reach_kind kind)
+{
+        uint8_t *priority = data;
+
+        priority[range->bo_index] = MIN2(priority[range->bo_index],
+                                         reach_priority[kind]);
+}
+
+/* Walks the CLs over the live mappings to find each BO's enum bo_priority,
+ * with BO_PRIORITY_OTHER for the ones they can't reach.
+ */
+static uint8_t *
+find_bo_priorities(struct hang *hang)
+{
+        struct vc4_addr_space space;
+        uint8_t *priority = malloc(hang->bo_count);
+
+        if (!priority)
+                err(1, "malloc failure");
+        memset(priority, BO_PRIORITY_OTHER, hang->bo_count);
+
+        vc4_addr_space_init(&space, hang->bo_state, hang->maps,
+                            hang->bo_count);
+        space.map_bo = reach_map_bo;
+        space.map_bo_data = hang;
+        vc4_dump_reach(&space, hang->get_state, classify_bo, priority);
+        vc4_addr_space_fini(&space);
+
+        return priority;
+}
+
+/* Cuts each BO down to its first keep_size[i] bytes, dropping the ones with
+ * nothing kept, and lists what was dropped for the dump.
+ */
+static void
+drop_bos(struct hang *hang, const uint32_t *keep_size)
+{
+        struct drm_vc4_get_hang_state *state = malloc(sizeof(*state));
+        struct drm_vc4_get_hang_state_bo *bo_state =
+                calloc(hang->bo_count, sizeof(*bo_state));
+        void **maps = calloc(hang->bo_count, sizeof(*maps));
+        long page_size = sysconf(_SC_PAGESIZE);
+        uint32_t kept = 0;
+
+        hang->omitted_bos = realloc(hang->omitted_bos,
+                                    (hang->omitted_bo_count +
+                                     hang->bo_count) *
+                                    sizeof(*hang->omitted_bos));
+        if (!state || !bo_state || !maps || !hang->omitted_bos)
+                err(1, "malloc failure");
+
+        /* The fake device maps BOs by their index in its list, so map the
+         * kept ones before they get new indices.
+         */
+        for (int i = 0; i < hang->bo_count; i++) {
+                struct drm_vc4_get_hang_state_bo bo = hang->bo_state[i];
+
+                if (keep_size[i] < bo.size || !keep_size[i]) {
+                        hang->omitted_bos[hang->omitted_bo_count++] =
+                                (struct drm_vc4_get_hang_state_bo) {
+                                .handle = bo.handle,
+                                .paddr = bo.paddr + keep_size[i],
+                                .size = bo.size - keep_size[i],
+                        };
+                }
+
+                if (!keep_size[i]) {
+                        if (hang->maps[i] && !hang->fake)
+                                munmap(hang->maps[i], bo.size);
+                        continue;
+                }
+
+                bo_state[kept] = bo;
+                bo_state[kept].size = keep_size[i];
+                maps[kept] = reach_map_bo(hang, i);
+
+                /* Unmap the part of a BO that was cut off. */
+                uint64_t mapped = (keep_size[i] + page_size - 1) & -page_size;
+                if (!hang->fake && mapped < bo.size)
+                        munmap((char *)maps[kept] + mapped,
+                               bo.size - mapped);
+
+                kept++;
+        }
+
+        *state = *hang->get_state;
+        state->bo_count = kept;
+        if (!state_is_fake(hang)) {
+                free(hang->get_state);
+                free(hang->bo_state);
+        }
+        free(hang->maps);
+        hang->get_state = state;
+        hang->bo_state = bo_state;
+        hang->maps = maps;
+        hang->bo_count = kept;
+}
+
+/* Drops the BOs that the CLs can't reach from the hang. */
+static void
+prune_unreachable(struct hang *hang)
+{
+        uint8_t *priority = find_bo_priorities(hang);
+        uint32_t *keep_size = calloc(hang->bo_count, sizeof(*keep_size));
+        uint64_t size = 0, omitted_size = 0;
+        uint32_t bo_count = hang->bo_count, omitted = 0;
+
+        if (!keep_size)
+                err(1, "malloc failure");
+
+        for (int i = 0; i < hang->bo_count; i++) {
+                size += hang->bo_state[i].size;
+
+                if (priority[i] == BO_PRIORITY_OTHER) {
+                        omitted++;
+                        omitted_size += hang->bo_state[i].size;
+                } else {
+                        keep_size[i] = hang->bo_state[i].size;
+                }
+        }
+
+        drop_bos(hang, keep_size);
+
+        fprintf(stderr, "Left out %d of %d BOs (%"PRIu64" of %"PRIu64" "
+                "bytes) that the CLs don't reach\n",
+                omitted, bo_count, omitted_size, size);
+        free(keep_size);
+        free(priority);
+}
+
+/* Most zero ranges that a BO of size bytes can have: zero pages
+ * alternating with data.
+ */
+static uint64_t
+max_bo_zero_ranges(uint32_t size)
+{
+        return ((size + VC4_DUMP_ALIGN - 1) / VC4_DUMP_ALIGN + 1) / 2;
+}
+
+struct budget_entry {
+        uint8_t priority;
+        uint32_t size;
+        uint32_t bo;
+};
+
+static int
+compare_budget_entries(const void *a, const void *b)
+{
+        const struct budget_entry *ea = a, *eb = b;
+
+        if (ea->priority != eb->priority)
+                return ea->priority < eb->priority ? -1 : 1;
+        if (ea->size != eb->size)
+                return ea->size < eb->size ? -1 : 1;
+        return ea->bo < eb->bo ? -1 : 1;
+}
+
+/**
+ * Cuts the hang down so that its dump takes at most max_bytes, keeping the
+ * BOs in order of enum bo_priority, and the smaller ones first within
+ * each, so that as many as possible are whole.  The first BO that doesn't
+ * fit keeps as much of its start as does, and the BOs after it are left
+ * out.
+ *
+ * The budget assumes the worst case for the header and tables, and that
+ * nothing is zero or compresses, so it's a hard limit whatever the output.
+ */
+static void
+fit_max_bytes(struct hang *hang, uint64_t max_bytes, bool compress)
+{
+        uint8_t *priority = find_bo_priorities(hang);
+        uint32_t *keep_size = calloc(hang->bo_count, sizeof(*keep_size));
+        struct budget_entry *order = calloc(hang->bo_count, sizeof(*order));
+        uint64_t max_zero_ranges = 0, size = 0, kept_size = 0;
+        uint32_t bo_count = hang->bo_count, omitted = 0, truncated = 0;
+
+        if (!keep_size || !order)
+                err(1, "malloc failure");
+
+        for (int i = 0; i < hang->bo_count; i++) {
+                order[i] = (struct budget_entry) {
+                        .priority = priority[i],
+                        .size = hang->bo_state[i].size,
+                        .bo = i,
+                };
+                size += hang->bo_state[i].size;
+                max_zero_ranges += max_bo_zero_ranges(hang->bo_state[i].size);
+        }
+        qsort(order, hang->bo_count, sizeof(*order), compare_budget_entries);
+
+        /* Each BO could add an entry to the omitted table. */
+        uint64_t used = vc4_dump_align(sizeof(struct vc4_dump_header) +
+                                       (uint64_t)hang->bo_count *
+                                       sizeof(struct vc4_dump_bo) +
+                                       ((uint64_t)hang->omitted_bo_count +
+                                        hang->bo_count) *
+                                       sizeof(*hang->omitted_bos) +
+                                       max_zero_ranges *
+                                       sizeof(struct vc4_dump_zero_range));
+        if (compress) {
+                used += (sizeof(struct vc4_dump_compressed_header) +
+                         (max_bytes + VC4_DUMP_BLOCK_SIZE - 1) /
+                         VC4_DUMP_BLOCK_SIZE * sizeof(struct vc4_dump_block));
+        }
+        if (used > max_bytes) {
+                errx(1, "--max-bytes must be at least %"PRIu64" for the "
+                     "dump's header and tables", used);
+        }
+
+        for (int i = 0; i < hang->bo_count; i++) {
+                uint32_t bo = order[i].bo;
+                uint32_t bo_size = order[i].size;
+
+                if (used + vc4_dump_align(bo_size) <= max_bytes) {
+                        keep_size[bo] = bo_size;
+                } else {
+                        keep_size[bo] = ((max_bytes - used) &
+                                         ~(uint64_t)(VC4_DUMP_ALIGN - 1));
+                        if (keep_size[bo])
+                                truncated++;
+                        else
+                                omitted++;
+                }
+
+                used += vc4_dump_align(keep_size[bo]);
+                kept_size += keep_size[bo];
+        }
+
+        drop_bos(hang, keep_size);
+
+        if (omitted || truncated) {
+                fprintf(stderr, "Left out %d of %d BOs and cut %d short to "
+                        "fit in %"PRIu64" bytes (kept %"PRIu64" of "
+                        "%"PRIu64" bytes)\n",
+                        omitted, bo_count, truncated, max_bytes, kept_size,
+                        size);
+        }
+        free(order);
+        free(keep_size);
+        free(priority);
+}
+
+static void
+add_zero_range(struct hang *hang, uint32_t bo, uint32_t offset,
+               uint32_t size)
+{
+        if (hang->zero_range_count) {
+                struct vc4_dump_zero_range *last =
+                        &hang->zero_ranges[hang->zero_range_count - 1];
+
+                if (last->bo == bo && last->offset + last->size == offset) {
+                        last->size += size;
+                        return;
+                }
+        }
+
+        if (hang->zero_range_count == hang->zero_range_size) {
+                hang->zero_range_size = MAX2(hang->zero_range_size * 2, 16);
+                hang->zero_ranges = realloc(hang->zero_ranges,
+                                            hang->zero_range_size *
+                                            sizeof(*hang->zero_ranges));
+                if (!hang->zero_ranges)
+                        err(1, "malloc failure");
+        }
+
+        hang->zero_ranges[hang->zero_range_count++] =
+                (struct vc4_dump_zero_range) {
+                .bo = bo,
+                .offset = offset,
+                .size = size,
+        };
+}
+
+/* Finds the pages of each BO that are all zero, which is usually most of
+ * the tile allocation and overflow memory and the unused tails of
+ * buffers, and checksums the BOs on the way.
+ */
+static void
+find_zero_ranges(struct hang *hang)
+{
+        for (int i = 0; i < hang->bo_count; i++) {
+                const char *map = hang->maps[i];
+                uint32_t size = hang->bo_state[i].size;
+                uint32_t crc = 0, zeroes = 0;
+
+                for (uint32_t offset = 0; offset < size;
+                     offset += VC4_DUMP_ALIGN) {
+                        uint32_t page_size = MIN2(size - offset,
+                                                  VC4_DUMP_ALIGN);
+
+                        if (memcmp(map + offset, zero_page, page_size) == 0) {
+                                add_zero_range(hang, i, offset, page_size);
+                                zeroes += page_size;
+                                continue;
+                        }
+
+                        crc = vc4_crc32c_zeros(crc, zeroes);
+                        crc = vc4_crc32c(crc, map + offset, page_size);
+                        zeroes = 0;
+                }
+
+                hang->bo_crc[i] = vc4_crc32c_zeros(crc, zeroes);
+        }
+}
+
+/* Number of iovecs gathered up before they're written out in one call. */
+#define WRITER_BATCH    64
+
+/**
+ * Writes the dump straight from the BO mappings, without copying them
+ * through stdio.
+ *
+ * Pieces of the output are gathered up and written out with one writev()
+ * per batch, or handed to a pipe with vmsplice(), which lets the pipe
+ * reference the pages rather than copying them.  When the output can be
+ * seeked, skipped ranges are left as holes.
+ */
+struct writer {
+        int fd;
+        bool seekable;
+        /* Whether to try vmsplice(), which is only safe if the queued
+         * memory is never changed afterwards.
+         */
+        bool splice;
+        /* Whether the last writer_flush() spliced anything. */
+        bool spliced;
+
+        /* The file offset that the queued data goes at. */
+        uint64_t pos;
+        struct iovec iov[WRITER_BATCH];
+        int iov_count;
+        uint64_t queued;
+
+        uint64_t written;
+};
+
+static void
+writer_init(struct writer *w, int fd)
+{
+        struct stat stat;
+
+        memset(w, 0, sizeof(*w));
+        w->fd = fd;
+        w->seekable = lseek(fd, 0, SEEK_CUR) != -1;
+        w->splice = fstat(fd, &stat) == 0 && S_ISFIFO(stat.st_mode);
+}
+
+static ssize_t
+writer_write_iov(struct writer *w, struct iovec *iov, int count)
+{
+        if (w->splice) {
+                ssize_t ret = vmsplice(w->fd, iov, count, 0);
+
+                if (ret > 0)
+                        w->spliced = true;
+
+                /* BO mappings of device memory can't be spliced, so fall
+                 * back to copying.
+                 */
+                if (ret != -1 || (errno != EFAULT && errno != EINVAL &&
+                                  errno != ENOSYS)) {
+                        return ret;
+                }
+                w->splice = false;
+        }
+
+        if (w->seekable)
+                return pwritev(w->fd, iov, count, w->pos);
+        else
+                return writev(w->fd, iov, count);
+}
+
+static void
+writer_flush(struct writer *w)
+{
+        struct iovec *iov = w->iov;
+        int count = w->iov_count;
+
+        w->spliced = false;
+        while (count) {
+                ssize_t ret = writer_write_iov(w, iov, count);
+
+                if (ret == -1) {
+                        if (errno == EINTR)
+                                continue;
+                        err(1, "Error writing hang state file");
+                }
+
+                w->pos += ret;
+                w->written += ret;
+
+                /* Step over what got written, which may end partway
+                 * through an iovec.
+                 */
+                while (count && ret >= iov->iov_len) {
+                        ret -= iov->iov_len;
+                        iov++;
+                        count--;
+                }
+                if (count) {
+                        iov->iov_base += ret;
+                        iov->iov_len -= ret;
+                }
+        }
+
+        w->iov_count = 0;
+        w->queued = 0;
+}
+
+static void
+writer_add(struct writer *w, const void *data, size_t size)
+{
+        if (!size)
+                return;
+
+        if (w->iov_count) {
+                struct iovec *last = &w->iov[w->iov_count - 1];
+
+                if (last->iov_base + last->iov_len == data) {
+                        last->iov_len += size;
+                        w->queued += size;
+                        return;
+                }
+        }
+
+        if (w->iov_count == WRITER_BATCH)
+                writer_flush(w);
+
+        w->iov[w->iov_count].iov_base = (void *)data;
+        w->iov[w->iov_count].iov_len = size;
+        w->iov_count++;
+        w->queued += size;
+}
+
+static uint64_t
+writer_offset(struct writer *w)
+{
+        return w->pos + w->queued;
+}
+
+/* Moves the output up to offset, leaving a hole if the output can be
+ * seeked, or writing zeroes if it's a pipe.
+ */
+static void
+writer_skip_to(struct writer *w, uint64_t offset)
+{
+        if (writer_offset(w) == offset)
+                return;
+
+        if (w->seekable) {
+                writer_flush(w);
+                w->pos = offset;
+                return;
+        }
+
+        while (writer_offset(w) < offset) {
+                writer_add(w, zero_page, MIN2(offset - writer_offset(w),
+                                              sizeof(zero_page)));
+        }
+}
+
+/* Lays out the version 1 dump: builds the header and BO table that go at
+ * the start of it, and places each BO's contents after them, leaving room
+ * for a zero range table of up to max_zero_ranges.
+ */
+static void
+lay_out_image(struct hang *hang, uint64_t max_zero_ranges)
+{
+        struct vc4_dump_header *header;
+        struct vc4_dump_bo *entries;
+        uint64_t offset;
+
+        hang->metadata_reserved = (sizeof(*header) +
+                                   (uint64_t)hang->bo_count *
+                                   sizeof(*entries) +
+                                   (uint64_t)hang->omitted_bo_count *
+                                   sizeof(*hang->omitted_bos) +
+                                   max_zero_ranges *
+                                   sizeof(*hang->zero_ranges));
+        hang->metadata = calloc(1, hang->metadata_reserved);
+        hang->bo_offset = calloc(hang->bo_count, sizeof(*hang->bo_offset));
+        if (!hang->metadata || !hang->bo_offset)
+                err(1, "malloc failure");
+
+        header = hang->metadata;
+        header->version = VC4_DUMP_VERSION;
+        header->header_size = sizeof(*header);
+        header->bo_entry_size = sizeof(*entries);
+        header->align = VC4_DUMP_ALIGN;
+        header->bo_table_offset = sizeof(*header);
+        header->omitted_table_offset = (header->bo_table_offset +
+                                        (uint64_t)hang->bo_count *
+                                        sizeof(*entries));
+        header->omitted_bo_count = hang->omitted_bo_count;
+        header->zero_table_offset = (header->omitted_table_offset +
+                                     (uint64_t)hang->omitted_bo_count *
+                                     sizeof(*hang->omitted_bos));
+        header->state = *hang->get_state;
+
+        memcpy(hang->metadata + header->omitted_table_offset,
+               hang->omitted_bos,
+               hang->omitted_bo_count * sizeof(*hang->omitted_bos));
+
+        entries = hang->metadata + header->bo_table_offset;
+        offset = vc4_dump_align(hang->metadata_reserved);
+        hang->image_size = hang->metadata_reserved;
+        for (int i = 0; i < hang->bo_count; i++) {
+                entries[i].bo = hang->bo_state[i];
+                entries[i].offset = offset;
+                hang->bo_offset[i] = offset;
+                hang->image_size = offset + hang->bo_state[i].size;
+                offset = vc4_dump_align(hang->image_size);
+        }
+
+        hang->metadata_size = header->zero_table_offset;
+}
+
+/* Fills in the checksums given by crc_flags, which have to be last since
+ * the metadata's covers everything else in it.
+ */
+static void
+checksum_metadata(struct hang *hang, uint32_t crc_flags)
+{
+        struct vc4_dump_header *header = hang->metadata;
+        struct vc4_dump_bo *entries = (hang->metadata +
+                                       header->bo_table_offset);
+
+        if (crc_flags & VC4_DUMP_CRC_BOS) {
+                for (int i = 0; i < hang->bo_count; i++)
+                        entries[i].crc = hang->bo_crc[i];
+        }
+
+        header->crc_flags = crc_flags;
+        header->metadata_crc = 0;
+        header->metadata_crc = vc4_crc32c(0, hang->metadata,
+                                          hang->metadata_size);
+}
+
+/* Adds the zero ranges found so far and the BO checksums to the
+ * metadata.
+ */
+static void
+finish_metadata(struct hang *hang)
+{
+        struct vc4_dump_header *header = hang->metadata;
+
+        header->zero_range_count = hang->zero_range_count;
+        memcpy(hang->metadata + header->zero_table_offset, hang->zero_ranges,
+               hang->zero_range_count * sizeof(*hang->zero_ranges));
+        hang->metadata_size = (header->zero_table_offset +
+                               (uint64_t)hang->zero_range_count *
+                               sizeof(*hang->zero_ranges));
+
+        checksum_metadata(hang, VC4_DUMP_CRC_METADATA | VC4_DUMP_CRC_BOS);
+}
+
+/* Size of the pieces of BOs that the capture threads copy out at a
+ * time.
+ */
+#define CAPTURE_CHUNK_SIZE      (1024 * 1024)
+#define CAPTURE_CHUNK_PAGES     (CAPTURE_CHUNK_SIZE / VC4_DUMP_ALIGN)
+
+/* Default budget for the staging buffers, in MB. */
+#define DEFAULT_STAGING_MB      16
+
+struct capture_chunk {
+        uint32_t bo;
+        uint32_t offset;
+        uint32_t size;
+};
+
+struct staging_buffer {
+        bool done;
+        void *data;
+        /* CRC32C of the chunk. */
+        uint32_t crc;
+        /* Bitmap of the chunk's pages that are all zero. */
+        uint32_t zero_pages[CAPTURE_CHUNK_PAGES / 32];
+};
+
+/**
+ * Pipeline for writing out a dump without compression.
+ *
+ * Reading the BOs is the slow part of a capture, since they're uncached
+ * memory, so a pool of threads maps the BOs and copies chunks of them into
+ * staging buffers, while the main thread writes the chunks out in order.
+ * The staging buffers are a fixed budget: a thread that gets too far
+ * ahead of the writer waits for the chunk's buffer to be written out.
+ */
+struct capture {
+        struct hang *hang;
+        /* Whether the output can be seeked, so that the header can be
+         * written last with the zero ranges and checksums.
+         */
+        bool find_zeroes;
+
+        struct capture_chunk *chunks;
+        uint32_t chunk_count;
+
+        pthread_mutex_t lock;
+        pthread_cond_t cond;
+        /* The next chunk for a thread to copy, and the next one to be
+         * written out.
+         */
+        uint32_t next_chunk;
+        uint32_t next_write;
+
+        /* Ring of the chunks after next_write. */
+        struct staging_buffer *buffers;
+        uint32_t buffer_count;
+};
+
+static void *
+alloc_staging(void)
+{
+        void *data = mmap(NULL, CAPTURE_CHUNK_SIZE, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (data == MAP_FAILED)
+                err(1, "malloc failure");
+        return data;
+}
+
+static void
+copy_chunk(struct capture *c, const struct capture_chunk *chunk,
+           struct staging_buffer *buffer)
+{
+        memcpy(buffer->data, c->hang->maps[chunk->bo] + chunk->offset,
+               chunk->size);
+
+        memset(buffer->zero_pages, 0, sizeof(buffer->zero_pages));
+        if (!c->find_zeroes)
+                return;
+
+        buffer->crc = vc4_crc32c(0, buffer->data, chunk->size);
+
+        for (uint32_t i = 0; i * VC4_DUMP_ALIGN < chunk->size; i++) {
+                uint32_t offset = i * VC4_DUMP_ALIGN;
+
+                if (memcmp(buffer->data + offset, zero_page,
+                           MIN2(chunk->size - offset, VC4_DUMP_ALIGN)) == 0) {
+                        buffer->zero_pages[i / 32] |= 1u << (i % 32);
+                }
+        }
+}
+
+static void *
+capture_thread(void *data)
+{
+        struct capture *c = data;
+
+        pthread_mutex_lock(&c->lock);
+        while (c->next_chunk < c->chunk_count) {
+                uint32_t index = c->next_chunk;
+                const struct capture_chunk *chunk = &c->chunks[index];
+                struct staging_buffer *buffer =
+                        &c->buffers[index % c->buffer_count];
+
+                /* Wait for the chunk's buffer to be written out. */
+                if (index >= c->next_write + c->buffer_count) {
+                        pthread_cond_wait(&c->cond, &c->lock);
+                        continue;
+                }
+                c->next_chunk++;
+
+                /* Chunks are handed out in order, so the first one of a BO
+                 * maps it for the rest.
+                 */
+                if (!c->hang->maps[chunk->bo])
+                        c->hang->maps[chunk->bo] = map_bo(c->hang, chunk->bo);
+                pthread_mutex_unlock(&c->lock);
+
+                copy_chunk(c, chunk, buffer);
+
+                pthread_mutex_lock(&c->lock);
+                buffer->done = true;
+                pthread_cond_broadcast(&c->cond);
+        }
+        pthread_mutex_unlock(&c->lock);
+
+        return NULL;
+}
+
+static void
+write_chunk(struct writer *w, struct hang *hang,
+            const struct capture_chunk *chunk,
+            const struct staging_buffer *buffer)
+{
+        uint64_t offset = hang->bo_offset[chunk->bo] + chunk->offset;
+
+        for (uint32_t i = 0; i * VC4_DUMP_ALIGN < chunk->size; i++) {
+                uint32_t page_offset = i * VC4_DUMP_ALIGN;
+                uint32_t size = MIN2(chunk->size - page_offset,
+                                     VC4_DUMP_ALIGN);
+
+                if (buffer->zero_pages[i / 32] & (1u << (i % 32))) {
+                        add_zero_range(hang, chunk->bo,
+                                       chunk->offset + page_offset, size);
+                } else {
+                        writer_skip_to(w, offset + page_offset);
+                        writer_add(w, buffer->data + page_offset, size);
+                }
+        }
+}
+
+/* Splits the BOs up into chunks, returning the most zero ranges they could
+ * have.
+ */
+static uint64_t
+make_chunks(struct capture *c)
+{
+        struct hang *hang = c->hang;
+        uint64_t max_zero_ranges = 0;
+
+        for (int i = 0; i < hang->bo_count; i++) {
+                uint32_t size = hang->bo_state[i].size;
+
+                c->chunk_count += ((size + CAPTURE_CHUNK_SIZE - 1) /
+                                   CAPTURE_CHUNK_SIZE);
+                max_zero_ranges += max_bo_zero_ranges(size);
+        }
 
-        hang->maps = calloc(hang->bo_count, sizeof(*hang->maps));
-        if (!hang->maps)
+        c->chunks = calloc(c->chunk_count, sizeof(*c->chunks));
+        if (!c->chunks)
                 err(1, "malloc failure");
 
+        uint32_t chunk = 0;
         for (int i = 0; i < hang->bo_count; i++) {
-                struct drm_vc4_mmap_bo map;
+                uint32_t size = hang->bo_state[i].size;
+
+                for (uint32_t offset = 0; offset < size;
+                     offset += CAPTURE_CHUNK_SIZE) {
+                        c->chunks[chunk++] = (struct capture_chunk) {
+                                .bo = i,
+                                .offset = offset,
+                                .size = MIN2(size - offset,
+                                             CAPTURE_CHUNK_SIZE),
+                        };
+                }
+        }
+
+        return max_zero_ranges;
+}
+
+/* Writes the dump without compression, copying the BOs out with threads
+ * and staging buffers of up to staging_size bytes.
+ *
+ * If the output can be seeked, the zero pages found on the way are left
+ * as holes, and the header and tables are written last, into space left
+ * for them at the start.  A pipe gets them first, without a zero table,
+ * and gets all of the zeroes.
+ */
+static void
+write_capture(struct writer *w, struct hang *hang, uint32_t threads,
+              uint64_t staging_size)
+{
+        struct capture c = {
+                .hang = hang,
+                .find_zeroes = w->seekable,
+                .buffer_count = MAX2(staging_size / CAPTURE_CHUNK_SIZE, 1),
+        };
+        pthread_t *thread_ids = calloc(threads, sizeof(*thread_ids));
+        uint64_t max_zero_ranges = make_chunks(&c);
+
+        c.buffers = calloc(c.buffer_count, sizeof(*c.buffers));
+        if (!thread_ids || !c.buffers)
+                err(1, "malloc failure");
+        for (uint32_t i = 0; i < c.buffer_count; i++)
+                c.buffers[i].data = alloc_staging();
+        pthread_mutex_init(&c.lock, NULL);
+        pthread_cond_init(&c.cond, NULL);
+
+        lay_out_image(hang, c.find_zeroes ? max_zero_ranges : 0);
+        if (c.find_zeroes) {
+                writer_skip_to(w, hang->metadata_reserved);
+        } else {
+                /* The BOs haven't been read yet, so only the metadata can
+                 * have a checksum.
+                 */
+                checksum_metadata(hang, VC4_DUMP_CRC_METADATA);
+                writer_add(w, hang->metadata, hang->metadata_size);
+        }
+
+        for (uint32_t i = 0; i < threads; i++) {
+                if (pthread_create(&thread_ids[i], NULL, capture_thread, &c))
+                        errx(1, "Couldn't start capture thread");
+        }
+
+        for (uint32_t i = 0; i < c.chunk_count; i++) {
+                struct staging_buffer *buffer =
+                        &c.buffers[i % c.buffer_count];
+
+                pthread_mutex_lock(&c.lock);
+                while (!buffer->done)
+                        pthread_cond_wait(&c.cond, &c.lock);
+                pthread_mutex_unlock(&c.lock);
+
+                write_chunk(w, hang, &c.chunks[i], buffer);
+                writer_flush(w);
+
+                /* Chunks are written in order, so this puts each BO's
+                 * checksum together a chunk at a time.
+                 */
+                const struct capture_chunk *chunk = &c.chunks[i];
+                if (chunk->offset) {
+                        hang->bo_crc[chunk->bo] =
+                                vc4_crc32c_combine(hang->bo_crc[chunk->bo],
+                                                   buffer->crc, chunk->size);
+                } else {
+                        hang->bo_crc[chunk->bo] = buffer->crc;
+                }
+
+                /* Pages handed to a pipe stay referenced by it, so the
+                 * buffer can't be reused.
+                 */
+                if (w->spliced) {
+                        munmap(buffer->data, CAPTURE_CHUNK_SIZE);
+                        buffer->data = alloc_staging();
+                }
+
+                pthread_mutex_lock(&c.lock);
+                buffer->done = false;
+                c.next_write++;
+                pthread_cond_broadcast(&c.cond);
+                pthread_mutex_unlock(&c.lock);
+        }
+
+        for (uint32_t i = 0; i < threads; i++)
+                pthread_join(thread_ids[i], NULL);
+
+        if (c.find_zeroes) {
+                /* Write the header and tables, and extend the file over
+                 * any zeroes at the end of the last BO.
+                 */
+                finish_metadata(hang);
+                w->pos = 0;
+                writer_add(w, hang->metadata, hang->metadata_size);
+                writer_flush(w);
+                if (ftruncate(w->fd, hang->image_size))
+                        err(1, "Couldn't size hang state file");
+        } else {
+                writer_skip_to(w, hang->image_size);
+                writer_flush(w);
+        }
+
+        for (uint32_t i = 0; i < c.buffer_count; i++)
+                munmap(c.buffers[i].data, CAPTURE_CHUNK_SIZE);
+        free(c.buffers);
+        free(c.chunks);
+        free(thread_ids);
+}
 
-                memset(&map, 0, sizeof(map));
-                map.handle = hang->bo_state[i].handle;
-                ret = ioctl(fd, DRM_IOCTL_VC4_MMAP_BO, &map);
-                if (ret) {
-                        err(1, "Couldn't get map offset for "
-                            "bo %d (handle %d)", i, hang->bo_state[i].handle);
+/* Copies the part of the dump's image at offset into data. */
+static void
+read_image(struct hang *hang, uint64_t offset, void *data, uint32_t size)
+{
+        uint64_t end = offset + size;
+        int lo = 0, hi = hang->bo_count;
+
+        memset(data, 0, size);
+
+        if (offset < hang->metadata_size) {
+                memcpy(data, hang->metadata + offset,
+                       MIN2(hang->metadata_size - offset, size));
+        }
+
+        /* Find the first BO that ends after offset. */
+        while (lo < hi) {
+                int mid = (lo + hi) / 2;
+
+                if (hang->bo_offset[mid] + hang->bo_state[mid].size <=
+                    offset) {
+                        lo = mid + 1;
+                } else {
+                        hi = mid;
                 }
+        }
 
-                hang->maps[i] = mmap(NULL, hang->bo_state[i].size,
-                                     PROT_READ, MAP_SHARED,
-                                     fd, map.offset);
+        for (int i = lo; i < hang->bo_count && hang->bo_offset[i] < end;
+             i++) {
+                uint64_t bo_start = MAX2(hang->bo_offset[i], offset);
+                uint64_t bo_end = MIN2(hang->bo_offset[i] +
+                                       hang->bo_state[i].size, end);
 
-                if (hang->maps[i] == MAP_FAILED) {
-                        err(1, "Failed to map BO %d (handle %d)",
-                            i, hang->bo_state[i].handle);
+                memcpy(data + (bo_start - offset),
+                       hang->maps[i] + (bo_start - hang->bo_offset[i]),
+                       bo_end - bo_start);
+        }
+}
+
+static bool
+is_zero(const void *data, uint32_t size)
+{
+        for (uint32_t i = 0; i < size; i += sizeof(zero_page)) {
+                if (memcmp(data + i, zero_page,
+                           MIN2(size - i, sizeof(zero_page))) != 0) {
+                        return false;
                 }
         }
+
+        return true;
 }
 
+/* Each compression thread can have this many blocks in flight, waiting for
+ * the blocks before them to be written out.
+ */
+#define COMPRESS_BLOCKS_PER_THREAD      4
+
+struct compressed_block {
+        bool done;
+        uint32_t type;
+        uint32_t size;
+        void *data;
+};
+
+struct compressor {
+        struct hang *hang;
+        int level;
+        uint32_t block_count;
+
+        pthread_mutex_t lock;
+        pthread_cond_t cond;
+        /* The next block for a thread to compress, and the next one to
+         * be written out.
+         */
+        uint32_t next_block;
+        uint32_t next_write;
+
+        /* Ring of the blocks after next_write. */
+        struct compressed_block *slots;
+        uint32_t slot_count;
+};
+
 static void
-write_hang_state(const char *filename, struct hang *hang)
+compress_block(struct compressor *c, uint32_t index, void *raw,
+               struct compressed_block *block)
 {
-        uint32_t data;
-        FILE *f;
+        uint64_t offset = (uint64_t)index * VC4_DUMP_BLOCK_SIZE;
+        uint32_t size = MIN2(c->hang->image_size - offset,
+                             VC4_DUMP_BLOCK_SIZE);
+        uLongf compressed_size = compressBound(VC4_DUMP_BLOCK_SIZE);
+
+        read_image(c->hang, offset, raw, size);
+
+        if (is_zero(raw, size)) {
+                block->type = VC4_DUMP_BLOCK_ZERO;
+                block->size = 0;
+        } else if (compress2(block->data, &compressed_size, raw, size,
+                             c->level) == Z_OK && compressed_size < size) {
+                block->type = VC4_DUMP_BLOCK_ZLIB;
+                block->size = compressed_size;
+        } else {
+                block->type = VC4_DUMP_BLOCK_RAW;
+                block->size = size;
+                memcpy(block->data, raw, size);
+        }
+}
+
+static void *
+compress_thread(void *data)
+{
+        struct compressor *c = data;
+        void *raw = malloc(VC4_DUMP_BLOCK_SIZE);
+
+        if (!raw)
+                err(1, "malloc failure");
+
+        pthread_mutex_lock(&c->lock);
+        while (c->next_block < c->block_count) {
+                uint32_t index = c->next_block;
+                struct compressed_block *block =
+                        &c->slots[index % c->slot_count];
+
+                /* Wait for the block's slot to be written out. */
+                if (index >= c->next_write + c->slot_count) {
+                        pthread_cond_wait(&c->cond, &c->lock);
+                        continue;
+                }
+                c->next_block++;
+                pthread_mutex_unlock(&c->lock);
+
+                compress_block(c, index, raw, block);
+
+                pthread_mutex_lock(&c->lock);
+                block->done = true;
+                pthread_cond_broadcast(&c->cond);
+        }
+        pthread_mutex_unlock(&c->lock);
+
+        free(raw);
+        return NULL;
+}
+
+/* Writes the dump as a compressed dump, with a thread per CPU compressing
+ * blocks while this one writes them out in order.
+ */
+static void
+write_compressed(struct writer *w, struct hang *hang, int level,
+                 uint32_t threads)
+{
+        struct compressor c = {
+                .hang = hang,
+                .level = level,
+                .block_count = ((hang->image_size + VC4_DUMP_BLOCK_SIZE - 1) /
+                                VC4_DUMP_BLOCK_SIZE),
+                .slot_count = threads * COMPRESS_BLOCKS_PER_THREAD,
+        };
+        struct vc4_dump_compressed_header header = {
+                .version = VC4_DUMP_VERSION_COMPRESSED,
+                .header_size = sizeof(header),
+                .block_size = VC4_DUMP_BLOCK_SIZE,
+                .block_count = c.block_count,
+                .image_size = hang->image_size,
+        };
+        struct vc4_dump_block *table = calloc(c.block_count, sizeof(*table));
+        pthread_t *thread_ids = calloc(threads, sizeof(*thread_ids));
+        c.slots = calloc(c.slot_count, sizeof(*c.slots));
+        if (!table || !thread_ids || !c.slots)
+                err(1, "malloc failure");
+        for (uint32_t i = 0; i < c.slot_count; i++) {
+                c.slots[i].data = malloc(compressBound(VC4_DUMP_BLOCK_SIZE));
+                if (!c.slots[i].data)
+                        err(1, "malloc failure");
+        }
+        pthread_mutex_init(&c.lock, NULL);
+        pthread_cond_init(&c.cond, NULL);
+
+        for (uint32_t i = 0; i < threads; i++) {
+                if (pthread_create(&thread_ids[i], NULL, compress_thread, &c))
+                        errx(1, "Couldn't start compression thread");
+        }
+
+        /* The compressed blocks' slots get reused as soon as they're
+         * written, so they can't be left referenced by a pipe.
+         */
+        w->splice = false;
+        writer_add(w, &header, sizeof(header));
+
+        for (uint32_t i = 0; i < c.block_count; i++) {
+                struct compressed_block *block = &c.slots[i % c.slot_count];
+
+                pthread_mutex_lock(&c.lock);
+                while (!block->done)
+                        pthread_cond_wait(&c.cond, &c.lock);
+                pthread_mutex_unlock(&c.lock);
+
+                table[i].offset = writer_offset(w);
+                table[i].size = block->size;
+                table[i].type = block->type;
+                writer_add(w, block->data, block->size);
+                writer_flush(w);
+
+                pthread_mutex_lock(&c.lock);
+                block->done = false;
+                c.next_write++;
+                pthread_cond_broadcast(&c.cond);
+                pthread_mutex_unlock(&c.lock);
+        }
+
+        for (uint32_t i = 0; i < threads; i++)
+                pthread_join(thread_ids[i], NULL);
+
+        writer_add(w, table, (size_t)c.block_count * sizeof(*table));
+        writer_flush(w);
+
+        for (uint32_t i = 0; i < c.slot_count; i++)
+                free(c.slots[i].data);
+        free(c.slots);
+        free(thread_ids);
+        free(table);
+}
+
+static double
+elapsed_ms(const struct timespec *start)
+{
+        struct timespec now;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return ((now.tv_sec - start->tv_sec) * 1000.0 +
+                (now.tv_nsec - start->tv_nsec) / 1000000.0);
+}
+
+struct options {
+        bool compress;
+        int level;
+        uint32_t threads;
+        uint64_t staging_size;
+        bool reachable;
+        uint64_t max_bytes;
+        const char *fake_device;
+};
+
+static void
+write_hang_state(const char *filename, struct hang *hang,
+                 const struct options *options,
+                 const struct timespec *capture_start)
+{
+        struct timespec write_start;
+        struct writer w;
+        int fd;
 
         if (strcmp(filename, "-") == 0)
-                f = stdout;
+                fd = STDOUT_FILENO;
         else
-                f = fopen(filename, "w+");
-        if (!f)
+                fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd == -1)
                 err(1, "Couldn't open %s for writing", filename);
 
-        /* Version */
-        data = 0;
-        fwrite(&data, sizeof(data), 1, f);
+        hang->bo_crc = calloc(hang->bo_count, sizeof(*hang->bo_crc));
+        if (!hang->bo_crc && hang->bo_count)
+                err(1, "malloc failure");
 
-        fwrite(hang->get_state, sizeof(*hang->get_state), 1, f);
+        clock_gettime(CLOCK_MONOTONIC, &write_start);
+        writer_init(&w, fd);
 
-        fwrite(hang->bo_state, sizeof(*hang->bo_state), hang->bo_count, f);
+        if (options->compress) {
+                map_bos(hang);
+                find_zero_ranges(hang);
+                lay_out_image(hang, hang->zero_range_count);
+                finish_metadata(hang);
+                write_compressed(&w, hang, options->level,
+                                 options->threads);
+        } else {
+                write_capture(&w, hang, options->threads,
+                              options->staging_size);
+        }
 
-        for (int i = 0; i < hang->bo_count; i++)
-                fwrite(hang->maps[i], hang->bo_state[i].size, 1, f);
+        if (fd != STDOUT_FILENO && close(fd))
+                err(1, "Error writing hang state file");
 
-        if (ferror(f))
-                errx(1, "Error writing hang state file\n");
+        double write_ms = elapsed_ms(&write_start);
+        fprintf(stderr, "Wrote %"PRIu64" bytes in %.1f ms (%.1f MB/s), "
+                "%.1f ms after the capture started\n",
+                w.written, write_ms,
+                write_ms ? w.written / write_ms / 1000.0 : 0.0,
+                elapsed_ms(capture_start));
+}
 
-        fclose(f);
+/* Captures the current hang to filename, returning false if there isn't
+ * one.
+ */
+static bool
+capture_hang(int fd, const struct options *options, const char *filename)
+{
+        struct timespec capture_start;
+        struct hang hang;
+        bool found;
+
+        memset(&hang, 0, sizeof(hang));
+        hang.fd = fd;
+        clock_gettime(CLOCK_MONOTONIC, &capture_start);
+
+        if (options->fake_device)
+                found = get_fake_hang_state(options->fake_device, &hang);
+        else
+                found = get_hang_state(&hang);
+        if (!found)
+                return false;
+
+        hang.maps = calloc(hang.bo_count, sizeof(*hang.maps));
+        if (!hang.maps)
+                err(1, "malloc failure");
+
+        if (options->reachable)
+                prune_unreachable(&hang);
+        if (options->max_bytes) {
+                fit_max_bytes(&hang, options->max_bytes,
+                              options->compress);
+        }
+
+        write_hang_state(filename, &hang, options, &capture_start);
+        free_hang(&hang);
+
+        return true;
+}
+
+#define RING_PREFIX             "vc4-hang-"
+#define RING_SUFFIX             ".dump"
+#define DEFAULT_RING_MB         256
+#define DEFAULT_INTERVAL_MS     1000
+
+struct ring_dump {
+        unsigned long long seq;
+        uint64_t size;
+};
+
+static int
+compare_ring_dumps(const void *a, const void *b)
+{
+        const struct ring_dump *da = a, *db = b;
+
+        if (da->seq != db->seq)
+                return da->seq < db->seq ? -1 : 1;
+        return 0;
+}
+
+static char *
+ring_path(const char *dir, unsigned long long seq)
+{
+        char *path;
+
+        if (asprintf(&path, "%s/" RING_PREFIX "%06llu" RING_SUFFIX,
+                     dir, seq) == -1) {
+                err(1, "malloc failure");
+        }
+        return path;
+}
+
+/* Lists the dumps in the ring, oldest first. */
+static uint32_t
+list_ring(const char *dir, struct ring_dump **dumps)
+{
+        DIR *d = opendir(dir);
+        struct dirent *entry;
+        uint32_t count = 0, allocated = 0;
+
+        if (!d)
+                err(1, "Couldn't open %s", dir);
+
+        *dumps = NULL;
+        while ((entry = readdir(d))) {
+                const char *name = entry->d_name;
+                unsigned long long seq;
+                char *end, *path;
+                struct stat st;
+
+                if (strncmp(name, RING_PREFIX, strlen(RING_PREFIX)) != 0)
+                        continue;
+                seq = strtoull(name + strlen(RING_PREFIX), &end, 10);
+                if (end == name + strlen(RING_PREFIX) ||
+                    strcmp(end, RING_SUFFIX) != 0) {
+                        continue;
+                }
+
+                path = ring_path(dir, seq);
+                if (stat(path, &st) || !S_ISREG(st.st_mode)) {
+                        free(path);
+                        continue;
+                }
+                free(path);
+
+                if (count == allocated) {
+                        allocated = allocated ? allocated * 2 : 16;
+                        *dumps = realloc(*dumps,
+                                         allocated * sizeof(**dumps));
+                        if (!*dumps)
+                                err(1, "malloc failure");
+                }
+                (*dumps)[count++] = (struct ring_dump) {
+                        .seq = seq,
+                        .size = st.st_size,
+                };
+        }
+        closedir(d);
+
+        qsort(*dumps, count, sizeof(**dumps), compare_ring_dumps);
+
+        return count;
+}
+
+/* Removes the oldest dumps until the ring fits in ring_bytes, always keeping
+ * the newest one, and returns the sequence number of the newest.
+ */
+static unsigned long long
+trim_ring(const char *dir, uint64_t ring_bytes)
+{
+        struct ring_dump *dumps;
+        uint32_t count = list_ring(dir, &dumps);
+        unsigned long long last_seq = count ? dumps[count - 1].seq : 0;
+        uint64_t total = 0;
+
+        for (uint32_t i = 0; i < count; i++)
+                total += dumps[i].size;
+
+        for (uint32_t i = 0; i + 1 < count && total > ring_bytes; i++) {
+                char *path = ring_path(dir, dumps[i].seq);
+
+                if (unlink(path))
+                        err(1, "Couldn't remove %s", path);
+                fprintf(stderr, "Removed %s to stay under %"PRIu64
+                        " bytes\n", path, ring_bytes);
+                total -= dumps[i].size;
+                free(path);
+        }
+
+        free(dumps);
+
+        return last_seq;
+}
+
+/* Polls for hangs every interval_ms and captures each one into the ring of
+ * dumps in dir, removing the oldest ones to keep the ring under ring_bytes.
+ *
+ * Each hang is written to a hidden file and renamed into place once it's
+ * complete, so anything picking up dumps from the ring never sees a partial
+ * one.  Between hangs, all the daemon does is one get hang state ioctl per
+ * interval.
+ */
+static void
+run_daemon(int fd, const struct options *options, const char *dir,
+           uint32_t interval_ms, uint64_t ring_bytes)
+{
+        const struct timespec interval = {
+                .tv_sec = interval_ms / 1000,
+                .tv_nsec = (interval_ms % 1000) * 1000000l,
+        };
+        struct options dump_options = *options;
+        unsigned long long seq = trim_ring(dir, ring_bytes);
+        char *tmp_path;
+
+        if (asprintf(&tmp_path, "%s/.vc4-hang.tmp", dir) == -1)
+                err(1, "malloc failure");
+
+        /* A single dump can't be bigger than the whole ring. */
+        if (!dump_options.max_bytes || dump_options.max_bytes > ring_bytes)
+                dump_options.max_bytes = ring_bytes;
+
+        while (true) {
+                if (!capture_hang(fd, &dump_options, tmp_path)) {
+                        nanosleep(&interval, NULL);
+                        continue;
+                }
+
+                char *path = ring_path(dir, ++seq);
+                if (rename(tmp_path, path))
+                        err(1, "Couldn't rename %s to %s", tmp_path, path);
+                fprintf(stderr, "Captured hang to %s\n", path);
+                free(path);
+
+                trim_ring(dir, ring_bytes);
+        }
 }
 
 static void
 usage(const char *name)
 {
-        fprintf(stderr, "Usage: %s hang_file\n", name);
+        fprintf(stderr, "Usage: %s [--compress[=LEVEL]] [--threads=N]\n"
+                "       [--staging=MB] [--fake-device=DUMP] [--reachable]\n"
+                "       [--max-bytes=N] hang_file\n"
+                "       %s [options] --daemon=DIR [--interval=MS]\n"
+                "       [--ring-bytes=N]\n", name, name);
         exit(1);
 }
 
 int
 main(int argc, char **argv)
 {
-        int fd;
-        struct hang hang;
+        static const struct option long_options[] = {
+                { "compress", optional_argument, NULL, 'z' },
+                { "threads", required_argument, NULL, 't' },
+                { "staging", required_argument, NULL, 's' },
+                { "fake-device", required_argument, NULL, 'f' },
+                { "reachable", no_argument, NULL, 'r' },
+                { "max-bytes", required_argument, NULL, 'm' },
+                { "daemon", required_argument, NULL, 'd' },
+                { "interval", required_argument, NULL, 'i' },
+                { "ring-bytes", required_argument, NULL, 'b' },
+                { NULL, 0, NULL, 0 },
+        };
+        struct options options = {
+                .level = Z_DEFAULT_COMPRESSION,
+                .staging_size = (uint64_t)DEFAULT_STAGING_MB << 20,
+        };
+        long threads = sysconf(_SC_NPROCESSORS_ONLN);
+        unsigned long staging_mb;
+        const char *daemon_dir = NULL;
+        unsigned long interval_ms = DEFAULT_INTERVAL_MS;
+        uint64_t ring_bytes = (uint64_t)DEFAULT_RING_MB << 20;
+        char *end;
+        int fd = -1;
+        int c;
 
-        if (argc != 2)
+        while ((c = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+                switch (c) {
+                case 'z':
+                        options.compress = true;
+                        if (optarg) {
+                                options.level = strtol(optarg, &end, 0);
+                                if (*end || !*optarg || options.level < 0 ||
+                                    options.level > 9) {
+                                        usage(argv[0]);
+                                }
+                        }
+                        break;
+                case 't':
+                        threads = strtol(optarg, &end, 0);
+                        if (*end || !*optarg || threads < 1)
+                                usage(argv[0]);
+                        break;
+                case 's':
+                        staging_mb = strtoul(optarg, &end, 0);
+                        if (*end || !*optarg || staging_mb < 1)
+                                usage(argv[0]);
+                        options.staging_size = (uint64_t)staging_mb << 20;
+                        break;
+                case 'f':
+                        options.fake_device = optarg;
+                        break;
+                case 'r':
+                        options.reachable = true;
+                        break;
+                case 'm':
+                        options.max_bytes = strtoull(optarg, &end, 0);
+                        if (*end || !*optarg || !options.max_bytes)
+                                usage(argv[0]);
+                        break;
+                case 'd':
+                        daemon_dir = optarg;
+                        break;
+                case 'i':
+                        interval_ms = strtoul(optarg, &end, 0);
+                        if (*end || !*optarg || interval_ms < 1)
+                                usage(argv[0]);
+                        break;
+                case 'b':
+                        ring_bytes = strtoull(optarg, &end, 0);
+                        if (*end || !*optarg || !ring_bytes)
+                                usage(argv[0]);
+                        break;
+                default:
+                        usage(argv[0]);
+                }
+        }
+
+        if (optind != argc - (daemon_dir ? 0 : 1))
                 usage(argv[0]);
+        options.threads = threads < 1 ? 1 : threads;
 
-        memset(&hang, 0, sizeof(hang));
+        if (!options.fake_device) {
+                fd = drmOpen("vc4", NULL);
+                if (fd == -1)
+                        err(1, "couldn't open DRM node");
+        }
 
-        fd = drmOpen("vc4", NULL);
-        if (fd == -1)
-                err(1, "couldn't open DRM node");
+        if (daemon_dir) {
+                struct stat st;
+
+                /* A single fake dump would be a hang that never goes
+                 * away, and get captured over and over.
+                 */
+                if (options.fake_device &&
+                    (stat(options.fake_device, &st) ||
+                     !S_ISDIR(st.st_mode))) {
+                        errx(1, "--fake-device=%s must be a directory of "
+                             "dumps with --daemon", options.fake_device);
+                }
+                run_daemon(fd, &options, daemon_dir, interval_ms,
+                           ring_bytes);
+        }
 
-        get_hang_state(fd, &hang);
-        map_bos(fd, &hang);
-        write_hang_state(argv[1], &hang);
+        if (!capture_hang(fd, &options, argv[optind]))
+                fprintf(stdout, "No hang state recorded\n");
 
         return 0;
 }
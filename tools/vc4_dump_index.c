@@ -0,0 +1,746 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/** @file vc4_dump_index.c
+ *
+ * Building, writing and loading the sidecar index described in
+ * vc4_dump_index.h, and the parts of the parse phases that work from it.
+ *
+ * The index is built by walking the dump in a context of its own, the
+ * same way vc4_dump_print() does with no range, with a renderer that keeps
+ * every CL's items.  The parse phases can then skip decoding a CL whose
+ * items are in the index, as long as they'd have decoded it the same way
+ * from the same address.
+ */
+
+/* For asprintf(). */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <err.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "vc4_tools.h"
+#include "vc4_crc32c.h"
+#include "vc4_dump_file.h"
+#include "vc4_dump_index.h"
+#include "vc4_dump_parse.h"
+#include "vc4_packet.h"
+
+/* Where the CL items recorded during the walk went, by CL table entry. */
+struct index_builder_cl {
+        uint32_t first_item;
+        uint32_t item_count;
+        bool decoded;
+};
+
+struct index_builder {
+        struct vc4_dump_ctx *ctx;
+
+        struct vc4_cl_item *items;
+        uint32_t item_count;
+        uint32_t item_size;
+
+        struct index_builder_cl *cls;
+        uint32_t cl_size;
+};
+
+static uint32_t
+index_cl_entry(uint32_t cl)
+{
+        switch (cl) {
+        case VC4_CL_BIN:
+                return VC4_INDEX_CL_BIN_ENTRY;
+        case VC4_CL_RENDER:
+                return VC4_INDEX_CL_RENDER_ENTRY;
+        case VC4_CL_NONE:
+                return VC4_INDEX_NONE;
+        default:
+                return cl + 2;
+        }
+}
+
+static void
+record_cl(void *data, const struct vc4_cl_ir *ir)
+{
+        struct index_builder *builder = data;
+        uint32_t entry = index_cl_entry(builder->ctx->cl_current);
+
+        if (entry >= builder->cl_size) {
+                uint32_t old_size = builder->cl_size;
+
+                builder->cl_size = MAX2(entry + 1, old_size * 2);
+                builder->cls = realloc(builder->cls, builder->cl_size *
+                                       sizeof(*builder->cls));
+                if (!builder->cls)
+                        err(1, "malloc failure");
+                memset(builder->cls + old_size, 0,
+                       (builder->cl_size - old_size) * sizeof(*builder->cls));
+        }
+
+        if (builder->item_count + ir->count > builder->item_size) {
+                builder->item_size = MAX2(builder->item_count + ir->count,
+                                          builder->item_size * 2);
+                builder->items = realloc(builder->items, builder->item_size *
+                                         sizeof(*builder->items));
+                if (!builder->items)
+                        err(1, "malloc failure");
+        }
+
+        builder->cls[entry].first_item = builder->item_count;
+        builder->cls[entry].item_count = ir->count;
+        builder->cls[entry].decoded = true;
+
+        memcpy(builder->items + builder->item_count, ir->items,
+               ir->count * sizeof(*ir->items));
+        builder->item_count += ir->count;
+}
+
+/* Returns the table entry of the mem area a decoder link points at, plus
+ * one, given the bucket it's in.
+ */
+static uint32_t
+index_link(struct vc4_dump_ctx *ctx, uint32_t handle,
+           enum vc4_mem_area_bucket bucket)
+{
+        struct vc4_mem_area_rec *rec = vc4_parse_mem_area(ctx, handle);
+        uint32_t entry = rec - ctx->mem_areas[bucket].recs;
+
+        if (bucket == VC4_MEM_AREA_BUCKET_CL)
+                entry = index_cl_entry(entry);
+
+        return entry + 1;
+}
+
+static void
+fill_cls(struct index_builder *builder, struct vc4_index_cl *cls)
+{
+        struct vc4_dump_ctx *ctx = builder->ctx;
+        struct vc4_mem_area_list *list =
+                &ctx->mem_areas[VC4_MEM_AREA_BUCKET_CL];
+
+        for (int i = 0; i < 2; i++) {
+                cls[i].type = i ? VC4_INDEX_CL_RENDER : VC4_INDEX_CL_BIN;
+                cls[i].paddr = ctx->root_cls[i].start;
+                cls[i].decoded_end = ctx->root_cls[i].end;
+                cls[i].parent = VC4_INDEX_NONE;
+                cls[i].prim_mode = ~0;
+        }
+
+        for (uint32_t i = 0; i < list->count; i++) {
+                struct vc4_mem_area_rec *rec = &list->recs[i];
+                struct vc4_index_cl *cl = &cls[i + 2];
+
+                cl->type = (rec->type == VC4_MEM_AREA_SUB_LIST ?
+                            VC4_INDEX_CL_SUB_LIST :
+                            VC4_INDEX_CL_COMPRESSED_LIST);
+                cl->paddr = rec->paddr;
+                cl->decoded_end = rec->decoded_end;
+                cl->parent = index_cl_entry(rec->parent);
+                cl->prim_mode = rec->prim_mode;
+        }
+
+        for (uint32_t i = 0; i < MIN2(builder->cl_size, list->count + 2);
+             i++) {
+                cls[i].first_item = builder->cls[i].first_item;
+                cls[i].item_count = builder->cls[i].item_count;
+                cls[i].decoded = builder->cls[i].decoded;
+        }
+}
+
+static void
+fill_items(struct index_builder *builder, struct vc4_cl_item *items,
+           uint32_t *opcode_counts)
+{
+        struct vc4_dump_ctx *ctx = builder->ctx;
+
+        memcpy(items, builder->items,
+               builder->item_count * sizeof(*builder->items));
+
+        for (uint32_t i = 0; i < builder->item_count; i++) {
+                struct vc4_cl_item *item = &items[i];
+
+                if (item->kind == VC4_CL_ITEM_PACKET ||
+                    item->kind == VC4_CL_ITEM_RAW_PACKET) {
+                        opcode_counts[item->opcode]++;
+                }
+
+                if (!item->link)
+                        continue;
+
+                enum vc4_mem_area_bucket bucket = VC4_MEM_AREA_BUCKET_CL;
+                if (item->kind == VC4_CL_ITEM_PACKET &&
+                    (item->opcode == VC4_PACKET_GL_SHADER_STATE ||
+                     item->opcode == VC4_PACKET_NV_SHADER_STATE)) {
+                        bucket = VC4_MEM_AREA_BUCKET_SHADER_REC;
+                }
+                item->link = index_link(ctx, item->link, bucket);
+        }
+}
+
+static void
+fill_shader_recs(struct vc4_dump_ctx *ctx, struct vc4_index_shader_rec *recs)
+{
+        static const struct {
+                enum vc4_mem_area_type type;
+                uint32_t offset;
+        } shaders[] = {
+                [VC4_INDEX_SHADER_FS] = { VC4_MEM_AREA_FS, 4 },
+                [VC4_INDEX_SHADER_VS] = { VC4_MEM_AREA_VS, 16 },
+                [VC4_INDEX_SHADER_CS] = { VC4_MEM_AREA_CS, 28 },
+        };
+        struct vc4_mem_area_list *list =
+                &ctx->mem_areas[VC4_MEM_AREA_BUCKET_SHADER_REC];
+        struct vc4_mem_area_list *shader_list =
+                &ctx->mem_areas[VC4_MEM_AREA_BUCKET_SHADER];
+
+        for (uint32_t i = 0; i < list->count; i++) {
+                struct vc4_mem_area_rec *rec = &list->recs[i];
+                struct vc4_index_shader_rec *entry = &recs[i];
+
+                entry->paddr = rec->paddr;
+                entry->size = rec->size;
+                entry->gl = rec->type == VC4_MEM_AREA_GL_SHADER_REC;
+                entry->extended = rec->extended;
+                entry->attributes = rec->attributes;
+                entry->mapped = rec->addr;
+                if (!rec->addr)
+                        continue;
+
+                /* The walk already queued these, so this just finds them
+                 * again.
+                 */
+                for (int s = 0; s < (entry->gl ? 3 : 1); s++) {
+                        if (rec->size < shaders[s].offset + sizeof(uint32_t))
+                                break;
+
+                        uint32_t paddr =
+                                *(uint32_t *)(rec->addr + shaders[s].offset);
+                        struct vc4_mem_area_rec *shader =
+                                vc4_parse_add_mem_area(ctx, shaders[s].type,
+                                                       paddr);
+
+                        entry->shaders[s] = shader - shader_list->recs + 1;
+                }
+        }
+}
+
+static void
+fill_shaders(struct vc4_dump_ctx *ctx, struct vc4_index_shader *shaders)
+{
+        struct vc4_mem_area_list *list =
+                &ctx->mem_areas[VC4_MEM_AREA_BUCKET_SHADER];
+
+        for (uint32_t i = 0; i < list->count; i++) {
+                struct vc4_mem_area_rec *rec = &list->recs[i];
+                struct vc4_index_shader *shader = &shaders[i];
+                bool prog_end;
+
+                shader->paddr = rec->paddr;
+                switch (rec->type) {
+                case VC4_MEM_AREA_VS:
+                        shader->type = VC4_INDEX_SHADER_VS;
+                        break;
+                case VC4_MEM_AREA_CS:
+                        shader->type = VC4_INDEX_SHADER_CS;
+                        break;
+                default:
+                        shader->type = VC4_INDEX_SHADER_FS;
+                        break;
+                }
+                if (!rec->addr)
+                        continue;
+                shader->flags |= VC4_INDEX_SHADER_MAPPED;
+
+                shader->size = vc4_parse_shader_size(rec, &prog_end);
+                if (prog_end)
+                        shader->flags |= VC4_INDEX_SHADER_PROG_END;
+                shader->hash = vc4_crc32c(0, rec->addr, shader->size);
+        }
+}
+
+static uint64_t
+table_offset(uint64_t *offset, uint32_t count, size_t entry_size)
+{
+        uint64_t start = (*offset + 7) & ~(uint64_t)7;
+
+        *offset = start + (uint64_t)count * entry_size;
+
+        return start;
+}
+
+/* Points the index's tables into its data, as laid out by its header. */
+static void
+index_set_tables(struct vc4_dump_index *index)
+{
+        const struct vc4_index_header *header = index->data;
+
+        index->header = header;
+        index->cls = index->data + header->cl_offset;
+        index->items = index->data + header->item_offset;
+        index->shader_recs = index->data + header->shader_rec_offset;
+        index->shaders = index->data + header->shader_offset;
+}
+
+/**
+ * Fills in the fields of the index header that say which dump it's for,
+ * returning false if the dump's file can't be stat()ed.
+ */
+static bool
+index_stamp(struct vc4_dump_file *file, struct vc4_index_header *header)
+{
+        struct stat stat;
+
+        if (fstat(file->fd, &stat))
+                return false;
+
+        header->dump_size = stat.st_size;
+        header->dump_ino = stat.st_ino;
+        header->dump_mtime_sec = stat.st_mtim.tv_sec;
+        header->dump_mtime_nsec = stat.st_mtim.tv_nsec;
+        if (file->crc_flags & VC4_DUMP_CRC_METADATA)
+                header->dump_metadata_crc = file->metadata_crc;
+        else
+                header->dump_metadata_crc = 0;
+
+        return true;
+}
+
+static bool
+index_stamp_matches(const struct vc4_index_header *a,
+                    const struct vc4_index_header *b)
+{
+        return (a->dump_size == b->dump_size &&
+                a->dump_ino == b->dump_ino &&
+                a->dump_mtime_sec == b->dump_mtime_sec &&
+                a->dump_mtime_nsec == b->dump_mtime_nsec &&
+                a->dump_metadata_crc == b->dump_metadata_crc);
+}
+
+/**
+ * Walks the dump in filename from scratch and returns its index, with the
+ * dump fields of its header from stamp.
+ */
+static struct vc4_dump_index *
+index_build(const char *filename, const struct vc4_index_header *stamp)
+{
+        struct vc4_dump_ctx *ctx = vc4_dump_ctx_open(filename);
+        struct index_builder builder = { .ctx = ctx };
+        struct vc4_cl_renderer renderer = { record_cl, &builder };
+        struct vc4_dump_index *index = calloc(1, sizeof(*index));
+        struct vc4_index_header header = {
+                .magic = VC4_INDEX_MAGIC,
+                .version = VC4_INDEX_VERSION,
+                .header_size = sizeof(header),
+                .cl_entry_size = sizeof(struct vc4_index_cl),
+                .item_entry_size = sizeof(struct vc4_cl_item),
+                .shader_rec_entry_size = sizeof(struct vc4_index_shader_rec),
+                .shader_entry_size = sizeof(struct vc4_index_shader),
+                .dump_size = stamp->dump_size,
+                .dump_ino = stamp->dump_ino,
+                .dump_mtime_sec = stamp->dump_mtime_sec,
+                .dump_mtime_nsec = stamp->dump_mtime_nsec,
+                .dump_metadata_crc = stamp->dump_metadata_crc,
+        };
+        uint64_t offset = sizeof(header);
+
+        if (!index)
+                err(1, "malloc failure");
+
+        /* Leave an unreadable dump to the full walk that the caller falls
+         * back to, which reports it.
+         */
+        if (!vc4_dump_ctx_error(ctx)) {
+                ctx->quiet = true;
+                vc4_dump_walk(ctx, &renderer);
+        }
+        if (vc4_dump_ctx_error(ctx)) {
+                free(builder.items);
+                free(builder.cls);
+                free(index);
+                vc4_dump_ctx_close(ctx);
+                return NULL;
+        }
+
+        header.cl_count = ctx->mem_areas[VC4_MEM_AREA_BUCKET_CL].count + 2;
+        header.item_count = builder.item_count;
+        header.shader_rec_count =
+                ctx->mem_areas[VC4_MEM_AREA_BUCKET_SHADER_REC].count;
+        header.shader_count = ctx->mem_areas[VC4_MEM_AREA_BUCKET_SHADER].count;
+
+        header.cl_offset = table_offset(&offset, header.cl_count,
+                                        header.cl_entry_size);
+        header.item_offset = table_offset(&offset, header.item_count,
+                                          header.item_entry_size);
+        header.shader_rec_offset =
+                table_offset(&offset, header.shader_rec_count,
+                             header.shader_rec_entry_size);
+        header.shader_offset = table_offset(&offset, header.shader_count,
+                                            header.shader_entry_size);
+
+        index->size = offset;
+        index->data = calloc(1, index->size);
+        if (!index->data)
+                err(1, "malloc failure");
+
+        struct vc4_index_header *data_header = index->data;
+        *data_header = header;
+        index_set_tables(index);
+
+        fill_cls(&builder, (void *)index->cls);
+        fill_items(&builder, (void *)index->items,
+                   data_header->opcode_counts);
+        fill_shader_recs(ctx, (void *)index->shader_recs);
+        fill_shaders(ctx, (void *)index->shaders);
+
+        free(builder.items);
+        free(builder.cls);
+        vc4_dump_ctx_close(ctx);
+
+        return index;
+}
+
+static bool
+table_fits(const struct vc4_dump_index *index, uint64_t offset,
+           uint32_t count, uint32_t entry_size)
+{
+        return (offset % 8 == 0 &&
+                offset <= index->size &&
+                (uint64_t)count * entry_size <= index->size - offset);
+}
+
+/**
+ * Checks that the CL and shader rec entries only point at others that are
+ * in the index.
+ *
+ * The items' links don't get checked, since that would read the whole
+ * index on every load, so anything following them has to.
+ */
+static bool
+index_tables_valid(const struct vc4_dump_index *index)
+{
+        const struct vc4_index_header *header = index->header;
+
+        if (header->cl_count < 2)
+                return false;
+
+        for (uint32_t i = 0; i < header->cl_count; i++) {
+                const struct vc4_index_cl *cl = &index->cls[i];
+
+                if (cl->first_item > header->item_count ||
+                    cl->item_count > header->item_count - cl->first_item ||
+                    (cl->parent != VC4_INDEX_NONE &&
+                     cl->parent >= header->cl_count)) {
+                        return false;
+                }
+        }
+
+        for (uint32_t i = 0; i < header->shader_rec_count; i++) {
+                for (int s = 0; s < 3; s++) {
+                        if (index->shader_recs[i].shaders[s] >
+                            header->shader_count) {
+                                return false;
+                        }
+                }
+        }
+
+        return true;
+}
+
+/**
+ * Maps the index at path, returning NULL if there isn't one, or if it
+ * isn't for the dump that stamp is from.
+ */
+static struct vc4_dump_index *
+index_load(const char *path, const struct vc4_index_header *stamp)
+{
+        struct vc4_dump_index index = { .mapped = true };
+        const struct vc4_index_header *header;
+        struct stat stat;
+        int fd;
+
+        fd = open(path, O_RDONLY);
+        if (fd == -1)
+                return NULL;
+
+        if (fstat(fd, &stat) || stat.st_size < sizeof(*header)) {
+                close(fd);
+                return NULL;
+        }
+
+        index.size = stat.st_size;
+        index.data = mmap(NULL, index.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (index.data == MAP_FAILED)
+                return NULL;
+
+        header = index.data;
+        if (header->magic != VC4_INDEX_MAGIC ||
+            header->version != VC4_INDEX_VERSION ||
+            header->header_size != sizeof(*header) ||
+            header->cl_entry_size != sizeof(struct vc4_index_cl) ||
+            header->item_entry_size != sizeof(struct vc4_cl_item) ||
+            header->shader_rec_entry_size !=
+            sizeof(struct vc4_index_shader_rec) ||
+            header->shader_entry_size != sizeof(struct vc4_index_shader) ||
+            !index_stamp_matches(header, stamp) ||
+            !table_fits(&index, header->cl_offset, header->cl_count,
+                        header->cl_entry_size) ||
+            !table_fits(&index, header->item_offset, header->item_count,
+                        header->item_entry_size) ||
+            !table_fits(&index, header->shader_rec_offset,
+                        header->shader_rec_count,
+                        header->shader_rec_entry_size) ||
+            !table_fits(&index, header->shader_offset, header->shader_count,
+                        header->shader_entry_size)) {
+                munmap(index.data, index.size);
+                return NULL;
+        }
+
+        index_set_tables(&index);
+        if (!index_tables_valid(&index)) {
+                munmap(index.data, index.size);
+                return NULL;
+        }
+
+        struct vc4_dump_index *copy = malloc(sizeof(*copy));
+        if (!copy)
+                err(1, "malloc failure");
+        *copy = index;
+
+        return copy;
+}
+
+/**
+ * Writes the index to path, replacing any that's there in one step so
+ * that other readers never see half of one.  It gets the same permissions
+ * as the dump, whose file is dump_fd.
+ *
+ * The index is only a cache, so failing to write it is left quiet, as for
+ * a dump in a directory that we can't write to.
+ */
+static void
+index_write(const struct vc4_dump_index *index, const char *path,
+            int dump_fd)
+{
+        char *tmp_path;
+        struct stat stat;
+        size_t done = 0;
+        int fd;
+
+        if (asprintf(&tmp_path, "%s.XXXXXX", path) == -1)
+                err(1, "malloc failure");
+
+        fd = mkstemp(tmp_path);
+        if (fd == -1) {
+                free(tmp_path);
+                return;
+        }
+
+        if (!fstat(dump_fd, &stat))
+                fchmod(fd, stat.st_mode & 0666);
+
+        while (done < index->size) {
+                ssize_t ret = write(fd, index->data + done,
+                                    index->size - done);
+
+                if (ret <= 0)
+                        break;
+                done += ret;
+        }
+
+        if (close(fd) || done != index->size || rename(tmp_path, path))
+                unlink(tmp_path);
+
+        free(tmp_path);
+}
+
+void
+vc4_dump_index_free(struct vc4_dump_index *index)
+{
+        if (index->mapped)
+                munmap(index->data, index->size);
+        else
+                free(index->data);
+        free(index);
+}
+
+/**
+ * Gets the dump's index from its sidecar file, or if that's missing or out
+ * of date, builds it and maybe writes the file as mode says, and has the
+ * parse phases use it from then on.
+ *
+ * Returns NULL for a context that isn't on a dump file, if the dump
+ * couldn't be read through, or for VC4_INDEX_LOAD if there was no index to
+ * load.
+ */
+const struct vc4_dump_index *
+vc4_dump_ctx_use_index(struct vc4_dump_ctx *ctx, enum vc4_index_mode mode)
+{
+        struct vc4_index_header stamp;
+        char *path;
+
+        if (ctx->index || !ctx->file || ctx->file->error ||
+            !index_stamp(ctx->file, &stamp)) {
+                return ctx->index;
+        }
+
+        if (asprintf(&path, "%s" VC4_INDEX_SUFFIX, ctx->filename) == -1)
+                err(1, "malloc failure");
+
+        ctx->index = index_load(path, &stamp);
+        if (!ctx->index && mode != VC4_INDEX_LOAD) {
+                ctx->index = index_build(ctx->filename, &stamp);
+                if (ctx->index && mode == VC4_INDEX_SAVE)
+                        index_write(ctx->index, path, ctx->file->fd);
+        }
+
+        free(path);
+
+        return ctx->index;
+}
+
+/**
+ * Returns the index of the item in cl containing addr, cl->item_count if
+ * addr is just past the last byte decoded, or ~0 if it's not in the CL.
+ *
+ * Relative branches in compressed lists mean the items aren't necessarily
+ * in address order, so an item only extends to the next one if that comes
+ * after it.
+ */
+uint32_t
+vc4_index_find_item(const struct vc4_dump_index *index,
+                    const struct vc4_index_cl *cl, uint32_t addr)
+{
+        const struct vc4_cl_item *items = index->items + cl->first_item;
+
+        for (uint32_t i = 0; i < cl->item_count; i++) {
+                uint32_t start = items[i].offset;
+                uint32_t end = cl->decoded_end;
+
+                if (i + 1 < cl->item_count && items[i + 1].offset > start)
+                        end = items[i + 1].offset;
+
+                if (addr >= start && addr < end)
+                        return i;
+        }
+
+        if (addr == cl->decoded_end)
+                return cl->item_count;
+
+        return ~0;
+}
+
+/**
+ * Returns the index's entry for the root CL cl (VC4_CL_BIN or
+ * VC4_CL_RENDER) if the context has an index and the CL was decoded from
+ * start, or NULL.
+ */
+const struct vc4_index_cl *
+vc4_index_root_cl(struct vc4_dump_ctx *ctx, uint32_t cl, uint32_t start)
+{
+        const struct vc4_index_cl *entry;
+
+        if (!ctx->index)
+                return NULL;
+
+        entry = &ctx->index->cls[index_cl_entry(cl)];
+        if (!entry->decoded || entry->paddr != start)
+                return NULL;
+
+        return entry;
+}
+
+/**
+ * Makes the same hook calls that decoding cl again would, from its items
+ * in the index, and returns the address just past the last byte decoded.
+ *
+ * This is only the same as decoding it if nothing it overlaps has been
+ * decoded since the index was built, which holds for the bin CL and then
+ * the render CL as the first ones decoded from a dump.
+ */
+uint32_t
+vc4_index_replay_cl(struct vc4_dump_ctx *ctx, const struct vc4_index_cl *cl)
+{
+        const struct vc4_cl_item *items = ctx->index->items + cl->first_item;
+        uint8_t prim_mode = cl->prim_mode;
+
+        if (!ctx->hooks->paddr_to_pointer(ctx, cl->paddr)) {
+                vc4_parse_diag(ctx, "No mapping found\n");
+                return cl->paddr;
+        }
+
+        for (uint32_t i = 0; i < cl->item_count; i++) {
+                const struct vc4_cl_item *item = &items[i];
+
+                switch (item->kind) {
+                case VC4_CL_ITEM_REVISIT:
+                        ctx->hooks->note_cl_revisit(ctx, item->offset);
+                        continue;
+                case VC4_CL_ITEM_COMPRESSED_BRANCH:
+                        ctx->hooks->add_compressed_list(
+                                ctx, item->u.compressed_branch.addr,
+                                prim_mode);
+                        continue;
+                case VC4_CL_ITEM_PACKET:
+                        break;
+                default:
+                        continue;
+                }
+
+                switch (item->opcode) {
+                case VC4_PACKET_PRIMITIVE_LIST_FORMAT:
+                        prim_mode = item->u.prim_list_format.format & 0x0f;
+                        break;
+                case VC4_PACKET_BRANCH:
+                case VC4_PACKET_BRANCH_TO_SUB_LIST:
+                        ctx->hooks->add_sublist(ctx, item->u.branch.addr,
+                                                prim_mode);
+                        break;
+                case VC4_PACKET_GL_SHADER_STATE:
+                        ctx->hooks->add_gl_shader_rec(
+                                ctx, item->u.gl_shader_state.rec_paddr,
+                                item->u.gl_shader_state.attributes,
+                                item->u.gl_shader_state.extended);
+                        break;
+                case VC4_PACKET_NV_SHADER_STATE:
+                        ctx->hooks->add_nv_shader_rec(
+                                ctx, item->u.nv_shader_state.rec_paddr);
+                        break;
+                }
+        }
+
+        ctx->hooks->mark_cl_visited(ctx, cl->paddr,
+                                    cl->decoded_end - cl->paddr);
+
+        return cl->decoded_end;
+}
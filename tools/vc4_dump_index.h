@@ -0,0 +1,212 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/** @file vc4_dump_index.h
+ *
+ * The sidecar index of a dump, which records what a full walk of the dump
+ * found so that later runs over it don't have to walk it again.
+ *
+ * It's saved next to the dump as <dump>.vc4idx, when the caller asks for
+ * that with VC4_INDEX_SAVE: a struct vc4_index_header,
+ * then tables of the CLs that were decoded, the items they decoded to, the
+ * shader recs they queued and the shaders those point to.  The items are
+ * the decoder's own struct vc4_cl_item, with the links pointing into the
+ * tables here instead of at the decoder's mem areas.  Each table starts at
+ * a multiple of 8 bytes, so the file can be used in place once it's
+ * mapped.
+ *
+ * The index is only used while the dump's file is the same one, going by
+ * its inode, size and modification time, and by the checksum of its
+ * header and tables when it has one, so a dump that's been rewritten gets
+ * a new index the next time it's opened.  It's laid out in the native byte
+ * order and struct layout, and one written by a different build is treated
+ * as stale and rebuilt.
+ */
+
+#ifndef VC4_DUMP_INDEX_H
+#define VC4_DUMP_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vc4_cl_ir.h"
+
+struct vc4_dump_ctx;
+
+#define VC4_INDEX_MAGIC         0x78646934 /* "4idx" */
+#define VC4_INDEX_VERSION       3
+
+/* Appended to the dump's path for the index's. */
+#define VC4_INDEX_SUFFIX        ".vc4idx"
+
+struct vc4_index_header {
+        /* VC4_INDEX_MAGIC and VC4_INDEX_VERSION. */
+        uint32_t magic;
+        uint32_t version;
+        /* sizeof() of the header and of each table entry, which have to
+         * match the reader's.
+         */
+        uint32_t header_size;
+        uint32_t cl_entry_size;
+        uint32_t item_entry_size;
+        uint32_t shader_rec_entry_size;
+        uint32_t shader_entry_size;
+        uint32_t pad;
+
+        /* The stat() of the dump that the index was built from, and the
+         * checksum of its header and tables, or 0 if it doesn't have one.
+         */
+        uint64_t dump_size;
+        uint64_t dump_ino;
+        int64_t dump_mtime_sec;
+        uint32_t dump_mtime_nsec;
+        uint32_t dump_metadata_crc;
+
+        /* File offsets and lengths of the tables. */
+        uint64_t cl_offset;
+        uint64_t item_offset;
+        uint64_t shader_rec_offset;
+        uint64_t shader_offset;
+        uint32_t cl_count;
+        uint32_t item_count;
+        uint32_t shader_rec_count;
+        uint32_t shader_count;
+
+        /* Packets of each opcode over all the CLs, counting the raw ones
+         * but not the entries of compressed lists.  A query for a packet
+         * that the dump doesn't have can stop here.
+         */
+        uint32_t opcode_counts[256];
+};
+
+enum vc4_index_cl_type {
+        VC4_INDEX_CL_BIN,
+        VC4_INDEX_CL_RENDER,
+        VC4_INDEX_CL_SUB_LIST,
+        VC4_INDEX_CL_COMPRESSED_LIST,
+};
+
+/* Entries 0 and 1 of the CL table are the bin and render CLs, followed by
+ * the CLs that they reached, in the order they were decoded in.
+ */
+#define VC4_INDEX_CL_BIN_ENTRY          0
+#define VC4_INDEX_CL_RENDER_ENTRY       1
+
+/* The parent of the root CLs. */
+#define VC4_INDEX_NONE                  0xffffffff
+
+struct vc4_index_cl {
+        uint32_t paddr;
+        /* Address just past the last byte decoded. */
+        uint32_t decoded_end;
+        /* Entry of the CL whose branch queued this one. */
+        uint32_t parent;
+        /* The CL's items in the item table. */
+        uint32_t first_item;
+        uint32_t item_count;
+        uint8_t type;
+        /* The primitive mode in effect at the start of the CL. */
+        uint8_t prim_mode;
+        /* Whether the CL was decoded at all.  The bin CL isn't if the job
+         * had no binning, and neither are CLs that weren't mapped.
+         */
+        bool decoded;
+        uint8_t pad;
+};
+
+/* The items' link fields are 1 + the entry in the CL table for branches
+ * and compressed list branches, and 1 + the entry in the shader rec table
+ * for shader state packets.
+ */
+
+enum vc4_index_shader_type {
+        VC4_INDEX_SHADER_FS,
+        VC4_INDEX_SHADER_VS,
+        VC4_INDEX_SHADER_CS,
+};
+
+struct vc4_index_shader_rec {
+        uint32_t paddr;
+        uint32_t size;
+        /* Whether it's a GL shader rec rather than an NV one. */
+        bool gl;
+        bool extended;
+        uint8_t attributes;
+        bool mapped;
+        /* 1 + the shader table entries of the rec's shaders, indexed by
+         * enum vc4_index_shader_type, or 0.
+         */
+        uint32_t shaders[3];
+};
+
+/* The shader's PROG_END and its delay slots are in its BO, rather than it
+ * running off the end of the BO.
+ */
+#define VC4_INDEX_SHADER_PROG_END       (1 << 0)
+#define VC4_INDEX_SHADER_MAPPED         (1 << 1)
+
+struct vc4_index_shader {
+        uint32_t paddr;
+        /* Bytes of code, through the delay slots after the PROG_END. */
+        uint32_t size;
+        /* CRC32C of the code, for finding the same shader across dumps. */
+        uint32_t hash;
+        uint8_t type;
+        uint8_t flags;
+        uint16_t pad;
+};
+
+/** An index, either mapped from its file or built in memory. */
+struct vc4_dump_index {
+        const struct vc4_index_header *header;
+        const struct vc4_index_cl *cls;
+        const struct vc4_cl_item *items;
+        const struct vc4_index_shader_rec *shader_recs;
+        const struct vc4_index_shader *shaders;
+
+        void *data;
+        size_t size;
+        bool mapped;
+};
+
+/* What vc4_dump_ctx_use_index() does for a dump that doesn't have a current
+ * index saved next to it.
+ */
+enum vc4_index_mode {
+        /* Go without one. */
+        VC4_INDEX_LOAD,
+        /* Build one for this context only. */
+        VC4_INDEX_BUILD,
+        /* Build one and save it next to the dump for later runs. */
+        VC4_INDEX_SAVE,
+};
+
+const struct vc4_dump_index *vc4_dump_ctx_use_index(struct vc4_dump_ctx *ctx,
+                                                    enum vc4_index_mode mode);
+
+uint32_t vc4_index_find_item(const struct vc4_dump_index *index,
+                             const struct vc4_index_cl *cl, uint32_t addr);
+
+#endif /* VC4_DUMP_INDEX_H */
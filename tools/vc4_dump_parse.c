@@ -22,567 +22,228 @@
  */
 
 #include <err.h>
-#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
-#include <string.h>
 #include <unistd.h>
-#include <sys/errno.h>
-#include <sys/ioctl.h>
-#include <sys/mman.h>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include "vc4_drm.h"
 
-#include "list.h"
-#include "vc4_tools.h"
-#include "vc4_dump_parse.h"
-#include "vc4_packet.h"
-#include "vc4_qpu_defines.h"
+#include "vc4_dump.h"
+#include "vc4_dump_index.h"
+#include "vc4_output.h"
 
-static void *
-map_input(const char *filename)
-{
-        int fd;
-        void *map;
-        struct stat stat;
-        int ret;
-
-        fd = open(filename, 0);
-        if (fd == -1)
-                err(1, "Couldn't open input file %s", filename);
-
-        ret = fstat(fd, &stat);
-        if (ret)
-                err(1, "Couldn't get size of input file %s", filename);
-
-        map = mmap(NULL, stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
-        if (map == MAP_FAILED)
-                err(1, "Couldn't map input file %s", filename);
-
-        return map;
-}
-
-struct vc4_mem_area_rec {
-        struct list_head link;
-
-        enum vc4_mem_area_type type;
-        void *addr;
-        uint32_t paddr;
-        uint32_t size;
-        uint8_t prim_mode;
-
-        /* GL shader rec bits. */
-        uint8_t attributes;
-        bool extended;
-};
+/* Packets shown on each side of the current address by default. */
+#define LOCUS_DEFAULT_WINDOW    8
 
-static struct {
-        struct drm_vc4_get_hang_state *state;
-        struct drm_vc4_get_hang_state_bo *bo_state;
-        void **map;
-
-        struct list_head mem_areas;
-} dump;
+static struct vc4_output *out;
+/* The library's reports of problems in the dump, which go to stderr. */
+static struct vc4_output *diag;
 
 static void
-dump_bo_list(void)
+flush_output(void)
 {
-        fprintf(stderr, "BOs:\n");
-
-        for (int i = 0; i < dump.state->bo_count; i++) {
-                uint32_t paddr = dump.bo_state[i].paddr;
-                fprintf(stderr, "0x%08x..0x%08x (%p)\n",
-                        paddr,
-                        paddr + dump.bo_state[i].size - 1,
-                        dump.map[i]);
-        }
-}
-
-void *
-vc4_paddr_to_pointer(uint32_t addr)
-{
-        for (int i = 0; i < dump.state->bo_count; i++) {
-                uint32_t paddr = dump.bo_state[i].paddr;
-                if (addr >= paddr && addr < paddr + dump.bo_state[i].size)
-                        return dump.map[i] + (addr - paddr);
-        }
-
-        fprintf(stderr, "Couldn't translate address 0x%08x\n", addr);
-        dump_bo_list();
-
-        return NULL;
+        vc4_output_flush(out);
 }
 
-uint32_t
-vc4_pointer_to_paddr(void *p)
+static void
+usage(const char *name)
 {
-        for (int i = 0; i < dump.state->bo_count; i++) {
-                void *map = dump.map[i];
-                if (p >= map && p < map + dump.bo_state[i].size)
-                        return dump.bo_state[i].paddr + (p - map);
-        }
-
-        fprintf(stderr, "Couldn't translate pointer %p\n", p);
-        dump_bo_list();
-
-        return 0;
+        fprintf(stderr,
+                "Usage: %s [--json | --stats | --locus[=N] | --verify]\n"
+                "       [--range START:END | --bo N] [--threads=N]\n"
+                "       [--index | --no-index] input.dump\n",
+                name);
+        exit(1);
 }
 
-static uint32_t
-vc4_get_end_paddr(uint32_t paddr)
+/* Parses the number at the start of s, in C syntax, into value and points
+ * end past it.  Returns false if s doesn't start with a number or it
+ * doesn't fit in 32 bits.
+ */
+static bool
+parse_u32(const char *s, char **end, uint32_t *value)
 {
-        for (int i = 0; i < dump.state->bo_count; i++) {
-                uint32_t start = dump.bo_state[i].paddr;
-                uint32_t end = start + dump.bo_state[i].size;
-                if (paddr >= start && paddr < end)
-                        return end;
-        }
+        unsigned long long v;
 
-        fprintf(stderr, "Couldn't translate paddr 0x%08x\n", paddr);
-        dump_bo_list();
-
-        return 0;
-}
-
-static struct vc4_mem_area_rec *
-vc4_add_mem_area_to_list(struct vc4_mem_area_rec *rec)
-{
-        /* Don't add exact duplicates of memory areas to the list.  We have to
-         * be careful to not compare the list pointers, since the new rec
-         * won't be in the list.
+        /* strtoull() would take leading spaces and a sign, and wrap
+         * negative numbers around.
          */
-        struct vc4_mem_area_rec compare_a = *rec;
-        memset(&compare_a.link, 0, sizeof(compare_a.link));
-        list_for_each_entry(struct vc4_mem_area_rec, list_rec, &dump.mem_areas,
-                            link) {
-                struct vc4_mem_area_rec compare_b = *list_rec;
-                memset(&compare_b.link, 0, sizeof(compare_b.link));
-                if (memcmp(&compare_a, &compare_b, sizeof(compare_a)) == 0)
-                        return list_rec;
-        }
+        if (*s < '0' || *s > '9')
+                return false;
 
-        struct vc4_mem_area_rec *list_rec = malloc(sizeof(*list_rec));
-        *list_rec = *rec;
-        list_addtail(&list_rec->link, &dump.mem_areas);
-        return list_rec;
-}
+        errno = 0;
+        v = strtoull(s, end, 0);
+        if (errno || v > UINT32_MAX)
+                return false;
 
-static void
-vc4_init_mem_area(struct vc4_mem_area_rec *rec, enum vc4_mem_area_type type,
-                  uint32_t paddr, uint32_t size)
-{
-        memset(rec, 0, sizeof(*rec));
-        rec->type = type;
-        rec->paddr = paddr;
-        rec->addr = vc4_paddr_to_pointer(paddr);
-        rec->size = size;
-        rec->prim_mode = ~0;
+        *value = v;
+        return true;
 }
 
+/* Exits with the reason if the dump couldn't be read. */
 static void
-vc4_init_mem_area_unsized(struct vc4_mem_area_rec *rec,
-                          enum vc4_mem_area_type type, uint32_t paddr)
+check_dump_error(struct vc4_dump_ctx *ctx)
 {
-        vc4_init_mem_area(rec, type, paddr, vc4_get_end_paddr(paddr) - paddr);
-}
-
-struct vc4_mem_area_rec *
-vc4_parse_add_mem_area_sized(enum vc4_mem_area_type type, uint32_t paddr,
-                             uint32_t size)
-{
-        struct vc4_mem_area_rec rec;
-        vc4_init_mem_area(&rec, type, paddr, size);
-        return vc4_add_mem_area_to_list(&rec);
-}
-
-struct vc4_mem_area_rec *
-vc4_parse_add_mem_area(enum vc4_mem_area_type type, uint32_t paddr)
-{
-        struct vc4_mem_area_rec rec;
-        vc4_init_mem_area_unsized(&rec, type, paddr);
-        return vc4_add_mem_area_to_list(&rec);
-}
-
-void
-vc4_parse_add_sublist(uint32_t paddr, uint8_t prim_mode)
-{
-        struct vc4_mem_area_rec rec;
-        vc4_init_mem_area_unsized(&rec, VC4_MEM_AREA_SUB_LIST, paddr);
-        rec.prim_mode = prim_mode;
-        vc4_add_mem_area_to_list(&rec);
-}
+        const char *error = vc4_dump_ctx_error(ctx);
 
-void
-vc4_parse_add_compressed_list(uint32_t paddr, uint8_t prim_mode)
-{
-        struct vc4_mem_area_rec rec;
-        vc4_init_mem_area_unsized(&rec,
-                                  VC4_MEM_AREA_COMPRESSED_PRIM_LIST, paddr);
-        rec.prim_mode = prim_mode;
-        vc4_add_mem_area_to_list(&rec);
-}
-
-void
-vc4_parse_add_gl_shader_rec(uint32_t paddr, uint8_t attributes, bool extended)
-{
-        uint32_t size = 36 + attributes * 8;
-
-        assert(!extended);
-
-        struct vc4_mem_area_rec rec;
-        vc4_init_mem_area(&rec, VC4_MEM_AREA_GL_SHADER_REC, paddr, size);
-        rec.attributes = attributes;
-        rec.extended = extended;
-        vc4_add_mem_area_to_list(&rec);
-}
-
-void
-vc4_parse_add_nv_shader_rec(uint32_t paddr)
-{
-        struct vc4_mem_area_rec rec;
-        vc4_init_mem_area(&rec, VC4_MEM_AREA_NV_SHADER_REC, paddr, 16);
-        vc4_add_mem_area_to_list(&rec);
+        if (error)
+                errx(1, "%s", error);
 }
 
+/* Checks the BOs against the checksums they were captured with, exiting
+ * with an error if any don't match.
+ */
 static void
-set_bo_maps(void *input)
+verify_dump(struct vc4_dump_ctx *ctx)
 {
-        uint32_t *version = input;
-        if (*version != 0) {
-                fprintf(stderr, "Input had wrong version %d\n", *version);
-                exit(1);
-        }
+        uint32_t bo_count = vc4_dump_ctx_bo_count(ctx);
+        uint32_t bad;
 
-        dump.state = (void *)&version[1];
-        dump.bo_state = (void *)&dump.state[1];
+        if (!vc4_dump_ctx_has_bo_crcs(ctx))
+                errx(1, "The dump doesn't have BO checksums to verify");
 
-        dump.map = calloc(dump.state->bo_count, sizeof(*dump.map));
-        if (!dump.map)
-                err(1, "malloc failure");
+        bad = vc4_dump_ctx_verify(ctx);
+        check_dump_error(ctx);
+        if (bad)
+                errx(1, "%d of %d BOs don't match their checksums",
+                     bad, bo_count);
 
-        void *next_map = &dump.bo_state[dump.state->bo_count];
-        for (int i = 0; i < dump.state->bo_count; i++) {
-                dump.map[i] = next_map;
-                next_map += dump.bo_state[i].size;
-        }
+        vc4_out_printf(out, "All %d BOs match their checksums\n", bo_count);
 }
 
-static void
-parse_cls(void)
-{
-        if (dump.state->start_bin != dump.state->ct0ea) {
-                printf("Bin CL at 0x%08x\n", dump.state->start_bin);
-                vc4_dump_cl(dump.state->start_bin, dump.state->ct0ea,
-                            false, false, ~0);
-        }
-
-        printf("Render CL at 0x%08x\n", dump.state->start_render);
-        vc4_dump_cl(dump.state->start_render, dump.state->ct1ea,
-                    true, false, ~0);
-}
-
-static void
-parse_sublists(void)
+int
+main(int argc, char **argv)
 {
-        list_for_each_entry(struct vc4_mem_area_rec, rec, &dump.mem_areas,
-                            link) {
-                switch (rec->type) {
-                case VC4_MEM_AREA_SUB_LIST:
-                        printf("Sublist at 0x%08x:\n", rec->paddr);
-                        if (!rec->addr) {
-                                printf("    No mapping found\n");
-                                continue;
-                        }
-                        vc4_dump_cl(rec->paddr, rec->paddr + rec->size, true,
-                                    false, rec->prim_mode);
-                        printf("\n");
+        static const struct option long_options[] = {
+                { "json", no_argument, NULL, 'j' },
+                { "stats", no_argument, NULL, 's' },
+                { "locus", optional_argument, NULL, 'l' },
+                { "range", required_argument, NULL, 'r' },
+                { "bo", required_argument, NULL, 'b' },
+                { "verify", no_argument, NULL, 'v' },
+                { "threads", required_argument, NULL, 't' },
+                { "index", no_argument, NULL, 'i' },
+                { "no-index", no_argument, NULL, 'n' },
+                { NULL, 0, NULL, 0 },
+        };
+        enum vc4_dump_format format = VC4_DUMP_FORMAT_TEXT;
+        bool json = false, print_only_stats = false, locus = false;
+        bool verify = false, range = false, use_index = true;
+        bool save_index = false;
+        uint32_t locus_window = LOCUS_DEFAULT_WINDOW;
+        uint32_t range_start = 0, range_end = 0;
+        const char *bo_arg = NULL;
+        long threads = sysconf(_SC_NPROCESSORS_ONLN);
+        struct vc4_dump_ctx *ctx;
+        char *end;
+        int c;
+
+        while ((c = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+                switch (c) {
+                case 'j':
+                        json = true;
+                        format = VC4_DUMP_FORMAT_JSON;
                         break;
-                case VC4_MEM_AREA_COMPRESSED_PRIM_LIST:
-                        printf("Compressed list at 0x%08x:\n", rec->paddr);
-                        if (!rec->addr) {
-                                printf("    No mapping found\n");
-                                continue;
-                        }
-                        vc4_dump_cl(rec->paddr, rec->paddr + rec->size, true,
-                                    true, rec->prim_mode);
-                        printf("\n");
+                case 's':
+                        print_only_stats = true;
+                        format = VC4_DUMP_FORMAT_STATS;
                         break;
-                default:
+                case 'l':
+                        locus = true;
+                        if (optarg &&
+                            (!parse_u32(optarg, &end, &locus_window) ||
+                             *end)) {
+                                usage(argv[0]);
+                        }
                         break;
-                }
-        }
-}
-
-static void
-parse_gl_shader_rec(struct vc4_mem_area_rec *rec)
-{
-        uint32_t paddr = rec->paddr;
-        void *addr = rec->addr;
-        uint8_t *b = addr;
-        uint16_t *s = addr;
-
-        printf("GL Shader rec at 0x%08x "
-               "(%d attributes, %sextended):\n", rec->paddr,
-               rec->attributes,
-               rec->extended ? "" : "not ");
-
-        if (!rec->addr) {
-                printf("    No mapping found\n");
-                return;
-        }
-
-        printf("0x%08x:     0x%04x: %s, %s, %s\n",
-               paddr, s[0],
-               (s[0] & VC4_SHADER_FLAG_ENABLE_CLIPPING) ?
-               "clipped" : "unclipped",
-               (s[0] & VC4_SHADER_FLAG_FS_SINGLE_THREAD) ?
-               "single thread" : "dual thread",
-               (s[0] & VC4_SHADER_FLAG_VS_POINT_SIZE) ?
-               "point size" : "no point size");
-
-        printf("0x%08x:     0x%02x: fs num uniforms\n", paddr + 2, b[2]);
-        printf("0x%08x:     0x%02x: fs inputs\n", paddr + 3, b[3]);
-        printf("0x%08x:     0x%04x: fs code\n", paddr + 4,
-               *(uint32_t *)(addr + 4));
-        printf("0x%08x:     0x%04x: fs uniforms\n", paddr + 8,
-               *(uint32_t *)(addr + 8));
-        vc4_parse_add_mem_area(VC4_MEM_AREA_FS,
-                               *(uint32_t *)(addr + 4));
-
-        printf("0x%08x:     0x%04x: vs num uniforms\n", paddr + 12,
-               *(uint16_t *)(addr + 12));
-        printf("0x%08x:     0x%02x: vs inputs\n", paddr + 14, b[14]);
-        printf("0x%08x:     0x%02x: vs attr size\n", paddr + 15, b[15]);
-        printf("0x%08x:     0x%04x: vs code\n", paddr + 16,
-               *(uint32_t *)(addr + 16));
-        printf("0x%08x:     0x%04x: vs uniforms\n", paddr + 20,
-               *(uint32_t *)(addr + 20));
-        vc4_parse_add_mem_area(VC4_MEM_AREA_VS,
-                               *(uint32_t *)(addr + 16));
-
-        printf("0x%08x:     0x%04x: cs num uniforms\n", paddr + 24,
-               *(uint16_t *)(addr + 24));
-        printf("0x%08x:     0x%02x: cs inputs\n", paddr + 26, b[26]);
-        printf("0x%08x:     0x%02x: cs attr size\n", paddr + 27, b[27]);
-        printf("0x%08x:     0x%04x: cs code\n", paddr + 28,
-               *(uint32_t *)(addr + 28));
-        printf("0x%08x:     0x%04x: cs uniforms\n", paddr + 32,
-               *(uint32_t *)(addr + 32));
-        vc4_parse_add_mem_area(VC4_MEM_AREA_CS,
-                               *(uint32_t *)(addr + 28));
-
-        for (int i = 0; i < rec->attributes; i++) {
-                uint32_t ext_stride = 0;
-                if (rec->extended)
-                        ext_stride = *(uint32_t *)(addr + 100 + i * 4);
-
-                printf("0x%08x:     0x%08x: attr %d addr\n",
-                       paddr + 36 + i * 8,
-                       *(uint32_t *)(addr + 36 + i * 8), i);
-                printf("0x%08x:     0x%04x: attr %d %db, %db stride\n",
-                       paddr + 40 + i * 8,
-                       *(uint16_t *)(addr + 40 + i * 8),
-                       i,
-                       *(uint8_t *)(addr + 40 + i * 8) + 1,
-                       *(uint8_t *)(addr + 41 + i * 8) + ext_stride);
-                printf("0x%08x:     0x%04x: attr %d %2d VS VPM, %2d CS VPM\n",
-                       paddr + 42 + i * 8,
-                       *(uint16_t *)(addr + 42 + i * 8),
-                       i,
-                       *(uint8_t *)(addr + 42 + i * 8),
-                       *(uint8_t *)(addr + 43 + i * 8));
-        }
-
-        printf("\n");
-}
-
-static void
-parse_nv_shader_rec(struct vc4_mem_area_rec *rec)
-{
-        uint32_t paddr = rec->paddr;
-        void *addr = rec->addr;
-        uint8_t *b = addr;
-
-        printf("NV Shader rec at 0x%08x:\n", rec->paddr);
-
-        if (!rec->addr) {
-                printf("    No mapping found\n");
-                return;
-        }
-
-        printf("0x%08x:     0x%02x: %sclip coords, %s, %s, %s\n",
-               paddr, b[0],
-               (b[0] & VC4_SHADER_FLAG_SHADED_CLIP_COORDS) ?
-               "" : "no ",
-               (b[0] & VC4_SHADER_FLAG_ENABLE_CLIPPING) ?
-               "clipped" : "unclipped",
-               (b[0] & VC4_SHADER_FLAG_FS_SINGLE_THREAD) ?
-               "single thread" : "dual thread",
-               (b[0] & VC4_SHADER_FLAG_VS_POINT_SIZE) ?
-               "point size" : "no point size");
-
-        printf("0x%08x:     0x%02x: vertex stride\n", paddr + 1, b[1]);
-        printf("0x%08x:     0x%02x: fs num uniforms\n", paddr + 2, b[2]);
-        printf("0x%08x:     0x%02x: fs inputs\n", paddr + 3, b[3]);
-        printf("0x%08x:     0x%04x: fs code\n", paddr + 4,
-               *(uint32_t *)(addr + 4));
-        vc4_parse_add_mem_area(VC4_MEM_AREA_FS,
-                               *(uint32_t *)(addr + 4));
-        printf("0x%08x:     0x%04x: fs uniforms\n", paddr + 8,
-               *(uint32_t *)(addr + 8));
-        printf("0x%08x:     0x%04x: vertex data\n", paddr + 12,
-               *(uint32_t *)(addr + 12));
-
-        printf("\n");
-}
-
-static void
-parse_shader_recs(void)
-{
-        list_for_each_entry(struct vc4_mem_area_rec, rec, &dump.mem_areas,
-                            link) {
-                switch (rec->type) {
-                case VC4_MEM_AREA_GL_SHADER_REC:
-                        parse_gl_shader_rec(rec);
+                case 'r':
+                        range = true;
+                        if (!parse_u32(optarg, &end, &range_start) ||
+                            *end != ':' ||
+                            !parse_u32(end + 1, &end, &range_end) || *end ||
+                            range_end <= range_start) {
+                                errx(1, "--range %s isn't START:END, with "
+                                     "32-bit addresses and START < END",
+                                     optarg);
+                        }
                         break;
-                case VC4_MEM_AREA_NV_SHADER_REC:
-                        parse_nv_shader_rec(rec);
+                case 'b':
+                        bo_arg = optarg;
                         break;
-                default:
+                case 'v':
+                        verify = true;
                         break;
-                }
-        }
-}
-
-static void
-parse_shaders(void)
-{
-        list_for_each_entry(struct vc4_mem_area_rec, rec, &dump.mem_areas,
-                            link) {
-                const char *type = NULL;
-
-                switch (rec->type) {
-                case VC4_MEM_AREA_CS:
-                        type = "CS";
+                case 't':
+                        threads = strtol(optarg, &end, 0);
+                        if (*end || !*optarg || threads < 1)
+                                usage(argv[0]);
                         break;
-                case VC4_MEM_AREA_VS:
-                        type = "VS";
+                case 'i':
+                        save_index = true;
                         break;
-                case VC4_MEM_AREA_FS:
-                        type = "FS";
+                case 'n':
+                        use_index = false;
                         break;
                 default:
-                        continue;
-                }
-
-                printf("%s at 0x%08x:\n", type, rec->paddr);
-
-                if (!rec->addr) {
-                        printf("    No mapping found\n");
-                        continue;
-                }
-
-                uint32_t end_offset = ~0;
-                for (uint32_t offset = 0;
-                     offset < end_offset;
-                     offset += sizeof(uint64_t)) {
-                        uint64_t inst = *(uint64_t *)(rec->addr + offset);
-
-                        printf("0x%08x: ", rec->paddr + offset);
-                        vc4_qpu_disasm(stdout, &inst, 1);
-                        printf("\n");
-
-                        if (QPU_GET_FIELD(inst, QPU_SIG) == QPU_SIG_PROG_END) {
-                                /* Parse two more instructions (the delay
-                                 * slots), then stop.
-                                 */
-                                end_offset = offset + 12;
-                        }
+                        usage(argv[0]);
                 }
-                printf("\n");
         }
-}
 
-static void
-usage(const char *name)
-{
-        fprintf(stderr, "Usage: %s input.dump\n", name);
-        exit(1);
-}
-
-static const struct {
-        int bit;
-        const char *name;
-} errstat_bits[] = {
-        { 15, "L2CARE: L2C AXI receive FIFO overrun error" },
-        { 14, "VCMRE: VCM error (binner)" },
-        { 13, "VCMRE: VCM error (renderer)" },
-        { 12, "VCDI: VCD Idle" },
-        { 11, "VCDE: VCD error - FIFO pointers out of snyc" },
-        { 10, "VDWE: VDW error - address overflows" },
-        { 9, "VPMEAS: VPM error - allocated size error" },
-        { 8, "VPMEFNA: VPM error - free non-allocated" },
-        { 7, "VPMEWNA: VPM error - write non-allocated" },
-        { 6, "VPMERNA: VPM error - read non-allocated" },
-        { 5, "VPMERR: VPM error - read range" },
-        { 4, "VPMEWR: VPM error - write range" },
-        { 3, "VPAERRGL: VPM allocator error - renderer request greater than limit" },
-        { 2, "VPAEBRGL: VPM allocator error - binner request greater than limit" },
-        { 1, "VPAERGS: VPM allocator error - request too big" },
-        { 0, "VPAEABB: VPM allocator error - allocating base while busy" },
-};
-
-static void
-dump_registers(void)
-{
-        printf("Bin CL:         0x%08x to 0x%08x\n",
-               dump.state->start_bin, dump.state->ct0ea);
-        printf("Bin current:    0x%08x\n", dump.state->ct0ca);
-        printf("Render CL:      0x%08x to 0x%08x\n",
-               dump.state->start_render, dump.state->ct1ea);
-        printf("Render current: 0x%08x\n", dump.state->ct1ca);
-        printf("\n");
-
-        printf("V3D_VPMBASE:    0x%08x\n", dump.state->vpmbase);
-        printf("V3D_DBGE:       0x%08x\n", dump.state->dbge);
-        printf("V3D_FDBGO:      0x%08x: %s\n", dump.state->fdbgo,
-               (dump.state->fdbgo & ~((1 << 1) |
-                                      (1 << 2) |
-                                      (1 << 11))) ?
-               "some errors" : "no errors");
-        printf("V3D_FDBGB:      0x%08x\n", dump.state->fdbgb);
-        printf("V3D_FDBGR:      0x%08x\n", dump.state->fdbgr);
-        printf("V3D_FDBGS:      0x%08x\n", dump.state->fdbgs);
-        printf("\n");
-        printf("V3D_ERRSTAT:    0x%08x\n", dump.state->errstat);
-        for (int i = 0; i < ARRAY_SIZE(errstat_bits); i++) {
-                if (dump.state->errstat & (1 << errstat_bits[i].bit))
-                        printf("V3D_ERRSTAT:    %s\n", errstat_bits[i].name);
+        if (optind != argc - 1 ||
+            json + print_only_stats + locus + verify > 1 ||
+            (bo_arg && range) ||
+            (save_index && (!use_index || verify)) ||
+            ((locus || verify) && (bo_arg || range))) {
+                usage(argv[0]);
         }
 
-        printf("\n");
-}
-
-int
-main(int argc, char **argv)
-{
-        void *input;
+        /* Flush from atexit so that the text before an err() exit still
+         * makes it out.
+         */
+        out = vc4_output_create(STDOUT_FILENO, 256 * 1024);
+        atexit(flush_output);
+        diag = vc4_output_create(STDERR_FILENO, 4096);
+
+        ctx = vc4_dump_ctx_open(argv[optind]);
+        check_dump_error(ctx);
+        vc4_dump_ctx_set_output(ctx, out, format);
+        vc4_dump_ctx_set_diagnostics(ctx, diag);
+        vc4_dump_ctx_set_threads(ctx, threads < 1 ? 1 : threads);
+
+        if (verify) {
+                verify_dump(ctx);
+                return 0;
+        }
 
-        list_inithead(&dump.mem_areas);
+        if (bo_arg) {
+                uint32_t bo;
 
-        if (argc != 2)
-                usage(argv[0]);
+                if (!parse_u32(bo_arg, &end, &bo) || *end ||
+                    !vc4_dump_ctx_set_range_bo(ctx, bo)) {
+                        vc4_dump_ctx_print_bo_list(ctx, diag);
+                        vc4_output_flush(diag);
+                        errx(1, "BO index %s out of range", bo_arg);
+                }
+        }
 
-        input = map_input(argv[1]);
-        set_bo_maps(input);
+        if (range)
+                vc4_dump_ctx_set_range(ctx, range_start, range_end);
 
-        dump_registers();
-        parse_cls();
-        parse_sublists();
-        parse_shader_recs();
-        parse_shaders();
+        /* A full dump decodes everything anyway, but a locus or a range
+         * can skip decoding the parts of the root CLs it doesn't show, if
+         * the dump has had its index saved with --index.
+         */
+        if (save_index)
+                vc4_dump_ctx_use_index(ctx, VC4_INDEX_SAVE);
+        else if (use_index && (locus || range || bo_arg))
+                vc4_dump_ctx_use_index(ctx, VC4_INDEX_LOAD);
+
+        if (locus)
+                vc4_dump_print_locus(ctx, locus_window);
+        else
+                vc4_dump_print(ctx);
+        check_dump_error(ctx);
 
         return 0;
 }
@@ -21,10 +21,26 @@
  * IN THE SOFTWARE.
  */
 
+/** @file vc4_dump_parse.h
+ *
+ * The inside of libvc4dump's struct vc4_dump_ctx, shared between the CL
+ * decoder, the context and the parse phases.
+ */
+
+#ifndef VC4_DUMP_PARSE_H
+#define VC4_DUMP_PARSE_H
+
 #include <stdbool.h>
 #include <stdint.h>
 
-struct vc4_mem_area_rec;
+#include "vc4_addr_space.h"
+#include "vc4_cl_ir.h"
+#include "vc4_dump.h"
+#include "vc4_json.h"
+
+struct vc4_dump_file;
+struct vc4_dump_index;
+struct vc4_index_cl;
 
 enum vc4_mem_area_type {
         VC4_MEM_AREA_GL_SHADER_REC,
@@ -34,23 +50,241 @@ enum vc4_mem_area_type {
         VC4_MEM_AREA_CS,
         VC4_MEM_AREA_VS,
         VC4_MEM_AREA_FS,
+        VC4_MEM_AREA_TYPE_COUNT,
 };
 
-void vc4_dump_cl(uint32_t start, uint32_t end, bool is_render,
-                 bool in_compressed_list, uint8_t prim_mode);
+struct vc4_mem_area_rec {
+        enum vc4_mem_area_type type;
+        void *addr;
+        uint32_t paddr;
+        uint32_t size;
+        uint8_t prim_mode;
 
-uint32_t vc4_pointer_to_paddr(void *p);
-void *vc4_paddr_to_pointer(uint32_t addr);
+        /* GL shader rec bits. */
+        uint8_t attributes;
+        bool extended;
 
-struct vc4_mem_area_rec *
-vc4_parse_add_mem_area(enum vc4_mem_area_type type, uint32_t paddr);
+        /* CL bits: the CL whose decode queued this one (see
+         * ctx->cl_current), and the address decoding stopped at.
+         */
+        uint32_t parent;
+        uint32_t decoded_end;
+};
+
+/* Values of ctx->cl_current/rec->parent that aren't CL worklist indices. */
+#define VC4_CL_BIN              0xfffffffd
+#define VC4_CL_RENDER           0xfffffffe
+#define VC4_CL_NONE             0xffffffff
+
+/**
+ * The discovered memory areas are stored in one array per parse phase, so
+ * that each phase walks just the areas it handles.  Areas of different
+ * types within a phase stay in a single array to keep their discovery order
+ * in the output.
+ */
+enum vc4_mem_area_bucket {
+        VC4_MEM_AREA_BUCKET_CL,
+        VC4_MEM_AREA_BUCKET_SHADER_REC,
+        VC4_MEM_AREA_BUCKET_SHADER,
+        VC4_MEM_AREA_BUCKET_COUNT,
+};
+
+struct vc4_mem_area_list {
+        struct vc4_mem_area_rec *recs;
+        uint32_t count;
+        uint32_t size;
+};
+
+struct vc4_mem_area_set_entry {
+        uint32_t handle;
+        uint32_t hash;
+};
+
+/**
+ * What vc4_dump_cl() calls to get at the CL bytes and to hand off what it
+ * finds in them.  A context opened on a dump uses the ones in
+ * vc4_dump_ctx.c, which queue up memory areas for the parse phases, while
+ * vc4_dump_reach.c has its own for walking everything the CLs reach.
+ *
+ * The add functions return a handle for the queued area to link the item
+ * to, or 0.
+ */
+struct vc4_dump_cl_hooks {
+        void *(*paddr_to_pointer)(struct vc4_dump_ctx *ctx, uint32_t paddr);
+
+        uint32_t (*add_sublist)(struct vc4_dump_ctx *ctx, uint32_t paddr,
+                                uint8_t prim_mode);
+        uint32_t (*add_compressed_list)(struct vc4_dump_ctx *ctx,
+                                        uint32_t paddr, uint8_t prim_mode);
+        uint32_t (*add_gl_shader_rec)(struct vc4_dump_ctx *ctx,
+                                      uint32_t paddr, uint8_t attributes,
+                                      bool extended);
+        uint32_t (*add_nv_shader_rec)(struct vc4_dump_ctx *ctx,
+                                      uint32_t paddr);
+
+        /* Returns the visited bitmap for the BO containing paddr, or NULL
+         * if no CL has been decoded from it yet, along with the BO's
+         * address range that the bitmap covers.  The decoder stops at any
+         * byte that's already set.
+         *
+         * The bitmap only changes in mark_cl_visited(), so the decoder
+         * looks it up once per CL instead of once per packet.
+         */
+        const uint32_t *(*get_cl_visited)(struct vc4_dump_ctx *ctx,
+                                          uint32_t paddr, uint32_t *bo_paddr,
+                                          uint32_t *bo_size);
+        /* Records that the decoder reached paddr a second time, returning
+         * whether it was through a cycle rather than an overlap between
+         * CLs.
+         */
+        bool (*note_cl_revisit)(struct vc4_dump_ctx *ctx, uint32_t paddr);
+        void (*mark_cl_visited)(struct vc4_dump_ctx *ctx, uint32_t paddr,
+                                uint32_t size);
+};
+
+struct vc4_dump_ctx {
+        /* The dump being parsed, which is NULL for a context made by
+         * vc4_dump_ctx_create() over BOs that aren't in a dump file.
+         */
+        struct vc4_dump_file *file;
+        char *filename;
+        const struct drm_vc4_get_hang_state *state;
+        const struct drm_vc4_get_hang_state_bo *bo_state;
+        struct vc4_addr_space *addr_space;
+        struct vc4_addr_space file_addr_space;
 
+        const struct vc4_dump_cl_hooks *hooks;
+        void *hooks_data;
+
+        /* The decoder's item array, reused from one CL to the next, and
+         * the renderer it's handed to.
+         */
+        struct vc4_cl_ir cl_ir;
+        const struct vc4_cl_renderer *cl_renderer;
+
+        struct vc4_mem_area_list mem_areas[VC4_MEM_AREA_BUCKET_COUNT];
+
+        /* Open-addressed hash set of the recs in mem_areas, for dropping
+         * duplicates as they're discovered.  Entries are
+         * vc4_mem_area_handle()s, with 0 for an empty slot, next to the
+         * rec's hash so that probing and growing don't have to look at the
+         * recs themselves.
+         */
+        struct vc4_mem_area_set_entry *mem_area_set;
+        uint32_t mem_area_set_size;
+        uint32_t mem_area_count;
+        uint32_t mem_area_duplicates;
+
+        /* One bit per byte of each BO, set once a CL has been decoded
+         * there.  NULL for BOs that no CL has been decoded from.
+         */
+        uint32_t **cl_visited;
+
+        /* The CL currently being decoded: an index into the CL worklist,
+         * or one of the VC4_CL_* values.
+         */
+        uint32_t cl_current;
+        struct {
+                uint32_t start;
+                uint32_t end;
+        } root_cls[2];
+
+        uint32_t cl_cycles;
+        uint32_t cl_overlaps;
+
+        /* References to memory that was left out of the dump, which are
+         * counted up rather than reported one by one.
+         */
+        uint32_t omitted_refs;
+        bool bo_list_shown;
+        /* Set for the walk that builds the index, which leaves reporting
+         * the dump's problems to the decode that it's built for.
+         */
+        bool quiet;
+
+        /* The renderer for the CLs being dumped, which vc4_dump_cl()
+         * switches away from for CLs that aren't shown.
+         */
+        struct vc4_cl_renderer renderer;
+
+        /* All of the dump text goes through here rather than stdio. */
+        struct vc4_output *out;
+        /* Where vc4_parse_diag() reports problems with the dump, if
+         * anywhere.
+         */
+        struct vc4_output *diag;
+
+        /* Set for JSON output, in which case each phase writes its part of
+         * the document here instead of the text dump.
+         */
+        struct vc4_json *json;
+        struct vc4_json json_writer;
+        /* In-memory output for building JSON strings. */
+        struct vc4_output *scratch;
+        enum vc4_dump_format format;
+        /* Whether to write the text dump, which is off for JSON and stats.
+         */
+        bool text;
+        struct vc4_cl_stats stats;
+
+        /* Address window set by vc4_dump_ctx_set_range().  Only the CLs,
+         * shader recs and shaders that overlap it get dumped.
+         */
+        struct {
+                bool enabled;
+                uint32_t start;
+                uint32_t end;
+
+                /* Start of the BO containing start, or start itself if
+                 * it's not in a BO.
+                 */
+                uint32_t bo_start;
+
+                /* The CL starting closest before the range in the same BO,
+                 * which may run on into the range.
+                 */
+                bool has_straddler;
+                struct vc4_mem_area_rec straddler;
+        } range;
+
+        /* Threads that vc4_dump_print() renders the sublists, shader recs
+         * and shaders with.  1 renders them in place, one at a time.
+         */
+        uint32_t threads;
+
+        /* The dump's index, once vc4_dump_ctx_use_index() has loaded or
+         * built it.
+         */
+        struct vc4_dump_index *index;
+};
+
+struct vc4_dump_ctx *
+vc4_dump_ctx_create(struct vc4_addr_space *space,
+                    const struct vc4_dump_cl_hooks *hooks, void *data);
+
+void vc4_parse_diag(struct vc4_dump_ctx *ctx, const char *format, ...)
+        __attribute__ ((format(__printf__, 2, 3)));
+uint32_t vc4_parse_get_end_paddr(struct vc4_dump_ctx *ctx, uint32_t paddr);
+bool vc4_parse_in_range(struct vc4_dump_ctx *ctx, uint32_t paddr,
+                        uint32_t size);
+
+struct vc4_mem_area_rec *vc4_parse_mem_area(struct vc4_dump_ctx *ctx,
+                                            uint32_t handle);
+uint32_t vc4_parse_insert_mem_area(struct vc4_dump_ctx *ctx,
+                                   struct vc4_mem_area_rec *rec);
 struct vc4_mem_area_rec *
-vc4_parse_add_mem_area_sized(enum vc4_mem_area_type type, uint32_t paddr,
-                             uint32_t size);
-
-void vc4_parse_add_sublist(uint32_t paddr, uint8_t prim_mode);
-void vc4_parse_add_compressed_list(uint32_t paddr, uint8_t prim_mode);
-void vc4_parse_add_gl_shader_rec(uint32_t paddr, uint8_t attributes,
-                                 bool extended);
-void vc4_parse_add_nv_shader_rec(uint32_t paddr);
+vc4_parse_add_mem_area(struct vc4_dump_ctx *ctx, enum vc4_mem_area_type type,
+                       uint32_t paddr);
+
+void vc4_dump_walk(struct vc4_dump_ctx *ctx,
+                   const struct vc4_cl_renderer *renderer);
+uint32_t vc4_parse_shader_size(const struct vc4_mem_area_rec *rec,
+                               bool *prog_end);
+
+void vc4_dump_index_free(struct vc4_dump_index *index);
+const struct vc4_index_cl *
+vc4_index_root_cl(struct vc4_dump_ctx *ctx, uint32_t cl, uint32_t start);
+uint32_t vc4_index_replay_cl(struct vc4_dump_ctx *ctx,
+                             const struct vc4_index_cl *cl);
+
+#endif /* VC4_DUMP_PARSE_H */
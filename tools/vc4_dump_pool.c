@@ -0,0 +1,432 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/* For asprintf(). */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <dirent.h>
+#include <err.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "vc4_dump_index.h"
+#include "vc4_dump_pool.h"
+#include "vc4_output.h"
+#include "vc4_tools.h"
+
+enum dump_status {
+        DUMP_PENDING,
+        DUMP_RUNNING,
+        /* Processed into results[], but not yet written out. */
+        DUMP_PROCESSED,
+        DUMP_DONE,
+        DUMP_FAILED,
+};
+
+/* The state that outlives a pool process that died. */
+struct vc4_dump_pool_shared {
+        /* The next dump to be written out, and how many have so far. */
+        uint32_t next_write;
+        uint32_t written;
+        uint8_t status[];
+};
+
+static void
+add_path(struct vc4_dump_pool *pool, char *path)
+{
+        if (pool->count == pool->size) {
+                pool->size = MAX2(pool->size * 2, 16);
+                pool->paths = realloc(pool->paths,
+                                      pool->size * sizeof(*pool->paths));
+                if (!pool->paths)
+                        err(1, "malloc failure");
+        }
+        pool->paths[pool->count++] = path;
+}
+
+static int
+compare_names(const void *a, const void *b)
+{
+        return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Whether name is a dump's index, rather than a dump. */
+static bool
+is_index(const char *name)
+{
+        size_t len = strlen(name);
+        size_t suffix_len = strlen(VC4_INDEX_SUFFIX);
+
+        return (len > suffix_len &&
+                !strcmp(name + len - suffix_len, VC4_INDEX_SUFFIX));
+}
+
+/* Adds the regular files in dir, other than the dumps' indices, sorted by
+ * name.
+ */
+static void
+add_dir(struct vc4_dump_pool *pool, const char *dir)
+{
+        DIR *d = opendir(dir);
+        struct dirent *entry;
+        uint32_t first = pool->count;
+
+        if (!d)
+                err(1, "Couldn't open %s", dir);
+
+        while ((entry = readdir(d))) {
+                char *path;
+                struct stat st;
+
+                if (is_index(entry->d_name))
+                        continue;
+                if (asprintf(&path, "%s/%s", dir, entry->d_name) == -1)
+                        err(1, "malloc failure");
+                if (stat(path, &st) == -1 || !S_ISREG(st.st_mode)) {
+                        free(path);
+                        continue;
+                }
+                add_path(pool, path);
+        }
+        closedir(d);
+
+        qsort(pool->paths + first, pool->count - first,
+              sizeof(*pool->paths), compare_names);
+}
+
+/** Adds a dump, or the dumps in a directory. */
+void
+vc4_dump_pool_add_arg(struct vc4_dump_pool *pool, const char *arg)
+{
+        struct stat st;
+        char *path;
+
+        if (stat(arg, &st) == -1)
+                err(1, "Couldn't stat %s", arg);
+
+        if (S_ISDIR(st.st_mode)) {
+                add_dir(pool, arg);
+                return;
+        }
+
+        path = strdup(arg);
+        if (!path)
+                err(1, "malloc failure");
+        add_path(pool, path);
+}
+
+/** Adds the paths in list, one per line, with "-" reading from stdin. */
+void
+vc4_dump_pool_add_list(struct vc4_dump_pool *pool, const char *list)
+{
+        FILE *f = strcmp(list, "-") ? fopen(list, "r") : stdin;
+        char *line = NULL;
+        size_t line_size = 0;
+        ssize_t len;
+
+        if (!f)
+                err(1, "Couldn't open %s", list);
+
+        while ((len = getline(&line, &line_size, f)) != -1) {
+                if (len && line[len - 1] == '\n')
+                        line[--len] = '\0';
+                if (len)
+                        vc4_dump_pool_add_arg(pool, line);
+        }
+        if (ferror(f))
+                err(1, "Couldn't read %s", list);
+
+        free(line);
+        if (f != stdin)
+                fclose(f);
+}
+
+/** Returns how many dumps have been written out. */
+uint32_t
+vc4_dump_pool_written(const struct vc4_dump_pool *pool)
+{
+        return pool->shared->written;
+}
+
+/* Starts the kernel reading the dump into the page cache, without waiting
+ * for it.
+ */
+static void
+prefetch_dump(const char *path)
+{
+        int fd = open(path, O_RDONLY);
+
+        if (fd == -1)
+                return;
+
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        close(fd);
+}
+
+/* Writes out the processed dumps that are next in order.  Called with the
+ * lock held.
+ */
+static void
+write_results(struct vc4_dump_pool *pool)
+{
+        struct vc4_dump_pool_shared *shared = pool->shared;
+
+        while (shared->next_write < pool->count) {
+                uint32_t i = shared->next_write;
+
+                if (shared->status[i] == DUMP_PROCESSED) {
+                        pool->write(pool, i, pool->results[i], pool->out);
+
+                        /* Out before it's counted as done, so that a pool
+                         * dying after this doesn't write it again.
+                         */
+                        vc4_output_flush(pool->out);
+                        shared->written++;
+
+                        vc4_output_destroy(pool->results[i]);
+                        pool->results[i] = NULL;
+                        shared->status[i] = DUMP_DONE;
+                } else if (shared->status[i] != DUMP_FAILED &&
+                           shared->status[i] != DUMP_DONE) {
+                        break;
+                }
+                shared->next_write++;
+        }
+}
+
+/* A worker picking up a dump asks the kernel to start reading in the one
+ * that will be picked up --jobs dumps later, so that the page cache misses
+ * of the next round overlap with processing this one.
+ */
+static void *
+pool_thread(void *data)
+{
+        struct vc4_dump_pool *pool = data;
+        uint8_t *status = pool->shared->status;
+
+        while (true) {
+                uint32_t i = __atomic_fetch_add(&pool->next_dump, 1,
+                                                __ATOMIC_RELAXED);
+                if (i >= pool->count)
+                        break;
+                if (status[i] != DUMP_PENDING)
+                        continue;
+
+                if (i + pool->jobs < pool->count &&
+                    status[i + pool->jobs] == DUMP_PENDING) {
+                        prefetch_dump(pool->paths[i + pool->jobs]);
+                }
+
+                status[i] = DUMP_RUNNING;
+
+                struct vc4_output *result = vc4_output_create(-1, 64 * 1024);
+                bool ok = pool->process(pool, i, result);
+
+                pthread_mutex_lock(&pool->lock);
+                if (ok) {
+                        pool->results[i] = result;
+                        status[i] = DUMP_PROCESSED;
+                } else {
+                        vc4_output_destroy(result);
+                        status[i] = DUMP_FAILED;
+                        if (pool->failed)
+                                pool->failed(pool, i);
+                }
+                write_results(pool);
+                pthread_mutex_unlock(&pool->lock);
+        }
+
+        return NULL;
+}
+
+/* Processes the pending dumps with a thread per job, in a pool process. */
+static void
+run_pool(struct vc4_dump_pool *pool)
+{
+        pthread_t *thread_ids = calloc(pool->jobs, sizeof(*thread_ids));
+
+        pool->results = calloc(pool->count, sizeof(*pool->results));
+        if (!thread_ids || !pool->results)
+                err(1, "malloc failure");
+        pool->out = vc4_output_create(STDOUT_FILENO, 256 * 1024);
+        pthread_mutex_init(&pool->lock, NULL);
+
+        /* Start the first round of dumps reading in. */
+        for (uint32_t i = 0, n = 0; i < pool->count && n < pool->jobs; i++) {
+                if (pool->shared->status[i] == DUMP_PENDING) {
+                        prefetch_dump(pool->paths[i]);
+                        n++;
+                }
+        }
+
+        for (uint32_t i = 0; i < pool->jobs; i++) {
+                if (pthread_create(&thread_ids[i], NULL, pool_thread, pool))
+                        errx(1, "Couldn't start worker thread");
+        }
+        for (uint32_t i = 0; i < pool->jobs; i++)
+                pthread_join(thread_ids[i], NULL);
+
+        vc4_output_destroy(pool->out);
+        free(pool->results);
+        free(thread_ids);
+}
+
+/* Runs fn(pool, i) in a child process, returning whether it exited
+ * cleanly.
+ */
+static bool
+run_child(struct vc4_dump_pool *pool, uint32_t i,
+          void (*fn)(struct vc4_dump_pool *, uint32_t))
+{
+        int status;
+        pid_t pid;
+
+        /* Flush before forking, so that nothing buffered gets written out
+         * twice.
+         */
+        fflush(stdout);
+        fflush(stderr);
+
+        pid = fork();
+        if (pid == -1)
+                err(1, "fork");
+        if (pid == 0) {
+                fn(pool, i);
+                exit(0);
+        }
+
+        if (waitpid(pid, &status, 0) == -1)
+                err(1, "waitpid");
+
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static void
+pool_child(struct vc4_dump_pool *pool, uint32_t i)
+{
+        run_pool(pool);
+}
+
+/* Processes the dump alone, throwing the output away.  Its error was
+ * already reported by the pool that it took down, so this one is kept
+ * quiet.
+ */
+static void
+probe_child(struct vc4_dump_pool *pool, uint32_t i)
+{
+        int null = open("/dev/null", O_WRONLY);
+
+        if (null != -1)
+                dup2(null, STDERR_FILENO);
+
+        struct vc4_output *out = vc4_output_create(-1, 64 * 1024);
+        bool ok = pool->process(pool, i, out);
+        vc4_output_destroy(out);
+
+        if (!ok)
+                exit(1);
+}
+
+/* After a pool process has died, finds which of the dumps it had in flight
+ * took it down, and sets the rest up to be tried again.  Returns the
+ * number of bad dumps found.
+ */
+static uint32_t
+find_bad_dumps(struct vc4_dump_pool *pool)
+{
+        uint8_t *status = pool->shared->status;
+        uint32_t bad = 0;
+
+        for (uint32_t i = 0; i < pool->count; i++) {
+                switch (status[i]) {
+                case DUMP_RUNNING:
+                        if (run_child(pool, i, probe_child)) {
+                                status[i] = DUMP_PENDING;
+                                break;
+                        }
+
+                        status[i] = DUMP_FAILED;
+                        if (pool->failed)
+                                pool->failed(pool, i);
+                        bad++;
+                        break;
+                case DUMP_PROCESSED:
+                        /* Its output went with the pool. */
+                        status[i] = DUMP_PENDING;
+                        break;
+                default:
+                        break;
+                }
+        }
+
+        return bad;
+}
+
+/**
+ * Processes all the dumps added, returning how many of them couldn't be.
+ */
+uint32_t
+vc4_dump_pool_run(struct vc4_dump_pool *pool)
+{
+        uint32_t failed = 0;
+
+        pool->jobs = MAX2(pool->jobs, 1);
+        pool->shared = mmap(NULL, sizeof(*pool->shared) + pool->count,
+                            PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (pool->shared == MAP_FAILED)
+                err(1, "Couldn't allocate the pool state");
+
+        while (!run_child(pool, 0, pool_child)) {
+                uint32_t bad = find_bad_dumps(pool);
+
+                /* If none of its dumps fail alone, the pool died of
+                 * something else, which a new one would just run into
+                 * again.
+                 */
+                if (!bad)
+                        errx(1, "Worker process failed");
+        }
+
+        /* Both the dumps the pools left out and the ones that took a pool
+         * down are marked in the shared state.
+         */
+        for (uint32_t i = 0; i < pool->count; i++) {
+                if (pool->shared->status[i] == DUMP_FAILED)
+                        failed++;
+        }
+
+        return failed;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/** @file vc4_dump_pool.h
+ *
+ * Runs a tool's work over a whole set of hang dumps, for the tools that
+ * triage many dumps at once.
+ *
+ * The dumps named on the command line, found in the directories given, or
+ * listed in a --files-from file are handed out one at a time to a pool of
+ * worker threads, each processing one into an output of its own.  The
+ * outputs are then written out in the order the dumps were given.
+ *
+ * A dump that process() can't read is left out.  In case one still takes
+ * the decoder down, the pool runs in a child process.  If that dies, each
+ * dump it had in flight is tried again alone in a process of its own to
+ * find the bad one, which is left out too, and a new pool picks up where
+ * the old one stopped.
+ */
+
+#ifndef VC4_DUMP_POOL_H
+#define VC4_DUMP_POOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct vc4_dump_pool_shared;
+struct vc4_output;
+
+struct vc4_dump_pool {
+        char **paths;
+        uint32_t count;
+        uint32_t size;
+
+        uint32_t jobs;
+
+        /**
+         * Called from the worker threads with each dump in turn, to write
+         * what the tool has to say about paths[i] into out.  Returns false,
+         * having reported why, if the dump couldn't be read.
+         */
+        bool (*process)(struct vc4_dump_pool *pool, uint32_t i,
+                        struct vc4_output *out);
+        /**
+         * Called in the order of the dumps, with what process() wrote for
+         * paths[i], to add it to out, which goes to stdout.
+         */
+        void (*write)(struct vc4_dump_pool *pool, uint32_t i,
+                      const struct vc4_output *result,
+                      struct vc4_output *out);
+        /** Optional, called for each dump left out for being bad. */
+        void (*failed)(struct vc4_dump_pool *pool, uint32_t i);
+        void *data;
+
+        /* The rest is private to vc4_dump_pool.c. */
+        struct vc4_dump_pool_shared *shared;
+        uint32_t next_dump;
+        pthread_mutex_t lock;
+        struct vc4_output **results;
+        struct vc4_output *out;
+};
+
+void vc4_dump_pool_add_arg(struct vc4_dump_pool *pool, const char *arg);
+void vc4_dump_pool_add_list(struct vc4_dump_pool *pool, const char *list);
+
+uint32_t vc4_dump_pool_run(struct vc4_dump_pool *pool);
+uint32_t vc4_dump_pool_written(const struct vc4_dump_pool *pool);
+
+#endif /* VC4_DUMP_POOL_H */
@@ -0,0 +1,1691 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/** @file vc4_dump_print.c
+ *
+ * The parse phases of a dump: the registers, then the bin and render CLs
+ * and the sublists they branch to, then the shader records those queued,
+ * then the shaders.  Each phase writes its part of the text or JSON dump
+ * to the context's output.
+ *
+ * With more than one thread, the sublists, shader recs and shaders are
+ * each rendered as a task into a buffer of their own by a pool of threads,
+ * and the buffers are written out in the order the items would have been
+ * rendered in, so that the output doesn't change.  The CLs are still
+ * decoded one at a time up front, since what each one decodes to depends
+ * on the ones before it, and only the rendering of them is left to the
+ * tasks.
+ */
+
+#include <err.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "vc4_drm.h"
+
+#include "vc4_tools.h"
+#include "vc4_addr_space.h"
+#include "vc4_cl_ir.h"
+#include "vc4_dump_file.h"
+#include "vc4_dump_index.h"
+#include "vc4_dump_parse.h"
+#include "vc4_json.h"
+#include "vc4_output.h"
+#include "vc4_packet.h"
+#include "vc4_qpu_defines.h"
+
+static void
+out_printf(struct vc4_dump_ctx *ctx, const char *format, ...)
+        __attribute__ ((format(__printf__, 2, 3)));
+
+static void
+out_printf(struct vc4_dump_ctx *ctx, const char *format, ...)
+{
+        va_list ap;
+
+        va_start(ap, format);
+        vc4_out_vprintf(ctx->out, format, ap);
+        va_end(ap);
+}
+
+/* Opens a top-level JSON array for a parse phase's output. */
+static void
+begin_json_array(struct vc4_dump_ctx *ctx, const char *key)
+{
+        if (ctx->json)
+                vc4_json_array_begin(ctx->json, key);
+}
+
+static void
+end_json_array(struct vc4_dump_ctx *ctx)
+{
+        if (ctx->json)
+                vc4_json_array_end(ctx->json);
+}
+
+static void
+begin_json_cl(struct vc4_dump_ctx *ctx, const char *type, uint32_t paddr)
+{
+        vc4_json_object_begin(ctx->json, NULL);
+        vc4_json_string(ctx->json, "type", type);
+        vc4_json_uint(ctx->json, "paddr", paddr);
+}
+
+static void
+end_json_cl(struct vc4_dump_ctx *ctx, uint32_t decoded_end)
+{
+        vc4_json_uint(ctx->json, "decoded_end", decoded_end);
+        vc4_json_object_end(ctx->json);
+}
+
+
+
+static void
+parse_root_cl(struct vc4_dump_ctx *ctx, uint32_t cl, const char *type,
+              const char *name, uint32_t start, uint32_t end)
+{
+        /* A root CL outside of the range still gets decoded for the
+         * sublists and shader recs that it queues, just not dumped, or
+         * just has those queued from the index if there is one.
+         */
+        bool show = vc4_parse_in_range(ctx, start, end - start);
+        const struct vc4_addr_range *range =
+                vc4_addr_space_lookup_paddr(ctx->addr_space, start);
+        const struct vc4_index_cl *indexed =
+                show ? NULL : vc4_index_root_cl(ctx, cl, start);
+        uint32_t decoded_end;
+
+        /* The CL can only run on past the end of its BO in a dump that cut
+         * the BO short, and the rest of it is missing.
+         */
+        if (range && end > start && end - range->paddr > range->size)
+                end = range->paddr + range->size;
+
+        if (!show)
+                vc4_dump_ctx_set_renderer(ctx, NULL);
+        else if (ctx->json)
+                begin_json_cl(ctx, type, start);
+        else if (ctx->text)
+                out_printf(ctx, "%s CL at 0x%08x\n", name, start);
+
+        ctx->cl_current = cl;
+        ctx->root_cls[cl - VC4_CL_BIN].start = start;
+        if (indexed) {
+                decoded_end = vc4_index_replay_cl(ctx, indexed);
+        } else {
+                decoded_end = vc4_dump_cl(ctx, start, end,
+                                          cl == VC4_CL_RENDER, false, ~0);
+        }
+        ctx->root_cls[cl - VC4_CL_BIN].end = decoded_end;
+
+        if (!show)
+                vc4_dump_ctx_set_renderer(ctx, &ctx->renderer);
+        else if (ctx->json)
+                end_json_cl(ctx, decoded_end);
+}
+
+static void
+parse_cls(struct vc4_dump_ctx *ctx)
+{
+        if (ctx->state->start_bin != ctx->state->ct0ea) {
+                parse_root_cl(ctx, VC4_CL_BIN, "bin", "Bin",
+                              ctx->state->start_bin, ctx->state->ct0ea);
+        }
+
+        parse_root_cl(ctx, VC4_CL_RENDER, "render", "Render",
+                      ctx->state->start_render, ctx->state->ct1ea);
+        ctx->cl_current = VC4_CL_NONE;
+}
+
+/* Most tasks that a thread renders in one go.  A sublist is often just a
+ * few packets, which would be swamped by the handoff if each were passed
+ * along by itself.
+ */
+#define PRINT_CHUNK_MAX_TASKS   64
+
+/* Chunks that each thread may render ahead of the one being written out. */
+#define PRINT_CHUNKS_PER_THREAD 4
+
+/* An item of a parse phase, to be rendered by one of the threads. */
+struct print_task {
+        void (*render)(struct vc4_dump_ctx *ctx, struct print_task *task);
+        struct vc4_mem_area_rec rec;
+        bool compressed;
+        /* For sublists, the CL as it was decoded up front. */
+        struct vc4_cl_ir ir;
+
+        /* The JSON writer as it would be when the item is reached. */
+        struct vc4_json json;
+};
+
+/* A run of consecutive tasks, rendered by one thread into one of the
+ * outputs, which get reused once they're written out.
+ */
+struct print_slot {
+        struct vc4_output *out;
+        bool done;
+};
+
+struct print_tasks {
+        struct vc4_dump_ctx *ctx;
+        struct print_task *tasks;
+        uint32_t count;
+        uint32_t size;
+
+        uint32_t chunk_size;
+        uint32_t chunk_count;
+        struct print_slot *slots;
+        uint32_t slot_count;
+
+        pthread_mutex_t lock;
+        pthread_cond_t cond;
+        /* The next chunk for a thread to render, and the next one to be
+         * written out.
+         */
+        uint32_t next_chunk;
+        uint32_t next_write;
+};
+
+/* Returns whether the phases' items get rendered as tasks.  The stats
+ * just add up the CLs, which isn't worth handing off.
+ */
+static bool
+use_tasks(struct vc4_dump_ctx *ctx)
+{
+        return ctx->threads > 1 && (ctx->text || ctx->json);
+}
+
+static struct print_task *
+add_task(struct print_tasks *tasks,
+         void (*render)(struct vc4_dump_ctx *ctx, struct print_task *task),
+         const struct vc4_mem_area_rec *rec)
+{
+        struct vc4_dump_ctx *ctx = tasks->ctx;
+
+        if (tasks->count == tasks->size) {
+                tasks->size = tasks->size ? tasks->size * 2 : 64;
+                tasks->tasks = realloc(tasks->tasks,
+                                       tasks->size * sizeof(*tasks->tasks));
+                if (!tasks->tasks)
+                        err(1, "malloc failure");
+        }
+
+        struct print_task *task = &tasks->tasks[tasks->count++];
+        memset(task, 0, sizeof(*task));
+        task->render = render;
+        task->rec = *rec;
+
+        /* Every task adds one value to the array that the phase writes, so
+         * the writer goes on as if this one had been written already.
+         */
+        if (ctx->json) {
+                task->json = *ctx->json;
+                ctx->json->stack[ctx->json->depth - 1].has_members = true;
+        }
+
+        return task;
+}
+
+/* Renders a chunk's tasks one after another, as they would have been
+ * without threads.
+ */
+static void
+render_chunk(struct print_tasks *tasks, struct vc4_dump_ctx *ctx,
+             uint32_t chunk, struct vc4_output *out)
+{
+        uint32_t first = chunk * tasks->chunk_size;
+        uint32_t end = MIN2(first + tasks->chunk_size, tasks->count);
+
+        ctx->out = out;
+        if (ctx->json) {
+                ctx->json_writer = tasks->tasks[first].json;
+                ctx->json_writer.out = out;
+                ctx->json = &ctx->json_writer;
+                ctx->renderer.data = ctx->json;
+        } else {
+                ctx->renderer.data = out;
+        }
+
+        for (uint32_t i = first; i < end; i++)
+                tasks->tasks[i].render(ctx, &tasks->tasks[i]);
+}
+
+static void *
+render_thread(void *data)
+{
+        struct print_tasks *tasks = data;
+        /* Each thread renders through a copy of the context that only
+         * differs in where the output goes.  Nothing else in it changes
+         * while the tasks run.
+         */
+        struct vc4_dump_ctx ctx = *tasks->ctx;
+
+        if (ctx.json)
+                ctx.scratch = vc4_output_create(-1, 256);
+
+        pthread_mutex_lock(&tasks->lock);
+        while (tasks->next_chunk < tasks->chunk_count) {
+                uint32_t chunk = tasks->next_chunk;
+                struct print_slot *slot =
+                        &tasks->slots[chunk % tasks->slot_count];
+
+                /* Wait for the chunk's slot to be written out. */
+                if (chunk >= tasks->next_write + tasks->slot_count) {
+                        pthread_cond_wait(&tasks->cond, &tasks->lock);
+                        continue;
+                }
+                tasks->next_chunk++;
+                pthread_mutex_unlock(&tasks->lock);
+
+                render_chunk(tasks, &ctx, chunk, slot->out);
+
+                pthread_mutex_lock(&tasks->lock);
+                slot->done = true;
+                pthread_cond_broadcast(&tasks->cond);
+        }
+        pthread_mutex_unlock(&tasks->lock);
+
+        if (ctx.json)
+                vc4_output_destroy(ctx.scratch);
+        return NULL;
+}
+
+/* Renders the tasks with the context's threads, while this one writes
+ * them out in order.
+ */
+static void
+run_tasks(struct print_tasks *tasks)
+{
+        struct vc4_dump_ctx *ctx = tasks->ctx;
+
+        if (!tasks->count)
+                return;
+
+        /* Small enough chunks for the threads to share out evenly. */
+        tasks->chunk_size = MIN2(MAX2(tasks->count /
+                                      (ctx->threads * 16), 1),
+                                 PRINT_CHUNK_MAX_TASKS);
+        tasks->chunk_count = ((tasks->count + tasks->chunk_size - 1) /
+                              tasks->chunk_size);
+
+        uint32_t threads = MIN2(ctx->threads, tasks->chunk_count);
+        pthread_t *thread_ids = calloc(threads, sizeof(*thread_ids));
+        tasks->slot_count = threads * PRINT_CHUNKS_PER_THREAD;
+        tasks->slots = calloc(tasks->slot_count, sizeof(*tasks->slots));
+        if (!thread_ids || !tasks->slots)
+                err(1, "malloc failure");
+        for (uint32_t i = 0; i < tasks->slot_count; i++)
+                tasks->slots[i].out = vc4_output_create(-1, 64 * 1024);
+
+        pthread_mutex_init(&tasks->lock, NULL);
+        pthread_cond_init(&tasks->cond, NULL);
+
+        for (uint32_t i = 0; i < threads; i++) {
+                if (pthread_create(&thread_ids[i], NULL, render_thread,
+                                   tasks)) {
+                        errx(1, "Couldn't start render thread");
+                }
+        }
+
+        for (uint32_t i = 0; i < tasks->chunk_count; i++) {
+                struct print_slot *slot = &tasks->slots[i % tasks->slot_count];
+
+                pthread_mutex_lock(&tasks->lock);
+                while (!slot->done)
+                        pthread_cond_wait(&tasks->cond, &tasks->lock);
+                pthread_mutex_unlock(&tasks->lock);
+
+                vc4_out_mem(ctx->out, slot->out->buf, slot->out->len);
+                vc4_output_reset(slot->out);
+
+                pthread_mutex_lock(&tasks->lock);
+                slot->done = false;
+                tasks->next_write++;
+                pthread_cond_broadcast(&tasks->cond);
+                pthread_mutex_unlock(&tasks->lock);
+        }
+
+        for (uint32_t i = 0; i < threads; i++)
+                pthread_join(thread_ids[i], NULL);
+
+        pthread_cond_destroy(&tasks->cond);
+        pthread_mutex_destroy(&tasks->lock);
+        for (uint32_t i = 0; i < tasks->slot_count; i++)
+                vc4_output_destroy(tasks->slots[i].out);
+        for (uint32_t i = 0; i < tasks->count; i++)
+                free(tasks->tasks[i].ir.items);
+        free(tasks->slots);
+        free(thread_ids);
+        free(tasks->tasks);
+}
+
+/* Keeps a copy of a decoded CL, for its task to render later. */
+static void
+capture_cl(void *data, const struct vc4_cl_ir *ir)
+{
+        struct vc4_cl_ir *copy = data;
+
+        *copy = *ir;
+        copy->size = ir->count;
+        copy->items = malloc(ir->count * sizeof(*ir->items));
+        if (!copy->items && ir->count)
+                err(1, "malloc failure");
+        memcpy(copy->items, ir->items, ir->count * sizeof(*ir->items));
+}
+
+/* Writes what comes before a sublist's packets, returning false if it
+ * isn't mapped, in which case that's all there is to it.
+ */
+static bool
+begin_sublist(struct vc4_dump_ctx *ctx, const struct vc4_mem_area_rec *rec,
+              bool compressed)
+{
+        if (ctx->json) {
+                begin_json_cl(ctx, compressed ? "compressed_list" :
+                              "sublist", rec->paddr);
+                vc4_json_bool(ctx->json, "mapped", rec->addr);
+        } else if (ctx->text) {
+                out_printf(ctx, "%s at 0x%08x:\n",
+                           compressed ? "Compressed list" : "Sublist",
+                           rec->paddr);
+                if (!rec->addr)
+                        out_printf(ctx, "    No mapping found\n");
+        }
+
+        if (!rec->addr) {
+                if (ctx->json)
+                        vc4_json_object_end(ctx->json);
+                return false;
+        }
+
+        return true;
+}
+
+static void
+end_sublist(struct vc4_dump_ctx *ctx, uint32_t decoded_end)
+{
+        if (ctx->json)
+                end_json_cl(ctx, decoded_end);
+        else if (ctx->text)
+                out_printf(ctx, "\n");
+}
+
+static void
+render_sublist(struct vc4_dump_ctx *ctx, struct print_task *task)
+{
+        if (!begin_sublist(ctx, &task->rec, task->compressed))
+                return;
+
+        ctx->renderer.render(ctx->renderer.data, &task->ir);
+        end_sublist(ctx, task->ir.end);
+}
+
+static void
+parse_sublists(struct vc4_dump_ctx *ctx)
+{
+        struct vc4_mem_area_list *list =
+                &ctx->mem_areas[VC4_MEM_AREA_BUCKET_CL];
+        struct print_tasks tasks = { .ctx = ctx };
+        bool parallel = use_tasks(ctx);
+
+        /* This array is the worklist of CLs reached by branches from the
+         * bin and render CLs.  Dumping a sublist may queue more of them,
+         * which get appended (and may move the array), so work on a copy of
+         * each rec and recheck the count every time around.
+         *
+         * Since vc4_dump_cl() stops at any byte that was already decoded,
+         * each byte of CL is decoded at most once however the branches are
+         * laid out.
+         *
+         * With a range, only the CLs starting in it were queued, so a CL
+         * in the range is only found if it's referenced from a root CL or
+         * another CL in the range.
+         */
+        if (ctx->range.has_straddler)
+                vc4_parse_insert_mem_area(ctx, &ctx->range.straddler);
+
+        for (uint32_t i = 0; i < list->count; i++) {
+                struct vc4_mem_area_rec rec = list->recs[i];
+                struct print_task *task = NULL;
+                bool compressed;
+
+                switch (rec.type) {
+                case VC4_MEM_AREA_SUB_LIST:
+                        compressed = false;
+                        break;
+                case VC4_MEM_AREA_COMPRESSED_PRIM_LIST:
+                        compressed = true;
+                        break;
+                default:
+                        continue;
+                }
+
+                if (parallel) {
+                        task = add_task(&tasks, render_sublist, &rec);
+                        task->compressed = compressed;
+                        if (!rec.addr)
+                                continue;
+                } else if (!begin_sublist(ctx, &rec, compressed)) {
+                        continue;
+                }
+
+                /* A task's CL gets decoded now, for the mem areas it
+                 * queues, and rendered later.
+                 */
+                struct vc4_cl_renderer capture = { capture_cl, NULL };
+                if (task) {
+                        capture.data = &task->ir;
+                        vc4_dump_ctx_set_renderer(ctx, &capture);
+                }
+
+                ctx->cl_current = i;
+                uint32_t decoded_end = vc4_dump_cl(ctx, rec.paddr,
+                                                   rec.paddr + rec.size, true,
+                                                   compressed, rec.prim_mode);
+                list->recs[i].decoded_end = decoded_end;
+
+                if (task)
+                        vc4_dump_ctx_set_renderer(ctx, &ctx->renderer);
+                else
+                        end_sublist(ctx, decoded_end);
+        }
+
+        ctx->cl_current = VC4_CL_NONE;
+
+        if (parallel)
+                run_tasks(&tasks);
+}
+
+/* Returns the size of a whole shader rec, which rec->size is less than if
+ * the rec was cut short at the end of its BO.
+ */
+static uint32_t
+shader_rec_full_size(const struct vc4_mem_area_rec *rec)
+{
+        if (rec->type == VC4_MEM_AREA_GL_SHADER_REC)
+                return 36 + rec->attributes * 8;
+        else
+                return 16;
+}
+
+/* Returns whether the first size bytes of the shader rec are in the dump,
+ * saying that the rec was cut short if not.
+ */
+static bool
+text_shader_rec_has(struct vc4_dump_ctx *ctx, struct vc4_mem_area_rec *rec,
+                    uint32_t size)
+{
+        if (rec->size >= size)
+                return true;
+
+        out_printf(ctx, "    Shader rec cut short at end of BO\n\n");
+        return false;
+}
+
+static void
+parse_gl_shader_rec(struct vc4_dump_ctx *ctx, struct vc4_mem_area_rec *rec)
+{
+        uint32_t paddr = rec->paddr;
+        void *addr = rec->addr;
+        uint8_t *b = addr;
+        uint16_t *s = addr;
+
+        out_printf(ctx, "GL Shader rec at 0x%08x "
+                   "(%d attributes, %sextended):\n", rec->paddr,
+                   rec->attributes,
+                   rec->extended ? "" : "not ");
+
+        if (!rec->addr) {
+                out_printf(ctx, "    No mapping found\n");
+                return;
+        }
+
+        if (!text_shader_rec_has(ctx, rec, 4))
+                return;
+        out_printf(ctx, "0x%08x:     0x%04x: %s, %s, %s\n",
+                   paddr, s[0],
+                   (s[0] & VC4_SHADER_FLAG_ENABLE_CLIPPING) ?
+                   "clipped" : "unclipped",
+                   (s[0] & VC4_SHADER_FLAG_FS_SINGLE_THREAD) ?
+                   "single thread" : "dual thread",
+                   (s[0] & VC4_SHADER_FLAG_VS_POINT_SIZE) ?
+                   "point size" : "no point size");
+
+        out_printf(ctx, "0x%08x:     0x%02x: fs num uniforms\n",
+                   paddr + 2, b[2]);
+        out_printf(ctx, "0x%08x:     0x%02x: fs inputs\n", paddr + 3, b[3]);
+        if (!text_shader_rec_has(ctx, rec, 8))
+                return;
+        out_printf(ctx, "0x%08x:     0x%04x: fs code\n", paddr + 4,
+                   *(uint32_t *)(addr + 4));
+        if (!text_shader_rec_has(ctx, rec, 12))
+                return;
+        out_printf(ctx, "0x%08x:     0x%04x: fs uniforms\n", paddr + 8,
+                   *(uint32_t *)(addr + 8));
+
+        if (!text_shader_rec_has(ctx, rec, 16))
+                return;
+        out_printf(ctx, "0x%08x:     0x%04x: vs num uniforms\n", paddr + 12,
+                   *(uint16_t *)(addr + 12));
+        out_printf(ctx, "0x%08x:     0x%02x: vs inputs\n", paddr + 14, b[14]);
+        out_printf(ctx, "0x%08x:     0x%02x: vs attr size\n",
+                   paddr + 15, b[15]);
+        if (!text_shader_rec_has(ctx, rec, 20))
+                return;
+        out_printf(ctx, "0x%08x:     0x%04x: vs code\n", paddr + 16,
+                   *(uint32_t *)(addr + 16));
+        if (!text_shader_rec_has(ctx, rec, 24))
+                return;
+        out_printf(ctx, "0x%08x:     0x%04x: vs uniforms\n", paddr + 20,
+                   *(uint32_t *)(addr + 20));
+
+        if (!text_shader_rec_has(ctx, rec, 28))
+                return;
+        out_printf(ctx, "0x%08x:     0x%04x: cs num uniforms\n", paddr + 24,
+                   *(uint16_t *)(addr + 24));
+        out_printf(ctx, "0x%08x:     0x%02x: cs inputs\n", paddr + 26, b[26]);
+        out_printf(ctx, "0x%08x:     0x%02x: cs attr size\n",
+                   paddr + 27, b[27]);
+        if (!text_shader_rec_has(ctx, rec, 32))
+                return;
+        out_printf(ctx, "0x%08x:     0x%04x: cs code\n", paddr + 28,
+                   *(uint32_t *)(addr + 28));
+        if (!text_shader_rec_has(ctx, rec, 36))
+                return;
+        out_printf(ctx, "0x%08x:     0x%04x: cs uniforms\n", paddr + 32,
+                   *(uint32_t *)(addr + 32));
+
+        for (int i = 0; i < rec->attributes; i++) {
+                uint32_t ext_stride = 0;
+                if (rec->extended)
+                        ext_stride = *(uint32_t *)(addr + 100 + i * 4);
+
+                if (!text_shader_rec_has(ctx, rec, 36 + (i + 1) * 8))
+                        return;
+                out_printf(ctx, "0x%08x:     0x%08x: attr %d addr\n",
+                           paddr + 36 + i * 8,
+                           *(uint32_t *)(addr + 36 + i * 8), i);
+                out_printf(ctx,
+                           "0x%08x:     0x%04x: attr %d %db, %db stride\n",
+                           paddr + 40 + i * 8,
+                           *(uint16_t *)(addr + 40 + i * 8),
+                           i,
+                           *(uint8_t *)(addr + 40 + i * 8) + 1,
+                           *(uint8_t *)(addr + 41 + i * 8) + ext_stride);
+                out_printf(ctx, "0x%08x:     0x%04x: "
+                           "attr %d %2d VS VPM, %2d CS VPM\n",
+                           paddr + 42 + i * 8,
+                           *(uint16_t *)(addr + 42 + i * 8),
+                           i,
+                           *(uint8_t *)(addr + 42 + i * 8),
+                           *(uint8_t *)(addr + 43 + i * 8));
+        }
+
+        out_printf(ctx, "\n");
+}
+
+static void
+parse_nv_shader_rec(struct vc4_dump_ctx *ctx, struct vc4_mem_area_rec *rec)
+{
+        uint32_t paddr = rec->paddr;
+        void *addr = rec->addr;
+        uint8_t *b = addr;
+
+        out_printf(ctx, "NV Shader rec at 0x%08x:\n", rec->paddr);
+
+        if (!rec->addr) {
+                out_printf(ctx, "    No mapping found\n");
+                return;
+        }
+
+        if (!text_shader_rec_has(ctx, rec, 4))
+                return;
+        out_printf(ctx, "0x%08x:     0x%02x: %sclip coords, %s, %s, %s\n",
+                   paddr, b[0],
+                   (b[0] & VC4_SHADER_FLAG_SHADED_CLIP_COORDS) ?
+                   "" : "no ",
+                   (b[0] & VC4_SHADER_FLAG_ENABLE_CLIPPING) ?
+                   "clipped" : "unclipped",
+                   (b[0] & VC4_SHADER_FLAG_FS_SINGLE_THREAD) ?
+                   "single thread" : "dual thread",
+                   (b[0] & VC4_SHADER_FLAG_VS_POINT_SIZE) ?
+                   "point size" : "no point size");
+
+        out_printf(ctx, "0x%08x:     0x%02x: vertex stride\n",
+                   paddr + 1, b[1]);
+        out_printf(ctx, "0x%08x:     0x%02x: fs num uniforms\n",
+                   paddr + 2, b[2]);
+        out_printf(ctx, "0x%08x:     0x%02x: fs inputs\n", paddr + 3, b[3]);
+        if (!text_shader_rec_has(ctx, rec, 8))
+                return;
+        out_printf(ctx, "0x%08x:     0x%04x: fs code\n", paddr + 4,
+                   *(uint32_t *)(addr + 4));
+        if (!text_shader_rec_has(ctx, rec, 12))
+                return;
+        out_printf(ctx, "0x%08x:     0x%04x: fs uniforms\n", paddr + 8,
+                   *(uint32_t *)(addr + 8));
+        if (!text_shader_rec_has(ctx, rec, 16))
+                return;
+        out_printf(ctx, "0x%08x:     0x%04x: vertex data\n", paddr + 12,
+                   *(uint32_t *)(addr + 12));
+
+        out_printf(ctx, "\n");
+}
+
+/* Adds the 32-bit field at offset in the shader rec to the JSON object, if
+ * the rec wasn't cut short before it.
+ */
+static void
+json_shader_rec_word(struct vc4_json *json, const char *name,
+                     struct vc4_mem_area_rec *rec, uint32_t offset)
+{
+        if (rec->size >= offset + sizeof(uint32_t))
+                vc4_json_uint(json, name, *(uint32_t *)(rec->addr + offset));
+}
+
+static void
+json_gl_shader_rec(struct vc4_dump_ctx *ctx, struct vc4_mem_area_rec *rec)
+{
+        struct vc4_json *json = ctx->json;
+        void *addr = rec->addr;
+        uint16_t flags;
+
+        vc4_json_object_begin(json, NULL);
+        vc4_json_string(json, "type", "gl");
+        vc4_json_uint(json, "paddr", rec->paddr);
+        vc4_json_uint(json, "attributes", rec->attributes);
+        vc4_json_bool(json, "extended", rec->extended);
+        vc4_json_bool(json, "mapped", addr);
+        if (!addr) {
+                vc4_json_object_end(json);
+                return;
+        }
+
+        /* The fields past the end of the BO are left out. */
+        vc4_json_bool(json, "cut_short",
+                      rec->size < shader_rec_full_size(rec));
+
+        if (rec->size < 4) {
+                vc4_json_object_end(json);
+                return;
+        }
+
+        flags = *(uint16_t *)addr;
+        vc4_json_uint(json, "flags", flags);
+        vc4_json_bool(json, "clipped",
+                      flags & VC4_SHADER_FLAG_ENABLE_CLIPPING);
+        vc4_json_bool(json, "single_thread",
+                      flags & VC4_SHADER_FLAG_FS_SINGLE_THREAD);
+        vc4_json_bool(json, "point_size",
+                      flags & VC4_SHADER_FLAG_VS_POINT_SIZE);
+
+        vc4_json_object_begin(json, "fs");
+        vc4_json_uint(json, "num_uniforms", *(uint8_t *)(addr + 2));
+        vc4_json_uint(json, "inputs", *(uint8_t *)(addr + 3));
+        json_shader_rec_word(json, "code", rec, 4);
+        json_shader_rec_word(json, "uniforms", rec, 8);
+        vc4_json_object_end(json);
+
+        if (rec->size >= 16) {
+                vc4_json_object_begin(json, "vs");
+                vc4_json_uint(json, "num_uniforms",
+                              *(uint16_t *)(addr + 12));
+                vc4_json_uint(json, "inputs", *(uint8_t *)(addr + 14));
+                vc4_json_uint(json, "attr_size", *(uint8_t *)(addr + 15));
+                json_shader_rec_word(json, "code", rec, 16);
+                json_shader_rec_word(json, "uniforms", rec, 20);
+                vc4_json_object_end(json);
+        }
+
+        if (rec->size >= 28) {
+                vc4_json_object_begin(json, "cs");
+                vc4_json_uint(json, "num_uniforms",
+                              *(uint16_t *)(addr + 24));
+                vc4_json_uint(json, "inputs", *(uint8_t *)(addr + 26));
+                vc4_json_uint(json, "attr_size", *(uint8_t *)(addr + 27));
+                json_shader_rec_word(json, "code", rec, 28);
+                json_shader_rec_word(json, "uniforms", rec, 32);
+                vc4_json_object_end(json);
+        }
+
+        vc4_json_array_begin(json, "attrs");
+        for (int i = 0;
+             i < rec->attributes && 36 + (i + 1) * 8 <= rec->size; i++) {
+                void *attr = addr + 36 + i * 8;
+                uint32_t ext_stride = 0;
+                if (rec->extended)
+                        ext_stride = *(uint32_t *)(addr + 100 + i * 4);
+
+                vc4_json_object_begin(json, NULL);
+                vc4_json_uint(json, "addr", *(uint32_t *)attr);
+                vc4_json_uint(json, "size", *(uint8_t *)(attr + 4) + 1);
+                vc4_json_uint(json, "stride",
+                              *(uint8_t *)(attr + 5) + ext_stride);
+                vc4_json_uint(json, "vs_vpm_offset", *(uint8_t *)(attr + 6));
+                vc4_json_uint(json, "cs_vpm_offset", *(uint8_t *)(attr + 7));
+                vc4_json_object_end(json);
+        }
+        vc4_json_array_end(json);
+
+        vc4_json_object_end(json);
+}
+
+static void
+json_nv_shader_rec(struct vc4_dump_ctx *ctx, struct vc4_mem_area_rec *rec)
+{
+        struct vc4_json *json = ctx->json;
+        void *addr = rec->addr;
+        uint8_t flags;
+
+        vc4_json_object_begin(json, NULL);
+        vc4_json_string(json, "type", "nv");
+        vc4_json_uint(json, "paddr", rec->paddr);
+        vc4_json_bool(json, "mapped", addr);
+        if (!addr) {
+                vc4_json_object_end(json);
+                return;
+        }
+
+        /* The fields past the end of the BO are left out. */
+        vc4_json_bool(json, "cut_short",
+                      rec->size < shader_rec_full_size(rec));
+        if (rec->size < 4) {
+                vc4_json_object_end(json);
+                return;
+        }
+
+        flags = *(uint8_t *)addr;
+        vc4_json_uint(json, "flags", flags);
+        vc4_json_bool(json, "shaded_clip_coords",
+                      flags & VC4_SHADER_FLAG_SHADED_CLIP_COORDS);
+        vc4_json_bool(json, "clipped",
+                      flags & VC4_SHADER_FLAG_ENABLE_CLIPPING);
+        vc4_json_bool(json, "single_thread",
+                      flags & VC4_SHADER_FLAG_FS_SINGLE_THREAD);
+        vc4_json_bool(json, "point_size",
+                      flags & VC4_SHADER_FLAG_VS_POINT_SIZE);
+        vc4_json_uint(json, "vertex_stride", *(uint8_t *)(addr + 1));
+
+        vc4_json_object_begin(json, "fs");
+        vc4_json_uint(json, "num_uniforms", *(uint8_t *)(addr + 2));
+        vc4_json_uint(json, "inputs", *(uint8_t *)(addr + 3));
+        json_shader_rec_word(json, "code", rec, 4);
+        json_shader_rec_word(json, "uniforms", rec, 8);
+        vc4_json_object_end(json);
+
+        json_shader_rec_word(json, "vertex_data", rec, 12);
+
+        vc4_json_object_end(json);
+}
+
+/* Queues the shader whose code address is at offset in a shader rec, and
+ * returns its mem area, or NULL if the shader rec isn't mapped or was cut
+ * short before that.
+ */
+static struct vc4_mem_area_rec *
+add_rec_shader(struct vc4_dump_ctx *ctx, struct vc4_mem_area_rec *rec,
+               enum vc4_mem_area_type type, uint32_t offset)
+{
+        if (!rec->addr || rec->size < offset + sizeof(uint32_t))
+                return NULL;
+
+        return vc4_parse_add_mem_area(ctx, type,
+                                      *(uint32_t *)(rec->addr + offset));
+}
+
+static void
+print_shader_rec(struct vc4_dump_ctx *ctx, struct vc4_mem_area_rec *rec)
+{
+        if (rec->type == VC4_MEM_AREA_GL_SHADER_REC) {
+                if (ctx->json)
+                        json_gl_shader_rec(ctx, rec);
+                else if (ctx->text)
+                        parse_gl_shader_rec(ctx, rec);
+        } else {
+                if (ctx->json)
+                        json_nv_shader_rec(ctx, rec);
+                else if (ctx->text)
+                        parse_nv_shader_rec(ctx, rec);
+        }
+}
+
+static void
+render_shader_rec(struct vc4_dump_ctx *ctx, struct print_task *task)
+{
+        print_shader_rec(ctx, &task->rec);
+}
+
+static void
+parse_shader_recs(struct vc4_dump_ctx *ctx)
+{
+        struct vc4_mem_area_list *list =
+                &ctx->mem_areas[VC4_MEM_AREA_BUCKET_SHADER_REC];
+        struct print_tasks tasks = { .ctx = ctx };
+        bool parallel = use_tasks(ctx);
+
+        /* Shader recs outside of the range are still read for the shaders
+         * they point to, which may be in it.
+         */
+        for (uint32_t i = 0; i < list->count; i++) {
+                struct vc4_mem_area_rec *rec = &list->recs[i];
+
+                if (rec->type != VC4_MEM_AREA_GL_SHADER_REC &&
+                    rec->type != VC4_MEM_AREA_NV_SHADER_REC) {
+                        continue;
+                }
+
+                if (vc4_parse_in_range(ctx, rec->paddr, rec->size)) {
+                        if (parallel)
+                                add_task(&tasks, render_shader_rec, rec);
+                        else
+                                print_shader_rec(ctx, rec);
+                }
+
+                add_rec_shader(ctx, rec, VC4_MEM_AREA_FS, 4);
+                if (rec->type == VC4_MEM_AREA_GL_SHADER_REC) {
+                        add_rec_shader(ctx, rec, VC4_MEM_AREA_VS, 16);
+                        add_rec_shader(ctx, rec, VC4_MEM_AREA_CS, 28);
+                }
+        }
+
+        if (parallel)
+                run_tasks(&tasks);
+}
+
+static void
+dump_instruction(struct vc4_dump_ctx *ctx, uint32_t paddr, uint64_t inst)
+{
+        vc4_out_lit(ctx->out, "0x");
+        vc4_out_hex(ctx->out, paddr, 8);
+        vc4_out_lit(ctx->out, ": ");
+        vc4_qpu_disasm(ctx->out, &inst, 1);
+        vc4_out_char(ctx->out, '\n');
+}
+
+static void
+json_instruction(struct vc4_dump_ctx *ctx, uint32_t paddr, uint64_t inst)
+{
+        struct vc4_output *scratch = ctx->scratch;
+
+        vc4_json_object_begin(ctx->json, NULL);
+        vc4_json_uint(ctx->json, "addr", paddr);
+
+        /* 64-bit values don't survive a trip through a JSON number in most
+         * readers, so the instruction goes out as a hex string.
+         */
+        vc4_output_reset(scratch);
+        vc4_out_lit(scratch, "0x");
+        vc4_out_hex(scratch, inst >> 32, 8);
+        vc4_out_hex(scratch, inst, 8);
+        vc4_json_string_len(ctx->json, "inst", scratch->buf, scratch->len);
+
+        vc4_output_reset(scratch);
+        vc4_qpu_disasm(scratch, &inst, 1);
+        vc4_json_string_len(ctx->json, "disasm", scratch->buf, scratch->len);
+
+        vc4_json_object_end(ctx->json);
+}
+
+/**
+ * Returns the size of the shader's code: through the two delay slots after
+ * its PROG_END, or up to the end of its BO if that comes first, which
+ * --max-bytes may have cut short of the program end.  Sets *prog_end to
+ * whether it got as far as the end of the program.  An unmapped shader
+ * has no code.
+ *
+ * This is what dump_shader() prints, and what the index records.
+ */
+uint32_t
+vc4_parse_shader_size(const struct vc4_mem_area_rec *rec, bool *prog_end)
+{
+        uint32_t end_offset = ~0;
+        uint32_t offset;
+
+        *prog_end = false;
+        if (!rec->addr)
+                return 0;
+
+        for (offset = 0;
+             offset < end_offset &&
+             offset + sizeof(uint64_t) <= rec->size;
+             offset += sizeof(uint64_t)) {
+                uint64_t inst = *(uint64_t *)(rec->addr + offset);
+
+                if (QPU_GET_FIELD(inst, QPU_SIG) == QPU_SIG_PROG_END)
+                        end_offset = offset + 12;
+        }
+
+        *prog_end = offset >= end_offset;
+        return offset;
+}
+
+static void
+dump_shader(struct vc4_dump_ctx *ctx, struct vc4_mem_area_rec *rec,
+            const char *type)
+{
+        if (ctx->json) {
+                vc4_json_object_begin(ctx->json, NULL);
+                vc4_json_string(ctx->json, "type", type);
+                vc4_json_uint(ctx->json, "paddr", rec->paddr);
+                vc4_json_bool(ctx->json, "mapped", rec->addr);
+                if (!rec->addr) {
+                        vc4_json_object_end(ctx->json);
+                        return;
+                }
+                vc4_json_array_begin(ctx->json, "instructions");
+        } else {
+                out_printf(ctx, "%s at 0x%08x:\n", type, rec->paddr);
+                if (!rec->addr) {
+                        out_printf(ctx, "    No mapping found\n");
+                        return;
+                }
+        }
+
+        bool prog_end;
+        uint32_t size = vc4_parse_shader_size(rec, &prog_end);
+        for (uint32_t offset = 0; offset < size; offset += sizeof(uint64_t)) {
+                uint64_t inst = *(uint64_t *)(rec->addr + offset);
+
+                if (ctx->json)
+                        json_instruction(ctx, rec->paddr + offset, inst);
+                else
+                        dump_instruction(ctx, rec->paddr + offset, inst);
+        }
+        bool cut_short = !prog_end;
+
+        if (ctx->json) {
+                vc4_json_array_end(ctx->json);
+                vc4_json_bool(ctx->json, "cut_short", cut_short);
+                vc4_json_object_end(ctx->json);
+        } else {
+                if (cut_short)
+                        out_printf(ctx, "    Shader cut short at end of BO\n");
+                out_printf(ctx, "\n");
+        }
+}
+
+static void
+print_shader(struct vc4_dump_ctx *ctx, struct vc4_mem_area_rec *rec)
+{
+        switch (rec->type) {
+        case VC4_MEM_AREA_CS:
+                dump_shader(ctx, rec, "CS");
+                break;
+        case VC4_MEM_AREA_VS:
+                dump_shader(ctx, rec, "VS");
+                break;
+        default:
+                dump_shader(ctx, rec, "FS");
+                break;
+        }
+}
+
+static void
+render_shader(struct vc4_dump_ctx *ctx, struct print_task *task)
+{
+        print_shader(ctx, &task->rec);
+}
+
+static void
+parse_shaders(struct vc4_dump_ctx *ctx)
+{
+        struct vc4_mem_area_list *list =
+                &ctx->mem_areas[VC4_MEM_AREA_BUCKET_SHADER];
+        struct print_tasks tasks = { .ctx = ctx };
+        bool parallel = use_tasks(ctx);
+
+        for (uint32_t i = 0; i < list->count; i++) {
+                struct vc4_mem_area_rec *rec = &list->recs[i];
+
+                if (rec->type != VC4_MEM_AREA_CS &&
+                    rec->type != VC4_MEM_AREA_VS &&
+                    rec->type != VC4_MEM_AREA_FS) {
+                        continue;
+                }
+
+                if (ctx->range.enabled) {
+                        bool prog_end;
+                        uint32_t size = vc4_parse_shader_size(rec, &prog_end);
+
+                        /* An unmapped shader is still listed if its
+                         * address is in the range.
+                         */
+                        if (!vc4_parse_in_range(ctx, rec->paddr,
+                                                MAX2(size, 1))) {
+                                continue;
+                        }
+                }
+
+                if (parallel)
+                        add_task(&tasks, render_shader, rec);
+                else
+                        print_shader(ctx, rec);
+        }
+
+        if (parallel)
+                run_tasks(&tasks);
+}
+
+static void
+print_stats(struct vc4_dump_ctx *ctx, const struct vc4_cl_stats *stats)
+{
+        uint32_t area_counts[VC4_MEM_AREA_TYPE_COUNT] = { 0 };
+
+        for (int b = 0; b < VC4_MEM_AREA_BUCKET_COUNT; b++) {
+                const struct vc4_mem_area_list *list = &ctx->mem_areas[b];
+
+                for (uint32_t i = 0; i < list->count; i++)
+                        area_counts[list->recs[i].type]++;
+        }
+
+        out_printf(ctx, "%10s  %s\n", "Count", "Packet");
+        for (int i = 0; i < ARRAY_SIZE(stats->packets); i++) {
+                if (stats->packets[i]) {
+                        out_printf(ctx, "%10u  0x%02x %s\n", stats->packets[i],
+                                   i, vc4_cl_packet_name(i));
+                }
+        }
+        if (stats->unknown_packets) {
+                out_printf(ctx, "%10u  unknown packets\n",
+                           stats->unknown_packets);
+        }
+        out_printf(ctx, "\n");
+
+        out_printf(ctx, "Draws:            %u\n", stats->draws);
+        out_printf(ctx, "Vertices:         %llu (max %u per draw)\n",
+                   (unsigned long long)stats->vertices,
+                   stats->max_draw_vertices);
+        out_printf(ctx, "Compressed prims: %u\n", stats->compressed_prims);
+        out_printf(ctx, "Tiles:            %u\n", stats->tiles);
+        out_printf(ctx, "Sublists:         %u\n",
+                   area_counts[VC4_MEM_AREA_SUB_LIST]);
+        out_printf(ctx, "Compressed lists: %u\n",
+                   area_counts[VC4_MEM_AREA_COMPRESSED_PRIM_LIST]);
+        out_printf(ctx, "GL shader recs:   %u\n",
+                   area_counts[VC4_MEM_AREA_GL_SHADER_REC]);
+        out_printf(ctx, "NV shader recs:   %u\n",
+                   area_counts[VC4_MEM_AREA_NV_SHADER_REC]);
+        out_printf(ctx, "Unique shaders:   %u (%u FS, %u VS, %u CS)\n",
+                   area_counts[VC4_MEM_AREA_FS] +
+                   area_counts[VC4_MEM_AREA_VS] +
+                   area_counts[VC4_MEM_AREA_CS],
+                   area_counts[VC4_MEM_AREA_FS],
+                   area_counts[VC4_MEM_AREA_VS],
+                   area_counts[VC4_MEM_AREA_CS]);
+        out_printf(ctx, "Duplicate refs:   %u\n", ctx->mem_area_duplicates);
+}
+
+
+
+static const struct {
+        int bit;
+        const char *name;
+} errstat_bits[] = {
+        { 15, "L2CARE: L2C AXI receive FIFO overrun error" },
+        { 14, "VCMRE: VCM error (binner)" },
+        { 13, "VCMRE: VCM error (renderer)" },
+        { 12, "VCDI: VCD Idle" },
+        { 11, "VCDE: VCD error - FIFO pointers out of snyc" },
+        { 10, "VDWE: VDW error - address overflows" },
+        { 9, "VPMEAS: VPM error - allocated size error" },
+        { 8, "VPMEFNA: VPM error - free non-allocated" },
+        { 7, "VPMEWNA: VPM error - write non-allocated" },
+        { 6, "VPMERNA: VPM error - read non-allocated" },
+        { 5, "VPMERR: VPM error - read range" },
+        { 4, "VPMEWR: VPM error - write range" },
+        { 3, "VPAERRGL: VPM allocator error - renderer request greater than limit" },
+        { 2, "VPAEBRGL: VPM allocator error - binner request greater than limit" },
+        { 1, "VPAERGS: VPM allocator error - request too big" },
+        { 0, "VPAEABB: VPM allocator error - allocating base while busy" },
+};
+
+static void
+dump_registers_json(struct vc4_dump_ctx *ctx)
+{
+        struct vc4_json *json = ctx->json;
+
+        vc4_json_object_begin(json, "registers");
+        vc4_json_uint(json, "start_bin", ctx->state->start_bin);
+        vc4_json_uint(json, "ct0ea", ctx->state->ct0ea);
+        vc4_json_uint(json, "ct0ca", ctx->state->ct0ca);
+        vc4_json_uint(json, "start_render", ctx->state->start_render);
+        vc4_json_uint(json, "ct1ea", ctx->state->ct1ea);
+        vc4_json_uint(json, "ct1ca", ctx->state->ct1ca);
+        vc4_json_uint(json, "vpmbase", ctx->state->vpmbase);
+        vc4_json_uint(json, "dbge", ctx->state->dbge);
+        vc4_json_uint(json, "fdbgo", ctx->state->fdbgo);
+        vc4_json_uint(json, "fdbgb", ctx->state->fdbgb);
+        vc4_json_uint(json, "fdbgr", ctx->state->fdbgr);
+        vc4_json_uint(json, "fdbgs", ctx->state->fdbgs);
+        vc4_json_uint(json, "errstat", ctx->state->errstat);
+        vc4_json_array_begin(json, "errstat_bits");
+        for (int i = 0; i < ARRAY_SIZE(errstat_bits); i++) {
+                if (ctx->state->errstat & (1 << errstat_bits[i].bit))
+                        vc4_json_string(json, NULL, errstat_bits[i].name);
+        }
+        vc4_json_array_end(json);
+        vc4_json_object_end(json);
+
+        vc4_json_array_begin(json, "bos");
+        for (int i = 0; i < ctx->state->bo_count; i++) {
+                vc4_json_object_begin(json, NULL);
+                vc4_json_uint(json, "handle", ctx->bo_state[i].handle);
+                vc4_json_uint(json, "paddr", ctx->bo_state[i].paddr);
+                vc4_json_uint(json, "size", ctx->bo_state[i].size);
+                vc4_json_object_end(json);
+        }
+        vc4_json_array_end(json);
+}
+
+static void
+dump_registers(struct vc4_dump_ctx *ctx)
+{
+        if (ctx->json) {
+                dump_registers_json(ctx);
+                return;
+        }
+
+        out_printf(ctx, "Bin CL:         0x%08x to 0x%08x\n",
+                   ctx->state->start_bin, ctx->state->ct0ea);
+        out_printf(ctx, "Bin current:    0x%08x\n", ctx->state->ct0ca);
+        out_printf(ctx, "Render CL:      0x%08x to 0x%08x\n",
+                   ctx->state->start_render, ctx->state->ct1ea);
+        out_printf(ctx, "Render current: 0x%08x\n", ctx->state->ct1ca);
+        out_printf(ctx, "\n");
+
+        out_printf(ctx, "V3D_VPMBASE:    0x%08x\n", ctx->state->vpmbase);
+        out_printf(ctx, "V3D_DBGE:       0x%08x\n", ctx->state->dbge);
+        out_printf(ctx, "V3D_FDBGO:      0x%08x: %s\n", ctx->state->fdbgo,
+                   (ctx->state->fdbgo & ~((1 << 1) |
+                                          (1 << 2) |
+                                          (1 << 11))) ?
+                   "some errors" : "no errors");
+        out_printf(ctx, "V3D_FDBGB:      0x%08x\n", ctx->state->fdbgb);
+        out_printf(ctx, "V3D_FDBGR:      0x%08x\n", ctx->state->fdbgr);
+        out_printf(ctx, "V3D_FDBGS:      0x%08x\n", ctx->state->fdbgs);
+        out_printf(ctx, "\n");
+        out_printf(ctx, "V3D_ERRSTAT:    0x%08x\n", ctx->state->errstat);
+        for (int i = 0; i < ARRAY_SIZE(errstat_bits); i++) {
+                if (ctx->state->errstat & (1 << errstat_bits[i].bit))
+                        out_printf(ctx, "V3D_ERRSTAT:    %s\n",
+                                   errstat_bits[i].name);
+        }
+
+        out_printf(ctx, "\n");
+}
+
+/* Size of the largest fixed-size packet (TILE_BINNING_MODE_CONFIG), for
+ * bounding how far past the current address a root CL gets decoded.
+ */
+#define LOCUS_MAX_PACKET_SIZE   16
+/* BRANCHes to follow looking for the current address before giving up. */
+#define LOCUS_MAX_BRANCHES      1024
+
+/**
+ * State for finding the packet containing addr.  This is the renderer's
+ * data, since the decoded items only live until the next vc4_dump_cl().
+ */
+struct locus_search {
+        struct vc4_dump_ctx *ctx;
+        uint32_t addr;
+        /* Name of the register addr came from, or NULL to not print the
+         * window of packets.
+         */
+        const char *name;
+        uint32_t window;
+
+        bool found;
+        /* The item containing addr, if found and addr isn't at the end. */
+        struct vc4_cl_item item;
+        /* Target of the BRANCH that the CL ended in, or 0. */
+        uint32_t branch;
+
+        /* The last shader state packet decoded before addr. */
+        bool has_shader_state;
+        struct vc4_cl_item shader_state;
+};
+
+/**
+ * Returns the index of the item containing addr, ir->count if addr is just
+ * past the last byte decoded, or ~0 if it's not in the CL.
+ *
+ * Relative branches in compressed lists mean the items aren't necessarily
+ * in address order, so an item only extends to the next one if that comes
+ * after it.
+ */
+static uint32_t
+locus_find_item(const struct vc4_cl_ir *ir, uint32_t addr)
+{
+        for (uint32_t i = 0; i < ir->count; i++) {
+                uint32_t start = ir->items[i].offset;
+                uint32_t end = ir->end;
+
+                if (i + 1 < ir->count && ir->items[i + 1].offset > start)
+                        end = ir->items[i + 1].offset;
+
+                if (addr >= start && addr < end)
+                        return i;
+        }
+
+        if (addr == ir->end)
+                return ir->count;
+
+        return ~0;
+}
+
+static void
+locus_render_items(struct vc4_dump_ctx *ctx, const struct vc4_cl_ir *ir,
+                   uint32_t first, uint32_t end)
+{
+        struct vc4_cl_ir slice = *ir;
+
+        slice.items = ir->items + first;
+        slice.count = end - first;
+        vc4_cl_render_text(ctx->out, &slice);
+}
+
+static void
+locus_render(void *data, const struct vc4_cl_ir *ir)
+{
+        struct locus_search *search = data;
+        struct vc4_dump_ctx *ctx = search->ctx;
+        uint32_t locus = locus_find_item(ir, search->addr);
+        uint32_t shader_end = locus == ~0 ? ir->count : locus;
+
+        for (uint32_t i = 0; i < shader_end; i++) {
+                const struct vc4_cl_item *item = &ir->items[i];
+
+                if (item->kind == VC4_CL_ITEM_PACKET &&
+                    (item->opcode == VC4_PACKET_GL_SHADER_STATE ||
+                     item->opcode == VC4_PACKET_NV_SHADER_STATE)) {
+                        search->shader_state = *item;
+                        search->has_shader_state = true;
+                }
+        }
+
+        if (locus == ~0) {
+                const struct vc4_cl_item *last;
+
+                search->branch = 0;
+                if (!ir->count)
+                        return;
+
+                last = &ir->items[ir->count - 1];
+                if (last->kind == VC4_CL_ITEM_PACKET &&
+                    last->opcode == VC4_PACKET_BRANCH) {
+                        search->branch = last->u.branch.addr;
+                }
+                return;
+        }
+
+        search->found = true;
+        if (locus < ir->count)
+                search->item = ir->items[locus];
+
+        if (!search->name)
+                return;
+
+        uint32_t first = locus > search->window ? locus - search->window : 0;
+        uint32_t end = MIN2(locus + search->window + 1, ir->count);
+
+        locus_render_items(ctx, ir, first, locus);
+        out_printf(ctx, "---------- %s 0x%08x\n", search->name, search->addr);
+        locus_render_items(ctx, ir, locus, end);
+}
+
+/**
+ * Decodes the CL from start looking for search->addr, following BRANCHes
+ * out of the CL until it's found.
+ */
+static bool
+locus_decode(struct vc4_dump_ctx *ctx, struct locus_search *search,
+             uint32_t start, uint32_t end)
+{
+        struct vc4_cl_renderer renderer = {
+                .render = locus_render,
+                .data = search,
+        };
+
+        vc4_dump_ctx_set_renderer(ctx, &renderer);
+
+        for (int i = 0; i < LOCUS_MAX_BRANCHES && !search->found; i++) {
+                search->branch = 0;
+                vc4_dump_cl(ctx, start, end, true, false, ~0);
+
+                start = search->branch;
+                if (!start)
+                        break;
+                end = vc4_parse_get_end_paddr(ctx, start);
+                if (!end)
+                        break;
+        }
+
+        vc4_dump_ctx_set_renderer(ctx, NULL);
+
+        return search->found;
+}
+
+static void
+locus_capture_shader_state(void *data, const struct vc4_cl_ir *ir)
+{
+        struct locus_search *search = data;
+
+        if (ir->count) {
+                search->shader_state = ir->items[0];
+                search->has_shader_state = true;
+        }
+}
+
+/**
+ * Does what locus_decode() would for an address in the root CL cl, but
+ * finds it in the index and decodes from the start of the window instead
+ * of from the start of the CL.  Returns false, having done nothing, if the
+ * index doesn't have the address.
+ *
+ * What decoding the packets before the window would have left behind is
+ * the shader state, the primitive mode and the bytes marked as visited.
+ * The last shader state packet gets decoded on its own, and the rest comes
+ * from the index.
+ */
+static bool
+locus_decode_indexed(struct vc4_dump_ctx *ctx, struct locus_search *search,
+                     uint32_t cl, uint32_t start, uint32_t end)
+{
+        const struct vc4_index_cl *entry = vc4_index_root_cl(ctx, cl, start);
+        const struct vc4_cl_item *items;
+        uint32_t locus, first, shader_state = ~0;
+        uint8_t prim_mode = ~0;
+
+        if (!entry)
+                return false;
+        items = ctx->index->items + entry->first_item;
+
+        locus = vc4_index_find_item(ctx->index, entry, search->addr);
+        if (locus >= entry->item_count)
+                return false;
+
+        /* Start at a packet, not among the entries of a compressed
+         * primitive.  The kinds of packet come first in the enum.
+         */
+        first = locus > search->window ? locus - search->window : 0;
+        while (first && items[first].kind > VC4_CL_ITEM_UNKNOWN_PACKET)
+                first--;
+        if (!first)
+                return false;
+
+        for (uint32_t i = 0; i < first; i++) {
+                if (items[i].kind != VC4_CL_ITEM_PACKET)
+                        continue;
+
+                switch (items[i].opcode) {
+                case VC4_PACKET_PRIMITIVE_LIST_FORMAT:
+                        prim_mode = items[i].u.prim_list_format.format & 0x0f;
+                        break;
+                case VC4_PACKET_GL_SHADER_STATE:
+                case VC4_PACKET_NV_SHADER_STATE:
+                        shader_state = i;
+                        break;
+                }
+        }
+
+        /* It's decoded again rather than taken from the index for its
+         * link to the shader rec.
+         */
+        if (shader_state != ~0) {
+                struct vc4_cl_renderer capture = {
+                        .render = locus_capture_shader_state,
+                        .data = search,
+                };
+
+                vc4_dump_ctx_set_renderer(ctx, &capture);
+                vc4_dump_cl(ctx, items[shader_state].offset,
+                            items[shader_state + 1].offset, true, false, ~0);
+        }
+
+        ctx->hooks->mark_cl_visited(ctx, start, items[first].offset - start);
+
+        struct vc4_cl_renderer renderer = {
+                .render = locus_render,
+                .data = search,
+        };
+
+        vc4_dump_ctx_set_renderer(ctx, &renderer);
+        vc4_dump_cl(ctx, items[first].offset, end, true, false, prim_mode);
+        vc4_dump_ctx_set_renderer(ctx, NULL);
+
+        return true;
+}
+
+/* Returns where to stop decoding a root CL to get the window of packets
+ * after addr.
+ */
+static uint32_t
+locus_decode_end(uint32_t addr, uint32_t end, uint32_t window)
+{
+        uint64_t bound = addr + ((uint64_t)window + 1) * LOCUS_MAX_PACKET_SIZE;
+
+        return MIN2(end, bound);
+}
+
+static void
+locus_dump_shaders(struct vc4_dump_ctx *ctx,
+                   const struct vc4_cl_item *shader_state)
+{
+        struct vc4_mem_area_rec *rec, *shader;
+
+        if (!shader_state->link)
+                return;
+        rec = vc4_parse_mem_area(ctx, shader_state->link);
+
+        if (rec->type == VC4_MEM_AREA_GL_SHADER_REC) {
+                parse_gl_shader_rec(ctx, rec);
+                if ((shader = add_rec_shader(ctx, rec, VC4_MEM_AREA_FS, 4)))
+                        dump_shader(ctx, shader, "FS");
+                if ((shader = add_rec_shader(ctx, rec, VC4_MEM_AREA_VS, 16)))
+                        dump_shader(ctx, shader, "VS");
+                if ((shader = add_rec_shader(ctx, rec, VC4_MEM_AREA_CS, 28)))
+                        dump_shader(ctx, shader, "CS");
+        } else {
+                parse_nv_shader_rec(ctx, rec);
+                if ((shader = add_rec_shader(ctx, rec, VC4_MEM_AREA_FS, 4)))
+                        dump_shader(ctx, shader, "FS");
+        }
+}
+
+/**
+ * Prints the packets around one thread's current address, and the shaders
+ * that were bound there.
+ *
+ * Only the part of the root CL up to a little past the current address gets
+ * decoded.  If the current address isn't in the root CL, the thread is in a
+ * sublist, and the packet just before the return address is the branch that
+ * got it there.
+ */
+static void
+dump_locus(struct vc4_dump_ctx *ctx, uint32_t cl, const char *name,
+           const char *reg, uint32_t start, uint32_t end, uint32_t ca,
+           uint32_t ra, uint32_t window)
+{
+        struct locus_search search = {
+                .ctx = ctx,
+                .addr = ca,
+                .name = reg,
+                .window = window,
+        };
+        if (ca >= start && ca <= end) {
+                uint32_t decode_end = locus_decode_end(ca, end, window);
+
+                out_printf(ctx, "%s current 0x%08x, in the %s CL at 0x%08x:\n",
+                           name, ca, name, start);
+                if (!locus_decode_indexed(ctx, &search, cl, start,
+                                          decode_end)) {
+                        locus_decode(ctx, &search, start, decode_end);
+                }
+        } else if (ra > start && ra <= end) {
+                struct locus_search caller = {
+                        .ctx = ctx,
+                        .addr = ra - 1,
+                };
+                uint32_t decode_end = locus_decode_end(ra, end, window);
+
+                if (!locus_decode_indexed(ctx, &caller, cl, start,
+                                          decode_end)) {
+                        locus_decode(ctx, &caller, start, decode_end);
+                }
+                if (caller.found &&
+                    caller.item.kind == VC4_CL_ITEM_PACKET &&
+                    caller.item.opcode == VC4_PACKET_BRANCH_TO_SUB_LIST) {
+                        uint32_t sublist = caller.item.u.branch.addr;
+                        uint32_t sublist_end =
+                                vc4_parse_get_end_paddr(ctx, sublist);
+
+                        out_printf(ctx, "%s current 0x%08x, in the sublist at "
+                                   "0x%08x called from 0x%08x:\n",
+                                   name, ca, sublist, caller.item.offset);
+                        search.has_shader_state = caller.has_shader_state;
+                        search.shader_state = caller.shader_state;
+                        if (sublist_end)
+                                locus_decode(ctx, &search, sublist,
+                                             sublist_end);
+                }
+        }
+
+        /* Without a known packet boundary to start from, decode from the
+         * current address itself.
+         */
+        if (!search.found) {
+                uint32_t ca_end = vc4_parse_get_end_paddr(ctx, ca);
+
+                out_printf(ctx, "%s current 0x%08x, not reached from the "
+                           "%s CL at 0x%08x:\n", name, ca, name, start);
+                if (ca_end)
+                        locus_decode(ctx, &search, ca, ca_end);
+                else
+                        out_printf(ctx, "    No mapping found\n");
+        }
+        out_printf(ctx, "\n");
+
+        if (search.has_shader_state)
+                locus_dump_shaders(ctx, &search.shader_state);
+}
+
+static void
+parse_locus(struct vc4_dump_ctx *ctx, uint32_t window)
+{
+        if (ctx->state->start_bin != ctx->state->ct0ea) {
+                dump_locus(ctx, VC4_CL_BIN, "bin", "ct0ca",
+                           ctx->state->start_bin, ctx->state->ct0ea,
+                           ctx->state->ct0ca, ctx->state->ct0ra0, window);
+        }
+
+        dump_locus(ctx, VC4_CL_RENDER, "render", "ct1ca",
+                   ctx->state->start_render, ctx->state->ct1ea,
+                   ctx->state->ct1ca, ctx->state->ct1ra0, window);
+}
+
+
+/**
+ * Decodes all of the CLs through renderer and reads the shader recs, the
+ * way vc4_dump_print() does but without writing anything, leaving
+ * everything they reached queued up in the context.
+ */
+void
+vc4_dump_walk(struct vc4_dump_ctx *ctx, const struct vc4_cl_renderer *renderer)
+{
+        ctx->renderer = *renderer;
+        vc4_dump_ctx_set_renderer(ctx, &ctx->renderer);
+
+        parse_cls(ctx);
+        parse_sublists(ctx);
+        parse_shader_recs(ctx);
+}
+
+/**
+ * Writes the dump in the format given to vc4_dump_ctx_set_output().
+ */
+void
+vc4_dump_print(struct vc4_dump_ctx *ctx)
+{
+        if (ctx->json) {
+                vc4_json_object_begin(ctx->json, NULL);
+                vc4_json_uint(ctx->json, "version", ctx->file->version);
+        }
+
+        vc4_dump_ctx_set_renderer(ctx, &ctx->renderer);
+
+        if (ctx->format == VC4_DUMP_FORMAT_STATS) {
+                /* The CLs and shader recs get walked for what they queue,
+                 * but there's no need to look at the shaders.
+                 */
+                parse_cls(ctx);
+                parse_sublists(ctx);
+                parse_shader_recs(ctx);
+                print_stats(ctx, &ctx->stats);
+                return;
+        }
+
+        dump_registers(ctx);
+
+        begin_json_array(ctx, "cls");
+        parse_cls(ctx);
+        parse_sublists(ctx);
+        end_json_array(ctx);
+
+        begin_json_array(ctx, "shader_recs");
+        parse_shader_recs(ctx);
+        end_json_array(ctx);
+
+        begin_json_array(ctx, "shaders");
+        parse_shaders(ctx);
+        end_json_array(ctx);
+
+        if (ctx->json) {
+                vc4_json_object_end(ctx->json);
+                vc4_json_finish(ctx->json);
+        }
+
+        if (ctx->cl_cycles || ctx->cl_overlaps) {
+                vc4_parse_diag(ctx, "Stopped CL decode at %d branch cycles "
+                               "and %d overlapping CLs\n",
+                               ctx->cl_cycles, ctx->cl_overlaps);
+        }
+        if (ctx->omitted_refs) {
+                vc4_parse_diag(ctx, "Skipped %d references to memory left "
+                               "out of the dump\n", ctx->omitted_refs);
+        }
+}
+
+/**
+ * Writes the registers, then the window packets on either side of where
+ * each thread's CL had got to, and the shaders bound there, as text.
+ */
+void
+vc4_dump_print_locus(struct vc4_dump_ctx *ctx, uint32_t window)
+{
+        dump_registers(ctx);
+        parse_locus(ctx, window);
+}
@@ -0,0 +1,1253 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/** @file vc4_dump_query.c
+ *
+ * Finds the packets or shader recs matching a predicate across a set of
+ * hang dumps, for questions like which dumps drew with more than 65535
+ * indices:
+ *
+ *     vc4_dump_query 'opcode == GL_INDEXED_PRIMITIVE && count > 65535' dir
+ *
+ * or had a fragment shader that never ends:
+ *
+ *     vc4_dump_query 'fs.prog_end == 0' dir
+ *
+ * The predicate is a C-like expression of fields, numbers, and the names
+ * of packets and primitive types, with ==, !=, <, <=, >, >=, !, && and ||.
+ * The fields it uses decide whether it's matched against packets or
+ * against shader recs.  A field that a packet or shader rec doesn't have
+ * makes any comparison with it false, and the field false on its own, so
+ * "!fs.prog_end" also matches the recs whose shader couldn't be read,
+ * where "fs.prog_end == 0" doesn't.
+ *
+ * The predicate is parsed once into a small stack program that's run on
+ * each packet or shader rec.  Parsing it also works out which opcodes a
+ * packet could possibly match with, so that the other packets aren't run
+ * through it at all, and whole dumps with none of those packets are
+ * skipped after reading the opcode counts of their index.
+ *
+ * The packets and shader recs come from each dump's index (see
+ * vc4_dump_index.h), which is built with a full walk of the dump unless
+ * it's been saved next to the dump, as --index does for the next query.
+ * The dumps are spread over a vc4_dump_pool, and the matches written out
+ * in the order the dumps were given.
+ */
+
+#include <err.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "vc4_dump.h"
+#include "vc4_dump_index.h"
+#include "vc4_dump_pool.h"
+#include "vc4_output.h"
+#include "vc4_packet.h"
+#include "vc4_tools.h"
+
+/* Deepest the stack program's stack, and the expression's parentheses,
+ * may go.
+ */
+#define QUERY_MAX_DEPTH         32
+
+enum query_class {
+        QUERY_PACKETS = 1 << 0,
+        QUERY_SHADER_RECS = 1 << 1,
+};
+
+/* What a predicate is evaluated on: a packet in a CL, or a shader rec. */
+struct query_record {
+        const struct vc4_dump_index *index;
+        const struct vc4_index_cl *cl;
+        const struct vc4_cl_item *item;
+        const struct vc4_index_shader_rec *rec;
+};
+
+struct query_field {
+        const char *name;
+        /* The records that can have the field. */
+        uint8_t classes;
+        /* The packets that have the field, or all of them if none are
+         * listed.
+         */
+        uint8_t opcode_count;
+        uint8_t opcodes[4];
+        /* Stores the field's value and returns true, or returns false if
+         * the record doesn't have the field.
+         */
+        bool (*get)(const struct query_record *r, int arg, uint64_t *value);
+        int arg;
+};
+
+enum query_op {
+        OP_CONST,
+        OP_FIELD,
+        /* Turns the value on top of the stack into 0 or 1. */
+        OP_TRUTH,
+        OP_NOT,
+        OP_AND,
+        OP_OR,
+        OP_EQ,
+        OP_NE,
+        OP_LT,
+        OP_LE,
+        OP_GT,
+        OP_GE,
+};
+
+struct query_insn {
+        enum query_op op;
+        uint64_t value;
+        const struct query_field *field;
+};
+
+struct query_value {
+        uint64_t value;
+        bool present;
+};
+
+struct opcode_set {
+        uint32_t bits[256 / 32];
+};
+
+/* A compiled predicate. */
+struct query {
+        enum query_class class;
+        struct query_insn *insns;
+        uint32_t count;
+        /* The opcodes of the packets the predicate could match. */
+        struct opcode_set opcodes;
+};
+
+/* The parsed form of the predicate, which is compiled to a struct query. */
+struct node {
+        enum query_op op;
+        uint64_t value;
+        const struct query_field *field;
+        struct node *left, *right;
+};
+
+struct parser {
+        const char *query;
+        const char *pos;
+        uint32_t depth;
+};
+
+static bool
+packet_decoded(const struct query_record *r)
+{
+        return r->item && r->item->kind == VC4_CL_ITEM_PACKET;
+}
+
+static bool
+get_opcode(const struct query_record *r, int arg, uint64_t *value)
+{
+        if (!r->item)
+                return false;
+        *value = r->item->opcode;
+        return true;
+}
+
+static bool
+get_addr(const struct query_record *r, int arg, uint64_t *value)
+{
+        *value = r->item ? r->item->offset : r->rec->paddr;
+        return true;
+}
+
+static bool
+get_cl(const struct query_record *r, int arg, uint64_t *value)
+{
+        if (!r->item)
+                return false;
+        *value = r->cl->paddr;
+        return true;
+}
+
+static bool
+get_prim_field(const struct query_record *r, int arg, uint64_t *value)
+{
+        const struct vc4_cl_item *item = r->item;
+        uint8_t mode;
+
+        if (!packet_decoded(r))
+                return false;
+
+        switch (item->opcode) {
+        case VC4_PACKET_GL_INDEXED_PRIMITIVE:
+                mode = item->u.indexed_prim.mode;
+                *value = item->u.indexed_prim.count;
+                break;
+        case VC4_PACKET_GL_ARRAY_PRIMITIVE:
+                mode = item->u.array_prim.mode;
+                *value = item->u.array_prim.count;
+                break;
+        default:
+                return false;
+        }
+
+        /* arg is 0 for the count, or else the mask of mode bits. */
+        if (arg)
+                *value = mode & arg;
+        return true;
+}
+
+static bool
+get_indexed_field(const struct query_record *r, int arg, uint64_t *value)
+{
+        const struct vc4_cl_item *item = r->item;
+
+        if (!packet_decoded(r) ||
+            item->opcode != VC4_PACKET_GL_INDEXED_PRIMITIVE)
+                return false;
+
+        switch (arg) {
+        case 0:
+                *value = item->u.indexed_prim.ib_offset;
+                break;
+        case 1:
+                *value = item->u.indexed_prim.max_index;
+                break;
+        default:
+                *value = (item->u.indexed_prim.mode &
+                          VC4_INDEX_BUFFER_U16) ? 16 : 8;
+                break;
+        }
+        return true;
+}
+
+static bool
+get_start(const struct query_record *r, int arg, uint64_t *value)
+{
+        if (!packet_decoded(r) ||
+            r->item->opcode != VC4_PACKET_GL_ARRAY_PRIMITIVE)
+                return false;
+        *value = r->item->u.array_prim.start;
+        return true;
+}
+
+static bool
+get_target(const struct query_record *r, int arg, uint64_t *value)
+{
+        if (!packet_decoded(r) ||
+            (r->item->opcode != VC4_PACKET_BRANCH &&
+             r->item->opcode != VC4_PACKET_BRANCH_TO_SUB_LIST))
+                return false;
+        *value = r->item->u.branch.addr;
+        return true;
+}
+
+static bool
+get_buffer_addr(const struct query_record *r, int arg, uint64_t *value)
+{
+        if (!packet_decoded(r))
+                return false;
+
+        switch (r->item->opcode) {
+        case VC4_PACKET_STORE_FULL_RES_TILE_BUFFER:
+        case VC4_PACKET_LOAD_FULL_RES_TILE_BUFFER:
+                *value = r->item->u.loadstore_full.addr;
+                return true;
+        case VC4_PACKET_STORE_TILE_BUFFER_GENERAL:
+        case VC4_PACKET_LOAD_TILE_BUFFER_GENERAL:
+                *value = r->item->u.loadstore_general.addr;
+                return true;
+        default:
+                return false;
+        }
+}
+
+static bool
+get_format(const struct query_record *r, int arg, uint64_t *value)
+{
+        if (!packet_decoded(r) ||
+            r->item->opcode != VC4_PACKET_PRIMITIVE_LIST_FORMAT)
+                return false;
+        *value = r->item->u.prim_list_format.format;
+        return true;
+}
+
+static bool
+get_rec(const struct query_record *r, int arg, uint64_t *value)
+{
+        if (!packet_decoded(r))
+                return false;
+
+        switch (r->item->opcode) {
+        case VC4_PACKET_GL_SHADER_STATE:
+                *value = r->item->u.gl_shader_state.rec_paddr;
+                return true;
+        case VC4_PACKET_NV_SHADER_STATE:
+                *value = r->item->u.nv_shader_state.rec_paddr;
+                return true;
+        default:
+                return false;
+        }
+}
+
+/* The fields that GL_SHADER_STATE packets share with shader recs: arg is 0
+ * for the attribute count and 1 for whether it's extended.
+ */
+static bool
+get_rec_flags(const struct query_record *r, int arg, uint64_t *value)
+{
+        if (r->rec) {
+                *value = arg ? r->rec->extended : r->rec->attributes;
+                return true;
+        }
+
+        if (!packet_decoded(r) ||
+            r->item->opcode != VC4_PACKET_GL_SHADER_STATE)
+                return false;
+        *value = (arg ? r->item->u.gl_shader_state.extended :
+                  r->item->u.gl_shader_state.attributes);
+        return true;
+}
+
+static bool
+get_binning_config(const struct query_record *r, int arg, uint64_t *value)
+{
+        if (!packet_decoded(r) ||
+            r->item->opcode != VC4_PACKET_TILE_BINNING_MODE_CONFIG)
+                return false;
+
+        switch (arg) {
+        case 0:
+                *value = r->item->u.tile_binning_config.tile_alloc_addr;
+                break;
+        case 1:
+                *value = r->item->u.tile_binning_config.tile_alloc_size;
+                break;
+        default:
+                *value = r->item->u.tile_binning_config.tile_state_addr;
+                break;
+        }
+        return true;
+}
+
+/* The size of the frame or clip window: arg is 0 for the width and 1 for
+ * the height.  The binning config's is in tiles.
+ */
+static bool
+get_size(const struct query_record *r, int arg, uint64_t *value)
+{
+        const struct vc4_cl_item *item = r->item;
+
+        if (!packet_decoded(r))
+                return false;
+
+        switch (item->opcode) {
+        case VC4_PACKET_TILE_BINNING_MODE_CONFIG:
+                *value = (arg ? item->u.tile_binning_config.height :
+                          item->u.tile_binning_config.width);
+                return true;
+        case VC4_PACKET_TILE_RENDERING_MODE_CONFIG:
+                *value = (arg ? item->u.tile_rendering_config.height :
+                          item->u.tile_rendering_config.width);
+                return true;
+        case VC4_PACKET_CLIP_WINDOW:
+                *value = (arg ? item->u.clip_window.height :
+                          item->u.clip_window.width);
+                return true;
+        default:
+                return false;
+        }
+}
+
+static bool
+get_color_addr(const struct query_record *r, int arg, uint64_t *value)
+{
+        if (!packet_decoded(r) ||
+            r->item->opcode != VC4_PACKET_TILE_RENDERING_MODE_CONFIG)
+                return false;
+        *value = r->item->u.tile_rendering_config.color_addr;
+        return true;
+}
+
+static bool
+get_rec_size(const struct query_record *r, int arg, uint64_t *value)
+{
+        *value = r->rec->size;
+        return true;
+}
+
+static bool
+get_rec_gl(const struct query_record *r, int arg, uint64_t *value)
+{
+        *value = r->rec->gl;
+        return true;
+}
+
+static bool
+get_rec_mapped(const struct query_record *r, int arg, uint64_t *value)
+{
+        *value = r->rec->mapped;
+        return true;
+}
+
+enum shader_field {
+        SHADER_ADDR,
+        SHADER_MAPPED,
+        SHADER_SIZE,
+        SHADER_HASH,
+        SHADER_PROG_END,
+};
+
+/* A field of one of the rec's shaders, with the shader type in the low
+ * bits of arg and the enum shader_field above them.  Only the address and
+ * whether the code was mapped are known for a shader that wasn't.
+ */
+static bool
+get_shader(const struct query_record *r, int arg, uint64_t *value)
+{
+        uint32_t entry = r->rec->shaders[arg & 3];
+        const struct vc4_index_shader *shader;
+
+        if (!entry)
+                return false;
+        shader = &r->index->shaders[entry - 1];
+
+        switch (arg >> 2) {
+        case SHADER_ADDR:
+                *value = shader->paddr;
+                return true;
+        case SHADER_MAPPED:
+                *value = !!(shader->flags & VC4_INDEX_SHADER_MAPPED);
+                return true;
+        }
+
+        if (!(shader->flags & VC4_INDEX_SHADER_MAPPED))
+                return false;
+
+        switch (arg >> 2) {
+        case SHADER_SIZE:
+                *value = shader->size;
+                break;
+        case SHADER_HASH:
+                *value = shader->hash;
+                break;
+        default:
+                *value = !!(shader->flags & VC4_INDEX_SHADER_PROG_END);
+                break;
+        }
+        return true;
+}
+
+#define PACKETS(...)                                                    \
+        QUERY_PACKETS,                                                  \
+        sizeof((uint8_t[]){ __VA_ARGS__ }), { __VA_ARGS__ }
+
+#define SHADER_FIELDS(prefix, type)                                     \
+        { prefix ".addr", QUERY_SHADER_RECS, 0, { 0 }, get_shader,      \
+          type | SHADER_ADDR << 2 },                                    \
+        { prefix ".mapped", QUERY_SHADER_RECS, 0, { 0 }, get_shader,    \
+          type | SHADER_MAPPED << 2 },                                  \
+        { prefix ".size", QUERY_SHADER_RECS, 0, { 0 }, get_shader,      \
+          type | SHADER_SIZE << 2 },                                    \
+        { prefix ".hash", QUERY_SHADER_RECS, 0, { 0 }, get_shader,      \
+          type | SHADER_HASH << 2 },                                    \
+        { prefix ".prog_end", QUERY_SHADER_RECS, 0, { 0 }, get_shader,  \
+          type | SHADER_PROG_END << 2 }
+
+static const struct query_field fields[] = {
+        { "opcode", QUERY_PACKETS, 0, { 0 }, get_opcode },
+        { "addr", QUERY_PACKETS | QUERY_SHADER_RECS, 0, { 0 }, get_addr },
+        { "cl", QUERY_PACKETS, 0, { 0 }, get_cl },
+
+        { "count", PACKETS(VC4_PACKET_GL_INDEXED_PRIMITIVE,
+                           VC4_PACKET_GL_ARRAY_PRIMITIVE),
+          get_prim_field, 0 },
+        { "mode", PACKETS(VC4_PACKET_GL_INDEXED_PRIMITIVE,
+                          VC4_PACKET_GL_ARRAY_PRIMITIVE),
+          get_prim_field, 0xff },
+        { "prim", PACKETS(VC4_PACKET_GL_INDEXED_PRIMITIVE,
+                          VC4_PACKET_GL_ARRAY_PRIMITIVE),
+          get_prim_field, 0x7 },
+        { "ib_offset", PACKETS(VC4_PACKET_GL_INDEXED_PRIMITIVE),
+          get_indexed_field, 0 },
+        { "max_index", PACKETS(VC4_PACKET_GL_INDEXED_PRIMITIVE),
+          get_indexed_field, 1 },
+        { "index_size", PACKETS(VC4_PACKET_GL_INDEXED_PRIMITIVE),
+          get_indexed_field, 2 },
+        { "start", PACKETS(VC4_PACKET_GL_ARRAY_PRIMITIVE), get_start },
+
+        { "target", PACKETS(VC4_PACKET_BRANCH,
+                            VC4_PACKET_BRANCH_TO_SUB_LIST),
+          get_target },
+        { "buffer_addr", PACKETS(VC4_PACKET_STORE_FULL_RES_TILE_BUFFER,
+                                 VC4_PACKET_LOAD_FULL_RES_TILE_BUFFER,
+                                 VC4_PACKET_STORE_TILE_BUFFER_GENERAL,
+                                 VC4_PACKET_LOAD_TILE_BUFFER_GENERAL),
+          get_buffer_addr },
+        { "format", PACKETS(VC4_PACKET_PRIMITIVE_LIST_FORMAT), get_format },
+        { "rec", PACKETS(VC4_PACKET_GL_SHADER_STATE,
+                         VC4_PACKET_NV_SHADER_STATE),
+          get_rec },
+
+        { "tile_alloc_addr", PACKETS(VC4_PACKET_TILE_BINNING_MODE_CONFIG),
+          get_binning_config, 0 },
+        { "tile_alloc_size", PACKETS(VC4_PACKET_TILE_BINNING_MODE_CONFIG),
+          get_binning_config, 1 },
+        { "tile_state_addr", PACKETS(VC4_PACKET_TILE_BINNING_MODE_CONFIG),
+          get_binning_config, 2 },
+        { "width", PACKETS(VC4_PACKET_TILE_BINNING_MODE_CONFIG,
+                           VC4_PACKET_TILE_RENDERING_MODE_CONFIG,
+                           VC4_PACKET_CLIP_WINDOW),
+          get_size, 0 },
+        { "height", PACKETS(VC4_PACKET_TILE_BINNING_MODE_CONFIG,
+                            VC4_PACKET_TILE_RENDERING_MODE_CONFIG,
+                            VC4_PACKET_CLIP_WINDOW),
+          get_size, 1 },
+        { "color_addr", PACKETS(VC4_PACKET_TILE_RENDERING_MODE_CONFIG),
+          get_color_addr },
+
+        /* A GL_SHADER_STATE packet has these too, so they don't decide
+         * what's matched on their own.
+         */
+        { "attributes", QUERY_PACKETS | QUERY_SHADER_RECS,
+          1, { VC4_PACKET_GL_SHADER_STATE }, get_rec_flags, 0 },
+        { "extended", QUERY_PACKETS | QUERY_SHADER_RECS,
+          1, { VC4_PACKET_GL_SHADER_STATE }, get_rec_flags, 1 },
+
+        { "size", QUERY_SHADER_RECS, 0, { 0 }, get_rec_size },
+        { "gl", QUERY_SHADER_RECS, 0, { 0 }, get_rec_gl },
+        { "mapped", QUERY_SHADER_RECS, 0, { 0 }, get_rec_mapped },
+        SHADER_FIELDS("fs", VC4_INDEX_SHADER_FS),
+        SHADER_FIELDS("vs", VC4_INDEX_SHADER_VS),
+        SHADER_FIELDS("cs", VC4_INDEX_SHADER_CS),
+};
+
+static void
+opcode_set_fill(struct opcode_set *set, bool value)
+{
+        memset(set->bits, value ? 0xff : 0, sizeof(set->bits));
+}
+
+static void
+opcode_set_add(struct opcode_set *set, uint8_t opcode)
+{
+        set->bits[opcode / 32] |= 1u << (opcode % 32);
+}
+
+static void
+opcode_set_remove(struct opcode_set *set, uint8_t opcode)
+{
+        set->bits[opcode / 32] &= ~(1u << (opcode % 32));
+}
+
+static bool
+opcode_set_has(const struct opcode_set *set, uint8_t opcode)
+{
+        return set->bits[opcode / 32] & (1u << (opcode % 32));
+}
+
+static void
+opcode_set_combine(struct opcode_set *set, const struct opcode_set *other,
+                   bool intersect)
+{
+        for (int i = 0; i < ARRAY_SIZE(set->bits); i++) {
+                if (intersect)
+                        set->bits[i] &= other->bits[i];
+                else
+                        set->bits[i] |= other->bits[i];
+        }
+}
+
+/* Intersects set with the packets that have the field. */
+static void
+opcode_set_restrict(struct opcode_set *set, const struct query_field *field)
+{
+        struct opcode_set field_set;
+
+        if (!field->opcode_count)
+                return;
+
+        opcode_set_fill(&field_set, false);
+        for (int i = 0; i < field->opcode_count; i++)
+                opcode_set_add(&field_set, field->opcodes[i]);
+        opcode_set_combine(set, &field_set, true);
+}
+
+static bool
+is_comparison(enum query_op op)
+{
+        return op >= OP_EQ;
+}
+
+static void
+parse_error(struct parser *p, const char *what)
+{
+        errx(1, "%s at \"%s\" in query \"%s\"", what, p->pos, p->query);
+}
+
+static void
+skip_space(struct parser *p)
+{
+        while (*p->pos == ' ' || *p->pos == '\t' || *p->pos == '\n')
+                p->pos++;
+}
+
+static const struct {
+        const char *token;
+        enum query_op op;
+} operators[] = {
+        /* The two-character ones first, so "<=" isn't taken as "<". */
+        { "==", OP_EQ },
+        { "!=", OP_NE },
+        { "<=", OP_LE },
+        { ">=", OP_GE },
+        { "&&", OP_AND },
+        { "||", OP_OR },
+        { "<", OP_LT },
+        { ">", OP_GT },
+        { "!", OP_NOT },
+};
+
+/* Consumes the operator at the parser's position if it's one of the ops
+ * from first through last, returning it, or returns OP_CONST.
+ */
+static enum query_op
+accept_operator(struct parser *p, enum query_op first, enum query_op last)
+{
+        skip_space(p);
+
+        for (int i = 0; i < ARRAY_SIZE(operators); i++) {
+                size_t len = strlen(operators[i].token);
+
+                if (strncmp(p->pos, operators[i].token, len) != 0)
+                        continue;
+                if (operators[i].op < first || operators[i].op > last)
+                        return OP_CONST;
+
+                p->pos += len;
+                return operators[i].op;
+        }
+
+        return OP_CONST;
+}
+
+static struct node *
+new_node(enum query_op op, struct node *left, struct node *right)
+{
+        struct node *n = calloc(1, sizeof(*n));
+
+        if (!n)
+                err(1, "malloc failure");
+        n->op = op;
+        n->left = left;
+        n->right = right;
+
+        return n;
+}
+
+static void
+free_node(struct node *n)
+{
+        if (!n)
+                return;
+        free_node(n->left);
+        free_node(n->right);
+        free(n);
+}
+
+/* Looks up a name that isn't a field: a packet, with or without its
+ * VC4_PACKET_ prefix, or a primitive type.
+ */
+static bool
+lookup_constant(const char *name, size_t len, uint64_t *value)
+{
+        for (int i = 0; i < 256; i++) {
+                const char *packet = vc4_cl_packet_name(i);
+
+                if (!packet)
+                        continue;
+                if ((strlen(packet) == len && !strncmp(packet, name, len)) ||
+                    (strlen(packet) == len + 11 &&
+                     !strncmp(packet + 11, name, len))) {
+                        *value = i;
+                        return true;
+                }
+        }
+
+        for (int i = 0; i < 7; i++) {
+                const char *prim = vc4_cl_prim_name(i);
+
+                if (strlen(prim) == len && !strncmp(prim, name, len)) {
+                        *value = i;
+                        return true;
+                }
+        }
+
+        return false;
+}
+
+static struct node *parse_or(struct parser *p);
+
+static struct node *
+parse_primary(struct parser *p)
+{
+        const char *start;
+        struct node *n;
+
+        skip_space(p);
+        start = p->pos;
+
+        if (*p->pos == '(') {
+                if (++p->depth > QUERY_MAX_DEPTH)
+                        parse_error(p, "Too many parentheses");
+                p->pos++;
+                n = parse_or(p);
+                skip_space(p);
+                if (*p->pos != ')')
+                        parse_error(p, "Expected \")\"");
+                p->pos++;
+                p->depth--;
+                return n;
+        }
+
+        if (*p->pos >= '0' && *p->pos <= '9') {
+                char *end;
+
+                n = new_node(OP_CONST, NULL, NULL);
+                n->value = strtoull(p->pos, &end, 0);
+                p->pos = end;
+                return n;
+        }
+
+        while ((*p->pos >= 'a' && *p->pos <= 'z') ||
+               (*p->pos >= 'A' && *p->pos <= 'Z') ||
+               (*p->pos >= '0' && *p->pos <= '9') ||
+               *p->pos == '_' || *p->pos == '.') {
+                p->pos++;
+        }
+        if (p->pos == start)
+                parse_error(p, "Expected a field or a value");
+
+        size_t len = p->pos - start;
+
+        for (int i = 0; i < ARRAY_SIZE(fields); i++) {
+                if (strlen(fields[i].name) == len &&
+                    !strncmp(fields[i].name, start, len)) {
+                        n = new_node(OP_FIELD, NULL, NULL);
+                        n->field = &fields[i];
+                        return n;
+                }
+        }
+
+        n = new_node(OP_CONST, NULL, NULL);
+        if (len == 4 && !strncmp(start, "true", len)) {
+                n->value = 1;
+        } else if (len == 5 && !strncmp(start, "false", len)) {
+                n->value = 0;
+        } else if (!lookup_constant(start, len, &n->value)) {
+                p->pos = start;
+                parse_error(p, "Unknown field or value");
+        }
+
+        return n;
+}
+
+static struct node *
+parse_comparison(struct parser *p)
+{
+        struct node *n = parse_primary(p);
+        enum query_op op = accept_operator(p, OP_EQ, OP_GE);
+
+        if (op == OP_CONST)
+                return n;
+
+        return new_node(op, n, parse_primary(p));
+}
+
+static struct node *
+parse_unary(struct parser *p)
+{
+        if (accept_operator(p, OP_NOT, OP_NOT) == OP_NOT) {
+                if (++p->depth > QUERY_MAX_DEPTH)
+                        parse_error(p, "Too many \"!\"s");
+                struct node *n = new_node(OP_NOT, parse_unary(p), NULL);
+                p->depth--;
+                return n;
+        }
+
+        return parse_comparison(p);
+}
+
+static struct node *
+parse_and(struct parser *p)
+{
+        struct node *n = parse_unary(p);
+
+        while (accept_operator(p, OP_AND, OP_AND) == OP_AND)
+                n = new_node(OP_AND, n, parse_unary(p));
+
+        return n;
+}
+
+static struct node *
+parse_or(struct parser *p)
+{
+        struct node *n = parse_and(p);
+
+        while (accept_operator(p, OP_OR, OP_OR) == OP_OR)
+                n = new_node(OP_OR, n, parse_and(p));
+
+        return n;
+}
+
+/* Returns the classes that the fields used only by one class ask for. */
+static uint8_t
+node_classes(const struct node *n)
+{
+        uint8_t classes = 0;
+
+        if (!n)
+                return 0;
+
+        if (n->op == OP_FIELD &&
+            n->field->classes != (QUERY_PACKETS | QUERY_SHADER_RECS)) {
+                classes = n->field->classes;
+        }
+
+        return classes | node_classes(n->left) | node_classes(n->right);
+}
+
+/**
+ * Sets set to the opcodes of the packets that n could be true for, or
+ * false for if negated.
+ *
+ * This only has to not leave out any that could, so it only looks at
+ * comparisons of the opcode with a constant, and at the fields that only
+ * some packets have, which make a comparison with them false for the rest.
+ */
+static void
+possible_opcodes(const struct node *n, bool negated, struct opcode_set *set)
+{
+        struct opcode_set right;
+
+        opcode_set_fill(set, true);
+
+        switch (n->op) {
+        case OP_CONST:
+                opcode_set_fill(set, (n->value != 0) != negated);
+                break;
+
+        case OP_FIELD:
+                if (!negated)
+                        opcode_set_restrict(set, n->field);
+                break;
+
+        case OP_NOT:
+                possible_opcodes(n->left, !negated, set);
+                break;
+
+        case OP_AND:
+        case OP_OR:
+                /* Negating one turns it into the other. */
+                possible_opcodes(n->left, negated, set);
+                possible_opcodes(n->right, negated, &right);
+                opcode_set_combine(set, &right,
+                                   (n->op == OP_AND) != negated);
+                break;
+
+        default: {
+                const struct node *field = n->left, *value = n->right;
+
+                if (field->op != OP_FIELD) {
+                        field = n->right;
+                        value = n->left;
+                }
+
+                if ((n->op == OP_EQ || n->op == OP_NE) &&
+                    field->op == OP_FIELD && value->op == OP_CONST &&
+                    field->field->get == get_opcode) {
+                        bool equal = (n->op == OP_EQ) != negated;
+
+                        opcode_set_fill(set, !equal);
+                        if (value->value < 256) {
+                                if (equal)
+                                        opcode_set_add(set, value->value);
+                                else
+                                        opcode_set_remove(set, value->value);
+                        }
+                        break;
+                }
+
+                if (negated)
+                        break;
+                if (n->left->op == OP_FIELD)
+                        opcode_set_restrict(set, n->left->field);
+                if (n->right->op == OP_FIELD)
+                        opcode_set_restrict(set, n->right->field);
+                break;
+        }
+        }
+}
+
+static void
+emit(struct query *q, enum query_op op, const struct node *n)
+{
+        q->insns = realloc(q->insns, (q->count + 1) * sizeof(*q->insns));
+        if (!q->insns)
+                err(1, "malloc failure");
+
+        q->insns[q->count++] = (struct query_insn) {
+                .op = op,
+                .value = n ? n->value : 0,
+                .field = n ? n->field : NULL,
+        };
+}
+
+/* Emits the program for n, leaving its value on the stack, or its truth
+ * value if truth is set.  depth is how deep the stack already is.
+ */
+static void
+compile_node(struct query *q, const struct node *n, bool truth,
+             uint32_t depth)
+{
+        if (depth + 1 > QUERY_MAX_DEPTH)
+                errx(1, "Query too deeply nested");
+
+        switch (n->op) {
+        case OP_CONST:
+        case OP_FIELD:
+                emit(q, n->op, n);
+                if (truth)
+                        emit(q, OP_TRUTH, NULL);
+                break;
+        case OP_NOT:
+                compile_node(q, n->left, true, depth);
+                emit(q, OP_NOT, NULL);
+                break;
+        case OP_AND:
+        case OP_OR:
+                compile_node(q, n->left, true, depth);
+                compile_node(q, n->right, true, depth + 1);
+                emit(q, n->op, NULL);
+                break;
+        default:
+                compile_node(q, n->left, false, depth);
+                compile_node(q, n->right, false, depth + 1);
+                emit(q, n->op, NULL);
+                break;
+        }
+}
+
+static void
+query_compile(struct query *q, const char *text)
+{
+        struct parser p = {
+                .query = text,
+                .pos = text,
+        };
+        struct node *root = parse_or(&p);
+        uint8_t classes;
+
+        skip_space(&p);
+        if (*p.pos)
+                parse_error(&p, "Unexpected text");
+
+        classes = node_classes(root);
+        if (classes == (QUERY_PACKETS | QUERY_SHADER_RECS))
+                errx(1, "Query mixes packet fields and shader rec fields");
+        q->class = classes ? classes : QUERY_PACKETS;
+
+        possible_opcodes(root, false, &q->opcodes);
+        compile_node(q, root, true, 0);
+
+        free_node(root);
+}
+
+static bool
+query_match(const struct query *q, const struct query_record *r)
+{
+        struct query_value stack[QUERY_MAX_DEPTH];
+        struct query_value *top = stack - 1;
+
+        for (uint32_t i = 0; i < q->count; i++) {
+                const struct query_insn *insn = &q->insns[i];
+                uint64_t a, b;
+
+                switch (insn->op) {
+                case OP_CONST:
+                        top++;
+                        top->value = insn->value;
+                        top->present = true;
+                        continue;
+                case OP_FIELD:
+                        top++;
+                        top->present = insn->field->get(r, insn->field->arg,
+                                                        &top->value);
+                        continue;
+                case OP_TRUTH:
+                        top->value = top->present && top->value;
+                        top->present = true;
+                        continue;
+                case OP_NOT:
+                        top->value = !top->value;
+                        continue;
+                default:
+                        break;
+                }
+
+                /* The rest combine the top two values into one, with a
+                 * comparison against a missing field being false.
+                 */
+                top--;
+                a = top[0].value;
+                b = top[1].value;
+                if (is_comparison(insn->op) &&
+                    (!top[0].present || !top[1].present)) {
+                        top->value = 0;
+                        top->present = true;
+                        continue;
+                }
+
+                switch (insn->op) {
+                case OP_AND:
+                        top->value = a && b;
+                        break;
+                case OP_OR:
+                        top->value = a || b;
+                        break;
+                case OP_EQ:
+                        top->value = a == b;
+                        break;
+                case OP_NE:
+                        top->value = a != b;
+                        break;
+                case OP_LT:
+                        top->value = a < b;
+                        break;
+                case OP_LE:
+                        top->value = a <= b;
+                        break;
+                case OP_GT:
+                        top->value = a > b;
+                        break;
+                default:
+                        top->value = a >= b;
+                        break;
+                }
+                top->present = true;
+        }
+
+        return stack[0].value;
+}
+
+/* Whether the dump has any packets or shader recs the query could match,
+ * going by its index's header.
+ */
+static bool
+query_may_match(const struct query *q, const struct vc4_index_header *header)
+{
+        if (q->class == QUERY_SHADER_RECS)
+                return header->shader_rec_count != 0;
+
+        for (int i = 0; i < 256; i++) {
+                if (header->opcode_counts[i] && opcode_set_has(&q->opcodes, i))
+                        return true;
+        }
+
+        return false;
+}
+
+static const char *
+cl_name(const struct vc4_index_cl *cl)
+{
+        static const char *const names[] = {
+                [VC4_INDEX_CL_BIN] = "Bin CL",
+                [VC4_INDEX_CL_RENDER] = "Render CL",
+                [VC4_INDEX_CL_SUB_LIST] = "Sublist",
+                [VC4_INDEX_CL_COMPRESSED_LIST] = "Compressed list",
+        };
+
+        return cl->type < ARRAY_SIZE(names) ? names[cl->type] : "CL";
+}
+
+static void
+query_packets(const struct query *q, const char *path,
+              const struct vc4_dump_index *index, struct vc4_output *out)
+{
+        struct query_record r = { .index = index };
+
+        for (uint32_t c = 0; c < index->header->cl_count; c++) {
+                const struct vc4_index_cl *cl = &index->cls[c];
+                const struct vc4_cl_item *items =
+                        &index->items[cl->first_item];
+
+                r.cl = cl;
+                for (uint32_t i = 0; i < cl->item_count; i++) {
+                        const struct vc4_cl_item *item = &items[i];
+
+                        if ((item->kind != VC4_CL_ITEM_PACKET &&
+                             item->kind != VC4_CL_ITEM_RAW_PACKET) ||
+                            !opcode_set_has(&q->opcodes, item->opcode)) {
+                                continue;
+                        }
+
+                        r.item = item;
+                        if (!query_match(q, &r))
+                                continue;
+
+                        vc4_out_printf(out, "%s: %s 0x%08x: 0x%08x %s\n",
+                                       path, cl_name(cl), cl->paddr,
+                                       item->offset,
+                                       vc4_cl_packet_name(item->opcode));
+                }
+        }
+}
+
+static void
+query_shader_recs(const struct query *q, const char *path,
+                  const struct vc4_dump_index *index, struct vc4_output *out)
+{
+        struct query_record r = { .index = index };
+
+        for (uint32_t i = 0; i < index->header->shader_rec_count; i++) {
+                r.rec = &index->shader_recs[i];
+                if (!query_match(q, &r))
+                        continue;
+
+                vc4_out_printf(out, "%s: %s Shader rec at 0x%08x\n",
+                               path, r.rec->gl ? "GL" : "NV", r.rec->paddr);
+        }
+}
+
+/* VC4_INDEX_SAVE for --index. */
+static enum vc4_index_mode index_mode = VC4_INDEX_BUILD;
+
+static bool
+query_process(struct vc4_dump_pool *pool, uint32_t i, struct vc4_output *out)
+{
+        const struct query *q = pool->data;
+        struct vc4_dump_ctx *ctx = vc4_dump_ctx_open(pool->paths[i]);
+        const struct vc4_dump_index *index =
+                vc4_dump_ctx_use_index(ctx, index_mode);
+
+        if (index && query_may_match(q, index->header)) {
+                if (q->class == QUERY_SHADER_RECS)
+                        query_shader_recs(q, pool->paths[i], index, out);
+                else
+                        query_packets(q, pool->paths[i], index, out);
+        }
+
+        const char *error = vc4_dump_ctx_error(ctx);
+        if (error)
+                warnx("%s", error);
+        vc4_dump_ctx_close(ctx);
+
+        return !error;
+}
+
+static void
+query_write(struct vc4_dump_pool *pool, uint32_t i,
+            const struct vc4_output *result, struct vc4_output *out)
+{
+        vc4_out_mem(out, result->buf, result->len);
+}
+
+static void
+usage(const char *name)
+{
+        fprintf(stderr,
+                "Usage: %s [--jobs=N] [--files-from=LIST] [--index] QUERY\n"
+                "       [dump | dir]...\n"
+                "\n"
+                "Packet fields:",
+                name);
+        for (int i = 0; i < ARRAY_SIZE(fields); i++) {
+                if (fields[i].classes & QUERY_PACKETS)
+                        fprintf(stderr, " %s", fields[i].name);
+        }
+        fprintf(stderr, "\nShader rec fields:");
+        for (int i = 0; i < ARRAY_SIZE(fields); i++) {
+                if (fields[i].classes & QUERY_SHADER_RECS)
+                        fprintf(stderr, " %s", fields[i].name);
+        }
+        fprintf(stderr, "\n");
+        exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+        static const struct option long_options[] = {
+                { "jobs", required_argument, NULL, 'j' },
+                { "files-from", required_argument, NULL, 'f' },
+                { "index", no_argument, NULL, 'i' },
+                { NULL, 0, NULL, 0 },
+        };
+        struct query q = { 0 };
+        struct vc4_dump_pool pool = {
+                .process = query_process,
+                .write = query_write,
+                .data = &q,
+        };
+        long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+        const char *list = NULL;
+        char *end;
+        int c;
+
+        while ((c = getopt_long(argc, argv, "j:", long_options,
+                                NULL)) != -1) {
+                switch (c) {
+                case 'j':
+                        jobs = strtol(optarg, &end, 0);
+                        if (*end || !*optarg || jobs < 1)
+                                usage(argv[0]);
+                        break;
+                case 'f':
+                        list = optarg;
+                        break;
+                case 'i':
+                        index_mode = VC4_INDEX_SAVE;
+                        break;
+                default:
+                        usage(argv[0]);
+                }
+        }
+
+        if (optind == argc || (optind == argc - 1 && !list))
+                usage(argv[0]);
+        pool.jobs = jobs;
+
+        query_compile(&q, argv[optind]);
+
+        for (int i = optind + 1; i < argc; i++)
+                vc4_dump_pool_add_arg(&pool, argv[i]);
+        if (list)
+                vc4_dump_pool_add_list(&pool, list);
+
+        uint32_t failed = vc4_dump_pool_run(&pool);
+
+        if (failed)
+                warnx("%u of %u dumps couldn't be read", failed, pool.count);
+
+        return failed ? 1 : 0;
+}
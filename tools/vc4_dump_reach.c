@@ -0,0 +1,496 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/** @file vc4_dump_reach.c
+ *
+ * Finds the bytes of a hang's BOs that its CLs can reach, for captures and
+ * trimmed dumps that leave out everything else.
+ *
+ * This drives the CL decoder in vc4_dump_parse_cl.c the same way
+ * vc4_dump_parse does, through a context with its own hooks: each CL that
+ * a branch reaches is queued and decoded in turn, with visited bitmaps
+ * keeping any byte from being decoded twice, and the shader records that
+ * the CLs point at are read for their shader code, uniforms and vertex
+ * data.
+ * Nothing gets rendered.  Each run of bytes read along the way is passed
+ * to the caller's callback.
+ */
+
+#include <err.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vc4_addr_space.h"
+#include "vc4_cl_ir.h"
+#include "vc4_dump_parse.h"
+#include "vc4_dump_reach.h"
+#include "vc4_packet.h"
+#include "vc4_qpu_defines.h"
+#include "vc4_tools.h"
+
+/* Bytes of the tile state data array that the binner uses per tile. */
+#define TILE_STATE_SIZE         48
+
+struct reach_cl {
+        uint32_t paddr;
+        uint8_t prim_mode;
+        bool compressed;
+};
+
+struct reach_state {
+        struct vc4_dump_ctx *ctx;
+        struct vc4_addr_space *space;
+        vc4_dump_reach_cb cb;
+        void *cb_data;
+
+        /* Per-BO bitmaps of the CL bytes decoded so far. */
+        uint32_t **visited;
+
+        /* Worklist of the CLs reached by branches. */
+        struct reach_cl *cls;
+        uint32_t cl_count, cl_size;
+
+        /* The shader record that draws fetch their vertices through, from
+         * the last shader state packet decoded.
+         */
+        uint32_t rec_paddr;
+        uint8_t rec_attributes;
+        bool rec_nv;
+        bool has_rec;
+};
+
+/* Reports the size bytes at paddr, clipped to the end of their BO. */
+static const struct vc4_addr_range *
+reach_bytes(struct reach_state *reach, uint32_t paddr, uint32_t size,
+            enum vc4_dump_reach_kind kind)
+{
+        const struct vc4_addr_range *range =
+                vc4_addr_space_lookup_paddr(reach->space, paddr);
+
+        if (range) {
+                uint32_t offset = paddr - range->paddr;
+
+                reach->cb(reach->cb_data, range, offset,
+                          MIN2(size, range->size - offset), kind);
+        }
+
+        return range;
+}
+
+/* Reports the bytes from paddr to the end of its BO. */
+static void
+reach_rest(struct reach_state *reach, uint32_t paddr,
+           enum vc4_dump_reach_kind kind)
+{
+        reach_bytes(reach, paddr, ~0, kind);
+}
+
+/* Returns the mapping of size bytes at paddr, if they're all in one BO. */
+static void *
+reach_map(struct reach_state *reach, uint32_t paddr, uint32_t size,
+          enum vc4_dump_reach_kind kind)
+{
+        const struct vc4_addr_range *range =
+                reach_bytes(reach, paddr, size, kind);
+
+        if (!range || range->paddr + range->size - paddr < size ||
+            !vc4_addr_space_map(reach->space, range)) {
+                return NULL;
+        }
+
+        return range->map + (paddr - range->paddr);
+}
+
+/* Reports the shader code at paddr, up to the program end signal and its
+ * two delay slots, the same instructions that vc4_dump_parse disassembles.
+ */
+static void
+reach_shader(struct reach_state *reach, uint32_t paddr)
+{
+        const struct vc4_addr_range *range =
+                vc4_addr_space_lookup_paddr(reach->space, paddr);
+
+        if (!range || !vc4_addr_space_map(reach->space, range))
+                return;
+
+        uint32_t offset = paddr - range->paddr;
+        uint32_t end = range->size;
+
+        for (uint32_t i = offset; i + sizeof(uint64_t) <= range->size;
+             i += sizeof(uint64_t)) {
+                uint64_t inst;
+
+                memcpy(&inst, range->map + i, sizeof(inst));
+                if (QPU_GET_FIELD(inst, QPU_SIG) == QPU_SIG_PROG_END) {
+                        end = MIN2(i + 3 * sizeof(uint64_t), range->size);
+                        break;
+                }
+        }
+
+        reach->cb(reach->cb_data, range, offset, end - offset,
+                  VC4_DUMP_REACH_SHADER);
+}
+
+static void *
+reach_paddr_to_pointer(struct vc4_dump_ctx *ctx, uint32_t addr)
+{
+        return reach_map(ctx->hooks_data, addr, 1, VC4_DUMP_REACH_CL);
+}
+
+static uint32_t
+queue_cl(struct reach_state *reach, uint32_t paddr, uint8_t prim_mode,
+         bool compressed)
+{
+        if (reach->cl_count == reach->cl_size) {
+                reach->cl_size = reach->cl_size ? reach->cl_size * 2 : 64;
+                reach->cls = realloc(reach->cls,
+                                     reach->cl_size * sizeof(*reach->cls));
+                if (!reach->cls)
+                        err(1, "malloc failure");
+        }
+
+        reach->cls[reach->cl_count++] = (struct reach_cl) {
+                .paddr = paddr,
+                .prim_mode = prim_mode,
+                .compressed = compressed,
+        };
+
+        return 0;
+}
+
+static uint32_t
+reach_add_sublist(struct vc4_dump_ctx *ctx, uint32_t paddr, uint8_t prim_mode)
+{
+        return queue_cl(ctx->hooks_data, paddr, prim_mode, false);
+}
+
+static uint32_t
+reach_add_compressed_list(struct vc4_dump_ctx *ctx, uint32_t paddr,
+                          uint8_t prim_mode)
+{
+        return queue_cl(ctx->hooks_data, paddr, prim_mode, true);
+}
+
+/* The uniform counts in shader records aren't filled in by the driver (the
+ * hardware doesn't use them), so the rest of the BO is kept for a uniform
+ * stream.
+ */
+static uint32_t
+reach_add_gl_shader_rec(struct vc4_dump_ctx *ctx, uint32_t paddr,
+                        uint8_t attributes, bool extended)
+{
+        struct reach_state *reach = ctx->hooks_data;
+        uint32_t *rec = reach_map(reach, paddr, 36 + attributes * 8,
+                                  VC4_DUMP_REACH_SHADER_REC);
+
+        if (!rec)
+                return 0;
+
+        /* The fs, vs and cs code and uniform addresses. */
+        for (int i = 0; i < 3; i++) {
+                reach_shader(reach, rec[1 + i * 3]);
+                reach_rest(reach, rec[2 + i * 3], VC4_DUMP_REACH_UNIFORMS);
+        }
+
+        return 0;
+}
+
+static uint32_t
+reach_add_nv_shader_rec(struct vc4_dump_ctx *ctx, uint32_t paddr)
+{
+        struct reach_state *reach = ctx->hooks_data;
+        uint32_t *rec = reach_map(reach, paddr, 16, VC4_DUMP_REACH_SHADER_REC);
+
+        if (!rec)
+                return 0;
+
+        reach_shader(reach, rec[1]);
+        reach_rest(reach, rec[2], VC4_DUMP_REACH_UNIFORMS);
+
+        return 0;
+}
+
+static const uint32_t *
+reach_get_cl_visited(struct vc4_dump_ctx *ctx, uint32_t paddr,
+                     uint32_t *bo_paddr, uint32_t *bo_size)
+{
+        struct reach_state *reach = ctx->hooks_data;
+        const struct vc4_addr_range *range =
+                vc4_addr_space_lookup_paddr(reach->space, paddr);
+
+        if (!range)
+                return NULL;
+
+        uint32_t **visited = &reach->visited[range->bo_index];
+        if (!*visited) {
+                *visited = calloc((range->size + 31) / 32, sizeof(uint32_t));
+                if (!*visited)
+                        err(1, "malloc failure");
+        }
+
+        *bo_paddr = range->paddr;
+        *bo_size = range->size;
+        return *visited;
+}
+
+static bool
+reach_note_cl_revisit(struct vc4_dump_ctx *ctx, uint32_t paddr)
+{
+        return false;
+}
+
+static void
+reach_mark_cl_visited(struct vc4_dump_ctx *ctx, uint32_t paddr, uint32_t size)
+{
+        uint32_t bo_paddr, bo_size;
+        uint32_t *visited = (uint32_t *)reach_get_cl_visited(ctx, paddr,
+                                                             &bo_paddr,
+                                                             &bo_size);
+
+        if (!visited)
+                return;
+
+        for (uint32_t bit = paddr - bo_paddr;
+             bit < MIN2(paddr - bo_paddr + size, bo_size); bit++) {
+                visited[bit / 32] |= 1u << (bit % 32);
+        }
+
+        reach_bytes(ctx->hooks_data, paddr, size, VC4_DUMP_REACH_CL);
+}
+
+/* Reports the vertex data that a draw fetches through the current shader
+ * record, for vertices 0 to max_index.
+ */
+static void
+reach_vertices(struct reach_state *reach, uint32_t max_index)
+{
+        if (!reach->has_rec)
+                return;
+
+        if (reach->rec_nv) {
+                uint8_t *rec = reach_map(reach, reach->rec_paddr, 16,
+                                         VC4_DUMP_REACH_SHADER_REC);
+
+                if (rec) {
+                        uint32_t stride = rec[1];
+
+                        reach_bytes(reach, *(uint32_t *)(rec + 12),
+                                    stride * ((uint64_t)max_index + 1),
+                                    VC4_DUMP_REACH_VERTICES);
+                }
+                return;
+        }
+
+        uint8_t *rec = reach_map(reach, reach->rec_paddr,
+                                 36 + reach->rec_attributes * 8,
+                                 VC4_DUMP_REACH_SHADER_REC);
+        if (!rec)
+                return;
+
+        for (int i = 0; i < reach->rec_attributes; i++) {
+                uint8_t *attr = rec + 36 + i * 8;
+                uint32_t size = attr[4] + 1;
+                uint32_t stride = attr[5];
+
+                reach_bytes(reach, *(uint32_t *)attr,
+                            MIN2((uint64_t)stride * max_index + size,
+                                 UINT32_MAX),
+                            VC4_DUMP_REACH_VERTICES);
+        }
+}
+
+static void
+reach_binning_config(struct reach_state *reach,
+                     const struct vc4_cl_item *item)
+{
+        uint32_t tiles = (item->u.tile_binning_config.width *
+                          item->u.tile_binning_config.height);
+
+        reach_bytes(reach, item->u.tile_binning_config.tile_alloc_addr,
+                    item->u.tile_binning_config.tile_alloc_size,
+                    VC4_DUMP_REACH_TILE_STATE);
+        reach_bytes(reach, item->u.tile_binning_config.tile_state_addr,
+                    tiles * TILE_STATE_SIZE, VC4_DUMP_REACH_TILE_STATE);
+}
+
+/* Picks up the memory that the CL's packets point at: the tile state and
+ * buffers of the binning and rendering setup, and the vertex data that
+ * draws fetch, which is the index buffers of indexed draws and the
+ * attributes of the shader record in effect.
+ */
+static void
+reach_render(void *data, const struct vc4_cl_ir *ir)
+{
+        struct reach_state *reach = data;
+
+        for (uint32_t i = 0; i < ir->count; i++) {
+                const struct vc4_cl_item *item = &ir->items[i];
+
+                if (item->kind != VC4_CL_ITEM_PACKET)
+                        continue;
+
+                switch (item->opcode) {
+                case VC4_PACKET_TILE_BINNING_MODE_CONFIG:
+                        reach_binning_config(reach, item);
+                        break;
+                case VC4_PACKET_TILE_RENDERING_MODE_CONFIG:
+                        reach_rest(reach,
+                                   item->u.tile_rendering_config.color_addr,
+                                   VC4_DUMP_REACH_TILE_STATE);
+                        break;
+                case VC4_PACKET_LOAD_FULL_RES_TILE_BUFFER:
+                case VC4_PACKET_STORE_FULL_RES_TILE_BUFFER:
+                        reach_rest(reach, item->u.loadstore_full.addr,
+                                   VC4_DUMP_REACH_TILE_STATE);
+                        break;
+                case VC4_PACKET_LOAD_TILE_BUFFER_GENERAL:
+                case VC4_PACKET_STORE_TILE_BUFFER_GENERAL:
+                        reach_rest(reach,
+                                   item->u.loadstore_general.addr & ~0xf,
+                                   VC4_DUMP_REACH_TILE_STATE);
+                        break;
+                case VC4_PACKET_GL_SHADER_STATE:
+                        reach->rec_paddr = item->u.gl_shader_state.rec_paddr;
+                        reach->rec_attributes =
+                                item->u.gl_shader_state.attributes;
+                        reach->rec_nv = false;
+                        reach->has_rec = true;
+                        break;
+                case VC4_PACKET_NV_SHADER_STATE:
+                        reach->rec_paddr = item->u.nv_shader_state.rec_paddr;
+                        reach->rec_nv = true;
+                        reach->has_rec = true;
+                        break;
+                case VC4_PACKET_GL_INDEXED_PRIMITIVE: {
+                        uint32_t index_size =
+                                (item->u.indexed_prim.mode &
+                                 VC4_INDEX_BUFFER_U16) ? 2 : 1;
+
+                        reach_bytes(reach, item->u.indexed_prim.ib_offset,
+                                    MIN2((uint64_t)index_size *
+                                         item->u.indexed_prim.count,
+                                         UINT32_MAX),
+                                    VC4_DUMP_REACH_VERTICES);
+                        reach_vertices(reach, item->u.indexed_prim.max_index);
+                        break;
+                }
+                case VC4_PACKET_GL_ARRAY_PRIMITIVE:
+                        if (item->u.array_prim.count) {
+                                reach_vertices(reach,
+                                               item->u.array_prim.start +
+                                               item->u.array_prim.count - 1);
+                        }
+                        break;
+                default:
+                        break;
+                }
+        }
+}
+
+static void
+reach_cl(struct reach_state *reach, uint32_t start, uint32_t end,
+         bool is_render, bool compressed, uint8_t prim_mode)
+{
+        const struct vc4_addr_range *range =
+                vc4_addr_space_lookup_paddr(reach->space, start);
+
+        if (!range || !reach_paddr_to_pointer(reach->ctx, start))
+                return;
+
+        /* Stop at the end of a BO that the dump cut short. */
+        if (end > start && end - range->paddr > range->size)
+                end = range->paddr + range->size;
+
+        vc4_dump_cl(reach->ctx, start, end, is_render, compressed, prim_mode);
+}
+
+static const struct vc4_dump_cl_hooks reach_hooks = {
+        .paddr_to_pointer = reach_paddr_to_pointer,
+        .add_sublist = reach_add_sublist,
+        .add_compressed_list = reach_add_compressed_list,
+        .add_gl_shader_rec = reach_add_gl_shader_rec,
+        .add_nv_shader_rec = reach_add_nv_shader_rec,
+        .get_cl_visited = reach_get_cl_visited,
+        .note_cl_revisit = reach_note_cl_revisit,
+        .mark_cl_visited = reach_mark_cl_visited,
+};
+
+/**
+ * Calls cb for each run of bytes in space that the bin and render CLs of
+ * the hang state can reach through branches, shader records, shader code,
+ * uniforms and vertex data, plus the words that the CL registers point at.
+ *
+ * The BOs are mapped through space as they need to be read.
+ */
+void
+vc4_dump_reach(struct vc4_addr_space *space,
+               const struct drm_vc4_get_hang_state *state,
+               vc4_dump_reach_cb cb, void *data)
+{
+        struct reach_state reach_state = {
+                .space = space,
+                .cb = cb,
+                .cb_data = data,
+        };
+        struct reach_state *reach = &reach_state;
+        const struct vc4_cl_renderer renderer = {
+                .render = reach_render,
+                .data = reach,
+        };
+
+        reach->visited = calloc(space->count, sizeof(*reach->visited));
+        if (!reach->visited)
+                err(1, "malloc failure");
+        reach->ctx = vc4_dump_ctx_create(space, &reach_hooks, reach);
+
+        reach_bytes(reach, state->ct0ca, 4, VC4_DUMP_REACH_CL);
+        reach_bytes(reach, state->ct0ra0, 4, VC4_DUMP_REACH_CL);
+        reach_bytes(reach, state->ct1ca, 4, VC4_DUMP_REACH_CL);
+        reach_bytes(reach, state->ct1ra0, 4, VC4_DUMP_REACH_CL);
+
+        vc4_dump_ctx_set_renderer(reach->ctx, &renderer);
+
+        if (state->start_bin != state->ct0ea) {
+                reach_cl(reach, state->start_bin, state->ct0ea, false, false,
+                         ~0);
+        }
+        reach_cl(reach, state->start_render, state->ct1ea, true, false, ~0);
+
+        /* Decoding a CL may queue more, so recheck the count each time. */
+        for (uint32_t i = 0; i < reach->cl_count; i++) {
+                struct reach_cl cl = reach->cls[i];
+                const struct vc4_addr_range *range =
+                        vc4_addr_space_lookup_paddr(space, cl.paddr);
+
+                if (range) {
+                        reach_cl(reach, cl.paddr, range->paddr + range->size,
+                                 true, cl.compressed, cl.prim_mode);
+                }
+        }
+
+        vc4_dump_ctx_close(reach->ctx);
+
+        for (uint32_t i = 0; i < space->count; i++)
+                free(reach->visited[i]);
+        free(reach->visited);
+        free(reach->cls);
+}
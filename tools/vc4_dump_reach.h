@@ -0,0 +1,61 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef VC4_DUMP_REACH_H
+#define VC4_DUMP_REACH_H
+
+#include <stdint.h>
+#include "vc4_drm.h"
+
+struct vc4_addr_range;
+struct vc4_addr_space;
+
+/** What the bytes passed to a vc4_dump_reach_cb are used for. */
+enum vc4_dump_reach_kind {
+        /* CLs, and the words that the CL registers point at. */
+        VC4_DUMP_REACH_CL,
+        VC4_DUMP_REACH_SHADER_REC,
+        VC4_DUMP_REACH_SHADER,
+        VC4_DUMP_REACH_UNIFORMS,
+        /* Tile allocation and tile state memory, and the buffers that the
+         * render CL loads and stores.
+         */
+        VC4_DUMP_REACH_TILE_STATE,
+        /* Index buffers and vertex attributes. */
+        VC4_DUMP_REACH_VERTICES,
+};
+
+/**
+ * Called with each run of bytes that the CLs reach, as an offset and size
+ * within the range's BO.  The same bytes may be reported more than once.
+ */
+typedef void (*vc4_dump_reach_cb)(void *data,
+                                  const struct vc4_addr_range *range,
+                                  uint32_t offset, uint32_t size,
+                                  enum vc4_dump_reach_kind kind);
+
+void vc4_dump_reach(struct vc4_addr_space *space,
+                    const struct drm_vc4_get_hang_state *state,
+                    vc4_dump_reach_cb cb, void *data);
+
+#endif /* VC4_DUMP_REACH_H */
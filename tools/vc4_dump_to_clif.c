@@ -22,116 +22,37 @@
  */
 
 #include <err.h>
-#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
-#include <string.h>
 #include <unistd.h>
-#include <sys/errno.h>
-#include <sys/ioctl.h>
-#include <sys/mman.h>
-#include <sys/stat.h>
-#include <sys/types.h>
 #include "vc4_drm.h"
 
-static void *
-map_input(const char *filename)
-{
-        int fd;
-        void *map;
-        struct stat stat;
-        int ret;
-
-        fd = open(filename, 0);
-        if (fd == -1)
-                err(1, "Couldn't open input file %s", filename);
-
-        ret = fstat(fd, &stat);
-        if (ret)
-                err(1, "Couldn't get size of input file %s", filename);
-
-        map = mmap(NULL, stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
-        if (map == MAP_FAILED)
-                err(1, "Couldn't map input file %s", filename);
-
-        return map;
-}
+#include "vc4_dump.h"
+#include "vc4_output.h"
 
-static struct {
-        struct drm_vc4_get_hang_state *state;
-        struct drm_vc4_get_hang_state_bo *bo_state;
-        void **map;
-} dump;
-
-static void
-dump_bo_list(void)
-{
-        fprintf(stderr, "BOs:\n");
-
-        for (int i = 0; i < dump.state->bo_count; i++) {
-                uint32_t paddr = dump.bo_state[i].paddr;
-                fprintf(stderr, "0x%08x..0x%08x (%p)\n",
-                        paddr, paddr + dump.bo_state[i].size - 1,
-                        dump.map[i]);
-        }
-}
+/* autoclif's address callbacks don't take a data pointer, so the context
+ * they translate through has to be found here.
+ */
+static struct vc4_dump_ctx *ctx;
+/* Where the addresses that don't translate get reported. */
+static struct vc4_output *diag;
 
 #include "autoclif/autoclif.h"
 static void *from_addr(V3D_ADDR_T addr)
 {
-        for (int i = 0; i < dump.state->bo_count; i++) {
-                uint32_t paddr = dump.bo_state[i].paddr;
-                if (addr >= paddr && addr < paddr + dump.bo_state[i].size)
-                        return dump.map[i] + (addr - paddr);
-        }
-
-        fprintf(stderr, "Couldn't translate address 0x%08x\n", addr);
-        dump_bo_list();
-
-        return NULL;
+        return vc4_dump_ctx_paddr_to_pointer(ctx, addr);
 }
 
 static V3D_ADDR_T to_addr(void *p)
 {
-        for (int i = 0; i < dump.state->bo_count; i++) {
-                void *map = dump.map[i];
-                if (p >= map && p < map + dump.bo_state[i].size)
-                        return dump.bo_state[i].paddr + (p - map);
-        }
-
-        fprintf(stderr, "Couldn't translate pointer %p\n", p);
-        dump_bo_list();
-
-        return NULL;
-}
-
-static void
-parse_input(void *input)
-{
-        uint32_t *version = input;
-        if (*version != 0) {
-                fprintf(stderr, "Input had wrong version %d\n", *version);
-                exit(1);
-        }
-
-        dump.state = (void *)&version[1];
-        dump.bo_state = (void *)&dump.state[1];
-
-        dump.map = calloc(dump.state->bo_count, sizeof(*dump.map));
-        if (!dump.map)
-                err(1, "malloc failure");
-
-        void *next_map = &dump.bo_state[dump.state->bo_count];
-        for (int i = 0; i < dump.state->bo_count; i++) {
-                dump.map[i] = next_map;
-                next_map += dump.bo_state[i].size;
-        }
+        return vc4_dump_ctx_pointer_to_paddr(ctx, p);
 }
 
 static void
 write_clif(const char *filename)
 {
+        const struct drm_vc4_get_hang_state *state = vc4_dump_ctx_state(ctx);
         V3D_IDENT_T ident = {
                 .tlb_w = 64,
                 .tlb_h = 64,
@@ -139,9 +60,9 @@ write_clif(const char *filename)
 
         autoclif_begin(from_addr, to_addr, &ident);
 
-        if (dump.state->start_bin != dump.state->ct0ea)
-                autoclif_bin(dump.state->start_bin, dump.state->ct0ea);
-        autoclif_render(dump.state->start_render, dump.state->ct1ea);
+        if (state->start_bin != state->ct0ea)
+                autoclif_bin(state->start_bin, state->ct0ea);
+        autoclif_render(state->start_render, state->ct1ea);
         autoclif_end(filename);
 }
 
@@ -155,14 +76,19 @@ usage(const char *name)
 int
 main(int argc, char **argv)
 {
-        void *input;
-
         if (argc != 3)
                 usage(argv[0]);
 
-        input = map_input(argv[1]);
-        parse_input(input);
+        ctx = vc4_dump_ctx_open(argv[1]);
+        if (vc4_dump_ctx_error(ctx))
+                errx(1, "%s", vc4_dump_ctx_error(ctx));
+        diag = vc4_output_create(STDERR_FILENO, 4096);
+        vc4_dump_ctx_set_diagnostics(ctx, diag);
         write_clif(argv[2]);
+        if (vc4_dump_ctx_error(ctx))
+                errx(1, "%s", vc4_dump_ctx_error(ctx));
+        vc4_dump_ctx_close(ctx);
+        vc4_output_destroy(diag);
 
         return 0;
 }
@@ -0,0 +1,563 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/** @file vc4_dump_trim.c
+ *
+ * Rewrites hang dumps to keep only the bytes that their CLs refer to.
+ *
+ * The CLs, shader records, shader code, uniforms, index buffers and vertex
+ * data that vc4_dump_reach finds are kept, and everything else in the BOs
+ * is zeroed and recorded in the zero table as trimmed, so that it's left
+ * out of the file wherever it covers whole pages.  The BO list is kept as
+ * is, so the trimmed dump decodes the same as the original in
+ * vc4_dump_parse.
+ *
+ * Given directories, every dump in the input directory is trimmed into the
+ * output directory, with a process per dump and up to --jobs of them
+ * running at once.
+ */
+
+#include <dirent.h>
+#include <err.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "vc4_drm.h"
+#include "vc4_addr_space.h"
+#include "vc4_crc32c.h"
+#include "vc4_dump_file.h"
+#include "vc4_dump_reach.h"
+#include "vc4_tools.h"
+
+struct trim {
+        struct vc4_dump_file *file;
+        int fd;
+
+        /* Per-BO bitmaps of the bytes that the CLs refer to. */
+        uint32_t **kept;
+
+        struct vc4_dump_zero_range *zero_ranges;
+        uint32_t zero_range_count, zero_range_size;
+
+        /* A run of pages to be written out in one go. */
+        uint64_t run_offset;
+        const void *run_data;
+        uint32_t run_size;
+
+        uint64_t kept_size;
+};
+
+static void
+keep_bytes(void *data, const struct vc4_addr_range *range, uint32_t offset,
+           uint32_t size, enum vc4_dump_reach_kind kind)
+{
+        struct trim *trim = data;
+        uint32_t **kept = &trim->kept[range->bo_index];
+
+        /* Nothing in the tile state or the render targets gets decoded,
+         * and they can be most of a dump.
+         */
+        if (kind == VC4_DUMP_REACH_TILE_STATE)
+                return;
+
+        if (!*kept) {
+                *kept = calloc((range->size + 31) / 32, sizeof(uint32_t));
+                if (!*kept)
+                        err(1, "malloc failure");
+        }
+
+        for (uint32_t bit = offset; bit < offset + size; bit++)
+                (*kept)[bit / 32] |= 1u << (bit % 32);
+}
+
+static bool
+is_kept(const uint32_t *kept, uint32_t offset)
+{
+        return kept && (kept[offset / 32] & (1u << (offset % 32)));
+}
+
+static void
+add_zero_range(struct trim *trim, uint32_t bo, uint32_t offset,
+               uint32_t size, uint32_t flags)
+{
+        if (trim->zero_range_count) {
+                struct vc4_dump_zero_range *last =
+                        &trim->zero_ranges[trim->zero_range_count - 1];
+
+                if (last->bo == bo && last->offset + last->size == offset &&
+                    last->flags == flags) {
+                        last->size += size;
+                        return;
+                }
+        }
+
+        if (trim->zero_range_count == trim->zero_range_size) {
+                trim->zero_range_size = MAX2(trim->zero_range_size * 2, 16);
+                trim->zero_ranges = realloc(trim->zero_ranges,
+                                            trim->zero_range_size *
+                                            sizeof(*trim->zero_ranges));
+                if (!trim->zero_ranges)
+                        err(1, "malloc failure");
+        }
+
+        trim->zero_ranges[trim->zero_range_count++] =
+                (struct vc4_dump_zero_range) {
+                .bo = bo,
+                .offset = offset,
+                .size = size,
+                .flags = flags,
+        };
+}
+
+static void
+write_at(struct trim *trim, const void *data, size_t size, uint64_t offset)
+{
+        while (size) {
+                ssize_t ret = pwrite(trim->fd, data, size, offset);
+
+                if (ret < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        err(1, "Couldn't write the dump");
+                }
+
+                data += ret;
+                size -= ret;
+                offset += ret;
+        }
+}
+
+static void
+flush_run(struct trim *trim)
+{
+        write_at(trim, trim->run_data, trim->run_size, trim->run_offset);
+        trim->run_size = 0;
+}
+
+/* Queues a page to be written, merging it into the run if it follows on
+ * from the last one in both the file and memory.
+ */
+static void
+write_page(struct trim *trim, const void *data, uint32_t size,
+           uint64_t offset)
+{
+        if (trim->run_size &&
+            (trim->run_offset + trim->run_size != offset ||
+             trim->run_data + trim->run_size != data)) {
+                flush_run(trim);
+        }
+
+        if (!trim->run_size) {
+                trim->run_offset = offset;
+                trim->run_data = data;
+        }
+        trim->run_size += size;
+}
+
+/* Writes out a BO's kept pages, with the rest of the bytes in them zeroed,
+ * and records the runs of trimmed and zero bytes.  Returns the checksum of
+ * the BO as written.
+ */
+static uint32_t
+trim_bo(struct trim *trim, uint32_t bo, uint64_t file_offset)
+{
+        static uint8_t page[VC4_DUMP_ALIGN];
+        const uint32_t *kept = trim->kept[bo];
+        uint32_t size = trim->file->bo_state[bo].size;
+        const uint8_t *map = NULL;
+        uint32_t crc = 0, zeroes = 0;
+
+        if (kept) {
+                map = vc4_dump_file_map_bo(trim->file, bo);
+                if (!map)
+                        errx(1, "%s", trim->file->error);
+        }
+
+        for (uint32_t offset = 0; offset < size; offset += VC4_DUMP_ALIGN) {
+                uint32_t page_size = MIN2(size - offset, VC4_DUMP_ALIGN);
+                uint32_t kept_bytes = 0;
+                bool zero = true;
+
+                for (uint32_t i = 0; i < page_size; i++) {
+                        if (is_kept(kept, offset + i)) {
+                                kept_bytes++;
+                                if (map[offset + i])
+                                        zero = false;
+                        }
+                }
+                trim->kept_size += kept_bytes;
+
+                if (!kept_bytes) {
+                        add_zero_range(trim, bo, offset, page_size,
+                                       VC4_DUMP_ZERO_RANGE_TRIMMED);
+                        zeroes += page_size;
+                        continue;
+                }
+
+                if (kept_bytes == page_size) {
+                        if (zero) {
+                                add_zero_range(trim, bo, offset, page_size, 0);
+                                zeroes += page_size;
+                        } else {
+                                write_page(trim, map + offset, page_size,
+                                           file_offset + offset);
+                                crc = vc4_crc32c_zeros(crc, zeroes);
+                                crc = vc4_crc32c(crc, map + offset,
+                                                 page_size);
+                                zeroes = 0;
+                        }
+                        continue;
+                }
+
+                /* A page with some of it trimmed: record each run of bytes
+                 * on its own, and write out the kept ones with zeroes
+                 * around them, unless that's all zero anyway.
+                 */
+                uint32_t run_start = 0;
+                for (uint32_t i = 1; i <= page_size; i++) {
+                        if (i < page_size && is_kept(kept, offset + i) ==
+                            is_kept(kept, offset + run_start)) {
+                                continue;
+                        }
+
+                        if (!is_kept(kept, offset + run_start)) {
+                                add_zero_range(trim, bo, offset + run_start,
+                                               i - run_start,
+                                               VC4_DUMP_ZERO_RANGE_TRIMMED);
+                        } else if (zero) {
+                                add_zero_range(trim, bo, offset + run_start,
+                                               i - run_start, 0);
+                        }
+                        run_start = i;
+                }
+
+                if (zero) {
+                        zeroes += page_size;
+                        continue;
+                }
+
+                if (trim->run_size)
+                        flush_run(trim);
+                for (uint32_t i = 0; i < page_size; i++) {
+                        page[i] = (is_kept(kept, offset + i) ?
+                                   map[offset + i] : 0);
+                }
+                write_at(trim, page, page_size, file_offset + offset);
+                crc = vc4_crc32c_zeros(crc, zeroes);
+                crc = vc4_crc32c(crc, page, page_size);
+                zeroes = 0;
+        }
+
+        if (trim->run_size)
+                flush_run(trim);
+
+        return vc4_crc32c_zeros(crc, zeroes);
+}
+
+static void
+trim_dump(const char *input, const char *output)
+{
+        struct vc4_addr_space space;
+        struct trim trim = { 0 };
+        struct vc4_dump_header header = { 0 };
+        struct vc4_dump_bo *entries;
+        uint64_t offset, total_size = 0;
+        struct stat st;
+
+        trim.file = vc4_dump_file_open(input);
+        if (trim.file->error)
+                errx(1, "%s", trim.file->error);
+        uint32_t bo_count = trim.file->state->bo_count;
+
+        trim.kept = calloc(bo_count, sizeof(*trim.kept));
+        entries = calloc(bo_count, sizeof(*entries));
+        if (!trim.kept || !entries)
+                err(1, "malloc failure");
+
+        vc4_dump_file_init_addr_space(trim.file, &space);
+        vc4_dump_reach(&space, trim.file->state, keep_bytes, &trim);
+        vc4_addr_space_fini(&space);
+        if (trim.file->error)
+                errx(1, "%s", trim.file->error);
+
+        trim.fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (trim.fd == -1)
+                err(1, "Couldn't open %s", output);
+
+        header.version = VC4_DUMP_VERSION;
+        header.header_size = sizeof(header);
+        header.bo_entry_size = sizeof(*entries);
+        header.align = VC4_DUMP_ALIGN;
+        header.bo_table_offset = sizeof(header);
+        header.omitted_table_offset = (header.bo_table_offset +
+                                       (uint64_t)bo_count *
+                                       sizeof(*entries));
+        header.omitted_bo_count = trim.file->omitted_bo_count;
+        header.state = *trim.file->state;
+
+        /* The zero table isn't known until the BOs have been written, so
+         * it goes after them.
+         */
+        offset = vc4_dump_align(header.omitted_table_offset +
+                                (uint64_t)header.omitted_bo_count *
+                                sizeof(*trim.file->omitted_bos));
+        for (uint32_t i = 0; i < bo_count; i++) {
+                entries[i].bo = trim.file->bo_state[i];
+                entries[i].offset = offset;
+                entries[i].crc = trim_bo(&trim, i, offset);
+
+                total_size += trim.file->bo_state[i].size;
+                offset = vc4_dump_align(offset +
+                                        trim.file->bo_state[i].size);
+        }
+
+        header.zero_table_offset = offset;
+        header.zero_range_count = trim.zero_range_count;
+
+        header.crc_flags = VC4_DUMP_CRC_METADATA | VC4_DUMP_CRC_BOS;
+        header.metadata_crc = vc4_crc32c(0, &header, sizeof(header));
+        header.metadata_crc = vc4_crc32c(header.metadata_crc, entries,
+                                         bo_count * sizeof(*entries));
+        header.metadata_crc = vc4_crc32c(header.metadata_crc,
+                                         trim.file->omitted_bos,
+                                         header.omitted_bo_count *
+                                         sizeof(*trim.file->omitted_bos));
+        header.metadata_crc = vc4_crc32c(header.metadata_crc,
+                                         trim.zero_ranges,
+                                         trim.zero_range_count *
+                                         sizeof(*trim.zero_ranges));
+
+        write_at(&trim, &header, sizeof(header), 0);
+        write_at(&trim, entries, bo_count * sizeof(*entries),
+                 header.bo_table_offset);
+        write_at(&trim, trim.file->omitted_bos,
+                 header.omitted_bo_count * sizeof(*trim.file->omitted_bos),
+                 header.omitted_table_offset);
+        write_at(&trim, trim.zero_ranges,
+                 trim.zero_range_count * sizeof(*trim.zero_ranges),
+                 header.zero_table_offset);
+
+        /* An empty zero table would leave the BOs' trailing holes past
+         * the end of the file.
+         */
+        if (ftruncate(trim.fd, header.zero_table_offset +
+                      (uint64_t)trim.zero_range_count *
+                      sizeof(*trim.zero_ranges)) == -1) {
+                err(1, "Couldn't write the dump");
+        }
+
+        if (fstat(trim.fd, &st) == -1)
+                err(1, "Couldn't stat %s", output);
+        if (close(trim.fd) == -1)
+                err(1, "Couldn't write the dump");
+
+        fprintf(stderr, "%s: kept %"PRIu64" of %"PRIu64" bytes of BOs, "
+                "%"PRIu64" bytes stored\n", output, trim.kept_size,
+                total_size, (uint64_t)st.st_blocks * 512);
+
+        for (uint32_t i = 0; i < bo_count; i++)
+                free(trim.kept[i]);
+        free(trim.kept);
+        free(trim.zero_ranges);
+        free(entries);
+}
+
+static int
+compare_names(const void *a, const void *b)
+{
+        return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Returns a sorted list of the regular files in dir. */
+static char **
+list_dumps(const char *dir, uint32_t *count)
+{
+        DIR *d = opendir(dir);
+        struct dirent *entry;
+        char **names = NULL;
+        uint32_t size = 0;
+
+        if (!d)
+                err(1, "Couldn't open %s", dir);
+
+        *count = 0;
+        while ((entry = readdir(d))) {
+                char *path;
+                struct stat st;
+
+                if (asprintf(&path, "%s/%s", dir, entry->d_name) == -1)
+                        err(1, "malloc failure");
+                if (stat(path, &st) == -1 || !S_ISREG(st.st_mode)) {
+                        free(path);
+                        continue;
+                }
+                free(path);
+
+                if (*count == size) {
+                        size = MAX2(size * 2, 16);
+                        names = realloc(names, size * sizeof(*names));
+                        if (!names)
+                                err(1, "malloc failure");
+                }
+                names[*count] = strdup(entry->d_name);
+                if (!names[*count])
+                        err(1, "malloc failure");
+                (*count)++;
+        }
+        closedir(d);
+
+        if (*count)
+                qsort(names, *count, sizeof(*names), compare_names);
+        return names;
+}
+
+/* Reaps one child, returning whether it failed. */
+static bool
+wait_job(void)
+{
+        int status;
+
+        if (wait(&status) == -1)
+                err(1, "wait");
+
+        return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+/* Trims each dump in input_dir into output_dir, in up to jobs processes at
+ * once.  trim_dump() exits on a malformed dump, so a process per dump
+ * keeps a bad one from taking down the rest.
+ */
+static int
+trim_dir(const char *input_dir, const char *output_dir, long jobs)
+{
+        uint32_t count, failed = 0;
+        char **names = list_dumps(input_dir, &count);
+        long running = 0;
+
+        if (mkdir(output_dir, 0777) == -1 && errno != EEXIST)
+                err(1, "Couldn't create %s", output_dir);
+
+        /* Flush before forking, so that nothing buffered gets written out
+         * twice.
+         */
+        fflush(stdout);
+        fflush(stderr);
+
+        for (uint32_t i = 0; i < count; i++) {
+                if (running == jobs) {
+                        failed += wait_job();
+                        running--;
+                }
+
+                pid_t pid = fork();
+                if (pid == -1)
+                        err(1, "fork");
+
+                if (pid == 0) {
+                        char *input, *output;
+
+                        if (asprintf(&input, "%s/%s", input_dir,
+                                     names[i]) == -1 ||
+                            asprintf(&output, "%s/%s", output_dir,
+                                     names[i]) == -1) {
+                                err(1, "malloc failure");
+                        }
+                        trim_dump(input, output);
+                        exit(0);
+                }
+                running++;
+        }
+
+        while (running--)
+                failed += wait_job();
+
+        for (uint32_t i = 0; i < count; i++)
+                free(names[i]);
+        free(names);
+
+        if (failed)
+                warnx("%u of %u dumps couldn't be trimmed", failed, count);
+
+        return failed ? 1 : 0;
+}
+
+static void
+usage(const char *name)
+{
+        fprintf(stderr,
+                "Usage: %s [--jobs=N] input.dump output.dump\n"
+                "       %s [--jobs=N] input_dir output_dir\n",
+                name, name);
+        exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+        static const struct option long_options[] = {
+                { "jobs", required_argument, NULL, 'j' },
+                { NULL, 0, NULL, 0 },
+        };
+        long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+        struct stat st;
+        char *end;
+        int c;
+
+        while ((c = getopt_long(argc, argv, "j:", long_options,
+                                NULL)) != -1) {
+                switch (c) {
+                case 'j':
+                        jobs = strtol(optarg, &end, 0);
+                        if (*end || !*optarg || jobs < 1)
+                                usage(argv[0]);
+                        break;
+                default:
+                        usage(argv[0]);
+                }
+        }
+
+        if (argc - optind != 2)
+                usage(argv[0]);
+
+        if (stat(argv[optind], &st) == -1)
+                err(1, "Couldn't stat %s", argv[optind]);
+
+        if (S_ISDIR(st.st_mode)) {
+                return trim_dir(argv[optind], argv[optind + 1],
+                                MAX2(jobs, 1));
+        }
+
+        trim_dump(argv[optind], argv[optind + 1]);
+        return 0;
+}
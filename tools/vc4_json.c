@@ -0,0 +1,226 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <err.h>
+#include <math.h>
+#include <string.h>
+
+#include "vc4_json.h"
+#include "vc4_output.h"
+
+void
+vc4_json_init(struct vc4_json *json, struct vc4_output *out)
+{
+        memset(json, 0, sizeof(*json));
+        json->out = out;
+}
+
+void
+vc4_json_finish(struct vc4_json *json)
+{
+        if (json->depth != 0)
+                errx(1, "JSON document ended with open containers");
+        vc4_out_char(json->out, '\n');
+}
+
+/* Writes the separator and key that go before a new value.  starts_line is
+ * set for values that get a line of their own: the members of the top
+ * level object, and objects in arrays.
+ */
+static void
+begin_value(struct vc4_json *json, const char *key, bool starts_line)
+{
+        if (json->depth == 0) {
+                if (key)
+                        errx(1, "JSON key \"%s\" outside of an object", key);
+                return;
+        }
+
+        struct vc4_json_container *parent = &json->stack[json->depth - 1];
+
+        if (parent->is_array == (key != NULL)) {
+                errx(1, "JSON %s in %s", key ? "key" : "missing key",
+                     parent->is_array ? "array" : "object");
+        }
+
+        if (parent->has_members)
+                vc4_out_char(json->out, ',');
+        parent->has_members = true;
+
+        if (starts_line || json->depth == 1)
+                vc4_out_char(json->out, '\n');
+
+        if (key) {
+                vc4_out_char(json->out, '"');
+                vc4_out_str(json->out, key);
+                vc4_out_lit(json->out, "\":");
+        }
+}
+
+static void
+push(struct vc4_json *json, bool is_array)
+{
+        if (json->depth == VC4_JSON_MAX_DEPTH)
+                errx(1, "JSON nesting too deep");
+
+        json->stack[json->depth].is_array = is_array;
+        json->stack[json->depth].has_members = false;
+        json->depth++;
+}
+
+static void
+pop(struct vc4_json *json, bool is_array)
+{
+        if (json->depth == 0 || json->stack[json->depth - 1].is_array !=
+            is_array) {
+                errx(1, "JSON %s end without a matching begin",
+                     is_array ? "array" : "object");
+        }
+        json->depth--;
+}
+
+void
+vc4_json_object_begin(struct vc4_json *json, const char *key)
+{
+        begin_value(json, key, json->depth &&
+                    json->stack[json->depth - 1].is_array);
+        vc4_out_char(json->out, '{');
+        push(json, false);
+}
+
+void
+vc4_json_object_end(struct vc4_json *json)
+{
+        pop(json, false);
+        if (json->depth == 0)
+                vc4_out_char(json->out, '\n');
+        vc4_out_char(json->out, '}');
+}
+
+void
+vc4_json_array_begin(struct vc4_json *json, const char *key)
+{
+        begin_value(json, key, false);
+        vc4_out_char(json->out, '[');
+        push(json, true);
+}
+
+void
+vc4_json_array_end(struct vc4_json *json)
+{
+        pop(json, true);
+        vc4_out_char(json->out, ']');
+}
+
+void
+vc4_json_uint(struct vc4_json *json, const char *key, uint32_t value)
+{
+        begin_value(json, key, false);
+        vc4_out_udec(json->out, value);
+}
+
+void
+vc4_json_int(struct vc4_json *json, const char *key, int32_t value)
+{
+        begin_value(json, key, false);
+        vc4_out_dec(json->out, value);
+}
+
+void
+vc4_json_bool(struct vc4_json *json, const char *key, bool value)
+{
+        begin_value(json, key, false);
+        if (value)
+                vc4_out_lit(json->out, "true");
+        else
+                vc4_out_lit(json->out, "false");
+}
+
+void
+vc4_json_null(struct vc4_json *json, const char *key)
+{
+        begin_value(json, key, false);
+        vc4_out_lit(json->out, "null");
+}
+
+/* JSON has no representation of NaN or infinity, so those become null. */
+void
+vc4_json_double(struct vc4_json *json, const char *key, double value)
+{
+        begin_value(json, key, false);
+        if (isfinite(value))
+                vc4_out_printf(json->out, "%.9g", value);
+        else
+                vc4_out_lit(json->out, "null");
+}
+
+void
+vc4_json_string_len(struct vc4_json *json, const char *key,
+                    const char *str, uint32_t len)
+{
+        static const char hex_digits[] = "0123456789abcdef";
+        uint32_t run = 0;
+
+        begin_value(json, key, false);
+        vc4_out_char(json->out, '"');
+
+        /* Copy runs of characters that don't need escaping in one go. */
+        for (uint32_t i = 0; i < len; i++) {
+                unsigned char c = str[i];
+
+                if (c >= 0x20 && c != '"' && c != '\\')
+                        continue;
+
+                vc4_out_mem(json->out, str + run, i - run);
+                run = i + 1;
+
+                switch (c) {
+                case '"':
+                        vc4_out_lit(json->out, "\\\"");
+                        break;
+                case '\\':
+                        vc4_out_lit(json->out, "\\\\");
+                        break;
+                case '\n':
+                        vc4_out_lit(json->out, "\\n");
+                        break;
+                case '\t':
+                        vc4_out_lit(json->out, "\\t");
+                        break;
+                default:
+                        vc4_out_lit(json->out, "\\u00");
+                        vc4_out_char(json->out, hex_digits[c >> 4]);
+                        vc4_out_char(json->out, hex_digits[c & 0xf]);
+                        break;
+                }
+        }
+        vc4_out_mem(json->out, str + run, len - run);
+
+        vc4_out_char(json->out, '"');
+}
+
+void
+vc4_json_string(struct vc4_json *json, const char *key, const char *str)
+{
+        vc4_json_string_len(json, key, str, strlen(str));
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/** @file vc4_json.h
+ *
+ * Streaming JSON writer on top of struct vc4_output.
+ *
+ * Values are written out as soon as they're added, so nothing of the
+ * document is kept around other than the stack of open containers.  That
+ * stack is used to place the commas and to catch mismatched begin/end
+ * calls and keys, which is enough to guarantee well-formed output.
+ *
+ * Every value function takes a key, which must be a plain literal (it
+ * isn't escaped) when adding to an object, and NULL when adding to an
+ * array or at the top level.
+ */
+
+#ifndef VC4_JSON_H
+#define VC4_JSON_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct vc4_output;
+
+#define VC4_JSON_MAX_DEPTH 16
+
+struct vc4_json_container {
+        bool is_array;
+        bool has_members;
+};
+
+struct vc4_json {
+        struct vc4_output *out;
+        uint32_t depth;
+        struct vc4_json_container stack[VC4_JSON_MAX_DEPTH];
+};
+
+void vc4_json_init(struct vc4_json *json, struct vc4_output *out);
+void vc4_json_finish(struct vc4_json *json);
+
+void vc4_json_object_begin(struct vc4_json *json, const char *key);
+void vc4_json_object_end(struct vc4_json *json);
+void vc4_json_array_begin(struct vc4_json *json, const char *key);
+void vc4_json_array_end(struct vc4_json *json);
+
+void vc4_json_uint(struct vc4_json *json, const char *key, uint32_t value);
+void vc4_json_int(struct vc4_json *json, const char *key, int32_t value);
+void vc4_json_bool(struct vc4_json *json, const char *key, bool value);
+void vc4_json_double(struct vc4_json *json, const char *key, double value);
+void vc4_json_null(struct vc4_json *json, const char *key);
+void vc4_json_string(struct vc4_json *json, const char *key,
+                     const char *str);
+void vc4_json_string_len(struct vc4_json *json, const char *key,
+                         const char *str, uint32_t len);
+
+#endif /* VC4_JSON_H */
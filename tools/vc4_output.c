@@ -0,0 +1,539 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "vc4_output.h"
+#include "vc4_tools.h"
+
+/* Pairs of decimal digits for 00 through 99. */
+static const char dec_pairs[] =
+        "00010203040506070809"
+        "10111213141516171819"
+        "20212223242526272829"
+        "30313233343536373839"
+        "40414243444546474849"
+        "50515253545556575859"
+        "60616263646566676869"
+        "70717273747576777879"
+        "80818283848586878889"
+        "90919293949596979899";
+
+struct vc4_output *
+vc4_output_create(int fd, uint32_t size)
+{
+        struct vc4_output *out = calloc(1, sizeof(*out));
+
+        if (size < VC4_OUTPUT_MIN_SIZE)
+                size = VC4_OUTPUT_MIN_SIZE;
+
+        if (!out)
+                err(1, "malloc failure");
+        out->buf = malloc(size);
+        if (!out->buf)
+                err(1, "malloc failure");
+        out->fd = fd;
+        out->size = size;
+
+        return out;
+}
+
+void
+vc4_output_destroy(struct vc4_output *out)
+{
+        vc4_output_flush(out);
+        free(out->buf);
+        free(out);
+}
+
+static void
+write_all(int fd, const char *data, uint32_t len)
+{
+        while (len) {
+                ssize_t ret = write(fd, data, len);
+                if (ret < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        err(1, "write failure");
+                }
+                data += ret;
+                len -= ret;
+        }
+}
+
+static void
+grow(struct vc4_output *out, uint32_t len)
+{
+        while (out->len + len > out->size)
+                out->size *= 2;
+        out->buf = realloc(out->buf, out->size);
+        if (!out->buf)
+                err(1, "malloc failure");
+}
+
+void
+vc4_output_flush(struct vc4_output *out)
+{
+        uint32_t len = out->len;
+
+        if (out->fd < 0) {
+                /* Make room for at least the inline helpers' reservation. */
+                grow(out, VC4_OUTPUT_MIN_SIZE);
+                return;
+        }
+
+        /* Clear the length first, so that an err() exit from inside the
+         * write doesn't try to flush the same text again.
+         */
+        out->len = 0;
+        write_all(out->fd, out->buf, len);
+}
+
+void
+vc4_out_mem_slow(struct vc4_output *out, const void *data, uint32_t len)
+{
+        if (out->fd < 0) {
+                grow(out, len);
+                memcpy(out->buf + out->len, data, len);
+                out->len += len;
+                return;
+        }
+
+        vc4_output_flush(out);
+
+        if (len > out->size) {
+                write_all(out->fd, data, len);
+        } else {
+                memcpy(out->buf, data, len);
+                out->len = len;
+        }
+}
+
+/* Formats value into the end of a buffer of at least 10 bytes, returning
+ * the start of the digits.
+ */
+static char *
+format_udec(char *end, uint32_t value)
+{
+        char *p = end;
+
+        while (value >= 100) {
+                uint32_t pair = (value % 100) * 2;
+                value /= 100;
+                p -= 2;
+                p[0] = dec_pairs[pair];
+                p[1] = dec_pairs[pair + 1];
+        }
+
+        if (value >= 10) {
+                p -= 2;
+                p[0] = dec_pairs[value * 2];
+                p[1] = dec_pairs[value * 2 + 1];
+        } else {
+                *--p = '0' + value;
+        }
+
+        return p;
+}
+
+void
+vc4_out_udec(struct vc4_output *out, uint32_t value)
+{
+        char tmp[10];
+        char *p = format_udec(tmp + sizeof(tmp), value);
+
+        vc4_out_mem(out, p, tmp + sizeof(tmp) - p);
+}
+
+void
+vc4_out_dec(struct vc4_output *out, int32_t value)
+{
+        if (value < 0) {
+                vc4_out_char(out, '-');
+                vc4_out_udec(out, -(uint32_t)value);
+        } else {
+                vc4_out_udec(out, value);
+        }
+}
+
+static void
+out_fill(struct vc4_output *out, char c, int count)
+{
+        while (count-- > 0)
+                vc4_out_char(out, c);
+}
+
+/* Writes a formatted field, padded out to width the way printf would. */
+static void
+out_padded(struct vc4_output *out, const char *sign, const char *digits,
+           uint32_t len, int width, bool zero, bool left)
+{
+        int sign_len = strlen(sign);
+        int pad = width - (int)len - sign_len;
+
+        if (left) {
+                vc4_out_str(out, sign);
+                vc4_out_mem(out, digits, len);
+                out_fill(out, ' ', pad);
+        } else if (zero) {
+                vc4_out_str(out, sign);
+                out_fill(out, '0', pad);
+                vc4_out_mem(out, digits, len);
+        } else {
+                out_fill(out, ' ', pad);
+                vc4_out_str(out, sign);
+                vc4_out_mem(out, digits, len);
+        }
+}
+
+/* The length modifiers of a conversion, by the type of argument they
+ * take.
+ */
+enum out_length {
+        OUT_LENGTH_NONE,
+        OUT_LENGTH_CHAR,
+        OUT_LENGTH_SHORT,
+        OUT_LENGTH_LONG,
+        OUT_LENGTH_LONG_LONG,
+        OUT_LENGTH_INTMAX,
+        OUT_LENGTH_SIZE,
+        OUT_LENGTH_PTRDIFF,
+        OUT_LENGTH_LONG_DOUBLE,
+};
+
+/* Reads the length modifier at p, returning the pointer past it. */
+static const char *
+out_parse_length(const char *p, enum out_length *length)
+{
+        switch (*p) {
+        case 'h':
+                if (p[1] == 'h') {
+                        *length = OUT_LENGTH_CHAR;
+                        return p + 2;
+                }
+                *length = OUT_LENGTH_SHORT;
+                return p + 1;
+        case 'l':
+                if (p[1] == 'l') {
+                        *length = OUT_LENGTH_LONG_LONG;
+                        return p + 2;
+                }
+                *length = OUT_LENGTH_LONG;
+                return p + 1;
+        case 'q':
+                *length = OUT_LENGTH_LONG_LONG;
+                return p + 1;
+        case 'j':
+                *length = OUT_LENGTH_INTMAX;
+                return p + 1;
+        case 'z':
+                *length = OUT_LENGTH_SIZE;
+                return p + 1;
+        case 't':
+                *length = OUT_LENGTH_PTRDIFF;
+                return p + 1;
+        case 'L':
+                *length = OUT_LENGTH_LONG_DOUBLE;
+                return p + 1;
+        default:
+                *length = OUT_LENGTH_NONE;
+                return p;
+        }
+}
+
+static intmax_t
+out_signed_arg(va_list *ap, enum out_length length)
+{
+        switch (length) {
+        case OUT_LENGTH_CHAR:
+                return (signed char)va_arg(*ap, int);
+        case OUT_LENGTH_SHORT:
+                return (short)va_arg(*ap, int);
+        case OUT_LENGTH_LONG:
+                return va_arg(*ap, long);
+        case OUT_LENGTH_LONG_LONG:
+                return va_arg(*ap, long long);
+        case OUT_LENGTH_INTMAX:
+                return va_arg(*ap, intmax_t);
+        case OUT_LENGTH_SIZE:
+                return va_arg(*ap, ssize_t);
+        case OUT_LENGTH_PTRDIFF:
+                return va_arg(*ap, ptrdiff_t);
+        default:
+                return va_arg(*ap, int);
+        }
+}
+
+static uintmax_t
+out_unsigned_arg(va_list *ap, enum out_length length)
+{
+        switch (length) {
+        case OUT_LENGTH_CHAR:
+                return (unsigned char)va_arg(*ap, unsigned);
+        case OUT_LENGTH_SHORT:
+                return (unsigned short)va_arg(*ap, unsigned);
+        case OUT_LENGTH_LONG:
+                return va_arg(*ap, unsigned long);
+        case OUT_LENGTH_LONG_LONG:
+                return va_arg(*ap, unsigned long long);
+        case OUT_LENGTH_INTMAX:
+                return va_arg(*ap, uintmax_t);
+        case OUT_LENGTH_SIZE:
+                return va_arg(*ap, size_t);
+        case OUT_LENGTH_PTRDIFF:
+                return (size_t)va_arg(*ap, ptrdiff_t);
+        default:
+                return va_arg(*ap, unsigned);
+        }
+}
+
+/* Hands a single conversion that we don't format ourselves to snprintf().
+ * Returns the pointer just past the conversion in the format string.
+ *
+ * The argument is read with the type its length modifier says, and integers
+ * are handed on as an intmax_t or uintmax_t with the length modifier changed
+ * to match.
+ */
+static const char *
+out_snprintf_conversion(struct vc4_output *out, const char *spec,
+                        va_list *ap)
+{
+        const char *p = spec + 1;
+        enum out_length length;
+        char format[32];
+        char tmp[512];
+        int len;
+
+        while (*p && strchr("#0- +'.123456789", *p))
+                p++;
+        int prefix_len = p - spec;
+        p = out_parse_length(p, &length);
+        if (!*p || prefix_len + 3 > sizeof(format))
+                errx(1, "unsupported output format \"%s\"", spec);
+        char conversion = *p++;
+
+        memcpy(format, spec, prefix_len);
+        format[prefix_len] = 0;
+
+        /* The format is a piece of the caller's, which the compiler has
+         * checked against the arguments at the vc4_out_printf() call, with
+         * just its length modifier replaced.
+         */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+        switch (conversion) {
+        case 'd':
+        case 'i':
+                if (length == OUT_LENGTH_LONG_DOUBLE)
+                        errx(1, "unsupported output format \"%s\"", spec);
+                snprintf(format + prefix_len, 3, "j%c", conversion);
+                len = snprintf(tmp, sizeof(tmp), format,
+                               out_signed_arg(ap, length));
+                break;
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+                if (length == OUT_LENGTH_LONG_DOUBLE)
+                        errx(1, "unsupported output format \"%s\"", spec);
+                snprintf(format + prefix_len, 3, "j%c", conversion);
+                len = snprintf(tmp, sizeof(tmp), format,
+                               out_unsigned_arg(ap, length));
+                break;
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+                if (length == OUT_LENGTH_LONG_DOUBLE) {
+                        snprintf(format + prefix_len, 3, "L%c", conversion);
+                        len = snprintf(tmp, sizeof(tmp), format,
+                                       va_arg(*ap, long double));
+                } else if (length == OUT_LENGTH_NONE ||
+                           length == OUT_LENGTH_LONG) {
+                        /* %a prints doubles differently from long
+                         * doubles, so these stay doubles.
+                         */
+                        snprintf(format + prefix_len, 3, "%c", conversion);
+                        len = snprintf(tmp, sizeof(tmp), format,
+                                       va_arg(*ap, double));
+                } else {
+                        errx(1, "unsupported output format \"%s\"", spec);
+                }
+                break;
+        case 'c':
+        case 's':
+        case 'p':
+                /* Wide characters and strings aren't supported. */
+                if (length != OUT_LENGTH_NONE)
+                        errx(1, "unsupported output format \"%s\"", spec);
+                format[prefix_len] = conversion;
+                format[prefix_len + 1] = 0;
+                if (conversion == 'c') {
+                        len = snprintf(tmp, sizeof(tmp), format,
+                                       va_arg(*ap, int));
+                } else if (conversion == 's') {
+                        len = snprintf(tmp, sizeof(tmp), format,
+                                       va_arg(*ap, const char *));
+                } else {
+                        len = snprintf(tmp, sizeof(tmp), format,
+                                       va_arg(*ap, void *));
+                }
+                break;
+        default:
+                errx(1, "unsupported output format \"%s\"", spec);
+        }
+#pragma GCC diagnostic pop
+
+        if (len < 0)
+                errx(1, "output formatting failure");
+        vc4_out_mem(out, tmp, MIN2(len, (int)sizeof(tmp) - 1));
+
+        return p;
+}
+
+void
+vc4_out_vprintf(struct vc4_output *out, const char *format, va_list ap)
+{
+        static const char hex_digits[] = "0123456789abcdef";
+        const char *p = format;
+        va_list args;
+
+        va_copy(args, ap);
+
+        while (*p) {
+                const char *literal = p;
+
+                while (*p && *p != '%')
+                        p++;
+                if (p != literal)
+                        vc4_out_mem(out, literal, p - literal);
+                if (!*p)
+                        break;
+
+                const char *spec = p++;
+                bool zero = false, left = false;
+                int width = 0;
+
+                if (*p == '%') {
+                        vc4_out_char(out, '%');
+                        p++;
+                        continue;
+                }
+
+                while (*p == '0' || *p == '-') {
+                        if (*p == '0')
+                                zero = true;
+                        else
+                                left = true;
+                        p++;
+                }
+                while (*p >= '0' && *p <= '9')
+                        width = width * 10 + *p++ - '0';
+
+                char tmp[10];
+                char *end = tmp + sizeof(tmp);
+                char *digits;
+
+                switch (*p) {
+                case 'd':
+                case 'i': {
+                        int value = va_arg(args, int);
+
+                        digits = format_udec(end, value < 0 ?
+                                             -(uint32_t)value : value);
+                        out_padded(out, value < 0 ? "-" : "",
+                                   digits, end - digits, width, zero, left);
+                        p++;
+                        break;
+                }
+                case 'u':
+                        digits = format_udec(end, va_arg(args, unsigned));
+                        out_padded(out, "", digits, end - digits,
+                                   width, zero, left);
+                        p++;
+                        break;
+                case 'x': {
+                        unsigned value = va_arg(args, unsigned);
+
+                        if (!left && width <= 8 && (zero || width <= 1)) {
+                                vc4_out_hex(out, value, width);
+                                p++;
+                                break;
+                        }
+
+                        digits = end;
+                        do {
+                                *--digits = hex_digits[value & 0xf];
+                                value >>= 4;
+                        } while (value);
+                        out_padded(out, "", digits, end - digits,
+                                   width, zero, left);
+                        p++;
+                        break;
+                }
+                case 's': {
+                        const char *str = va_arg(args, const char *);
+
+                        if (!str)
+                                str = "(null)";
+                        out_padded(out, "", str, strlen(str),
+                                   width, false, left);
+                        p++;
+                        break;
+                }
+                case 'c': {
+                        char c = va_arg(args, int);
+
+                        out_padded(out, "", &c, 1, width, false, left);
+                        p++;
+                        break;
+                }
+                default:
+                        p = out_snprintf_conversion(out, spec, &args);
+                        break;
+                }
+        }
+
+        va_end(args);
+}
+
+void
+vc4_out_printf(struct vc4_output *out, const char *format, ...)
+{
+        va_list ap;
+
+        va_start(ap, format);
+        vc4_out_vprintf(out, format, ap);
+        va_end(ap);
+}
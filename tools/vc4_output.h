@@ -0,0 +1,131 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/** @file vc4_output.h
+ *
+ * Buffered text output for the dump tools.
+ *
+ * Text is formatted straight into one large buffer, which is only passed to
+ * write() when it fills up or is flushed.  The integer formatting is
+ * table-driven rather than going through stdio, and vc4_out_printf()
+ * handles the printf conversions the tools use, falling back to
+ * snprintf() only for floating point.
+ *
+ * An output created with an fd of -1 keeps its text in buf instead, growing
+ * as needed, for building up strings to be used elsewhere.
+ */
+
+#ifndef VC4_OUTPUT_H
+#define VC4_OUTPUT_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+
+struct vc4_output {
+        int fd;
+        uint32_t len;
+        uint32_t size;
+        char *buf;
+};
+
+/* Longest run of characters that the inline helpers reserve at once. */
+#define VC4_OUTPUT_MIN_SIZE 64
+
+struct vc4_output *vc4_output_create(int fd, uint32_t size);
+void vc4_output_destroy(struct vc4_output *out);
+void vc4_output_flush(struct vc4_output *out);
+
+static inline void
+vc4_output_reset(struct vc4_output *out)
+{
+        out->len = 0;
+}
+
+void vc4_out_mem_slow(struct vc4_output *out, const void *data, uint32_t len);
+void vc4_out_udec(struct vc4_output *out, uint32_t value);
+void vc4_out_dec(struct vc4_output *out, int32_t value);
+
+void vc4_out_printf(struct vc4_output *out, const char *format, ...)
+        __attribute__ ((format(__printf__, 2, 3)));
+void vc4_out_vprintf(struct vc4_output *out, const char *format, va_list ap);
+
+static inline void
+vc4_out_reserve(struct vc4_output *out, uint32_t len)
+{
+        if (out->len + len > out->size)
+                vc4_output_flush(out);
+}
+
+static inline void
+vc4_out_mem(struct vc4_output *out, const void *data, uint32_t len)
+{
+        if (out->len + len <= out->size) {
+                memcpy(out->buf + out->len, data, len);
+                out->len += len;
+        } else {
+                vc4_out_mem_slow(out, data, len);
+        }
+}
+
+static inline void
+vc4_out_str(struct vc4_output *out, const char *str)
+{
+        vc4_out_mem(out, str, strlen(str));
+}
+
+/* Copies a string literal, with its length known at compile time. */
+#define vc4_out_lit(out, lit) vc4_out_mem(out, "" lit, sizeof(lit) - 1)
+
+static inline void
+vc4_out_char(struct vc4_output *out, char c)
+{
+        vc4_out_reserve(out, 1);
+        out->buf[out->len++] = c;
+}
+
+/**
+ * Writes value in lowercase hex, zero-padded to at least digits digits
+ * (like "%0*x").
+ */
+static inline void
+vc4_out_hex(struct vc4_output *out, uint32_t value, int digits)
+{
+        static const char hex_digits[] = "0123456789abcdef";
+        int len = 1;
+
+        while (len < 8 && (value >> (len * 4)))
+                len++;
+        if (len < digits)
+                len = digits;
+
+        vc4_out_reserve(out, len);
+        char *p = out->buf + out->len + len;
+        for (int i = 0; i < len; i++) {
+                *--p = hex_digits[value & 0xf];
+                value >>= 4;
+        }
+        out->len += len;
+}
+
+#endif /* VC4_OUTPUT_H */
@@ -0,0 +1,227 @@
+/*
+ * Copyright © 2015 Broadcom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/** @file vc4_output_bench.c
+ *
+ * Measures the MB/s of dump-style text written through stdio against
+ * struct vc4_output, and checks that the two produce the same bytes.
+ *
+ * The lines are the kinds that dominate vc4_dump_parse output: packet
+ * headers, hex fields and decimal fields.
+ */
+
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "vc4_output.h"
+#include "vc4_tools.h"
+
+#define LINES (4 * 1024 * 1024)
+
+static double
+get_time(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char *
+line_name(uint32_t i)
+{
+        static const char * const names[] = {
+                "VC4_PACKET_TILE_COORDINATES",
+                "VC4_PACKET_BRANCH_TO_SUB_LIST",
+                "VC4_PACKET_STORE_MS_TILE_BUFFER",
+                "VC4_PACKET_GL_SHADER_STATE",
+        };
+
+        return names[i % ARRAY_SIZE(names)];
+}
+
+static void
+write_stdio(FILE *f)
+{
+        for (uint32_t i = 0; i < LINES; i += 4) {
+                uint32_t paddr = 0x10000000 + i * 4;
+
+                fprintf(f, "0x%08x: 0x%02x %s\n",
+                        paddr, i & 0xff, line_name(i));
+                fprintf(f, "0x%08x:      %d, %d\n",
+                        paddr + 1, i & 0x3f, (i >> 6) & 0x3f);
+                fprintf(f, "0x%08x:      addr 0x%08x\n",
+                        paddr + 2, paddr * 3);
+                fprintf(f, "0x%08x:      0x%04x: attr %d %2d VS VPM\n",
+                        paddr + 3, i & 0xffff, i & 7, i & 15);
+        }
+        fflush(f);
+}
+
+static void
+write_output(struct vc4_output *out)
+{
+        for (uint32_t i = 0; i < LINES; i += 4) {
+                uint32_t paddr = 0x10000000 + i * 4;
+
+                vc4_out_printf(out, "0x%08x: 0x%02x %s\n",
+                               paddr, i & 0xff, line_name(i));
+                vc4_out_printf(out, "0x%08x:      %d, %d\n",
+                               paddr + 1, i & 0x3f, (i >> 6) & 0x3f);
+                vc4_out_printf(out, "0x%08x:      addr 0x%08x\n",
+                               paddr + 2, paddr * 3);
+                vc4_out_printf(out,
+                               "0x%08x:      0x%04x: attr %d %2d VS VPM\n",
+                               paddr + 3, i & 0xffff, i & 7, i & 15);
+        }
+        vc4_output_flush(out);
+}
+
+/* The same text, through the direct helpers that the hot paths use. */
+static void
+write_output_direct(struct vc4_output *out)
+{
+        for (uint32_t i = 0; i < LINES; i += 4) {
+                uint32_t paddr = 0x10000000 + i * 4;
+
+                vc4_out_lit(out, "0x");
+                vc4_out_hex(out, paddr, 8);
+                vc4_out_lit(out, ": 0x");
+                vc4_out_hex(out, i & 0xff, 2);
+                vc4_out_char(out, ' ');
+                vc4_out_str(out, line_name(i));
+                vc4_out_char(out, '\n');
+
+                vc4_out_lit(out, "0x");
+                vc4_out_hex(out, paddr + 1, 8);
+                vc4_out_lit(out, ":      ");
+                vc4_out_udec(out, i & 0x3f);
+                vc4_out_lit(out, ", ");
+                vc4_out_udec(out, (i >> 6) & 0x3f);
+                vc4_out_char(out, '\n');
+
+                vc4_out_lit(out, "0x");
+                vc4_out_hex(out, paddr + 2, 8);
+                vc4_out_lit(out, ":      addr 0x");
+                vc4_out_hex(out, paddr * 3, 8);
+                vc4_out_char(out, '\n');
+
+                vc4_out_printf(out,
+                               "0x%08x:      0x%04x: attr %d %2d VS VPM\n",
+                               paddr + 3, i & 0xffff, i & 7, i & 15);
+        }
+        vc4_output_flush(out);
+}
+
+static int
+open_tmp(char *template)
+{
+        int fd = mkstemp(template);
+
+        if (fd == -1)
+                err(1, "Couldn't create %s", template);
+        unlink(template);
+
+        return fd;
+}
+
+static void *
+read_back(int fd, off_t *size)
+{
+        *size = lseek(fd, 0, SEEK_END);
+        void *data = malloc(*size);
+
+        if (!data)
+                err(1, "malloc failure");
+        if (pread(fd, data, *size, 0) != *size)
+                err(1, "Couldn't read back output");
+
+        return data;
+}
+
+int
+main(int argc, char **argv)
+{
+        char stdio_name[] = "/tmp/vc4_output_bench.XXXXXX";
+        char output_name[] = "/tmp/vc4_output_bench.XXXXXX";
+        char direct_name[] = "/tmp/vc4_output_bench.XXXXXX";
+        int stdio_fd = open_tmp(stdio_name);
+        int output_fd = open_tmp(output_name);
+        int direct_fd = open_tmp(direct_name);
+        FILE *f = fdopen(stdio_fd, "w");
+        struct vc4_output *out = vc4_output_create(output_fd, 256 * 1024);
+        struct vc4_output *direct = vc4_output_create(direct_fd, 256 * 1024);
+        off_t stdio_size, output_size, direct_size;
+
+        if (!f)
+                err(1, "fdopen failure");
+
+        double start = get_time();
+        write_stdio(f);
+        double stdio_time = get_time() - start;
+
+        start = get_time();
+        write_output(out);
+        double output_time = get_time() - start;
+
+        start = get_time();
+        write_output_direct(direct);
+        double direct_time = get_time() - start;
+
+        void *stdio_data = read_back(stdio_fd, &stdio_size);
+        void *output_data = read_back(output_fd, &output_size);
+        void *direct_data = read_back(direct_fd, &direct_size);
+
+        if (output_size != stdio_size ||
+            memcmp(output_data, stdio_data, stdio_size) != 0) {
+                errx(1, "vc4_out_printf() output doesn't match stdio");
+        }
+        if (direct_size != stdio_size ||
+            memcmp(direct_data, stdio_data, stdio_size) != 0) {
+                errx(1, "direct vc4_output output doesn't match stdio");
+        }
+
+        double mb = stdio_size / (1024.0 * 1024.0);
+        printf("stdio fprintf():  %8.1f MB/s\n", mb / stdio_time);
+        printf("vc4_out_printf(): %8.1f MB/s (%.1fx)\n",
+               mb / output_time, stdio_time / output_time);
+        printf("vc4_out_hex() etc: %7.1f MB/s (%.1fx)\n",
+               mb / direct_time, stdio_time / direct_time);
+
+        fclose(f);
+        vc4_output_destroy(out);
+        vc4_output_destroy(direct);
+        close(output_fd);
+        close(direct_fd);
+        free(stdio_data);
+        free(output_data);
+        free(direct_data);
+
+        return 0;
+}
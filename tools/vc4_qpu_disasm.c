@@ -25,6 +25,8 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include "vc4_dump.h"
+#include "vc4_output.h"
 #include "vc4_qpu_defines.h"
 #include "vc4_tools.h"
 
@@ -247,26 +249,26 @@ get_special_write_desc(int reg, bool is_a)
 }
 
 static void
-vc4_qpu_disasm_pack_mul(FILE *out, uint32_t pack)
+vc4_qpu_disasm_pack_mul(struct vc4_output *out, uint32_t pack)
 {
-        fprintf(out, ".%s", DESC(qpu_pack_mul, pack));
+        vc4_out_printf(out, ".%s", DESC(qpu_pack_mul, pack));
 }
 
 static void
-vc4_qpu_disasm_pack_a(FILE *out, uint32_t pack)
+vc4_qpu_disasm_pack_a(struct vc4_output *out, uint32_t pack)
 {
-        fprintf(out, "%s", DESC(qpu_pack_a, pack));
+        vc4_out_str(out, DESC(qpu_pack_a, pack));
 }
 
 static void
-vc4_qpu_disasm_unpack(FILE *out, uint32_t unpack)
+vc4_qpu_disasm_unpack(struct vc4_output *out, uint32_t unpack)
 {
         if (unpack != QPU_UNPACK_NOP)
-                fprintf(out, ".%s", DESC(qpu_unpack, unpack));
+                vc4_out_printf(out, ".%s", DESC(qpu_unpack, unpack));
 }
 
 static void
-print_alu_dst(FILE *out, uint64_t inst, bool is_mul)
+print_alu_dst(struct vc4_output *out, uint64_t inst, bool is_mul)
 {
         bool is_a = is_mul == ((inst & QPU_WS) != 0);
         uint32_t waddr = (is_mul ?
@@ -276,11 +278,11 @@ print_alu_dst(FILE *out, uint64_t inst, bool is_mul)
         uint32_t pack = QPU_GET_FIELD(inst, QPU_PACK);
 
         if (waddr <= 31)
-                fprintf(out, "r%s%d", file, waddr);
+                vc4_out_printf(out, "r%s%d", file, waddr);
         else if (get_special_write_desc(waddr, is_a))
-                fprintf(out, "%s", get_special_write_desc(waddr, is_a));
+                vc4_out_str(out, get_special_write_desc(waddr, is_a));
         else
-                fprintf(out, "%s%d?", file, waddr);
+                vc4_out_printf(out, "%s%d?", file, waddr);
 
         if (is_mul && (inst & QPU_PM)) {
                 vc4_qpu_disasm_pack_mul(out, pack);
@@ -290,7 +292,7 @@ print_alu_dst(FILE *out, uint64_t inst, bool is_mul)
 }
 
 static void
-print_alu_src(FILE *out, uint64_t inst, uint32_t mux)
+print_alu_src(struct vc4_output *out, uint64_t inst, uint32_t mux)
 {
         bool is_a = mux != QPU_MUX_B;
         const char *file = is_a ? "a" : "b";
@@ -300,27 +302,27 @@ print_alu_src(FILE *out, uint64_t inst, uint32_t mux)
         uint32_t unpack = QPU_GET_FIELD(inst, QPU_UNPACK);
 
         if (mux <= QPU_MUX_R5)
-                fprintf(out, "r%d", mux);
+                vc4_out_printf(out, "r%d", mux);
         else if (!is_a &&
                  QPU_GET_FIELD(inst, QPU_SIG) == QPU_SIG_SMALL_IMM) {
                 uint32_t si = QPU_GET_FIELD(inst, QPU_SMALL_IMM);
                 if (si <= 15)
-                        fprintf(out, "%d", si);
+                        vc4_out_printf(out, "%d", si);
                 else if (si <= 31)
-                        fprintf(out, "%d", -16 + (si - 16));
+                        vc4_out_printf(out, "%d", -16 + (si - 16));
                 else if (si <= 39)
-                        fprintf(out, "%.1f", (float)(1 << (si - 32)));
+                        vc4_out_printf(out, "%.1f", (float)(1 << (si - 32)));
                 else if (si <= 47)
-                        fprintf(out, "%f", 1.0f / (1 << (48 - si)));
+                        vc4_out_printf(out, "%f", 1.0f / (1 << (48 - si)));
                 else
-                        fprintf(out, "<bad imm %d>", si);
+                        vc4_out_printf(out, "<bad imm %d>", si);
         } else if (raddr <= 31)
-                fprintf(out, "r%s%d", file, raddr);
+                vc4_out_printf(out, "r%s%d", file, raddr);
         else {
                 if (is_a)
-                        fprintf(out, "%s", DESC(special_read_a, raddr - 32));
+                        vc4_out_str(out, DESC(special_read_a, raddr - 32));
                 else
-                        fprintf(out, "%s", DESC(special_read_b, raddr - 32));
+                        vc4_out_str(out, DESC(special_read_b, raddr - 32));
         }
 
         if (((mux == QPU_MUX_A && !(inst & QPU_PM)) ||
@@ -330,7 +332,7 @@ print_alu_src(FILE *out, uint64_t inst, uint32_t mux)
 }
 
 static void
-print_add_op(FILE *out, uint64_t inst)
+print_add_op(struct vc4_output *out, uint64_t inst)
 {
         uint32_t op_add = QPU_GET_FIELD(inst, QPU_OP_ADD);
         uint32_t cond = QPU_GET_FIELD(inst, QPU_COND_ADD);
@@ -338,25 +340,25 @@ print_add_op(FILE *out, uint64_t inst)
                        QPU_GET_FIELD(inst, QPU_ADD_A) ==
                        QPU_GET_FIELD(inst, QPU_ADD_B));
 
-        fprintf(out, "%s%s%s ",
+        vc4_out_printf(out, "%s%s%s ",
                 is_mov ? "mov" : DESC(qpu_add_opcodes, op_add),
                 ((inst & QPU_SF) && op_add != QPU_A_NOP) ? ".sf" : "",
                 op_add != QPU_A_NOP ? DESC(qpu_condflags, cond) : "");
 
         print_alu_dst(out, inst, false);
-        fprintf(out, ", ");
+        vc4_out_lit(out, ", ");
 
         print_alu_src(out, inst, QPU_GET_FIELD(inst, QPU_ADD_A));
 
         if (!is_mov) {
-                fprintf(out, ", ");
+                vc4_out_lit(out, ", ");
 
                 print_alu_src(out, inst, QPU_GET_FIELD(inst, QPU_ADD_B));
         }
 }
 
 static void
-print_mul_op(FILE *out, uint64_t inst)
+print_mul_op(struct vc4_output *out, uint64_t inst)
 {
         uint32_t op_add = QPU_GET_FIELD(inst, QPU_OP_ADD);
         uint32_t op_mul = QPU_GET_FIELD(inst, QPU_OP_MUL);
@@ -365,24 +367,24 @@ print_mul_op(FILE *out, uint64_t inst)
                        QPU_GET_FIELD(inst, QPU_MUL_A) ==
                        QPU_GET_FIELD(inst, QPU_MUL_B));
 
-        fprintf(out, "%s%s%s ",
+        vc4_out_printf(out, "%s%s%s ",
                 is_mov ? "mov" : DESC(qpu_mul_opcodes, op_mul),
                 ((inst & QPU_SF) && op_add == QPU_A_NOP) ? ".sf" : "",
                 op_mul != QPU_M_NOP ? DESC(qpu_condflags, cond) : "");
 
         print_alu_dst(out, inst, true);
-        fprintf(out, ", ");
+        vc4_out_lit(out, ", ");
 
         print_alu_src(out, inst, QPU_GET_FIELD(inst, QPU_MUL_A));
 
         if (!is_mov) {
-                fprintf(out, ", ");
+                vc4_out_lit(out, ", ");
                 print_alu_src(out, inst, QPU_GET_FIELD(inst, QPU_MUL_B));
         }
 }
 
 static void
-print_load_imm(FILE *out, uint64_t inst)
+print_load_imm(struct vc4_output *out, uint64_t inst)
 {
         uint32_t imm = inst;
         uint32_t waddr_add = QPU_GET_FIELD(inst, QPU_WADDR_ADD);
@@ -390,18 +392,19 @@ print_load_imm(FILE *out, uint64_t inst)
         uint32_t cond_add = QPU_GET_FIELD(inst, QPU_COND_ADD);
         uint32_t cond_mul = QPU_GET_FIELD(inst, QPU_COND_MUL);
 
-        fprintf(out, "load_imm ");
+        vc4_out_lit(out, "load_imm ");
         print_alu_dst(out, inst, false);
-        fprintf(out, "%s, ", (waddr_add != QPU_W_NOP ?
-                              DESC(qpu_condflags, cond_add) : ""));
+        vc4_out_printf(out, "%s, ", (waddr_add != QPU_W_NOP ?
+                                     DESC(qpu_condflags, cond_add) : ""));
         print_alu_dst(out, inst, true);
-        fprintf(out, "%s, ", (waddr_mul != QPU_W_NOP ?
-                              DESC(qpu_condflags, cond_mul) : ""));
-        fprintf(out, "0x%08x (%f)", imm, uif(imm));
+        vc4_out_printf(out, "%s, ", (waddr_mul != QPU_W_NOP ?
+                                     DESC(qpu_condflags, cond_mul) : ""));
+        vc4_out_printf(out, "0x%08x (%f)", imm, uif(imm));
 }
 
 void
-vc4_qpu_disasm(FILE *out, const uint64_t *instructions, int num_instructions)
+vc4_qpu_disasm(struct vc4_output *out, const uint64_t *instructions,
+               int num_instructions)
 {
         for (int i = 0; i < num_instructions; i++) {
                 uint64_t inst = instructions[i];
@@ -409,21 +412,22 @@ vc4_qpu_disasm(FILE *out, const uint64_t *instructions, int num_instructions)
 
                 switch (sig) {
                 case QPU_SIG_BRANCH:
-                        fprintf(out, "branch");
+                        vc4_out_lit(out, "branch");
                         break;
                 case QPU_SIG_LOAD_IMM:
                         print_load_imm(out, inst);
                         break;
                 default:
                         if (sig != QPU_SIG_NONE)
-                                fprintf(out, "%s ", DESC(qpu_sig, sig));
+                                vc4_out_printf(out, "%s ",
+                                               DESC(qpu_sig, sig));
                         print_add_op(out, inst);
-                        fprintf(out, " ; ");
+                        vc4_out_lit(out, " ; ");
                         print_mul_op(out, inst);
                         break;
                 }
 
                 if (num_instructions != 1)
-                        fprintf(out, "\n");
+                        vc4_out_lit(out, "\n");
         }
 }